@@ -369,6 +369,7 @@ void InitApp()
 //--------------------------------------------------------------------------------------
 void FinalizeApp()
 {
+    SAFE_RELEASE(gSparkModule);
     SAFE_RELEASE(gSparkContext);
 }
 
@@ -1317,6 +1318,13 @@ Base* CreateSparkShaderInstance()
         mixinCount,
         mixins );
 
+    // The composed class holds on to its mixins, and
+    // the instance holds on to the composed class.
+    for( int ii = 0; ii < mixinCount; ++ii )
+    {
+        SAFE_RELEASE( mixins[ii] );
+    }
+
     if( composed == nullptr )
     {
         return nullptr;
@@ -1324,6 +1332,7 @@ Base* CreateSparkShaderInstance()
 
     spark::ShaderInstance* shaderInstance =
         static_cast<spark::ShaderInstance*>(composed->CreateInstance( DXUTGetD3D11Device() ));
+    composed->Release();
 
     return shaderInstance->DynamicCast<Base>();
 }
@@ -21,12 +21,28 @@
 
 namespace spark
 {
+    class IAsyncRequest;
     class IContext;
     class IModule;
     class IShaderClass;
 
     struct ShaderClassDesc;
 
+    struct ModuleCacheStats
+    {
+        unsigned int hitCount;
+        unsigned int missCount;
+    };
+
+    struct ContextMemoryStats
+    {
+        unsigned int moduleCount;
+        unsigned int pendingModuleCount;    // released, but not yet reclaimed
+        unsigned int shaderClassCount;
+        unsigned int instanceCount;
+        unsigned __int64 jitCodeBytes;
+    };
+
     class IShaderBytecodeCallback
     {
     public:
@@ -36,6 +52,66 @@ namespace spark
             const void* data ) = 0;
     };
 
+    enum AsyncStatus
+    {
+        kAsyncStatus_Pending,
+        kAsyncStatus_Running,
+        kAsyncStatus_Completed,     // the result may still be NULL, if compiling failed
+        kAsyncStatus_Cancelled,
+    };
+
+    // A compile queued by IContext::CompileFileAsync or
+    // IModule::CreateShaderClassAsync. Each context runs its
+    // queued requests one at a time, on a worker thread, highest
+    // priority first (and in submission order for equal ones).
+    //
+    // The request is reference counted; releasing it does not
+    // cancel it.
+    class IAsyncRequest
+    {
+    public:
+        virtual void Acquire() = 0;
+        virtual void Release() = 0;
+
+        virtual AsyncStatus SPARK_CALL GetStatus() = 0;
+
+        // Block until the request has completed or been cancelled.
+        // A pending request is moved to the front of the queue
+        // first. Must not be called from a bytecode callback.
+        virtual AsyncStatus SPARK_CALL Wait() = 0;
+
+        // Cancel a request that hasn't started running yet.
+        // Returns false if it is already running or done.
+        virtual bool SPARK_CALL Cancel() = 0;
+
+        // Change the priority of a request that hasn't started
+        // running yet (e.g., raise it because a draw needs it).
+        virtual void SPARK_CALL SetPriority( int priority ) = 0;
+
+        // The result of a completed request, as a new reference
+        // (or NULL if the request failed, isn't complete, or is of
+        // the other kind).
+        virtual IModule* SPARK_CALL GetModule() = 0;
+        virtual IShaderClass* SPARK_CALL GetShaderClass() = 0;
+    };
+
+    // Threading: compiling (IContext, IModule, and creating shader
+    // classes) is serialized by the context, so compiles may be
+    // started from any thread, including while asynchronous
+    // requests are being compiled in the background. Once created,
+    // shader instances may be submitted from several threads at
+    // once, each recording into its own deferred context, as long
+    // as no thread changes an instance's attributes while others
+    // are submitting it. Instances may also be created and released
+    // from any thread.
+    //
+    // Lifetime: modules and shader classes are reference counted.
+    // CompileFile, FindShaderClass, FindOrLoadShaderClass and
+    // CreateShaderClass all return a new reference, which the
+    // caller must Release. A shader class keeps its module alive,
+    // a composed class keeps its mixins alive, an instance keeps
+    // its class alive, and an async request keeps its context
+    // alive.
     class IContext
     {
     public:
@@ -44,21 +120,74 @@ namespace spark
 
         virtual IModule* SPARK_CALL CompileFile(const char* filename) = 0;
 
+        // Queue a CompileFile on the context's worker thread.
+        // Returns a new reference to the request.
+        virtual IAsyncRequest* SPARK_CALL CompileFileAsync(
+            const char* filename,
+            int priority = 0 ) = 0;
+
         virtual IShaderClass* SPARK_CALL FindOrLoadShaderClass( const ShaderClassDesc* desc ) = 0;
 
+        // Enable the on-disk module cache. Compiled modules (and
+        // dynamically-composed shader classes) are stored under
+        // the given directory, keyed on their source, the standard
+        // library, the compiler and runtime builds, and the cache
+        // format version. Passing NULL or an empty string disables
+        // the cache. The initial directory is taken from the
+        // SPARK_MODULE_CACHE environment variable, if set.
+        virtual void SPARK_CALL SetModuleCacheDirectory( const char* path ) = 0;
+        virtual void SPARK_CALL GetModuleCacheStats( ModuleCacheStats* outStats ) = 0;
+
+        // Free the modules (including their JIT-compiled code) that
+        // are no longer referenced by any shader class or instance.
+        // Modules can be released from any thread, so the actual
+        // teardown is deferred to this call (which must be serialized
+        // with compiling, as above) and to the start of each compile.
+        virtual void SPARK_CALL ReclaimMemory() = 0;
+        virtual void SPARK_CALL GetMemoryStats( ContextMemoryStats* outStats ) = 0;
+
+        // Enable tracing of the LLVM IR built while emitting modules.
+        // The trace is buffered in memory and appended to the given
+        // file once per compiled module. Passing NULL or an empty
+        // string disables tracing for subsequently compiled modules.
+        // The initial file is taken from the SPARK_IR_TRACE
+        // environment variable, if set.
+        virtual void SPARK_CALL SetIRTraceFile( const char* path ) = 0;
+
         template<typename ShaderT>
         __forceinline ShaderT* CreateShaderInstance( ID3D11Device* device )
         {
             auto shaderClass = FindOrLoadShaderClass( ShaderT::GetShaderClassDesc() );
             if( shaderClass == nullptr )
                 return nullptr;
-            return reinterpret_cast<ShaderT*>(shaderClass->CreateInstance( device ));
+            auto instance = shaderClass->CreateInstance( device );
+            shaderClass->Release();
+            return reinterpret_cast<ShaderT*>(instance);
+        }
+
+        // Create `count` instances of the same shader class at once.
+        // Returns false if the class could not be loaded.
+        template<typename ShaderT>
+        __forceinline bool CreateShaderInstances(
+            ID3D11Device* device,
+            size_t count,
+            ShaderT** outInstances )
+        {
+            auto shaderClass = FindOrLoadShaderClass( ShaderT::GetShaderClassDesc() );
+            if( shaderClass == nullptr )
+                return false;
+            shaderClass->CreateInstances( device, count, reinterpret_cast<void**>(outInstances) );
+            shaderClass->Release();
+            return true;
         }
     };
 
     class IModule
     {
     public:
+        virtual void Acquire() = 0;
+        virtual void Release() = 0;
+
         virtual IShaderClass* SPARK_CALL FindShaderClass( const char* name ) = 0;
 
         template<typename T>
@@ -67,20 +196,74 @@ namespace spark
             return FindShaderClass( T::StaticGetShaderClassName() );
         }
 
+        // Compose a shader class from the given mixins. Classes are
+        // cached by mixin set: if another thread (or the async
+        // worker) is already compiling the same set, this waits for
+        // its result rather than compiling it again. The callback
+        // sees the bytecode either way, and must not itself create
+        // shader classes.
         virtual IShaderClass* SPARK_CALL CreateShaderClass(
             size_t mixinCount,
             IShaderClass*const* mixins,
             IShaderBytecodeCallback* callback = nullptr ) = 0;
+
+        // Queue a CreateShaderClass on the context's worker thread.
+        // The request keeps the module and mixins alive; the
+        // callback (if any) is called on the worker thread, and
+        // must stay valid until the request is done. Returns a new
+        // reference to the request.
+        virtual IAsyncRequest* SPARK_CALL CreateShaderClassAsync(
+            size_t mixinCount,
+            IShaderClass*const* mixins,
+            IShaderBytecodeCallback* callback = nullptr,
+            int priority = 0 ) = 0;
     };
 
     class IShaderClass
     {
     public:
+        virtual void Acquire() = 0;
+        virtual void Release() = 0;
+
         virtual const char* SPARK_CALL GetName() = 0;
         virtual void* SPARK_CALL CreateInstance( ID3D11Device* device ) = 0;
+
+        // Instances of a class are carved out of cache-line aligned
+        // slabs owned by the class, so instances created together
+        // end up together in memory.
+        virtual void SPARK_CALL CreateInstances(
+            ID3D11Device* device,
+            size_t count,
+            void** outInstances ) = 0;
+
+        // Drop one reference from each of the given instances (all
+        // of which must belong to this class), freeing any that
+        // reach zero.
+        virtual void SPARK_CALL ReleaseInstances(
+            size_t count,
+            void*const* instances ) = 0;
+
+        // Copy up to `capacity` pointers to the live instances of
+        // this class into `outInstances`, in memory order, and
+        // return the total number of live instances.
+        virtual size_t SPARK_CALL GetLiveInstances(
+            void** outInstances,
+            size_t capacity ) = 0;
     };
 }
 
 SPARK_DLL spark::IContext* SparkCreateContext();
 
+// Compile a file into the given module cache directory, so that
+// later calls to IContext::CompileFile can skip compilation.
+// Returns zero on success.
+SPARK_DLL int SparkPopulateModuleCache(
+    const char* cacheDirectory,
+    const char* filename );
+
+// Finalize and free a shader instance, dropping its reference
+// to its shader class. Called by spark::ShaderInstance::Release.
+SPARK_DLL void SparkReleaseShaderInstance(
+    void* instance );
+
 #endif
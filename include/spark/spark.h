@@ -21,6 +21,25 @@
 #include <spark/context.h>
 #include <cmath>
 
+// The math types below use SSE when the target allows it (SSE2 is
+// always there on x64), plus SSE4.1 and FMA when the compiler is
+// told they are available. Define SPARK_NO_SIMD to get the plain
+// scalar versions. Managed (/clr) code, like the runtime itself,
+// always gets the scalar versions, since __m128 can't be used in
+// managed functions.
+#if !defined(SPARK_NO_SIMD) && !defined(_M_CEE) && (defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SPARK_SIMD_SSE2 1
+#include <emmintrin.h>
+#if defined(SPARK_USE_SSE4_1) || defined(__SSE4_1__) || defined(__AVX__)
+#define SPARK_SIMD_SSE4_1 1
+#include <smmintrin.h>
+#endif
+#if defined(__FMA__) || defined(__AVX2__)
+#define SPARK_SIMD_FMA 1
+#include <immintrin.h>
+#endif
+#endif
+
 #ifndef SPARK_SKIP_PRAGMA_LIB
 #pragma comment(lib, "SparkCPP")
 #endif // SPARK_SKIP_PRAGMA_LIB
@@ -56,16 +75,6 @@ namespace spark
         float x, y, z;
     };
 
-    inline float3 normalize( float3 value )
-    {
-        float invLength = 1.0f / sqrtf(value.x*value.x + value.y*value.y + value.z*value.z);
-        float3 result(
-            value.x * invLength,
-            value.y * invLength,
-            value.z * invLength );
-        return result;
-    }
-
     class float4
     {
     public:
@@ -99,15 +108,136 @@ namespace spark
             return (&c0)[c][r];
         }
 
+        // Columns are stored contiguously, so these are the
+        // rows of the transpose.
+        const float4& column( int c ) const
+        {
+            return (&c0)[c];
+        }
+
+        float4& column( int c )
+        {
+            return (&c0)[c];
+        }
+
     private:
         float4 c0, c1, c2, c3;
     };
 
+    // The types keep their natural (4-byte) alignment, since they
+    // are passed by value and overlaid on D3DX types by client code,
+    // so all SIMD loads and stores are unaligned.
+#ifdef SPARK_SIMD_SSE2
+    namespace simd
+    {
+        // a*b + c, fused where the target supports it.
+        __forceinline __m128 MulAdd( __m128 a, __m128 b, __m128 c )
+        {
+#ifdef SPARK_SIMD_FMA
+            return _mm_fmadd_ps(a, b, c);
+#else
+            return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+        }
+
+        template<int II>
+        __forceinline __m128 Splat( __m128 v )
+        {
+            return _mm_shuffle_ps(v, v, _MM_SHUFFLE(II, II, II, II));
+        }
+
+        // Returns m * v, for m given as its four columns.
+        __forceinline __m128 MulColumns(
+            const __m128& m0, const __m128& m1, const __m128& m2, const __m128& m3,
+            const __m128& v )
+        {
+            __m128 result = _mm_mul_ps(m0, Splat<0>(v));
+            result = MulAdd(m1, Splat<1>(v), result);
+            result = MulAdd(m2, Splat<2>(v), result);
+            result = MulAdd(m3, Splat<3>(v), result);
+            return result;
+        }
+    }
+#endif
+
+    inline float3 normalize( float3 value )
+    {
+#ifdef SPARK_SIMD_SSE2
+        __m128 v = _mm_set_ps(0.0f, value.z, value.y, value.x);
+#ifdef SPARK_SIMD_SSE4_1
+        __m128 lengthSquared = _mm_dp_ps(v, v, 0x7F);
+#else
+        __m128 squares = _mm_mul_ps(v, v);
+        __m128 lengthSquared = _mm_add_ps(
+            _mm_add_ps(
+                simd::Splat<0>(squares),
+                simd::Splat<1>(squares)),
+            simd::Splat<2>(squares));
+#endif
+        __m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+        __m128 r = _mm_mul_ps(v, invLength);
+
+        float3 result;
+        _mm_store_ss(&result.x, r);
+        _mm_store_ss(&result.y, simd::Splat<1>(r));
+        _mm_store_ss(&result.z, simd::Splat<2>(r));
+        return result;
+#else
+        float invLength = 1.0f / sqrtf(value.x*value.x + value.y*value.y + value.z*value.z);
+        float3 result(
+            value.x * invLength,
+            value.y * invLength,
+            value.z * invLength );
+        return result;
+#endif
+    }
+
+    // Matrix-vector product, treating value as a column vector
+    // (as HLSL mul() does).
+    inline float4 mul(
+        const float4x4& left,
+        const float4& right )
+    {
+        float4 result;
+#ifdef SPARK_SIMD_SSE2
+        __m128 r = simd::MulColumns(
+            _mm_loadu_ps(left.column(0)),
+            _mm_loadu_ps(left.column(1)),
+            _mm_loadu_ps(left.column(2)),
+            _mm_loadu_ps(left.column(3)),
+            _mm_loadu_ps(right));
+        _mm_storeu_ps(result, r);
+#else
+        for( int r = 0; r < 4; ++r )
+        {
+            result[r] = left(r,0) * right.x
+                + left(r,1) * right.y
+                + left(r,2) * right.z
+                + left(r,3) * right.w;
+        }
+#endif
+        return result;
+    }
+
     inline float4x4 operator*(
-        float4x4 left,
-        float4x4 right )
+        const float4x4& left,
+        const float4x4& right )
     {
         float4x4 result;
+#ifdef SPARK_SIMD_SSE2
+        // Each column of the result is left times the
+        // corresponding column of right.
+        __m128 l0 = _mm_loadu_ps(left.column(0));
+        __m128 l1 = _mm_loadu_ps(left.column(1));
+        __m128 l2 = _mm_loadu_ps(left.column(2));
+        __m128 l3 = _mm_loadu_ps(left.column(3));
+        for( int c = 0; c < 4; ++c )
+        {
+            _mm_storeu_ps(
+                result.column(c),
+                simd::MulColumns(l0, l1, l2, l3, _mm_loadu_ps(right.column(c))));
+        }
+#else
         for( int r = 0; r < 4; ++r )
         {
             for( int c = 0; c < 4; ++c )
@@ -120,13 +250,25 @@ namespace spark
                 result(r,c) = sum;
             }
         }
+#endif
         return result;
     }
 
     inline float4x4 transpose(
-        float4x4 value )
+        const float4x4& value )
     {
         float4x4 result;
+#ifdef SPARK_SIMD_SSE2
+        __m128 c0 = _mm_loadu_ps(value.column(0));
+        __m128 c1 = _mm_loadu_ps(value.column(1));
+        __m128 c2 = _mm_loadu_ps(value.column(2));
+        __m128 c3 = _mm_loadu_ps(value.column(3));
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        _mm_storeu_ps(result.column(0), c0);
+        _mm_storeu_ps(result.column(1), c1);
+        _mm_storeu_ps(result.column(2), c2);
+        _mm_storeu_ps(result.column(3), c3);
+#else
         for( int r = 0; r < 4; ++r )
         {
             for( int c = 0; c < 4; ++c )
@@ -134,9 +276,77 @@ namespace spark
                 result(r,c) = value(c,r);
             }
         }
+#endif
         return result;
     }
 
+    // Batch forms: result[ii] = mul(left, right[ii]), and
+    // result[ii] = left[ii] * right (e.g., every object's world
+    // matrix times a shared view-projection). The shared matrix is
+    // only loaded once. result may alias the input array.
+    inline void mulArray(
+        const float4x4& left,
+        const float4* right,
+        float4* result,
+        size_t count )
+    {
+#ifdef SPARK_SIMD_SSE2
+        __m128 l0 = _mm_loadu_ps(left.column(0));
+        __m128 l1 = _mm_loadu_ps(left.column(1));
+        __m128 l2 = _mm_loadu_ps(left.column(2));
+        __m128 l3 = _mm_loadu_ps(left.column(3));
+        for( size_t ii = 0; ii < count; ++ii )
+        {
+            _mm_storeu_ps(
+                result[ii],
+                simd::MulColumns(l0, l1, l2, l3, _mm_loadu_ps(right[ii])));
+        }
+#else
+        for( size_t ii = 0; ii < count; ++ii )
+            result[ii] = mul(left, right[ii]);
+#endif
+    }
+
+    inline void mulArray(
+        const float4x4* left,
+        const float4x4& right,
+        float4x4* result,
+        size_t count )
+    {
+#ifdef SPARK_SIMD_SSE2
+        // Column c of each result is the columns of left[ii]
+        // weighted by the entries of column c of right, so splat
+        // those entries once up front.
+        __m128 weights[4][4];
+        for( int c = 0; c < 4; ++c )
+        {
+            __m128 rc = _mm_loadu_ps(right.column(c));
+            weights[c][0] = simd::Splat<0>(rc);
+            weights[c][1] = simd::Splat<1>(rc);
+            weights[c][2] = simd::Splat<2>(rc);
+            weights[c][3] = simd::Splat<3>(rc);
+        }
+        for( size_t ii = 0; ii < count; ++ii )
+        {
+            __m128 l0 = _mm_loadu_ps(left[ii].column(0));
+            __m128 l1 = _mm_loadu_ps(left[ii].column(1));
+            __m128 l2 = _mm_loadu_ps(left[ii].column(2));
+            __m128 l3 = _mm_loadu_ps(left[ii].column(3));
+            for( int c = 0; c < 4; ++c )
+            {
+                __m128 column = _mm_mul_ps(l0, weights[c][0]);
+                column = simd::MulAdd(l1, weights[c][1], column);
+                column = simd::MulAdd(l2, weights[c][2], column);
+                column = simd::MulAdd(l3, weights[c][3], column);
+                _mm_storeu_ps(result[ii].column(c), column);
+            }
+        }
+#else
+        for( size_t ii = 0; ii < count; ++ii )
+            result[ii] = left[ii] * right;
+#endif
+    }
+
     struct ShaderClassDesc;
 
     class ShaderInstance
@@ -155,50 +365,15 @@ namespace spark
                 return;
             }
 
-            // \todo: This really belongs in the
-            // SparkCPP.lib, but getting it in
-            // there involves linker trickery
-            // I don't feel like doing right now... :(
-            struct ClassInfo
-            {
-                int a;
-                int b;
-                void* c;
-                void* d;
-                void (__stdcall * Finalize)( void* obj );
-            };
-
-            ClassInfo* ci = (ClassInfo*) _shaderClassInfo;
-            ci->Finalize( this );
+            SparkReleaseShaderInstance( this );
         }
 
         void* DynamicCast( const char* name )
         {
-            struct FacetInfo
-            {
-                const char* name;
-                int offset;
-            };
-            struct ClassInfo
-            {
-                int size;
-                int facetCount;
-                FacetInfo* facets;
-            };
-
-            ClassInfo* ci = (ClassInfo*) _shaderClassInfo;
-
-            for( int ff = 0; ff < ci->facetCount; ++ff )
-            {
-                auto& facetInfo = ci->facets[ff];
-
-                if( strcmp(name, facetInfo.name) == 0 )
-                {
-                    return ((unsigned char*) this) + facetInfo.offset;
-                }
-            }
-
-            return nullptr;
+            auto facet = FindFacet( name, HashFacetName( name ) );
+            if( facet == nullptr )
+                return nullptr;
+            return ((unsigned char*) this) + facet->offset;
         }
 
         void* DynamicCast( IShaderClass* shaderClass )
@@ -209,10 +384,86 @@ namespace spark
         template<typename T>
         inline T* DynamicCast()
         {
-            return reinterpret_cast<T*>(DynamicCast( T::StaticGetShaderClassName() ));
+            // Each T keeps a few of the facet entries it has found,
+            // in slots chosen by the address of the class info, so
+            // casting instances of several classes to T doesn't
+            // thrash one entry. A cached entry is always T's facet
+            // in some class's table, so if it lies in our table it
+            // is ours; the hash check only guards against a table
+            // freed with its module and reallocated in place.
+            static const unsigned int hash = HashFacetName( T::StaticGetShaderClassName() );
+            static const void* volatile cachedFacets[kFacetCacheSize];
+
+            auto ci = (const ClassInfo*) _shaderClassInfo;
+            auto& cachedFacet = cachedFacets[((size_t) ci / sizeof(ClassInfo)) % kFacetCacheSize];
+            auto facet = (const FacetInfo*) cachedFacet;
+            if( facet < ci->facets
+                || facet >= ci->facets + ci->facetCount
+                || facet->hash != hash )
+            {
+                facet = FindFacet( T::StaticGetShaderClassName(), hash );
+                if( facet == nullptr )
+                    return nullptr;
+                cachedFacet = facet;
+            }
+
+            return reinterpret_cast<T*>(((unsigned char*) this) + facet->offset);
         }
 
+        // 32-bit FNV-1a. Facet tables are emitted sorted
+        // by this hash (see EmitContext.HashFacetName).
+        static unsigned int HashFacetName( const char* name )
+        {
+            unsigned int hash = 2166136261U;
+            for( const unsigned char* cc = (const unsigned char*) name; *cc != 0; ++cc )
+            {
+                hash ^= *cc;
+                hash *= 16777619U;
+            }
+            return hash;
+        }
 
+    private:
+        static const size_t kFacetCacheSize = 8;
+
+        struct FacetInfo
+        {
+            const char* name;
+            unsigned int hash;
+            int offset;
+        };
+        struct ClassInfo
+        {
+            int size;
+            int facetCount;
+            const FacetInfo* facets;
+        };
+
+        const FacetInfo* FindFacet( const char* name, unsigned int hash )
+        {
+            auto ci = (const ClassInfo*) _shaderClassInfo;
+
+            // Find the first entry with a matching hash, then
+            // compare names across the (rare) run of collisions.
+            int lo = 0;
+            int hi = ci->facetCount;
+            while( lo < hi )
+            {
+                int mid = lo + (hi - lo) / 2;
+                if( ci->facets[mid].hash < hash )
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+
+            for( int ff = lo; ff < ci->facetCount && ci->facets[ff].hash == hash; ++ff )
+            {
+                if( strcmp( name, ci->facets[ff].name ) == 0 )
+                    return &ci->facets[ff];
+            }
+
+            return nullptr;
+        }
 
     protected:
         void* _shaderClassInfo;
@@ -221,6 +472,12 @@ namespace spark
 
     namespace d3d11
     {
+        struct DrawSpan;
+
+        // Passed as the state shadow to generated Submit code to
+        // have it look up the context's shadow (GetStateShadow).
+        static void* const kLookupStateShadow = (void*) ~(size_t) 0;
+
         class D3D11DrawPass :
             public ShaderInstance
         {
@@ -230,6 +487,46 @@ namespace spark
             void Submit(
                 ID3D11Device* device,
                 ID3D11DeviceContext* context )
+            {
+                SubmitImpl( device, context, nullptr, kLookupStateShadow );
+            }
+
+            // Submit using the given draw span in place of the
+            // instance's own IA_DrawSpan.
+            void Submit(
+                ID3D11Device* device,
+                ID3D11DeviceContext* context,
+                const DrawSpan& drawSpan )
+            {
+                SubmitImpl( device, context, &drawSpan, kLookupStateShadow );
+            }
+
+            // Submit with the context's state shadow (or NULL), as
+            // already returned by GetStateShadow. Looking the shadow
+            // up once per context, rather than in every Submit,
+            // saves a GetPrivateData call per draw. A NULL drawSpan
+            // uses the instance's own IA_DrawSpan.
+            void SubmitWithStateShadow(
+                ID3D11Device* device,
+                ID3D11DeviceContext* context,
+                void* stateShadow,
+                const DrawSpan* drawSpan = nullptr )
+            {
+                SubmitImpl( device, context, drawSpan, stateShadow );
+            }
+
+            ID3D11DepthStencilView*  GetDepthStencilView() const { return m_depthStencilView; }
+            void SetDepthStencilView( ID3D11DepthStencilView*  value ) { m_depthStencilView = value; }
+
+            template<typename TBase>
+            TBase* StaticCast() { return _StaticCastImpl(static_cast<TBase*>(nullptr)); }
+
+        private:
+            void SubmitImpl(
+                ID3D11Device* device,
+                ID3D11DeviceContext* context,
+                const DrawSpan* drawSpan,
+                void* stateShadow )
             {
                 // \todo: This really belongs in the
                 // SparkCPP.lib, but getting it in
@@ -242,19 +539,13 @@ namespace spark
                     void* c;
                     void* d;
                     void* e;
-                    void (__stdcall * Submit)(void* obj, ID3D11Device*, ID3D11DeviceContext*);
+                    void (__stdcall * Submit)(void* obj, ID3D11Device*, ID3D11DeviceContext*, const DrawSpan*, void*);
                 };
 
                 ClassInfo* ci = (ClassInfo*) _shaderClassInfo;
-                ci->Submit( this, device, context );
+                ci->Submit( this, device, context, drawSpan, stateShadow );
             }
 
-            ID3D11DepthStencilView*  GetDepthStencilView() const { return m_depthStencilView; }
-            void SetDepthStencilView( ID3D11DepthStencilView*  value ) { m_depthStencilView = value; }
-
-            template<typename TBase>
-            TBase* StaticCast() { return _StaticCastImpl(static_cast<TBase*>(nullptr)); }
-
         protected:
         	D3D11DrawPass* _StaticCastImpl( void* ) { return this; }
         public:
@@ -600,6 +891,11 @@ namespace spark
         // This will, of course, need to be rectified eventually, but for
         // now it means that they need to cache/memoize their results
         // internally, so that we don't allocate new states per-frame. :(
+        //
+        // The caches are keyed on (device, description), may be used
+        // from multiple threads, and own the returned states (callers
+        // must not Release them). Call ReleaseStateObjects before
+        // destroying a device, once no thread is still using it.
 
         SPARK_DLL ID3D11SamplerState* CreateSamplerState(
             ID3D11Device* device,
@@ -615,6 +911,7 @@ namespace spark
             float                         maxLOD );
 
         SPARK_DLL ID3D11RasterizerState* CreateRasterizerState(
+            ID3D11Device*     device,
             D3D11_FILL_MODE   fillMode,
             D3D11_CULL_MODE   cullMode,
             bool              frontCounterClockwise,
@@ -626,6 +923,262 @@ namespace spark
             bool              multisampleEnable,
             bool              antialiasedLineEnable );
 
+        SPARK_DLL ID3D11BlendState* CreateBlendState(
+            ID3D11Device*           device,
+            const D3D11_BLEND_DESC* desc );
+
+        SPARK_DLL ID3D11DepthStencilState* CreateDepthStencilState(
+            ID3D11Device*           device,
+            bool                    depthEnable,
+            bool                    depthWriteEnable,
+            D3D11_COMPARISON_FUNC   depthFunc );
+
+        SPARK_DLL void ReleaseStateObjects(
+            ID3D11Device* device );
+
+        // Shader objects, input layouts and immutable states are
+        // shared by all instances of a shader class on the same
+        // device. Generated constructors/destructors use these
+        // to acquire/release the (reference-counted) shared block.
+        SPARK_DLL void* AcquireSharedState(
+            void* instance,
+            ID3D11Device* device );
+
+        SPARK_DLL void ReleaseSharedState(
+            void* sharedState );
+
+        // Each instance keeps a CPU-side shadow of each of its
+        // constant buffers. Generated Submit code writes uniform
+        // values into the block returned by
+        // BeginConstantBufferUpdate, and marks the byte range it
+        // wrote with MarkConstantBufferDirty. EndConstantBufferUpdate
+        // only compares that range against what was last uploaded,
+        // and only maps/uploads the buffer if it differs. It returns
+        // the buffer that Submit should bind. Submit begins all of
+        // its updates before ending them (in the same order).
+        //
+        // On deferred contexts the staging area and buffers come
+        // from a per-context ring instead, so that any number of
+        // threads can record the same instances concurrently.
+        SPARK_DLL void* CreateConstantBufferShadow(
+            UINT sizeInBytes );
+
+        SPARK_DLL void DestroyConstantBufferShadow(
+            void* shadow );
+
+        SPARK_DLL void* BeginConstantBufferUpdate(
+            ID3D11DeviceContext* context,
+            void* shadow );
+
+        SPARK_DLL void MarkConstantBufferDirty(
+            ID3D11DeviceContext* context,
+            void* shadow,
+            UINT begin,
+            UINT end );
+
+        SPARK_DLL ID3D11Buffer* EndConstantBufferUpdate(
+            ID3D11DeviceContext* context,
+            ID3D11Buffer* buffer,
+            void* shadow );
+
+        struct ConstantBufferUploadStats
+        {
+            unsigned int uploadCount;
+            unsigned int skippedUploadCount;
+        };
+
+        // Query the number of constant-buffer uploads performed
+        // (and skipped because the contents were unchanged) by
+        // all instances since startup.
+        SPARK_DLL void GetConstantBufferUploadStats(
+            ConstantBufferUploadStats* outStats );
+
+        // The setter for each input @Uniform attribute bumps a
+        // version counter, and generated Submit code only recomputes
+        // the values in a constant buffer when the inputs they are
+        // derived from have changed (so inputs must be set through
+        // their setters). CheckUniformInputVersions compares the
+        // versions of those inputs against the ones the buffer was
+        // last computed from, and returns non-zero (updating
+        // *cachedVersion) if the values must be recomputed. On
+        // deferred contexts it always returns non-zero.
+        SPARK_DLL UINT CheckUniformInputVersions(
+            ID3D11DeviceContext* context,
+            UINT* cachedVersion,
+            const UINT* inputVersions,
+            UINT inputCount );
+
+        struct UniformRecomputeStats
+        {
+            unsigned int recomputeCount;
+            unsigned int skippedRecomputeCount;
+        };
+
+        // Query the number of times generated Submit code has
+        // computed the contents of a constant buffer (and skipped
+        // doing so because its inputs were unchanged) since startup.
+        SPARK_DLL void GetUniformRecomputeStats(
+            UniformRecomputeStats* outStats );
+
+        // Optional per-context state shadow. When enabled on a
+        // device context, the state-setting calls made by generated
+        // Submit code are filtered against the state last bound
+        // through Spark, so consecutive draws only rebind what has
+        // changed. The shadow assumes Spark is the only code setting
+        // state on the context; call InvalidateStateShadow after
+        // binding state directly, and after anything that resets the
+        // context state (ClearState, FinishCommandList, or
+        // ExecuteCommandList without restoring state). The shadow is
+        // freed with the context, or by DisableStateShadow.
+        //
+        // Binding a resource as an output silently unbinds any of its
+        // shader-resource views from every stage. Spark accounts for
+        // this when it binds render targets itself; after calling
+        // OMSetRenderTargets, OMSetRenderTargetsAndUnorderedAccessViews
+        // or CSSetUnorderedAccessViews directly, call (at least)
+        // InvalidateStateShadowOutputs, which forgets the shadowed
+        // render targets and shader resources only.
+        SPARK_DLL void EnableStateShadow(
+            ID3D11DeviceContext* context );
+
+        SPARK_DLL void DisableStateShadow(
+            ID3D11DeviceContext* context );
+
+        SPARK_DLL void InvalidateStateShadow(
+            ID3D11DeviceContext* context );
+
+        SPARK_DLL void InvalidateStateShadowOutputs(
+            ID3D11DeviceContext* context );
+
+        struct StateShadowStats
+        {
+            unsigned int issuedCallCount;
+            unsigned int skippedCallCount;
+        };
+
+        SPARK_DLL void GetStateShadowStats(
+            ID3D11DeviceContext* context,
+            StateShadowStats* outStats );
+
+        // Batched submission. Items are sorted (in place) by shader
+        // class and then stateKey, keeping the original order among
+        // equal keys, and each group is submitted with a single
+        // class-info lookup. If the context has no state shadow,
+        // one is used for the duration of the batch, so that
+        // state shared between consecutive items isn't rebound.
+        struct SubmitBatchItem
+        {
+            D3D11DrawPass* instance;
+            const DrawSpan* drawSpan; // NULL to use the instance's own
+            unsigned __int64 stateKey;
+        };
+
+        SPARK_DLL void SubmitBatch(
+            ID3D11Device* device,
+            ID3D11DeviceContext* context,
+            SubmitBatchItem* items,
+            UINT itemCount );
+
+        // The remaining routines are used by generated code. The
+        // state shadow (or NULL) is passed in to Submit, or looked
+        // up once per Submit if it is kLookupStateShadow, and then
+        // passed to each state-setting call.
+
+        enum ShaderStage
+        {
+            kShaderStage_Vertex,
+            kShaderStage_Hull,
+            kShaderStage_Domain,
+            kShaderStage_Geometry,
+            kShaderStage_Pixel,
+        };
+
+        SPARK_DLL void* GetStateShadow(
+            ID3D11DeviceContext* context );
+
+        SPARK_DLL void* ResolveStateShadow(
+            ID3D11DeviceContext* context,
+            void* stateShadow );
+
+        SPARK_DLL void ShadowSetShader(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            ID3D11DeviceChild* shader );
+
+        SPARK_DLL void ShadowSetConstantBuffers(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            UINT startSlot,
+            UINT count,
+            ID3D11Buffer* const* buffers );
+
+        SPARK_DLL void ShadowSetShaderResources(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            UINT startSlot,
+            UINT count,
+            ID3D11ShaderResourceView* const* views );
+
+        SPARK_DLL void ShadowSetSamplers(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            UINT startSlot,
+            UINT count,
+            ID3D11SamplerState* const* samplers );
+
+        SPARK_DLL void ShadowSetInputLayout(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11InputLayout* inputLayout );
+
+        SPARK_DLL void ShadowSetDrawSpan(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            const DrawSpan* drawSpanOverride,
+            DrawSpan drawSpan );
+
+        SPARK_DLL void SubmitDrawSpan(
+            ID3D11DeviceContext* context,
+            const DrawSpan* drawSpanOverride,
+            DrawSpan drawSpan );
+
+        SPARK_DLL void ShadowSetVertexBuffers(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT startSlot,
+            UINT count,
+            ID3D11Buffer* const* buffers,
+            const UINT* strides,
+            const UINT* offsets );
+
+        SPARK_DLL void ShadowSetRenderTargets(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT count,
+            ID3D11RenderTargetView* const* renderTargetViews,
+            ID3D11DepthStencilView* depthStencilView );
+
+        SPARK_DLL void ShadowSetBlendState(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11BlendState* blendState,
+            const FLOAT* blendFactor,
+            UINT sampleMask );
+
+        SPARK_DLL void ShadowSetRasterizerState(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11RasterizerState* rasterizerState );
+
+        SPARK_DLL void ShadowSetDepthStencilState(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11DepthStencilState* depthStencilState,
+            UINT stencilRef );
     }
 }
 
@@ -0,0 +1,885 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace Spark.AbstractSyntax
+{
+    // A compact binary encoding of a parsed source record, so that
+    // code that never changes (i.e., the standard library) doesn't
+    // need to go through the scanner and parser on every compile.
+    //
+    // Identifiers are written by name and re-interned into the
+    // reader's IdentifierFactory, so a snapshot can be loaded by
+    // any number of compiles, each with its own identifiers.
+    public static class AbsSnapshot
+    {
+        // Bump this whenever the encoding (or the AST) changes.
+        public const int FormatVersion = 1;
+
+        public static void Write(
+            System.IO.BinaryWriter writer,
+            AbsSourceRecord record)
+        {
+            writer.Write(FormatVersion);
+            new AbsSnapshotWriter(writer).WriteNode(record);
+        }
+
+        // Returns null if the data was written by another
+        // version of the encoding.
+        public static AbsSourceRecord Read(
+            System.IO.BinaryReader reader,
+            IdentifierFactory identifiers)
+        {
+            if (reader.ReadInt32() != FormatVersion)
+                return null;
+            return new AbsSnapshotReader(reader, identifiers).ReadNode<AbsSourceRecord>();
+        }
+    }
+
+    internal enum AbsSnapshotTag : byte
+    {
+        Null,
+        SourceRecord,
+        PipelineDecl,
+        TypeSlotDecl,
+        GenericTypeParamDecl,
+        GenericValueParamDecl,
+        StructDecl,
+        ElementDecl,
+        SlotDecl,
+        ConceptDecl,
+        MethodDecl,
+        ParamDecl,
+        BlockStmt,
+        ReturnStmt,
+        ExpStmt,
+        LetStmt,
+        EmptyStmt,
+        Case,
+        SwitchStmt,
+        IfStmt,
+        ForStmt,
+        SeqStmt,
+        VarRef,
+        MemberRef,
+        ElementRef,
+        App,
+        GenericApp,
+        Assign,
+        IfTerm,
+        PositionalArg,
+        KeywordArg,
+        LitInt32,
+        LitDouble,
+        LitString,
+        LitBool,
+        Void,
+        FreqQualTerm,
+        Attribute,
+        BaseExp,
+    }
+
+    internal enum AbsSnapshotIdentifierKind : byte
+    {
+        Simple,
+        Operator,
+        Unique,
+    }
+
+    internal class AbsSnapshotWriter
+    {
+        private System.IO.BinaryWriter _writer;
+        private Dictionary<Identifier, int> _identifiers = new Dictionary<Identifier, int>();
+        private Dictionary<string, int> _fileNames = new Dictionary<string, int>();
+
+        public AbsSnapshotWriter(
+            System.IO.BinaryWriter writer)
+        {
+            _writer = writer;
+        }
+
+        public void WriteNode(AbsSyntax node)
+        {
+            if (node == null)
+            {
+                WriteTag(AbsSnapshotTag.Null);
+                return;
+            }
+
+            WriteNodeImpl((dynamic) node);
+        }
+
+        private void WriteNodes<T>(IEnumerable<T> nodes)
+            where T : AbsSyntax
+        {
+            if (nodes == null)
+            {
+                _writer.Write(-1);
+                return;
+            }
+
+            var array = nodes.ToArray();
+            _writer.Write(array.Length);
+            foreach (var node in array)
+                WriteNode(node);
+        }
+
+        private void WriteTag(AbsSnapshotTag tag)
+        {
+            _writer.Write((byte) tag);
+        }
+
+        private void WriteHeader(AbsSnapshotTag tag, AbsSyntax node)
+        {
+            WriteTag(tag);
+
+            var range = node.Range;
+            WriteFileName(range.fileName);
+            WritePos(range.start);
+            WritePos(range.end);
+        }
+
+        private void WritePos(SourcePos pos)
+        {
+            _writer.Write(pos.lineNumber);
+            _writer.Write(pos.columnNumber);
+            _writer.Write(pos.Location);
+        }
+
+        // Each distinct string/identifier is written out in full
+        // the first time only, and by index from then on.
+        private void WriteFileName(string fileName)
+        {
+            int index;
+            if (fileName != null && _fileNames.TryGetValue(fileName, out index))
+            {
+                _writer.Write(index);
+                return;
+            }
+
+            if (fileName == null)
+            {
+                _writer.Write(-1);
+                return;
+            }
+
+            index = _fileNames.Count;
+            _fileNames.Add(fileName, index);
+            _writer.Write(index);
+            _writer.Write(fileName);
+        }
+
+        private void WriteIdentifier(Identifier identifier)
+        {
+            int index;
+            if (identifier == null)
+            {
+                _writer.Write(-1);
+                return;
+            }
+
+            if (_identifiers.TryGetValue(identifier, out index))
+            {
+                _writer.Write(index);
+                return;
+            }
+
+            index = _identifiers.Count;
+            _identifiers.Add(identifier, index);
+            _writer.Write(index);
+
+            if (identifier is SimpleIdentifier)
+            {
+                _writer.Write((byte) AbsSnapshotIdentifierKind.Simple);
+                _writer.Write(((SimpleIdentifier) identifier).name);
+            }
+            else if (identifier is OperatorIdentifier)
+            {
+                _writer.Write((byte) AbsSnapshotIdentifierKind.Operator);
+                _writer.Write(((OperatorIdentifier) identifier).Operator);
+            }
+            else if (identifier is UniqueIdentifier)
+            {
+                _writer.Write((byte) AbsSnapshotIdentifierKind.Unique);
+                _writer.Write(((UniqueIdentifier) identifier).Name);
+            }
+            else
+            {
+                throw new NotSupportedException(string.Format(
+                    "Cannot snapshot identifier of type {0}", identifier.GetType().Name));
+            }
+        }
+
+        // Member declarations are written as the header and name,
+        // then the per-class fields, and then the modifiers and
+        // attributes (which the parser also fills in last).
+        private void WriteMemberDeclStart(AbsSnapshotTag tag, AbsMemberDecl decl)
+        {
+            WriteHeader(tag, decl);
+            WriteIdentifier(decl.Name);
+        }
+
+        private void WriteMemberDeclEnd(AbsMemberDecl decl)
+        {
+            _writer.Write((int) decl.Modifiers);
+            WriteNodes(decl.Attributes);
+        }
+
+        private void WriteNodeImpl(AbsSyntax node)
+        {
+            throw new NotSupportedException(string.Format(
+                "Cannot snapshot syntax of type {0}", node.GetType().Name));
+        }
+
+        private void WriteNodeImpl(AbsSourceRecord node)
+        {
+            WriteHeader(AbsSnapshotTag.SourceRecord, node);
+            WriteNodes(node.decls);
+        }
+
+        private void WriteNodeImpl(AbsPipelineDecl node)
+        {
+            WriteHeader(AbsSnapshotTag.PipelineDecl, node);
+            _writer.Write((int) node.Modifiers);
+            WriteIdentifier(node.Name);
+            WriteNodes(node.Bases);
+            WriteNodes(node.Members);
+        }
+
+        private void WriteNodeImpl(AbsTypeSlotDecl node)
+        {
+            WriteMemberDeclStart(AbsSnapshotTag.TypeSlotDecl, node);
+            WriteNodes(node.GenericParams);
+            WriteMemberDeclEnd(node);
+        }
+
+        private void WriteNodeImpl(AbsGenericTypeParamDecl node)
+        {
+            WriteHeader(AbsSnapshotTag.GenericTypeParamDecl, node);
+            WriteIdentifier(node.Name);
+        }
+
+        private void WriteNodeImpl(AbsGenericValueParamDecl node)
+        {
+            WriteHeader(AbsSnapshotTag.GenericValueParamDecl, node);
+            WriteNode(node.Type);
+            WriteIdentifier(node.Name);
+            _writer.Write(node.IsImplicit);
+        }
+
+        private void WriteNodeImpl(AbsStructDecl node)
+        {
+            WriteMemberDeclStart(AbsSnapshotTag.StructDecl, node);
+            WriteNodes(node.Members);
+            WriteMemberDeclEnd(node);
+        }
+
+        private void WriteNodeImpl(AbsElementDecl node)
+        {
+            WriteMemberDeclStart(AbsSnapshotTag.ElementDecl, node);
+            WriteMemberDeclEnd(node);
+        }
+
+        private void WriteNodeImpl(AbsSlotDecl node)
+        {
+            WriteMemberDeclStart(AbsSnapshotTag.SlotDecl, node);
+            WriteNode(node.Type);
+            WriteNode(node.Init);
+            WriteMemberDeclEnd(node);
+        }
+
+        private void WriteNodeImpl(AbsConceptDecl node)
+        {
+            WriteMemberDeclStart(AbsSnapshotTag.ConceptDecl, node);
+            WriteNodes(node.GenericParams);
+            WriteNodes(node.Members);
+            WriteMemberDeclEnd(node);
+        }
+
+        private void WriteNodeImpl(AbsMethodDecl node)
+        {
+            WriteMemberDeclStart(AbsSnapshotTag.MethodDecl, node);
+            WriteNode(node.resultType);
+            WriteNodes(node.parameters);
+            WriteNode(node.body);
+            WriteNodes(node.GenericParams);
+            WriteMemberDeclEnd(node);
+        }
+
+        private void WriteNodeImpl(AbsParamDecl node)
+        {
+            WriteHeader(AbsSnapshotTag.ParamDecl, node);
+            WriteIdentifier(node.name);
+            WriteNode(node.type);
+        }
+
+        private void WriteNodeImpl(AbsBlockStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.BlockStmt, node);
+            WriteNodes(node.stmts);
+        }
+
+        private void WriteNodeImpl(AbsReturnStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.ReturnStmt, node);
+            WriteNode(node.exp);
+        }
+
+        private void WriteNodeImpl(AbsExpStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.ExpStmt, node);
+            WriteNode(node.Value);
+        }
+
+        private void WriteNodeImpl(AbsLetStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.LetStmt, node);
+            _writer.Write((int) node.Flavor);
+            WriteNode(node.Type);
+            WriteIdentifier(node.Name);
+            WriteNode(node.Value);
+        }
+
+        private void WriteNodeImpl(AbsEmptyStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.EmptyStmt, node);
+        }
+
+        private void WriteNodeImpl(AbsCase node)
+        {
+            WriteHeader(AbsSnapshotTag.Case, node);
+            WriteNode(node.Value);
+            WriteNode(node.Body);
+        }
+
+        private void WriteNodeImpl(AbsSwitchStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.SwitchStmt, node);
+            WriteNode(node.Value);
+            WriteNodes(node.Cases);
+        }
+
+        private void WriteNodeImpl(AbsIfStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.IfStmt, node);
+            WriteNode(node.Condition);
+            WriteNode(node.ThenStmt);
+            WriteNode(node.ElseStmt);
+        }
+
+        private void WriteNodeImpl(AbsForStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.ForStmt, node);
+            WriteIdentifier(node.Name);
+            WriteNode(node.Sequence);
+            WriteNode(node.Body);
+        }
+
+        private void WriteNodeImpl(AbsSeqStmt node)
+        {
+            WriteHeader(AbsSnapshotTag.SeqStmt, node);
+            WriteNode(node.Head);
+            WriteNode(node.Tail);
+        }
+
+        private void WriteNodeImpl(AbsVarRef node)
+        {
+            WriteHeader(AbsSnapshotTag.VarRef, node);
+            WriteIdentifier(node.name);
+        }
+
+        private void WriteNodeImpl(AbsMemberRef node)
+        {
+            WriteHeader(AbsSnapshotTag.MemberRef, node);
+            WriteNode(node.baseObject);
+            WriteIdentifier(node.memberName);
+        }
+
+        private void WriteNodeImpl(AbsElementRef node)
+        {
+            WriteHeader(AbsSnapshotTag.ElementRef, node);
+            WriteNode(node.BaseObject);
+            WriteNode(node.Index);
+        }
+
+        private void WriteNodeImpl(AbsApp node)
+        {
+            WriteHeader(AbsSnapshotTag.App, node);
+            WriteNode(node.function);
+            WriteNodes(node.arguments);
+        }
+
+        private void WriteNodeImpl(AbsGenericApp node)
+        {
+            WriteHeader(AbsSnapshotTag.GenericApp, node);
+            WriteNode(node.function);
+            WriteNodes(node.arguments);
+        }
+
+        private void WriteNodeImpl(AbsAssign node)
+        {
+            WriteHeader(AbsSnapshotTag.Assign, node);
+            WriteNode(node.Left);
+            WriteNode(node.Right);
+        }
+
+        private void WriteNodeImpl(AbsIfTerm node)
+        {
+            WriteHeader(AbsSnapshotTag.IfTerm, node);
+            WriteNode(node.Condition);
+            WriteNode(node.Then);
+            WriteNode(node.Else);
+        }
+
+        private void WriteNodeImpl(AbsPositionalArg node)
+        {
+            WriteHeader(AbsSnapshotTag.PositionalArg, node);
+            WriteNode(node.Term);
+        }
+
+        private void WriteNodeImpl(AbsKeywordArg node)
+        {
+            WriteHeader(AbsSnapshotTag.KeywordArg, node);
+            WriteIdentifier(node.Name);
+            WriteNode(node.Term);
+        }
+
+        private void WriteNodeImpl(AbsLit<Int32> node)
+        {
+            WriteHeader(AbsSnapshotTag.LitInt32, node);
+            _writer.Write(node.Value);
+        }
+
+        private void WriteNodeImpl(AbsLit<Double> node)
+        {
+            WriteHeader(AbsSnapshotTag.LitDouble, node);
+            _writer.Write(node.Value);
+        }
+
+        private void WriteNodeImpl(AbsLit<String> node)
+        {
+            WriteHeader(AbsSnapshotTag.LitString, node);
+            _writer.Write(node.Value);
+        }
+
+        private void WriteNodeImpl(AbsLit<bool> node)
+        {
+            WriteHeader(AbsSnapshotTag.LitBool, node);
+            _writer.Write(node.Value);
+        }
+
+        private void WriteNodeImpl(AbsVoid node)
+        {
+            WriteHeader(AbsSnapshotTag.Void, node);
+        }
+
+        private void WriteNodeImpl(AbsFreqQualTerm node)
+        {
+            WriteHeader(AbsSnapshotTag.FreqQualTerm, node);
+            WriteNode(node.Freq);
+            WriteNode(node.Type);
+        }
+
+        private void WriteNodeImpl(AbsAttribute node)
+        {
+            WriteHeader(AbsSnapshotTag.Attribute, node);
+            WriteIdentifier(node.Name);
+            WriteNodes(node.Args);
+        }
+
+        private void WriteNodeImpl(AbsBaseExp node)
+        {
+            WriteHeader(AbsSnapshotTag.BaseExp, node);
+        }
+    }
+
+    internal class AbsSnapshotReader
+    {
+        private System.IO.BinaryReader _reader;
+        private IdentifierFactory _identifierFactory;
+        private List<Identifier> _identifiers = new List<Identifier>();
+        private List<string> _fileNames = new List<string>();
+
+        public AbsSnapshotReader(
+            System.IO.BinaryReader reader,
+            IdentifierFactory identifierFactory)
+        {
+            _reader = reader;
+            _identifierFactory = identifierFactory;
+        }
+
+        public T ReadNode<T>()
+            where T : AbsSyntax
+        {
+            var node = ReadNode();
+            if (node != null && !(node is T))
+            {
+                throw new System.IO.InvalidDataException(string.Format(
+                    "Expected {0} in syntax snapshot, found {1}",
+                    typeof(T).Name,
+                    node.GetType().Name));
+            }
+            return (T) node;
+        }
+
+        private T[] ReadNodes<T>()
+            where T : AbsSyntax
+        {
+            var result = ReadOptionalNodes<T>();
+            if (result == null)
+                throw Corrupt("Missing node list");
+            return result;
+        }
+
+        // Only generic parameter lists may be null.
+        private T[] ReadOptionalNodes<T>()
+            where T : AbsSyntax
+        {
+            int count = _reader.ReadInt32();
+            if (count < 0)
+                return null;
+
+            // Every node takes at least its tag byte, so a count
+            // past the end of the data can only mean corruption.
+            var stream = _reader.BaseStream;
+            if (stream.CanSeek && count > stream.Length - stream.Position)
+                throw Corrupt("Node count out of range");
+
+            var result = new T[count];
+            for (int ii = 0; ii < count; ++ii)
+                result[ii] = ReadNode<T>();
+            return result;
+        }
+
+        private AbsSyntaxInfo ReadInfo()
+        {
+            var fileName = ReadFileName();
+            var start = ReadPos();
+            var end = ReadPos();
+            return new AbsSyntaxInfo(new SourceRange(fileName, start, end));
+        }
+
+        private SourcePos ReadPos()
+        {
+            int lineNumber = _reader.ReadInt32();
+            int columnNumber = _reader.ReadInt32();
+            int location = _reader.ReadInt32();
+            return new SourcePos(lineNumber, columnNumber, location);
+        }
+
+        private string ReadFileName()
+        {
+            int index = _reader.ReadInt32();
+            if (index < 0)
+                return null;
+            if (index == _fileNames.Count)
+                _fileNames.Add(_reader.ReadString());
+            if (index >= _fileNames.Count)
+                throw Corrupt("File name index out of range");
+            return _fileNames[index];
+        }
+
+        private Identifier ReadIdentifier()
+        {
+            int index = _reader.ReadInt32();
+            if (index < 0)
+                return null;
+            if (index < _identifiers.Count)
+                return _identifiers[index];
+            if (index > _identifiers.Count)
+                throw Corrupt("Identifier index out of range");
+
+            var kind = (AbsSnapshotIdentifierKind) _reader.ReadByte();
+            var name = _reader.ReadString();
+
+            Identifier result;
+            switch (kind)
+            {
+                case AbsSnapshotIdentifierKind.Simple:
+                    result = _identifierFactory.simpleIdentifier(name);
+                    break;
+                case AbsSnapshotIdentifierKind.Operator:
+                    result = _identifierFactory.operatorIdentifier(name);
+                    break;
+                case AbsSnapshotIdentifierKind.Unique:
+                    result = _identifierFactory.unique(name);
+                    break;
+                default:
+                    throw Corrupt("Unknown identifier kind");
+            }
+
+            _identifiers.Add(result);
+            return result;
+        }
+
+        private T ReadMemberDeclEnd<T>(T decl)
+            where T : AbsMemberDecl
+        {
+            decl.Modifiers = (AbsModifiers) _reader.ReadInt32();
+            foreach (var attribute in ReadNodes<AbsAttribute>())
+                decl.Attributes.Add(attribute);
+            return decl;
+        }
+
+        private static System.IO.InvalidDataException Corrupt(string message)
+        {
+            return new System.IO.InvalidDataException(message + " in syntax snapshot");
+        }
+
+        private AbsSyntax ReadNode()
+        {
+            var tag = (AbsSnapshotTag) _reader.ReadByte();
+            if (tag == AbsSnapshotTag.Null)
+                return null;
+
+            var info = ReadInfo();
+            switch (tag)
+            {
+                case AbsSnapshotTag.SourceRecord:
+                    return new AbsSourceRecord(info, ReadNodes<AbsGlobalDecl>());
+
+                case AbsSnapshotTag.PipelineDecl:
+                    {
+                        var modifiers = (AbsModifiers) _reader.ReadInt32();
+                        var name = ReadIdentifier();
+                        var bases = ReadNodes<AbsTerm>();
+                        var members = ReadNodes<AbsMemberDecl>();
+                        var result = new AbsPipelineDecl(info, name, bases, members);
+                        result.Modifiers = modifiers;
+                        return result;
+                    }
+
+                case AbsSnapshotTag.TypeSlotDecl:
+                    {
+                        var result = new AbsTypeSlotDecl(info, ReadIdentifier());
+                        var genericParams = ReadOptionalNodes<AbsGenericParamDecl>();
+                        if (genericParams != null)
+                            result.GenericParams = genericParams;
+                        return ReadMemberDeclEnd(result);
+                    }
+
+                case AbsSnapshotTag.GenericTypeParamDecl:
+                    return new AbsGenericTypeParamDecl(info, ReadIdentifier());
+
+                case AbsSnapshotTag.GenericValueParamDecl:
+                    {
+                        var type = ReadNode<AbsTerm>();
+                        var name = ReadIdentifier();
+                        var isImplicit = _reader.ReadBoolean();
+                        return new AbsGenericValueParamDecl(info, type, name, isImplicit);
+                    }
+
+                case AbsSnapshotTag.StructDecl:
+                    {
+                        var name = ReadIdentifier();
+                        var members = ReadNodes<AbsMemberDecl>();
+                        return ReadMemberDeclEnd(new AbsStructDecl(info, name, members));
+                    }
+
+                case AbsSnapshotTag.ElementDecl:
+                    return ReadMemberDeclEnd(new AbsElementDecl(info, ReadIdentifier()));
+
+                case AbsSnapshotTag.SlotDecl:
+                    {
+                        var name = ReadIdentifier();
+                        var type = ReadNode<AbsTerm>();
+                        var init = ReadNode<AbsTerm>();
+                        return ReadMemberDeclEnd(new AbsSlotDecl(info, name, type, init));
+                    }
+
+                case AbsSnapshotTag.ConceptDecl:
+                    {
+                        var name = ReadIdentifier();
+                        var genericParams = ReadOptionalNodes<AbsGenericParamDecl>();
+                        var members = ReadNodes<AbsMemberDecl>();
+                        return ReadMemberDeclEnd(new AbsConceptDecl(info, name, genericParams, members));
+                    }
+
+                case AbsSnapshotTag.MethodDecl:
+                    {
+                        var name = ReadIdentifier();
+                        var resultType = ReadNode<AbsTerm>();
+                        var parameters = ReadNodes<AbsParamDecl>();
+                        var body = ReadNode<AbsStmt>();
+                        var genericParams = ReadOptionalNodes<AbsGenericParamDecl>();
+                        var result = new AbsMethodDecl(info, name, resultType, parameters, body);
+                        if (genericParams != null)
+                            result.GenericParams = genericParams;
+                        return ReadMemberDeclEnd(result);
+                    }
+
+                case AbsSnapshotTag.ParamDecl:
+                    {
+                        var name = ReadIdentifier();
+                        var type = ReadNode<AbsTerm>();
+                        return new AbsParamDecl(info, name, type);
+                    }
+
+                case AbsSnapshotTag.BlockStmt:
+                    return new AbsBlockStmt(info, ReadNodes<AbsStmt>());
+
+                case AbsSnapshotTag.ReturnStmt:
+                    return new AbsReturnStmt(info, ReadNode<AbsTerm>());
+
+                case AbsSnapshotTag.ExpStmt:
+                    return new AbsExpStmt(info, ReadNode<AbsTerm>());
+
+                case AbsSnapshotTag.LetStmt:
+                    {
+                        var flavor = (AbsLetFlavor) _reader.ReadInt32();
+                        var type = ReadNode<AbsTerm>();
+                        var name = ReadIdentifier();
+                        var value = ReadNode<AbsTerm>();
+                        return new AbsLetStmt(info, flavor, type, name, value);
+                    }
+
+                case AbsSnapshotTag.EmptyStmt:
+                    return new AbsEmptyStmt(info);
+
+                case AbsSnapshotTag.Case:
+                    {
+                        var value = ReadNode<AbsTerm>();
+                        var body = ReadNode<AbsStmt>();
+                        return new AbsCase(info, value, body);
+                    }
+
+                case AbsSnapshotTag.SwitchStmt:
+                    {
+                        var value = ReadNode<AbsTerm>();
+                        var cases = ReadNodes<AbsCase>();
+                        return new AbsSwitchStmt(info, value, cases);
+                    }
+
+                case AbsSnapshotTag.IfStmt:
+                    {
+                        var condition = ReadNode<AbsTerm>();
+                        var thenStmt = ReadNode<AbsStmt>();
+                        var elseStmt = ReadNode<AbsStmt>();
+                        return new AbsIfStmt(info, condition, thenStmt, elseStmt);
+                    }
+
+                case AbsSnapshotTag.ForStmt:
+                    {
+                        var name = ReadIdentifier();
+                        var sequence = ReadNode<AbsTerm>();
+                        var body = ReadNode<AbsStmt>();
+                        return new AbsForStmt(info, name, sequence, body);
+                    }
+
+                case AbsSnapshotTag.SeqStmt:
+                    {
+                        var head = ReadNode<AbsStmt>();
+                        var tail = ReadNode<AbsStmt>();
+                        return new AbsSeqStmt(info, head, tail);
+                    }
+
+                case AbsSnapshotTag.VarRef:
+                    return new AbsVarRef(info, ReadIdentifier());
+
+                case AbsSnapshotTag.MemberRef:
+                    {
+                        var baseObject = ReadNode<AbsTerm>();
+                        var memberName = ReadIdentifier();
+                        return new AbsMemberRef(info, baseObject, memberName);
+                    }
+
+                case AbsSnapshotTag.ElementRef:
+                    {
+                        var baseObject = ReadNode<AbsTerm>();
+                        var index = ReadNode<AbsTerm>();
+                        return new AbsElementRef(info, baseObject, index);
+                    }
+
+                case AbsSnapshotTag.App:
+                    {
+                        var function = ReadNode<AbsTerm>();
+                        var arguments = ReadNodes<AbsArg>();
+                        return new AbsApp(info, function, arguments);
+                    }
+
+                case AbsSnapshotTag.GenericApp:
+                    {
+                        var function = ReadNode<AbsTerm>();
+                        var arguments = ReadNodes<AbsArg>();
+                        return new AbsGenericApp(info, function, arguments);
+                    }
+
+                case AbsSnapshotTag.Assign:
+                    {
+                        var left = ReadNode<AbsTerm>();
+                        var right = ReadNode<AbsTerm>();
+                        return new AbsAssign(info, left, right);
+                    }
+
+                case AbsSnapshotTag.IfTerm:
+                    {
+                        var condition = ReadNode<AbsTerm>();
+                        var thenTerm = ReadNode<AbsTerm>();
+                        var elseTerm = ReadNode<AbsTerm>();
+                        return new AbsIfTerm(info, condition, thenTerm, elseTerm);
+                    }
+
+                case AbsSnapshotTag.PositionalArg:
+                    return new AbsPositionalArg(info, ReadNode<AbsTerm>());
+
+                case AbsSnapshotTag.KeywordArg:
+                    {
+                        var name = ReadIdentifier();
+                        var term = ReadNode<AbsTerm>();
+                        return new AbsKeywordArg(info, name, term);
+                    }
+
+                case AbsSnapshotTag.LitInt32:
+                    return new AbsLit<Int32>(info, _reader.ReadInt32());
+
+                case AbsSnapshotTag.LitDouble:
+                    return new AbsLit<Double>(info, _reader.ReadDouble());
+
+                case AbsSnapshotTag.LitString:
+                    return new AbsLit<String>(info, _reader.ReadString());
+
+                case AbsSnapshotTag.LitBool:
+                    return new AbsLit<bool>(info, _reader.ReadBoolean());
+
+                case AbsSnapshotTag.Void:
+                    return new AbsVoid(info);
+
+                case AbsSnapshotTag.FreqQualTerm:
+                    {
+                        var freq = ReadNode<AbsTerm>();
+                        var type = ReadNode<AbsTerm>();
+                        return new AbsFreqQualTerm(info, freq, type);
+                    }
+
+                case AbsSnapshotTag.Attribute:
+                    {
+                        var name = ReadIdentifier();
+                        var args = ReadNodes<AbsArg>();
+                        return new AbsAttribute(info, name, args);
+                    }
+
+                case AbsSnapshotTag.BaseExp:
+                    return new AbsBaseExp(info);
+
+                default:
+                    throw new System.IO.InvalidDataException(string.Format(
+                        "Unknown tag {0} in syntax snapshot", (int) tag));
+            }
+        }
+    }
+}
@@ -95,12 +95,21 @@ namespace Spark.Compiler
         {
             _absSourceRecords = new List<AbsSourceRecord>();
 
-            // Parse the "standard library."
-            var assembly = System.Reflection.Assembly.GetExecutingAssembly();
-            using (var stdlib = assembly.GetManifestResourceStream("Spark.stdlib.spark"))
+            // Load the "standard library," parsing it only if
+            // there is no snapshot of it yet.
+            var stdlibRecord = StdlibSnapshot.TryLoad(Identifiers);
+            if (stdlibRecord == null)
             {
-                ParseStream(stdlib, "Standard Library");
+                var assembly = System.Reflection.Assembly.GetExecutingAssembly();
+                using (var stdlib = assembly.GetManifestResourceStream("Spark.stdlib.spark"))
+                {
+                    stdlibRecord = ParseStream(stdlib, "Standard Library");
+                }
+                if (stdlibRecord != null)
+                    StdlibSnapshot.Save(stdlibRecord);
             }
+            if (stdlibRecord != null)
+                _absSourceRecords.Add(stdlibRecord);
 
             // Parse the user code.
             foreach (var input in _inputs)
@@ -112,7 +121,9 @@ namespace Spark.Compiler
 
                 using (stream)
                 {
-                    ParseStream(stream, input);
+                    var record = ParseStream(stream, input);
+                    if (record != null)
+                        _absSourceRecords.Add(record);
                 }
             }
 
@@ -154,7 +165,14 @@ namespace Spark.Compiler
             errorCount += Lower();
             if (errorCount != 0)
                 return errorCount;
-            
+
+            errorCount += Emit();
+            return errorCount;
+        }
+
+        public int Emit()
+        {
+            int errorCount = 0;
 
             var outputHeaderName = string.Format("{0}.h", OutputPrefix);
             var outputSourceName = string.Format("{0}.cpp", OutputPrefix);
@@ -187,7 +205,7 @@ namespace Spark.Compiler
             return errorCount;
         }
 
-        private void ParseStream(
+        private AbsSourceRecord ParseStream(
             System.IO.Stream stream,
             string name)
         {
@@ -198,8 +216,9 @@ namespace Spark.Compiler
                     name);
             var parser = new Spark.Parser.Generated.Parser(scanner);
 
-            if (parser.Parse())
-                _absSourceRecords.Add(parser.result);
+            if (!parser.Parse())
+                return null;
+            return parser.result;
         }
 
         private List<System.Reflection.Assembly> _assemblies = new List<System.Reflection.Assembly>();
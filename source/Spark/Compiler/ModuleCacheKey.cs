@@ -0,0 +1,135 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace Spark.Compiler
+{
+    // Computes the content-addressed keys used by the on-disk
+    // module cache. A key covers everything that can change
+    // the output of a compile: the cache format, the compiler
+    // and runtime builds, the embedded standard library, the user
+    // source files, and (for dynamically-composed shader classes)
+    // the mixin list.
+    public class ModuleCacheKey
+    {
+        // Bump this whenever a cached module could be wrong for
+        // a new build even though the sources are the same: a
+        // change to the layout of the descriptors in spark.h, to
+        // the code the emitters produce, or to the .entry files.
+        // The build IDs change with any rebuild of the compiler or
+        // the runtime, but not when only the spark.h that an
+        // application was built against has changed.
+        public const int FormatVersion = 1;
+
+        private System.Security.Cryptography.SHA1 _hash = System.Security.Cryptography.SHA1.Create();
+        private List<byte> _data = new List<byte>();
+
+        public ModuleCacheKey()
+        {
+            var assembly = System.Reflection.Assembly.GetExecutingAssembly();
+
+            AddString(FormatVersion.ToString());
+
+            // Any rebuild of the compiler invalidates the cache.
+            AddString(assembly.GetName().Version.ToString());
+            AddString(assembly.ManifestModule.ModuleVersionId.ToString());
+
+            using (var stdlib = assembly.GetManifestResourceStream("Spark.stdlib.spark"))
+            {
+                AddStream(stdlib);
+            }
+        }
+
+        public void AddFile(string fileName)
+        {
+            AddString(System.IO.Path.GetFileName(fileName));
+
+            var stream = new System.IO.FileStream(
+                fileName,
+                System.IO.FileMode.Open,
+                System.IO.FileAccess.Read);
+            using (stream)
+            {
+                AddStream(stream);
+            }
+        }
+
+        public void AddString(string value)
+        {
+            var bytes = Encoding.UTF8.GetBytes(value);
+            AddBytes(BitConverter.GetBytes(bytes.Length));
+            AddBytes(bytes);
+        }
+
+        public override string ToString()
+        {
+            var digest = _hash.ComputeHash(_data.ToArray());
+            var builder = new StringBuilder();
+            foreach (var b in digest)
+                builder.AppendFormat("{0:x2}", b);
+            return builder.ToString();
+        }
+
+        // Key for a module compiled from source files. The
+        // runtime's build ID covers the code generated and the
+        // descriptor layout expected by the runtime doing the
+        // compile, which the compiler's own build doesn't.
+        public static string ForFiles(
+            IEnumerable<string> fileNames,
+            string runtimeBuildId)
+        {
+            var key = new ModuleCacheKey();
+            key.AddString(runtimeBuildId);
+            foreach (var fileName in fileNames)
+                key.AddFile(fileName);
+            return key.ToString();
+        }
+
+        // Key for a shader class composed at runtime, given the
+        // keys of the modules that define each mixin.
+        public static string ForMixins(
+            IEnumerable<string> moduleKeys,
+            IEnumerable<string> mixinNames)
+        {
+            var key = new ModuleCacheKey();
+            foreach (var pair in moduleKeys.Zip(mixinNames, (k, n) => new { k, n }))
+            {
+                key.AddString(pair.k);
+                key.AddString(pair.n);
+            }
+            return key.ToString();
+        }
+
+        private void AddStream(System.IO.Stream stream)
+        {
+            var buffer = new byte[4096];
+            var start = _data.Count;
+            int count;
+            while ((count = stream.Read(buffer, 0, buffer.Length)) > 0)
+            {
+                _data.AddRange(buffer.Take(count));
+            }
+            AddBytes(BitConverter.GetBytes(_data.Count - start));
+        }
+
+        private void AddBytes(byte[] bytes)
+        {
+            _data.AddRange(bytes);
+        }
+    }
+}
@@ -0,0 +1,227 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+using Spark.AbstractSyntax;
+
+namespace Spark.Compiler
+{
+    // The standard library is the same for every compile, so
+    // rather than scan and parse it each time we keep a binary
+    // snapshot of its syntax tree (see AbsSnapshot) and just
+    // re-intern its identifiers into each new compile.
+    //
+    // The snapshot is captured the first time the stdlib gets
+    // parsed, kept for the rest of the process, and saved to
+    // the temp directory so that later processes (e.g., each
+    // run of sparkc) can load it without parsing at all. There
+    // is one file, stamped with the compiler build that wrote
+    // it and a digest of the snapshot; a file from any other
+    // build, or that is damaged, is ignored and replaced.
+    public static class StdlibSnapshot
+    {
+        private static readonly object _lock = new object();
+        private static byte[] _data;
+        private static bool _triedFile;
+        private static bool _dataFromFile;
+
+        // Build id (a GUID) and SHA1 digest; see GetStamp.
+        private const int StampSize = 16 + 20;
+
+        // Returns null if no usable snapshot is available yet.
+        public static AbsSourceRecord TryLoad(
+            IdentifierFactory identifiers)
+        {
+            var data = GetData();
+            if (data == null)
+                return null;
+
+            try
+            {
+                using (var reader = new System.IO.BinaryReader(new System.IO.MemoryStream(data)))
+                {
+                    return AbsSnapshot.Read(reader, identifiers);
+                }
+            }
+            catch (Exception ex)
+            {
+                // A corrupt snapshot (e.g., a truncated file) is
+                // discarded, and the stdlib parsed again.
+                if (ex is OutOfMemoryException
+                    || ex is System.Threading.ThreadAbortException)
+                {
+                    throw;
+                }
+            }
+
+            bool deleteFile = false;
+            lock (_lock)
+            {
+                if (_data == data)
+                {
+                    deleteFile = _dataFromFile;
+                    _data = null;
+                    _dataFromFile = false;
+                }
+            }
+            if (deleteFile)
+                DeleteFile();
+            return null;
+        }
+
+        public static void Save(
+            AbsSourceRecord record)
+        {
+            byte[] data;
+            using (var stream = new System.IO.MemoryStream())
+            {
+                using (var writer = new System.IO.BinaryWriter(stream))
+                {
+                    AbsSnapshot.Write(writer, record);
+                }
+                data = stream.ToArray();
+            }
+
+            lock (_lock)
+            {
+                _data = data;
+                _dataFromFile = false;
+            }
+
+            WriteFile(data);
+        }
+
+        private static byte[] GetData()
+        {
+            lock (_lock)
+            {
+                if (_data == null && !_triedFile)
+                {
+                    _triedFile = true;
+                    _data = ReadFile();
+                    _dataFromFile = _data != null;
+                }
+                return _data;
+            }
+        }
+
+        private static string GetPath()
+        {
+            return System.IO.Path.Combine(
+                System.IO.Path.GetTempPath(),
+                "spark-stdlib.snapshot");
+        }
+
+        // The stamp at the start of the file is the compiler
+        // build that wrote it (any rebuild, including any change
+        // to the embedded stdlib, invalidates the snapshot) and
+        // a digest of the rest of the file.
+        private static byte[] GetStamp(byte[] data, int offset, int count)
+        {
+            var assembly = System.Reflection.Assembly.GetExecutingAssembly();
+            var buildId = assembly.ManifestModule.ModuleVersionId.ToByteArray();
+            using (var sha1 = System.Security.Cryptography.SHA1.Create())
+            {
+                return buildId.Concat(sha1.ComputeHash(data, offset, count)).ToArray();
+            }
+        }
+
+        private static byte[] ReadFile()
+        {
+            try
+            {
+                var path = GetPath();
+                if (!System.IO.File.Exists(path))
+                    return null;
+                var contents = System.IO.File.ReadAllBytes(path);
+                if (contents.Length < StampSize)
+                    return null;
+
+                var stamp = GetStamp(contents, StampSize, contents.Length - StampSize);
+                for (int ii = 0; ii < StampSize; ++ii)
+                {
+                    if (contents[ii] != stamp[ii])
+                        return null;
+                }
+
+                var data = new byte[contents.Length - StampSize];
+                Array.Copy(contents, StampSize, data, 0, data.Length);
+                return data;
+            }
+            catch (System.IO.IOException)
+            {
+                return null;
+            }
+            catch (UnauthorizedAccessException)
+            {
+                return null;
+            }
+        }
+
+        private static void WriteFile(byte[] data)
+        {
+            // Write to a private file and then move it into place,
+            // so that a concurrent reader never sees a partial one.
+            try
+            {
+                var path = GetPath();
+                var tempPath = string.Format("{0}.{1}", path, Guid.NewGuid().ToString("N"));
+                using (var stream = System.IO.File.Create(tempPath))
+                {
+                    var stamp = GetStamp(data, 0, data.Length);
+                    stream.Write(stamp, 0, stamp.Length);
+                    stream.Write(data, 0, data.Length);
+                }
+                try
+                {
+                    if (System.IO.File.Exists(path))
+                        System.IO.File.Replace(tempPath, path, null);
+                    else
+                        System.IO.File.Move(tempPath, path);
+                }
+                catch (System.IO.IOException)
+                {
+                    // Another process got there first, or has
+                    // the file open.
+                    System.IO.File.Delete(tempPath);
+                }
+            }
+            catch (System.IO.IOException)
+            {
+                // Persistence is best-effort only.
+            }
+            catch (UnauthorizedAccessException)
+            {
+            }
+        }
+
+        private static void DeleteFile()
+        {
+            try
+            {
+                System.IO.File.Delete(GetPath());
+            }
+            catch (System.IO.IOException)
+            {
+            }
+            catch (UnauthorizedAccessException)
+            {
+            }
+        }
+    }
+}
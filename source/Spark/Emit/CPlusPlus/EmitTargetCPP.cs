@@ -843,6 +843,16 @@ namespace Spark.Emit.CPlusPlus
                 _span.InsertSpan());
         }
 
+        public void If(IEmitVal condition, Action<IEmitBlock> emitThen)
+        {
+            _span.WriteLine("if( {0} )", condition);
+            _span.WriteLine("{");
+            var thenSpan = _span.IndentSpan();
+            _span.WriteLine("}");
+
+            emitThen(new EmitBlockCPP(_method, thenSpan));
+        }
+
         public IEmitVal Local(string name, IEmitType type)
         {
             var sym = GenSym(name);
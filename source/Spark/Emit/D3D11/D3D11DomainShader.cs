@@ -34,7 +34,7 @@ namespace Spark.Emit.D3D11
             var fineVertexElement = GetElement("FineVertex");
             var rasterVertexElement = GetElement("RasterVertex");
 
-            InitBlock.AppendComment("D3D11 Domain Shader");
+            SharedInitBlock.AppendComment("D3D11 Domain Shader");
 
             var tessEnabledAttr = FindAttribute( constantElement, "__D3D11TessellationEnabled" );
             if( tessEnabledAttr  == null )
@@ -158,7 +158,7 @@ namespace Spark.Emit.D3D11
 
             hlslContext.EmitConstantBufferDecl();
 
-            EmitShaderSetup(
+            BeginShaderSetup(
                 hlslContext,
                 "ds_5_0",
                 "Domain",
@@ -172,13 +172,11 @@ namespace Spark.Emit.D3D11
             var tessEnabledAttr = FindAttribute( constantElement, "__D3D11TessellationEnabled" );
             if( tessEnabledAttr == null )
             {
-                ExecBlock.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    "DSSetShader",
-                    GetNullPointer( "ID3D11DomainShader*" ),
-                    GetNullPointer( "ID3D11ClassInstance*" ),
-                    ExecBlock.LiteralU32( 0 ) );
+                EmitStateCall(
+                    ExecBlock,
+                    "ShadowSetShader",
+                    GetShaderStageVal( ExecBlock, "DS" ),
+                    GetNullPointer( "ID3D11DomainShader*" ) );
                 return;
             }
 
@@ -31,7 +31,7 @@ namespace Spark.Emit.D3D11
         {
             constantElement = GetElement( "Constant" );
 
-            InitBlock.AppendComment( "D3D11 Geometry Shader" );
+            SharedInitBlock.AppendComment( "D3D11 Geometry Shader" );
 
             var gsEnabledAttr = FindAttribute( constantElement, "__D3D11GeometryShaderEnabled" );
             if( gsEnabledAttr == null )
@@ -110,7 +110,7 @@ namespace Spark.Emit.D3D11
 
             hlslContext.EmitConstantBufferDecl();
 
-            EmitShaderSetup(
+            BeginShaderSetup(
                 hlslContext,
                 "gs_5_0",
                 "Geometry",
@@ -124,13 +124,11 @@ namespace Spark.Emit.D3D11
             var gsEnabledAttr = FindAttribute( constantElement, "__D3D11GeometryShaderEnabled" );
             if( gsEnabledAttr == null )
             {
-                ExecBlock.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    "GSSetShader",
-                    GetNullPointer( "ID3D11GeometryShader*" ),
-                    GetNullPointer( "ID3D11ClassInstance*" ),
-                    ExecBlock.LiteralU32( 0 ) );
+                EmitStateCall(
+                    ExecBlock,
+                    "ShadowSetShader",
+                    GetShaderStageVal( ExecBlock, "GS" ),
+                    GetNullPointer( "ID3D11GeometryShader*" ) );
                 return;
             }
 
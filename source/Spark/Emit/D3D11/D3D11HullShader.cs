@@ -32,7 +32,7 @@ namespace Spark.Emit.D3D11
             var uniformElement = GetElement("Uniform");
             var coarseVertexElement = GetElement("CoarseVertex");
 
-            InitBlock.AppendComment("D3D11 Hull Shader");
+            SharedInitBlock.AppendComment("D3D11 Hull Shader");
 
             var tessEnabledAttr = FindAttribute( constantElement, "__D3D11TessellationEnabled" );
             if( tessEnabledAttr == null )
@@ -367,7 +367,7 @@ namespace Spark.Emit.D3D11
 
             hlslContext.EmitConstantBufferDecl();
 
-            EmitShaderSetup(
+            BeginShaderSetup(
                 hlslContext,
                 "hs_5_0",
                 "Hull",
@@ -383,13 +383,11 @@ namespace Spark.Emit.D3D11
             var tessEnabledAttr = FindAttribute( constantElement, "__D3D11TessellationEnabled" );
             if( tessEnabledAttr == null )
             {
-                ExecBlock.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    "HSSetShader",
-                    GetNullPointer( "ID3D11HullShader*" ),
-                    GetNullPointer( "ID3D11ClassInstance*" ),
-                    ExecBlock.LiteralU32( 0 ) );
+                EmitStateCall(
+                    ExecBlock,
+                    "ShadowSetShader",
+                    GetShaderStageVal( ExecBlock, "HS" ),
+                    GetNullPointer( "ID3D11HullShader*" ) );
                 return;
             }
 
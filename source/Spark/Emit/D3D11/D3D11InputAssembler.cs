@@ -40,6 +40,7 @@ namespace Spark.Emit.D3D11
         private int _inputElementCount = 0;
 
         IEmitField inputLayoutField;
+        IEmitVal inputElementDescsVal;
 
         private MidAttributeDecl _vertexIDAttr = null;
         private MidAttributeDecl _instanceIDAttr = null;
@@ -54,55 +55,65 @@ namespace Spark.Emit.D3D11
 
             _info[_vertexIDAttr] = new IndexSourceInfo(_vertexIDAttr.Range)
             {
-                InputSlotClass = InitBlock.Enum32("D3D11_INPUT_CLASSIFICATION", "D3D11_INPUT_PER_VERTEX_DATA", D3D11_INPUT_CLASSIFICATION.D3D11_INPUT_PER_VERTEX_DATA),
+                InputSlotClass = SharedInitBlock.Enum32("D3D11_INPUT_CLASSIFICATION", "D3D11_INPUT_PER_VERTEX_DATA", D3D11_INPUT_CLASSIFICATION.D3D11_INPUT_PER_VERTEX_DATA),
                 StepRate = 0
             };
 
             _info[_instanceIDAttr] = new IndexSourceInfo(_instanceIDAttr.Range)
             {
-                InputSlotClass = InitBlock.Enum32("D3D11_INPUT_CLASSIFICATION", "D3D11_INPUT_PER_INSTANCE_DATA", D3D11_INPUT_CLASSIFICATION.D3D11_INPUT_PER_INSTANCE_DATA),
+                InputSlotClass = SharedInitBlock.Enum32("D3D11_INPUT_CLASSIFICATION", "D3D11_INPUT_PER_INSTANCE_DATA", D3D11_INPUT_CLASSIFICATION.D3D11_INPUT_PER_INSTANCE_DATA),
                 StepRate = 1
             };
 
-            InitBlock.AppendComment("D3D11 Input Assembler");
+            SharedInitBlock.AppendComment("D3D11 Input Assembler");
 
             var inputElementInits = (from a in iaElement.Attributes
                      where a.IsOutput
                      let name = SharedHLSL.MapName(a)
                      let attrInfo = TryDecomposeAttr(a.Range, a)
                      where attrInfo != null
-                     from e in DeclareInputElements(InitBlock, name, attrInfo)
+                     from e in DeclareInputElements(SharedInitBlock, name, attrInfo)
                      select e).ToArray();
 
             if (_inputElementCount != 0)
             {
-                var inputElementDescsVal = InitBlock.Temp(
+                inputElementDescsVal = SharedInitBlock.Temp(
                     "inputElementDescs",
-                    InitBlock.Array(
+                    SharedInitBlock.Array(
                         EmitTarget.GetBuiltinType("D3D11_INPUT_ELEMENT_DESC"),
                         inputElementInits));
+            }
+        }
+
+        // Creating the input layout needs the vertex shader's
+        // bytecode, so it has to wait for the VS to finish.
+        public override void FinishImplSetup()
+        {
+            base.FinishImplSetup();
 
+            if (_inputElementCount != 0)
+            {
                 var inputLayoutPointerType = EmitTarget.GetOpaqueType("ID3D11InputLayout*");
-                inputLayoutField = EmitClass.AddPrivateField(
+                inputLayoutField = SharedClass.AddPrivateField(
                     inputLayoutPointerType,
                     "_inputLayout");
-                InitBlock.SetArrow(
-                    CtorThis,
+                SharedInitBlock.SetArrow(
+                    SharedInitThis,
                     inputLayoutField,
                     EmitTarget.GetNullPointer(inputLayoutPointerType));
 
-                InitBlock.CallCOM(
-                    CtorDevice,
+                SharedInitBlock.CallCOM(
+                    SharedDevice,
                     "ID3D11Device",
                     "CreateInputLayout",
                     inputElementDescsVal.GetAddress(),
-                    InitBlock.LiteralU32((UInt32)_inputElementCount),
+                    SharedInitBlock.LiteralU32((UInt32)_inputElementCount),
                     EmitPass.VertexShaderBytecodeVal,
                     EmitPass.VertexShaderBytecodeSizeVal,
-                    InitBlock.GetArrow(CtorThis, inputLayoutField).GetAddress());
+                    SharedInitBlock.GetArrow(SharedInitThis, inputLayoutField).GetAddress());
 
-                DtorBlock.CallCOM(
-                    DtorBlock.GetArrow(DtorThis, inputLayoutField),
+                SharedDtorBlock.CallCOM(
+                    SharedDtorBlock.GetArrow(SharedDtorThis, inputLayoutField),
                     "IUnknown",
                     "Release");
             }
@@ -115,19 +126,19 @@ namespace Spark.Emit.D3D11
 
             var uniformElement = GetElement( "Uniform" );
             var drawSpanAttr = GetAttribute( uniformElement, "IA_DrawSpan" );
-            ExecBlock.BuiltinApp( EmitTarget.VoidType, "{0}.Bind({1})",
-                new[] {
-                    EmitContext.EmitAttributeRef(drawSpanAttr, ExecBlock, SubmitEnv),
-                    SubmitContext, } );
+            EmitStateCall(
+                ExecBlock,
+                "ShadowSetDrawSpan",
+                EmitPass.SubmitDrawSpan,
+                EmitContext.EmitAttributeRef(drawSpanAttr, ExecBlock, SubmitEnv));
 
             var inputLayoutPointerType = EmitTarget.GetOpaqueType("ID3D11InputLayout*");
             var inputLayoutToBind = _inputElementCount == 0
                 ? EmitTarget.GetNullPointer(inputLayoutPointerType)
-                : ExecBlock.GetArrow(SubmitThis, inputLayoutField);
-            ExecBlock.CallCOM(
-                SubmitContext,
-                "ID3D11DeviceContext",
-                "IASetInputLayout",
+                : GetSharedArrow(ExecBlock, SubmitThis, inputLayoutField);
+            EmitStateCall(
+                ExecBlock,
+                "ShadowSetInputLayout",
                 inputLayoutToBind);
 
             if (_vertexBuffers.Count != 0)
@@ -153,10 +164,9 @@ namespace Spark.Emit.D3D11
                         (from b in _vertexBufferOffsets
                          select EmitExp(b, ExecBlock, SubmitEnv))));
 
-                ExecBlock.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    "IASetVertexBuffers",
+                EmitStateCall(
+                    ExecBlock,
+                    "ShadowSetVertexBuffers",
                     ExecBlock.LiteralU32(0),
                     ExecBlock.LiteralU32((UInt32)_vertexBuffers.Count),
                     vertexBuffersVal.GetAddress(),
@@ -178,10 +188,11 @@ namespace Spark.Emit.D3D11
         {
             var uniformElement = GetElement( "Uniform" );
             var drawSpanAttr = GetAttribute( uniformElement, "IA_DrawSpan" );
-            ExecBlock.BuiltinApp( EmitTarget.VoidType, "{0}.Submit({1})",
+            ExecBlock.BuiltinApp( EmitTarget.VoidType, "spark::d3d11::SubmitDrawSpan({0}, {1}, {2})",
                 new[] {
-                    EmitContext.EmitAttributeRef(drawSpanAttr, ExecBlock, SubmitEnv),
-                    SubmitContext, } );
+                    SubmitContext,
+                    EmitPass.SubmitDrawSpan,
+                    EmitContext.EmitAttributeRef(drawSpanAttr, ExecBlock, SubmitEnv), } );
         }
 
         private class AttributeInfo
@@ -458,19 +469,19 @@ namespace Spark.Emit.D3D11
             switch (type.Name)
             {
                 case "int":
-                    return InitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32_SINT", DXGI_FORMAT.DXGI_FORMAT_R32_SINT);
+                    return SharedInitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32_SINT", DXGI_FORMAT.DXGI_FORMAT_R32_SINT);
                 case "float2":
-                    return InitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32G32_FLOAT", DXGI_FORMAT.DXGI_FORMAT_R32G32_FLOAT);
+                    return SharedInitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32G32_FLOAT", DXGI_FORMAT.DXGI_FORMAT_R32G32_FLOAT);
                 case "float3":
                 case "Tangent":
-                    return InitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32G32B32_FLOAT", DXGI_FORMAT.DXGI_FORMAT_R32G32B32_FLOAT);
+                    return SharedInitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32G32B32_FLOAT", DXGI_FORMAT.DXGI_FORMAT_R32G32B32_FLOAT);
                 case "float4":
-                    return InitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32G32B32A32_FLOAT", DXGI_FORMAT.DXGI_FORMAT_R32G32B32A32_FLOAT);
+                    return SharedInitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R32G32B32A32_FLOAT", DXGI_FORMAT.DXGI_FORMAT_R32G32B32A32_FLOAT);
 
                 case "ubyte4":
-                    return InitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R8G8B8A8_UINT", DXGI_FORMAT.DXGI_FORMAT_R8G8B8A8_UINT);
+                    return SharedInitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R8G8B8A8_UINT", DXGI_FORMAT.DXGI_FORMAT_R8G8B8A8_UINT);
                 case "unorm4":
-                    return InitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R8G8B8A8_UNORM", DXGI_FORMAT.DXGI_FORMAT_R8G8B8A8_UNORM);
+                    return SharedInitBlock.Enum32("DXGI_FORMAT", "DXGI_FORMAT_R8G8B8A8_UNORM", DXGI_FORMAT.DXGI_FORMAT_R8G8B8A8_UNORM);
                 
                 default:
                     throw new NotImplementedException();
@@ -794,7 +794,7 @@ namespace Spark.Emit.D3D11
             // Blending stuff
             var blendStateType = EmitTarget.GetOpaqueType("ID3D11BlendState*");
 
-            blendStateField = EmitClass.AddPrivateField(
+            blendStateField = SharedClass.AddPrivateField(
                 blendStateType,
                 "_blendState");
 
@@ -808,61 +808,56 @@ namespace Spark.Emit.D3D11
 
             var rtBlendDescType = EmitTarget.GetBuiltinType("D3D11_RENDER_TARGET_BLEND_DESC");
             var blendSpecVals = (from desc in _renderTargetBlendDescs
-                                 select InitBlock.Struct(
+                                 select SharedInitBlock.Struct(
                                     "D3D11_RENDER_TARGET_BLEND_DESC",
-                                    InitBlock.LiteralBool(desc.blendEnable),
-                                    InitBlock.Enum32(desc.color.srcBlend),
-                                    InitBlock.Enum32(desc.color.destBlend),
-                                    InitBlock.Enum32(desc.color.op),
-                                    InitBlock.Enum32(desc.alpha.srcBlend),
-                                    InitBlock.Enum32(desc.alpha.destBlend),
-                                    InitBlock.Enum32(desc.alpha.op),
-                                    InitBlock.LiteralU32(desc.writeMask))).ToList();
+                                    SharedInitBlock.LiteralBool(desc.blendEnable),
+                                    SharedInitBlock.Enum32(desc.color.srcBlend),
+                                    SharedInitBlock.Enum32(desc.color.destBlend),
+                                    SharedInitBlock.Enum32(desc.color.op),
+                                    SharedInitBlock.Enum32(desc.alpha.srcBlend),
+                                    SharedInitBlock.Enum32(desc.alpha.destBlend),
+                                    SharedInitBlock.Enum32(desc.alpha.op),
+                                    SharedInitBlock.LiteralU32(desc.writeMask))).ToList();
             while (blendSpecVals.Count < 8) // \todo: get the limits from somwhere!!!
             {
                 blendSpecVals.Add(
-                    InitBlock.Struct(
+                    SharedInitBlock.Struct(
                         "D3D11_RENDER_TARGET_BLEND_DESC",
-                        InitBlock.LiteralBool(false),
-                        InitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ONE", D3D11_BLEND.D3D11_BLEND_ONE),
-                        InitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ZERO", D3D11_BLEND.D3D11_BLEND_ZERO),
-                        InitBlock.Enum32("D3D11_BLEND_OP", "D3D11_BLEND_OP_ADD", D3D11_BLEND_OP.D3D11_BLEND_OP_ADD),
-                        InitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ONE", D3D11_BLEND.D3D11_BLEND_ONE),
-                        InitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ZERO", D3D11_BLEND.D3D11_BLEND_ZERO),
-                        InitBlock.Enum32("D3D11_BLEND_OP", "D3D11_BLEND_OP_ADD", D3D11_BLEND_OP.D3D11_BLEND_OP_ADD),
-                        InitBlock.LiteralU32((UInt32)D3D11_COLOR_WRITE_ENABLE.D3D11_COLOR_WRITE_ENABLE_ALL)));
+                        SharedInitBlock.LiteralBool(false),
+                        SharedInitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ONE", D3D11_BLEND.D3D11_BLEND_ONE),
+                        SharedInitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ZERO", D3D11_BLEND.D3D11_BLEND_ZERO),
+                        SharedInitBlock.Enum32("D3D11_BLEND_OP", "D3D11_BLEND_OP_ADD", D3D11_BLEND_OP.D3D11_BLEND_OP_ADD),
+                        SharedInitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ONE", D3D11_BLEND.D3D11_BLEND_ONE),
+                        SharedInitBlock.Enum32("D3D11_BLEND", "D3D11_BLEND_ZERO", D3D11_BLEND.D3D11_BLEND_ZERO),
+                        SharedInitBlock.Enum32("D3D11_BLEND_OP", "D3D11_BLEND_OP_ADD", D3D11_BLEND_OP.D3D11_BLEND_OP_ADD),
+                        SharedInitBlock.LiteralU32((UInt32)D3D11_COLOR_WRITE_ENABLE.D3D11_COLOR_WRITE_ENABLE_ALL)));
             }
 
-            var blendSpecsVal = InitBlock.Array(
+            var blendSpecsVal = SharedInitBlock.Array(
                 rtBlendDescType,
                 blendSpecVals);
 
 
-            InitBlock.AppendComment("D3D11 Output Merger");
+            SharedInitBlock.AppendComment("D3D11 Output Merger");
             var blendDescVal =
-                InitBlock.Temp("blendDesc",
-                    InitBlock.Struct(
+                SharedInitBlock.Temp("blendDesc",
+                    SharedInitBlock.Struct(
                         "D3D11_BLEND_DESC",
-                        InitBlock.LiteralBool(false),
-                        InitBlock.LiteralBool(true),
+                        SharedInitBlock.LiteralBool(false),
+                        SharedInitBlock.LiteralBool(true),
                         blendSpecsVal));
 
-            InitBlock.SetArrow(
-                CtorThis,
+            // Blend states come from the runtime's state cache, which
+            // owns them, so there is nothing to release here.
+            SharedInitBlock.SetArrow(
+                SharedInitThis,
                 blendStateField,
-                EmitTarget.GetNullPointer(blendStateType));
-
-            InitBlock.CallCOM(
-                CtorDevice,
-                "ID3D11Device",
-                "CreateBlendState",
-                blendDescVal.GetAddress(),
-                InitBlock.GetArrow(CtorThis, blendStateField).GetAddress());
-
-            DtorBlock.CallCOM(
-                DtorBlock.GetArrow(DtorThis, blendStateField),
-                "IUnknown",
-                "Release");
+                SharedInitBlock.BuiltinApp(
+                    blendStateType,
+                    "spark::d3d11::CreateBlendState({0}, {1})",
+                    new IEmitVal[]{
+                        SharedDevice,
+                        blendDescVal.GetAddress() }));
 
 
 
@@ -871,7 +866,7 @@ namespace Spark.Emit.D3D11
 
             // Emit HLSL code for PS
 
-            InitBlock.AppendComment("D3D11 Pixel Shader");
+            SharedInitBlock.AppendComment("D3D11 Pixel Shader");
 
             hlslContext = new EmitContextHLSL(SharedHLSL, Range, this.EmitClass.GetName());
 
@@ -951,7 +946,7 @@ namespace Spark.Emit.D3D11
 
             //
 
-            EmitShaderSetup(
+            BeginShaderSetup(
                 hlslContext,
                 "ps_5_0",
                 "Pixel",
@@ -972,20 +967,18 @@ namespace Spark.Emit.D3D11
                         EmitTarget.GetOpaqueType("ID3D11RenderTargetView*"),
                         renderTargetViewVals));
 
-                ExecBlock.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    "OMSetRenderTargets",
+                EmitStateCall(
+                    ExecBlock,
+                    "ShadowSetRenderTargets",
                     ExecBlock.LiteralU32((UInt32)renderTargetCount),
                     renderTargetViewsVal.GetAddress(),
                     EmitContext.EmitAttributeRef(depthStencilViewAttribute, ExecBlock, SubmitEnv));
             }
             else
             {
-                ExecBlock.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    "OMSetRenderTargets",
+                EmitStateCall(
+                    ExecBlock,
+                    "ShadowSetRenderTargets",
                     ExecBlock.LiteralU32(0),
                     EmitTarget.GetNullPointer(
                         EmitTarget.GetOpaqueType("ID3D11RenderTargetView**")),
@@ -999,11 +992,10 @@ namespace Spark.Emit.D3D11
                     EmitTarget.GetBuiltinType( "float" ),
                     new IEmitVal[] { floatOne, floatOne, floatOne, floatOne } ) );
 
-            ExecBlock.CallCOM(
-                SubmitContext,
-                "ID3D11DeviceContext",
-                "OMSetBlendState",
-                ExecBlock.GetArrow( SubmitThis, blendStateField ),
+            EmitStateCall(
+                ExecBlock,
+                "ShadowSetBlendState",
+                GetSharedArrow( ExecBlock, SubmitThis, blendStateField ),
                 blendFactorVal.GetAddress(),
                 ExecBlock.LiteralU32( 0xFFFFFFFF ) );
         }
@@ -34,6 +34,14 @@ namespace Spark.Emit.D3D11
         public abstract void EmitImplSetup();
         public abstract void EmitImplBind();
 
+        // Called once every stage of the pass has run EmitImplSetup
+        // (and so has started compiling its shader), to wait on the
+        // compiled bytecode and embed it.
+        public virtual void FinishImplSetup()
+        {
+            FinishShaderSetup();
+        }
+
         protected MidElementDecl GetElement(string name)
         {
             return EmitContext.GetElement(MidPass, name);
@@ -59,18 +67,45 @@ namespace Spark.Emit.D3D11
             return null;
         }
 
+        protected void EmitStateCall(
+            IEmitBlock block,
+            string helperName,
+            params IEmitVal[] args)
+        {
+            EmitContext.EmitStateCall(block, EmitPass, helperName, args);
+        }
+
+        // Matches spark::d3d11::ShaderStage
+        protected IEmitVal GetShaderStageVal(IEmitBlock block, string prefix)
+        {
+            string[] stageNames = { "Vertex", "Hull", "Domain", "Geometry", "Pixel" };
+            string[] stagePrefixes = { "VS", "HS", "DS", "GS", "PS" };
+
+            var index = Array.IndexOf(stagePrefixes, prefix);
+            if (index < 0)
+                throw new NotImplementedException();
+
+            return block.Enum32(
+                "UINT",
+                string.Format("spark::d3d11::kShaderStage_{0}", stageNames[index]),
+                (UInt32)index);
+        }
+
         private void EmitShaderBinds(
             IEmitBlock block,
             string prefix,
             EmitContextHLSL hlslContext)
         {
-            block.CallCOM(
-                SubmitContext,
-                "ID3D11DeviceContext",
-                string.Format("{0}SetConstantBuffers", prefix),
-                block.LiteralU32(0),
-                block.LiteralU32(1),
-                block.GetArrow(SubmitThis, EmitPass.CBField).GetAddress());
+            if (EmitPass.SubmitCBCount != 0)
+            {
+                EmitStateCall(
+                    block,
+                    "ShadowSetConstantBuffers",
+                    GetShaderStageVal(block, prefix),
+                    block.LiteralU32(0),
+                    block.LiteralU32((UInt32) EmitPass.SubmitCBCount),
+                    EmitPass.SubmitCBBuffers.GetAddress());
+            }
 
             var resources = hlslContext.ShaderResources.ToArray();
             var resourceCount = resources.Length;
@@ -85,10 +120,10 @@ namespace Spark.Emit.D3D11
                         EmitTarget.GetOpaqueType("ID3D11ShaderResourceView*"),
                         resourceVals));
 
-                block.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    string.Format("{0}SetShaderResources", prefix),
+                EmitStateCall(
+                    block,
+                    "ShadowSetShaderResources",
+                    GetShaderStageVal(block, prefix),
                     block.LiteralU32(0),
                     block.LiteralU32((UInt32)resourceCount),
                     resourcesVal.GetAddress());
@@ -107,10 +142,10 @@ namespace Spark.Emit.D3D11
                         EmitTarget.GetOpaqueType("ID3D11SamplerState*"),
                         samplerVals));
 
-                block.CallCOM(
-                    SubmitContext,
-                    "ID3D11DeviceContext",
-                    string.Format("{0}SetSamplers", prefix),
+                EmitStateCall(
+                    block,
+                    "ShadowSetSamplers",
+                    GetShaderStageVal(block, prefix),
                     block.LiteralU32(0),
                     block.LiteralU32((UInt32)samplerCount),
                     samplersVal.GetAddress());
@@ -119,28 +154,58 @@ namespace Spark.Emit.D3D11
 
         IEmitField _shaderField = null;
 
-        protected void EmitShaderSetup(
+        private class PendingShader
+        {
+            public EmitContextHLSL HlslContext;
+            public PendingHlslCompile Compile;
+            public string StageName;
+            public string Prefix;
+        }
+
+        private PendingShader _pendingShader = null;
+
+        // Starts compiling the stage's HLSL, so that all of the
+        // stages in a pass compile concurrently; the shader itself
+        // is only created in FinishImplSetup.
+        protected void BeginShaderSetup(
             EmitContextHLSL hlslContext,
             string profile,
             string stageName,
             string prefix)
         {
-            var hlslSpan = hlslContext.Span;
+            _pendingShader = new PendingShader
+            {
+                HlslContext = hlslContext,
+                Compile = hlslContext.BeginCompile(profile),
+                StageName = stageName,
+                Prefix = prefix,
+            };
+        }
+
+        private void FinishShaderSetup()
+        {
+            if (_pendingShader == null)
+                return;
+
+            var hlslContext = _pendingShader.HlslContext;
+            var stageName = _pendingShader.StageName;
+            var prefix = _pendingShader.Prefix;
 
-            var bytecode = hlslContext.Compile(profile);
+            var bytecode = hlslContext.EndCompile(_pendingShader.Compile);
+            _pendingShader = null;
 
-            InitBlock.AppendComment(hlslContext.Span);
+            SharedInitBlock.AppendComment(hlslContext.Span);
 
             if (bytecode != null && bytecode.Length > 0)
                 EmitTarget.ShaderBytecodeCallback(prefix, bytecode);
 
-            var bytecodeLengthVal = InitBlock.Temp(
+            var bytecodeLengthVal = SharedInitBlock.Temp(
                 "bytecodeSize",
-                InitBlock.LiteralU32(
+                SharedInitBlock.LiteralU32(
                     (UInt32)bytecode.Length));
-            var bytecodeVal = InitBlock.Temp(
+            var bytecodeVal = SharedInitBlock.Temp(
                 "bytecode",
-                InitBlock.LiteralData(bytecode));
+                SharedInitBlock.LiteralData(bytecode));
 
             // Terrible hack - save off vals in case of vertex shader... :(
             // This is required because creating an Input Layout
@@ -155,29 +220,29 @@ namespace Spark.Emit.D3D11
             var shaderType = EmitTarget.GetOpaqueType(
                 string.Format("ID3D11{0}Shader*", stageName));
             var shaderNull = EmitTarget.GetNullPointer(shaderType);
-            _shaderField = EmitClass.AddPrivateField(
+            _shaderField = SharedClass.AddPrivateField(
                 shaderType,
                 string.Format("_{0}Shader", stageName));
 
-            InitBlock.SetArrow(
-                CtorThis,
+            SharedInitBlock.SetArrow(
+                SharedInitThis,
                 _shaderField,
                 shaderNull);
 
             var classLinkageNull = EmitTarget.GetNullPointer(
                 EmitTarget.GetOpaqueType("ID3D11ClassLinkage*"));
 
-            InitBlock.CallCOM(
-                CtorDevice,
+            SharedInitBlock.CallCOM(
+                SharedDevice,
                 "ID3D11Device",
                 string.Format("Create{0}Shader", stageName),
                 bytecodeVal,
                 bytecodeLengthVal,
                 classLinkageNull,
-                InitBlock.GetArrow(CtorThis, _shaderField).GetAddress());
+                SharedInitBlock.GetArrow(SharedInitThis, _shaderField).GetAddress());
 
-            DtorBlock.CallCOM(
-                DtorBlock.GetArrow(DtorThis, _shaderField),
+            SharedDtorBlock.CallCOM(
+                SharedDtorBlock.GetArrow(SharedDtorThis, _shaderField),
                 "IUnknown",
                 "Release");
         }
@@ -188,13 +253,11 @@ namespace Spark.Emit.D3D11
             string stageName,
             string prefix)
         {
-            ExecBlock.CallCOM(
-                SubmitContext,
-                "ID3D11DeviceContext",
-                string.Format("{0}SetShader", prefix),
-                ExecBlock.GetArrow(SubmitThis, _shaderField),
-                GetNullPointer("ID3D11ClassInstance**"),
-                ExecBlock.LiteralU32(0));
+            EmitStateCall(
+                ExecBlock,
+                "ShadowSetShader",
+                GetShaderStageVal(ExecBlock, prefix),
+                GetSharedArrow(ExecBlock, SubmitThis, _shaderField));
 
             EmitShaderBinds(ExecBlock, prefix, hlslContext);
         }
@@ -271,16 +334,30 @@ namespace Spark.Emit.D3D11
         protected IDiagnosticsCollection Diagnostics { get { return EmitContext.Diagnostics; } }
 
         protected HLSL.SharedContextHLSL SharedHLSL { get { return EmitPass.SharedHLSL; } }
-        protected IEmitBlock InitBlock { get { return EmitPass.InitBlock; } }
         protected IEmitBlock ExecBlock { get { return EmitPass.ExecBlock; } }
-        protected IEmitBlock DtorBlock { get { return EmitPass.DtorBlock; } }
         protected IEmitClass EmitClass { get { return EmitPass.EmitClass; } }
         protected IEmitTarget EmitTarget { get { return EmitPass.EmitContext.Target; } }
-        protected IEmitVal CtorDevice { get { return EmitPass.CtorDevice; } }
         protected IEmitVal SubmitContext { get { return EmitPass.SubmitContext; } }
-        protected IEmitVal CtorThis { get { return EmitPass.CtorThis; } }
         protected IEmitVal SubmitThis { get { return EmitPass.SubmitThis; } }
-        protected IEmitVal DtorThis { get { return EmitPass.DtorThis; } }
+
+        // GPU objects that don't vary per-instance are created
+        // once per shader class (and device), in the shared block.
+        protected IEmitClass SharedClass { get { return EmitPass.SharedClass; } }
+        protected IEmitBlock SharedInitBlock { get { return EmitPass.SharedInitBlock; } }
+        protected IEmitBlock SharedDtorBlock { get { return EmitPass.SharedDtorBlock; } }
+        protected IEmitVal SharedDevice { get { return EmitPass.SharedDevice; } }
+        protected IEmitVal SharedInitThis { get { return EmitPass.SharedInitThis; } }
+        protected IEmitVal SharedDtorThis { get { return EmitPass.SharedDtorThis; } }
+
+        protected IEmitVal GetSharedArrow(
+            IEmitBlock block,
+            IEmitVal obj,
+            IEmitField field)
+        {
+            return block.GetArrow(
+                block.GetArrow(obj, EmitPass.SharedField),
+                field);
+        }
 
         protected EmitEnv SubmitEnv { get { return EmitPass.SubmitEnv; } }
 
@@ -55,7 +55,7 @@ namespace Spark.Emit.D3D11
             }
 
 
-            InitBlock.AppendComment("D3D11 Vertex Shader");
+            SharedInitBlock.AppendComment("D3D11 Vertex Shader");
 
             var outputAttributes = new List<MidAttributeDecl>();
             foreach (var a in outputElement.Attributes)
@@ -118,7 +118,7 @@ namespace Spark.Emit.D3D11
 
             //
 
-            EmitShaderSetup(
+            BeginShaderSetup(
                 hlslContext,
                 "vs_5_0",
                 "Vertex",
@@ -37,9 +37,31 @@ namespace Spark.Emit
         public IEmitVal CtorThis { get; set; }
         public IEmitVal SubmitThis { get; set; }
         public IEmitVal DtorThis { get; set; }
-        public IEmitField CBField { get; set; }
+        // Array holding the constant buffers to bind (which may
+        // not be the instance's own buffers; see EmitPipeline).
+        public IEmitVal SubmitCBBuffers { get; set; }
+        public int SubmitCBCount { get; set; }
         public EmitEnv SubmitEnv { get; set; }
 
+        // Per-context state shadow (or null), looked up once at
+        // the start of Submit(); see EmitContext.EmitStateCall.
+        public IEmitVal SubmitStateShadow { get; set; }
+
+        // Optional DrawSpan that overrides IA_DrawSpan (may be null)
+        public IEmitVal SubmitDrawSpan { get; set; }
+
+        // Class-level state (shaders, input layout, immutable
+        // states) lives in a block shared by all instances of
+        // a shader class on a given device. Instances reach it
+        // through SharedField.
+        public IEmitClass SharedClass { get; set; }
+        public IEmitBlock SharedInitBlock { get; set; }
+        public IEmitBlock SharedDtorBlock { get; set; }
+        public IEmitVal SharedDevice { get; set; }
+        public IEmitVal SharedInitThis { get; set; }
+        public IEmitVal SharedDtorThis { get; set; }
+        public IEmitField SharedField { get; set; }
+
         public EmitEnv ShaderClassEnv { get; set; }
         public EmitContext.ShaderClassInfo ShaderClassInfo { get; set; }
 
@@ -180,6 +202,10 @@ namespace Spark.Emit
             public MidAttributeDecl AttributeDecl { get; set; }
             public Func<IEmitBlock, IEmitVal, IEmitVal> Accessor { get; set; }
 
+            // Reads a counter that the attribute's setter bumps,
+            // or null if changes to the attribute aren't tracked.
+            public Func<IEmitBlock, IEmitVal, IEmitVal> VersionAccessor { get; set; }
+
             public IEmitType Type { get; set; }
             public string Name { get; set; }
         }
@@ -263,6 +289,7 @@ namespace Spark.Emit
             MidElementDecl constantElement,
             MidElementDecl uniformElement,
             IEmitClass ifaceClass,
+            bool trackInputVersions,
             EmitEnv env)
         {
             var midAttributes = midFacet.Attributes.ToArray();
@@ -309,9 +336,18 @@ namespace Spark.Emit
                         midAttribute.Type,
                         attrName);
 
+                    IEmitField versionField = null;
+                    if (trackInputVersions)
+                    {
+                        versionField = ifaceClass.AddPrivateField(
+                            Target.GetBuiltinType("UINT"),
+                            "__version_" + attrName);
+                    }
+
                     var attrField = ifaceClass.AddFieldAndAccessors(
                         attrType,
-                        attrName);
+                        attrName,
+                        versionField);
 
                     var attrInfo = new ShaderAttributeInfo();
                     attrInfo.AttributeDecl = midAttribute;
@@ -319,6 +355,13 @@ namespace Spark.Emit
                         (b, shaderObj) => b.GetArrow(
                             shaderObj,
                             attrField);
+                    if (versionField != null)
+                    {
+                        attrInfo.VersionAccessor =
+                            (b, shaderObj) => b.GetArrow(
+                                shaderObj,
+                                versionField);
+                    }
                     attrInfo.Type = attrType;
                     attrInfo.Name = attrName;
 
@@ -329,6 +372,27 @@ namespace Spark.Emit
             return result;
         }
 
+        // Find how to read the version counters of the given inputs,
+        // or return null if changes to any of them aren't tracked.
+        private Func<IEmitBlock, IEmitVal, IEmitVal>[] GetInputVersionAccessors(
+            ShaderClassInfo classInfo,
+            IEnumerable<MidAttributeDecl> inputs)
+        {
+            var result = new List<Func<IEmitBlock, IEmitVal, IEmitVal>>();
+            foreach (var input in inputs)
+            {
+                var attrInfo = (from f in classInfo.AllFacets
+                                from a in f.Attributes
+                                where a != null && a.AttributeDecl == input
+                                select a).FirstOrDefault();
+                if (attrInfo == null || attrInfo.VersionAccessor == null)
+                    return null;
+
+                result.Add(attrInfo.VersionAccessor);
+            }
+            return result.ToArray();
+        }
+
         private MidFacetDecl GetFacetForBase(
             MidPipelineDecl classDecl,
             MidPipelineDecl baseDecl)
@@ -409,6 +473,7 @@ namespace Spark.Emit
                     continue;
 
                 var baseAttrAccessor = baseAttrInfo.Accessor;
+                var baseVersionAccessor = baseAttrInfo.VersionAccessor;
 
                 var derivedAttrDecl = derivedFacetAttrDecls[ ii ];
 
@@ -421,6 +486,12 @@ namespace Spark.Emit
                     Type = baseAttrInfo.Type,
                     Name = baseAttrInfo.Name,
                 };
+                if (baseVersionAccessor != null)
+                {
+                    attrInfo.VersionAccessor = (b, shaderObj) =>
+                        baseVersionAccessor(b,
+                            derivedFacetInfo.FacetAccessor(b, shaderObj));
+                }
 
                 derivedFacetInfo.Attributes[ii] = attrInfo;
             }
@@ -548,11 +619,14 @@ namespace Spark.Emit
 
             // Direct facet:
             var directFacetDecl = midPipeline.DirectFacet;
+            // The stdlib classes' layout is hand-written in spark.h,
+            // so only track changes to inputs of user classes.
             var directFacetInfo = CreateDirectFacet(
                 directFacetDecl,
                 constantElement,
                 uniformElement,
                 ifaceClass,
+                (ifaceFlags & EmitClassFlags.Internal) == 0,
                 pipelineEnv);
 
             info.DirectFacet = directFacetInfo;
@@ -778,6 +852,13 @@ namespace Spark.Emit
             }
 
 
+            // The shared class is declared first, since the
+            // impl class holds a pointer to it.
+            var sharedClass = emitModule.CreateClass(
+                string.Format("{0}_Shared", className),
+                null,
+                implFlags);
+
             var implClass = emitModule.CreateClass(
                 className,
                 implBase,
@@ -791,8 +872,7 @@ namespace Spark.Emit
             // The impl class needs a field to hold each of its mixin bases...
             Dictionary<MidPipelineDecl, Func<IEmitBlock, IEmitVal>> getFacetPointerForBase = new Dictionary<MidPipelineDecl, Func<IEmitBlock, IEmitVal>>();
 
-            var facetInfoData = new List<IEmitVal>();
-            var facetInfoCount = 0;
+            var facetEntries = new List<KeyValuePair<string, UInt32>>();
 
             foreach (var f in midPipeline.Facets)
             {
@@ -805,9 +885,9 @@ namespace Spark.Emit
                     // the inheritance chain...
                     getFacetPointerForBase[facetClassDecl] = (b) => b.Method.ThisParameter;
 
-                    facetInfoData.Add( emitModule.LiteralString( _mapShaderClassToInfo[ facetClassDecl ].InterfaceClass.GetName() ));
-                    facetInfoData.Add( Target.LiteralU32(0) );
-                    facetInfoCount++;
+                    facetEntries.Add( new KeyValuePair<string, UInt32>(
+                        _mapShaderClassToInfo[ facetClassDecl ].InterfaceClass.GetName(),
+                        0 ) );
                 }
             }
 
@@ -831,14 +911,28 @@ namespace Spark.Emit
                     var field = implClass.AddPrivateField(fieldType, fieldName);
                     getFacetPointerForBase[facetClassDecl] = (b) => b.GetArrow(b.Method.ThisParameter, field).GetAddress();
 
-                    facetInfoData.Add( emitModule.LiteralString(_mapShaderClassToInfo[ facetClassDecl ].InterfaceClass.GetName()) );
-                    facetInfoData.Add( Target.LiteralU32(facetOffset) );
-                    facetInfoCount++;
+                    facetEntries.Add( new KeyValuePair<string, UInt32>(
+                        _mapShaderClassToInfo[ facetClassDecl ].InterfaceClass.GetName(),
+                        facetOffset ) );
 
                     facetOffset += fieldType.Size;
                 }
             }
 
+            // The facet table is sorted by name hash, so that
+            // ShaderInstance::DynamicCast can binary-search it.
+            var facetInfoData = new List<IEmitVal>();
+            var facetInfoCount = facetEntries.Count;
+            var sortedFacetEntries = from e in facetEntries
+                                     orderby HashFacetName(e.Key), e.Key
+                                     select e;
+            foreach (var e in sortedFacetEntries)
+            {
+                facetInfoData.Add( emitModule.LiteralString( e.Key ) );
+                facetInfoData.Add( Target.LiteralU32( HashFacetName( e.Key ) ) );
+                facetInfoData.Add( Target.LiteralU32( e.Value ) );
+            }
+
             var facetInfoVal = emitModule.EmitGlobalStruct(
                 null,
                 facetInfoData.ToArray() ).GetAddress();
@@ -856,6 +950,7 @@ namespace Spark.Emit
                 "device");
 
             var facetInitBlock = ctor.EntryBlock.InsertBlock();
+            var sharedInit = ctor.EntryBlock.InsertBlock();
             var cbInit = ctor.EntryBlock.InsertBlock();
 
             // First things first: wire up all the various facets to
@@ -895,6 +990,15 @@ namespace Spark.Emit
             var dtor = implClass.CreateDtor();
 
             var cbFinit = dtor.EntryBlock.InsertBlock();
+            var sharedFinit = dtor.EntryBlock.InsertBlock();
+
+            // Create the constructor/destructor for the shared block
+
+            var sharedCtor = sharedClass.CreateCtor();
+            var sharedCtorDevice = sharedCtor.AddParameter(
+                deviceType,
+                "device");
+            var sharedDtor = sharedClass.CreateDtor();
 
             // Create Submit() method
 
@@ -907,15 +1011,29 @@ namespace Spark.Emit
             var submitContext = submit.AddParameter(
                 contextType,
                 "context");
+            var submitDrawSpan = submit.AddParameter(
+                Target.GetOpaqueType("const spark::d3d11::DrawSpan*"),
+                "drawSpan");
+            var submitStateShadowParam = submit.AddParameter(
+                Target.GetOpaqueType("void*"),
+                "stateShadowParam");
             var submitEnv = new EmitEnv(pipelineEnv);
 
+            // Callers that submit many draws pass the context's state
+            // shadow in; otherwise it's looked up here.
+            var stateSubmit = submit.EntryBlock.InsertBlock();
+            var submitStateShadow = stateSubmit.Temp(
+                "stateShadow",
+                stateSubmit.BuiltinApp(
+                    Target.GetOpaqueType("void*"),
+                    "spark::d3d11::ResolveStateShadow({0}, {1})",
+                    new IEmitVal[]{ submitContext, submitStateShadowParam }));
+
             var cbSubmit = submit.EntryBlock.InsertBlock();
+            var cbSubmitEnd = submit.EntryBlock.InsertBlock();
 
 
             var cbPointerType = Target.GetOpaqueType("ID3D11Buffer*");
-            var cbField = implClass.AddPrivateField(
-                cbPointerType,
-                "_cb");
 
             emitPass = new PassEmitContext()
             {
@@ -931,8 +1049,15 @@ namespace Spark.Emit
                 CtorThis = ctor.ThisParameter,
                 SubmitThis = submit.ThisParameter,
                 DtorThis = dtor.ThisParameter,
-                CBField = cbField,
                 SubmitEnv = submitEnv,
+                SubmitStateShadow = submitStateShadow,
+                SubmitDrawSpan = submitDrawSpan,
+                SharedClass = sharedClass,
+                SharedInitBlock = sharedCtor.EntryBlock,
+                SharedDtorBlock = sharedDtor.EntryBlock,
+                SharedDevice = sharedCtorDevice,
+                SharedInitThis = sharedCtor.ThisParameter,
+                SharedDtorThis = sharedDtor.ThisParameter,
             };
 
             // Now emit stage-specific code.
@@ -944,13 +1069,115 @@ namespace Spark.Emit
             var gsStage = new D3D11GeometryShader() { EmitPass = emitPass, Range = range };
             var psStage = new D3D11PixelShader()    { EmitPass = emitPass, Range = range };
 
+            // Generating each stage's HLSL kicks off its compile,
+            // so the compiles for a pass all run concurrently...
             vsStage.EmitImplSetup();
-            iaStage.EmitImplSetup(); // IA after VS for bytecode dependency
+            iaStage.EmitImplSetup();
             hsStage.EmitImplSetup();
             dsStage.EmitImplSetup();
             gsStage.EmitImplSetup();
             psStage.EmitImplSetup();
 
+            // ...and are then joined, in order, to embed the bytecode.
+            vsStage.FinishImplSetup();
+            iaStage.FinishImplSetup(); // IA after VS for bytecode dependency
+            hsStage.FinishImplSetup();
+            dsStage.FinishImplSetup();
+            gsStage.FinishImplSetup();
+            psStage.FinishImplSetup();
+
+            // All the class-level state is known now, so the shared
+            // block can be laid out, and instances given a pointer to it.
+            sharedClass.Seal();
+
+            // The stages have created all the uniforms now, and so
+            // we know how they are split across constant buffers.
+            // Each buffer gets a CPU-side copy of its contents, so
+            // that Submit can skip the upload when nothing in that
+            // buffer has changed.
+            var constantBuffers = sharedHLSL.ConstantBuffers.ToArray();
+            var cbFields = (from cb in constantBuffers
+                            select implClass.AddPrivateField(
+                                cbPointerType,
+                                string.Format("_cb{0}", cb.Index))).ToArray();
+            var cbShadowFields = (from cb in constantBuffers
+                                  select implClass.AddPrivateField(
+                                    Target.GetOpaqueType("void*"),
+                                    string.Format("_cbShadow{0}", cb.Index))).ToArray();
+
+            // A buffer's values only need to be recomputed when one
+            // of the inputs they depend on has been set since the
+            // last Submit. Each buffer whose inputs are all tracked
+            // remembers the combined version of those inputs that it
+            // was last computed from.
+            var uintType = Target.GetBuiltinType("UINT");
+            var cbInputVersionAccessors = (from cb in constantBuffers
+                                           select GetInputVersionAccessors(info, cb.Inputs)).ToArray();
+            var cbInputVersionFields = (from cb in constantBuffers
+                                        select cbInputVersionAccessors[cb.Index] == null ? null
+                                            : implClass.AddPrivateField(
+                                                uintType,
+                                                string.Format("_cbInputVersion{0}", cb.Index))).ToArray();
+
+            // The uniform values are only written into cbSubmit
+            // further down, but the buffers they end up in are needed
+            // by the stage binds, so emit the end of the CB updates
+            // (which runs after cbSubmit) now. On deferred contexts
+            // the runtime hands back buffers from a per-context
+            // ring, rather than the instance's own.
+            emitPass.SubmitCBCount = constantBuffers.Length;
+            if (constantBuffers.Length != 0)
+            {
+                var cbBufferVals = new List<IEmitVal>();
+                foreach (var cb in constantBuffers)
+                {
+                    // The updates must end in the same order they
+                    // began, so don't leave these calls to be
+                    // folded into the array initializer.
+                    cbBufferVals.Add(cbSubmitEnd.Temp(
+                        "cbBuffer",
+                        cbSubmitEnd.BuiltinApp(
+                            cbPointerType,
+                            "spark::d3d11::EndConstantBufferUpdate({0}, {1}, {2})",
+                            new IEmitVal[]{
+                                submitContext,
+                                cbSubmitEnd.GetArrow(submit.ThisParameter, cbFields[cb.Index]),
+                                cbSubmitEnd.GetArrow(submit.ThisParameter, cbShadowFields[cb.Index]) })));
+                }
+
+                emitPass.SubmitCBBuffers = cbSubmitEnd.Temp(
+                    "cbBuffers",
+                    cbSubmitEnd.Array(
+                        cbPointerType,
+                        cbBufferVals));
+            }
+
+            var sharedField = implClass.AddPrivateField(
+                sharedClass.Pointer(),
+                "_shared");
+            emitPass.SharedField = sharedField;
+
+            var voidPointerType = Target.GetOpaqueType("void*");
+            sharedInit.SetArrow(
+                ctor.ThisParameter,
+                sharedField,
+                sharedInit.CastRawPointer(
+                    sharedInit.BuiltinApp(
+                        voidPointerType,
+                        "spark::d3d11::AcquireSharedState({0}, {1})",
+                        new IEmitVal[]{
+                            sharedInit.CastRawPointer(ctor.ThisParameter, voidPointerType),
+                            ctorDevice }),
+                    sharedClass.Pointer()));
+
+            sharedFinit.BuiltinApp(
+                Target.VoidType,
+                "spark::d3d11::ReleaseSharedState({0})",
+                new IEmitVal[]{
+                    sharedFinit.CastRawPointer(
+                        sharedFinit.GetArrow(dtor.ThisParameter, sharedField),
+                        voidPointerType) });
+
             psStage.EmitImplBindOM(); // OM first
             iaStage.EmitImplBind(); // IA as early as possible
             vsStage.EmitImplBind();
@@ -966,69 +1193,156 @@ namespace Spark.Emit
             // what compute the required @Uniform values.
 
             var block = cbInit;
-            var cbDescVal = block.Temp(
-                "cbDesc",
-                block.Struct(
-                    "D3D11_BUFFER_DESC",
-                    block.LiteralU32((UInt32) sharedHLSL.ConstantBufferSize),
-                    block.Enum32("D3D11_USAGE", "D3D11_USAGE_DYNAMIC", D3D11Stage.D3D11_USAGE.D3D11_USAGE_DYNAMIC),
-                    block.LiteralU32((UInt32) D3D11Stage.D3D11_BIND_FLAG.D3D11_BIND_CONSTANT_BUFFER),
-                    block.LiteralU32((UInt32) D3D11Stage.D3D11_CPU_ACCESS_FLAG.D3D11_CPU_ACCESS_WRITE),
-                    block.LiteralU32(0),
-                    block.LiteralU32(0)));
-
-            block.SetArrow(
-                ctor.ThisParameter,
-                cbField,
-                cbPointerType.Null());
-            block.CallCOM(
-                ctorDevice,
-                "ID3D11Device",
-                "CreateBuffer",
-                cbDescVal.GetAddress(),
-                Target.GetBuiltinType("D3D11_SUBRESOURCE_DATA").Pointer().Null(),
-                block.GetArrow(ctor.ThisParameter, cbField).GetAddress());
+            foreach (var cb in constantBuffers)
+            {
+                var cbField = cbFields[cb.Index];
+                var cbShadowField = cbShadowFields[cb.Index];
+
+                var cbDescVal = block.Temp(
+                    "cbDesc",
+                    block.Struct(
+                        "D3D11_BUFFER_DESC",
+                        block.LiteralU32((UInt32) cb.Size),
+                        block.Enum32("D3D11_USAGE", "D3D11_USAGE_DYNAMIC", D3D11Stage.D3D11_USAGE.D3D11_USAGE_DYNAMIC),
+                        block.LiteralU32((UInt32) D3D11Stage.D3D11_BIND_FLAG.D3D11_BIND_CONSTANT_BUFFER),
+                        block.LiteralU32((UInt32) D3D11Stage.D3D11_CPU_ACCESS_FLAG.D3D11_CPU_ACCESS_WRITE),
+                        block.LiteralU32(0),
+                        block.LiteralU32(0)));
+
+                block.SetArrow(
+                    ctor.ThisParameter,
+                    cbField,
+                    cbPointerType.Null());
+                block.CallCOM(
+                    ctorDevice,
+                    "ID3D11Device",
+                    "CreateBuffer",
+                    cbDescVal.GetAddress(),
+                    Target.GetBuiltinType("D3D11_SUBRESOURCE_DATA").Pointer().Null(),
+                    block.GetArrow(ctor.ThisParameter, cbField).GetAddress());
+
+                block.SetArrow(
+                    ctor.ThisParameter,
+                    cbShadowField,
+                    block.BuiltinApp(
+                        Target.GetOpaqueType("void*"),
+                        "spark::d3d11::CreateConstantBufferShadow({0})",
+                        new IEmitVal[]{
+                            block.LiteralU32((UInt32) cb.Size) }));
+
+                // No version of the inputs matches this,
+                // so the first Submit always computes.
+                var cbInputVersionField = cbInputVersionFields[cb.Index];
+                if (cbInputVersionField != null)
+                {
+                    block.SetArrow(
+                        ctor.ThisParameter,
+                        cbInputVersionField,
+                        block.LiteralU32(UInt32.MaxValue));
+                }
+
+                cbFinit.CallCOM(
+                    cbFinit.GetArrow(dtor.ThisParameter, cbField),
+                    "ID3D11Buffer",
+                    "Release");
+                cbFinit.BuiltinApp(
+                    Target.VoidType,
+                    "spark::d3d11::DestroyConstantBufferShadow({0})",
+                    new IEmitVal[]{
+                        cbFinit.GetArrow(dtor.ThisParameter, cbShadowField) });
+            }
+
+            // Uniform values get written into the shadow copy, and
+            // the runtime only does the Map/Unmap if they differ
+            // from what was last uploaded.
 
             block = cbSubmit;
-            var mappedType = Target.GetBuiltinType("D3D11_MAPPED_SUBRESOURCE");
-            var cbMappedVal = block.Local("_cbMapped", mappedType);
-
-            block.CallCOM(
-                submitContext,
-                "ID3D11DeviceContext",
-                "Map",
-                block.GetArrow(submit.ThisParameter, cbField),
-                block.LiteralU32(0),
-                block.Enum32("D3D11_MAP", "D3D11_MAP_WRITE_DISCARD", D3D11Stage.D3D11_MAP.D3D11_MAP_WRITE_DISCARD),
-                block.LiteralU32(0),
-                cbMappedVal.GetAddress());
-
-
-            IEmitVal mappedData = block.Temp(
-                "cbMappedData",
-                block.CastRawPointer(
-                    block.GetBuiltinField(cbMappedVal, "pData", Target.GetOpaqueType("void*"))));
-
-            foreach (var u in sharedHLSL.Uniforms)
+            var cbDataVals = new IEmitVal[constantBuffers.Length];
+            foreach (var cb in constantBuffers)
             {
-                var val = EmitExp(u.Val, block, pipelineEnv);
-                block.StoreRaw(
-                    mappedData,
-                    (UInt32) u.ByteOffset,
-                    val);
+                cbDataVals[cb.Index] = block.Temp(
+                    "cbData",
+                    block.CastRawPointer(
+                        block.BuiltinApp(
+                            Target.GetOpaqueType("void*"),
+                            "spark::d3d11::BeginConstantBufferUpdate({0}, {1})",
+                            new IEmitVal[]{
+                                submitContext,
+                                block.GetArrow(submit.ThisParameter, cbShadowFields[cb.Index]) })));
             }
 
-            block.CallCOM(
-                submitContext,
-                "ID3D11DeviceContext",
-                "Unmap",
-                block.GetArrow(submit.ThisParameter, cbField),
-                block.LiteralU32(0));
+            foreach (var c in constantBuffers)
+            {
+                var cb = c; // avoid capture
+
+                // The stores only ever touch the byte range spanned
+                // by this buffer's uniforms, so that's the range
+                // marked dirty (and compared at upload) when they run.
+                var cbUniforms = (from u in sharedHLSL.Uniforms
+                                  where u.Buffer == cb.Index
+                                  select u).ToArray();
+                if (cbUniforms.Length == 0)
+                    continue;
+                var dirtyBegin = cbUniforms.Min((u) => u.ByteOffset);
+                var dirtyEnd = cbUniforms.Max((u) => u.ByteOffset + u.ByteSize);
+
+                Action<IEmitBlock> emitUniforms = (b) =>
+                {
+                    foreach (var u in cbUniforms)
+                    {
+                        var val = EmitExp(u.Val, b, pipelineEnv);
+                        b.StoreRaw(
+                            cbDataVals[cb.Index],
+                            (UInt32) u.ByteOffset,
+                            val);
+                    }
+
+                    b.BuiltinApp(
+                        Target.VoidType,
+                        "spark::d3d11::MarkConstantBufferDirty({0}, {1}, {2}, {3})",
+                        new IEmitVal[]{
+                            submitContext,
+                            b.GetArrow(submit.ThisParameter, cbShadowFields[cb.Index]),
+                            b.LiteralU32((UInt32) dirtyBegin),
+                            b.LiteralU32((UInt32) dirtyEnd) });
+                };
 
-            cbFinit.CallCOM(
-                cbFinit.GetArrow(dtor.ThisParameter, cbField),
-                "ID3D11Buffer",
-                "Release");
+                var versionAccessors = cbInputVersionAccessors[cb.Index];
+                if (versionAccessors == null)
+                {
+                    emitUniforms(block);
+                    continue;
+                }
+
+                // The shadow's staging area still holds the values
+                // from the last computation, so skipping the stores
+                // leaves it up to date. (On deferred contexts the
+                // staging area is fresh each time, and the runtime
+                // always asks for the values to be recomputed.)
+                var versionsVal = uintType.Pointer().Null();
+                if (versionAccessors.Length != 0)
+                {
+                    versionsVal = block.Temp(
+                        "cbInputVersions",
+                        block.Array(
+                            uintType,
+                            (from a in versionAccessors
+                             select a(block, submit.ThisParameter)).ToArray())).GetAddress();
+                }
+
+                var recomputeVal = block.Temp(
+                    "cbRecompute",
+                    block.BuiltinApp(
+                        uintType,
+                        "spark::d3d11::CheckUniformInputVersions({0}, {1}, {2}, {3})",
+                        new IEmitVal[]{
+                            submitContext,
+                            block.GetArrow(submit.ThisParameter, cbInputVersionFields[cb.Index]).GetAddress(),
+                            versionsVal,
+                            block.LiteralU32((UInt32) versionAccessors.Length) }));
+
+                block.If(recomputeVal, emitUniforms);
+            }
 
             // Now generate calls to bind the depth-stencil and rasterizer states
 
@@ -1038,10 +1352,10 @@ namespace Spark.Emit
                 block,
                 pipelineEnv);
 
-            block.CallCOM(
-                submitContext,
-                "ID3D11DeviceContext",
-                "RSSetState",
+            EmitStateCall(
+                block,
+                emitPass,
+                "ShadowSetRasterizerState",
                 rsStateVal);
 
 
@@ -1057,10 +1371,10 @@ namespace Spark.Emit
                 block,
                 pipelineEnv);
 
-            block.CallCOM(
-                submitContext,
-                "ID3D11DeviceContext",
-                "OMSetDepthStencilState",
+            EmitStateCall(
+                block,
+                emitPass,
+                "ShadowSetDepthStencilState",
                 omDepthStencilStateVal,
                 omStencilRefVal);
 
@@ -1081,6 +1395,10 @@ namespace Spark.Emit
                     emitModule.GetMethodPointer( ctor ),
                     emitModule.GetMethodPointer( dtor ),
                     emitModule.GetMethodPointer( submit ),
+                    Target.LiteralU32(sharedClass.Size),
+                    emitModule.GetMethodPointer( sharedCtor ),
+                    emitModule.GetMethodPointer( sharedDtor ),
+                    emitModule.LiteralString( ifaceClass.GetName() ),
                 } );
 
             if (emitModule is Emit.CPlusPlus.EmitModuleCPP)
@@ -1094,6 +1412,19 @@ namespace Spark.Emit
             }
         }
 
+        // Must match spark::HashFacetName in spark.h
+        // (32-bit FNV-1a over the bytes of the name).
+        private static UInt32 HashFacetName(string name)
+        {
+            UInt32 hash = 2166136261;
+            foreach (var c in Encoding.UTF8.GetBytes(name))
+            {
+                hash ^= c;
+                hash *= 16777619;
+            }
+            return hash;
+        }
+
         private void EmitStageInterface<T>(
             PassEmitContext emitPass)
             where T : D3D11Stage, new()
@@ -1106,9 +1437,12 @@ namespace Spark.Emit
             MidType midType,
             EmitEnv env )
         {
-            return EmitTypeImpl((dynamic) midType, env);
+            return _emitTypeImpl.For(midType)(this, midType, env);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContext, MidType, EmitEnv, IEmitType>> _emitTypeImpl =
+            new TypeDispatcher<Func<EmitContext, MidType, EmitEnv, IEmitType>>("EmitTypeImpl");
+
         private IEmitType EmitTypeImpl(
             MidBuiltinType midType,
             EmitEnv env)
@@ -1163,9 +1497,12 @@ namespace Spark.Emit
             IEmitBlock block,
             EmitEnv env)
         {
-            return EmitExpImpl((dynamic)exp, block, env);
+            return _emitExpImpl.For(exp)(this, exp, block, env);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContext, MidExp, IEmitBlock, EmitEnv, IEmitVal>> _emitExpImpl =
+            new TypeDispatcher<Func<EmitContext, MidExp, IEmitBlock, EmitEnv, IEmitVal>>("EmitExpImpl");
+
         private IEmitVal EmitExpImpl(
             MidLetExp exp,
             IEmitBlock block,
@@ -1257,6 +1594,30 @@ namespace Spark.Emit
             return EmitAttributeRef(attrRef.Decl, block, env);
         }
 
+        // State-setting calls in Submit() go through runtime
+        // helpers (spark::d3d11::ShadowSet*), rather than calling
+        // the device context directly, so that redundant calls
+        // can be skipped when the context has a state shadow.
+        public void EmitStateCall(
+            IEmitBlock block,
+            PassEmitContext emitPass,
+            string helperName,
+            params IEmitVal[] args)
+        {
+            var allArgs = new IEmitVal[] { emitPass.SubmitContext, emitPass.SubmitStateShadow }
+                .Concat(args)
+                .ToArray();
+            var argList = string.Join(
+                ", ",
+                (from i in Enumerable.Range(0, allArgs.Length)
+                 select "{" + i.ToString() + "}"));
+
+            block.BuiltinApp(
+                _target.VoidType,
+                "spark::d3d11::" + helperName + "(" + argList + ")",
+                allArgs);
+        }
+
         public IEmitVal EmitAttributeRef(
             MidAttributeWrapperDecl wrapper,
             IEmitBlock block,
@@ -1330,6 +1691,17 @@ namespace Spark.Emit
             this IEmitClass emitClass,
             IEmitType fieldType,
             string name)
+        {
+            return emitClass.AddFieldAndAccessors(fieldType, name, null);
+        }
+
+        // If versionField is non-null, the setter also increments it,
+        // so that generated code can tell when the value has changed.
+        public static IEmitField AddFieldAndAccessors(
+            this IEmitClass emitClass,
+            IEmitType fieldType,
+            string name,
+            IEmitField versionField)
         {
             var fieldName = "m_" + name;
             var field = emitClass.AddPrivateField(fieldType, fieldName );
@@ -1346,11 +1718,23 @@ namespace Spark.Emit
                     accessorName,
                     fieldName);
 
-                emitClassCPP.PublicSpan.WriteLine(
-                    "void Set{1}( {0} value ) {{ {2} = value; }}",
-                    fieldType.ToString(),
-                    accessorName,
-                    fieldName);
+                if (versionField != null)
+                {
+                    emitClassCPP.PublicSpan.WriteLine(
+                        "void Set{1}( {0} value ) {{ {2} = value; ++{3}; }}",
+                        fieldType.ToString(),
+                        accessorName,
+                        fieldName,
+                        versionField);
+                }
+                else
+                {
+                    emitClassCPP.PublicSpan.WriteLine(
+                        "void Set{1}( {0} value ) {{ {2} = value; }}",
+                        fieldType.ToString(),
+                        accessorName,
+                        fieldName);
+                }
             }
 
             return field;
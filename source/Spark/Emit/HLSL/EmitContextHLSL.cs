@@ -32,17 +32,63 @@ namespace Spark.Emit.HLSL
 
     public static class HlslCompilerHelper
     {
-        private static IHlslCompiler _compiler;
+        private static HlslCompilerCache _compiler;
+        private static string _persistPath;
 
+        // The registered compiler is always wrapped in a
+        // cache, so that identical HLSL is only compiled once.
         public static void Register(IHlslCompiler compiler)
         {
-            _compiler = compiler;
+            if (compiler == null)
+                _compiler = null;
+            else if (compiler is HlslCompilerCache)
+                _compiler = (HlslCompilerCache)compiler;
+            else
+                _compiler = new HlslCompilerCache(compiler);
+
+            if (_compiler != null && _persistPath != null)
+                _compiler.SetPersistPath(_persistPath);
+        }
+
+        // File used to persist the compiled-bytecode cache
+        // across runs (null to keep it in memory only).
+        public static void SetPersistPath(string path)
+        {
+            _persistPath = path;
+            if (_compiler != null)
+                _compiler.SetPersistPath(path);
         }
 
         public static IHlslCompiler Get()
         {
             return _compiler;
         }
+
+        public static HlslCompilerCache Cache
+        {
+            get { return _compiler; }
+        }
+
+        // Whether the stages of a pass may be compiled
+        // concurrently. Clear this when registering a
+        // compiler that is not safe to call from more
+        // than one thread at a time.
+        public static bool ParallelCompile
+        {
+            get { return _parallelCompile; }
+            set { _parallelCompile = value; }
+        }
+
+        private static bool _parallelCompile = true;
+    }
+
+    // A compile started by EmitContextHLSL.BeginCompile,
+    // to be collected with EndCompile.
+    public class PendingHlslCompile
+    {
+        internal System.Threading.Tasks.Task<byte[]> Task;
+        internal string Profile;
+        internal string Errors;
     }
 
     public interface ITypeHLSL
@@ -539,15 +585,49 @@ namespace Spark.Emit.HLSL
         {
             public string Name;
             public MidVal Val;
+            public int Buffer;
             public int Slot;
+            public int Component;
             public int ByteOffset;
+            public int ByteSize;
+        }
+
+        // Uniforms are split across several constant buffers,
+        // grouped by the input attributes they depend on, so that
+        // (e.g.) values derived only from per-frame inputs don't
+        // share a buffer with per-draw ones. Each buffer is
+        // uploaded separately, and only when its contents change.
+        //
+        // A buffer per distinct set of inputs would mostly hold a
+        // single value, so groups are merged: a value goes into a
+        // buffer whose inputs are a superset or a subset of its
+        // own, and the scalars and vectors left over share one
+        // buffer, since they are too small to be worth an upload
+        // of their own.
+        public class ConstantBufferInfo
+        {
+            public int Index;
+            public int Size { get { return SlotLanesUsed.Count * 16; } }
+
+            // Number of 4-byte lanes in use in each 16-byte slot
+            public readonly List<int> SlotLanesUsed = new List<int>();
+
+            public HashSet<MidAttributeDecl> Inputs;
+
+            // Whether this is the buffer for small values that
+            // matched no other group.
+            public bool IsShared;
         }
 
+        // Keep the number of buffers (and so, of uploads
+        // and bind slots) per pass small.
+        public const int MaxConstantBuffers = 4;
+
         public IEnumerable<UniformInfo> Uniforms { get { return _uniforms; } }
-        public int ConstantBufferSize { get { return _totalUniformSlots * 16; } }
+        public IEnumerable<ConstantBufferInfo> ConstantBuffers { get { return _constantBuffers; } }
 
         private List<UniformInfo> _uniforms = new List<UniformInfo>();
-        private int _totalUniformSlots;
+        private List<ConstantBufferInfo> _constantBuffers = new List<ConstantBufferInfo>();
 
         public SharedContextHLSL(
             IdentifierFactory identifiers,
@@ -628,28 +708,185 @@ namespace Spark.Emit.HLSL
             var name = GenerateName(baseName);
 
             int slotSize = 16;
+            int laneSize = 4;
+
+            int valLaneCount = CountLanes(uniformVal.Type);
+            var buffer = FindConstantBuffer(
+                GetUniformInputs(uniformVal),
+                valLaneCount != 0);
+            var slotLanesUsed = buffer.SlotLanesUsed;
+
+            int valSlot;
+            int valComponent = 0;
+            int valByteSize;
+
+            // Following the HLSL packing rules, a scalar or vector
+            // can share a slot with other scalars/vectors, as long
+            // as it doesn't straddle a slot boundary. Take the
+            // first slot with enough lanes left.
+            //
+            // Uniforms get created as each stage is emitted, and the
+            // earlier stages have already declared their cbuffer, so
+            // existing uniforms can never move; we can only fill in
+            // the gaps they left.
+            if (valLaneCount != 0)
+            {
+                valSlot = slotLanesUsed.FindIndex((used) => used + valLaneCount <= 4);
+                if (valSlot < 0)
+                {
+                    valSlot = slotLanesUsed.Count;
+                    slotLanesUsed.Add(0);
+                }
 
-            int valSlot = _totalUniformSlots;
-            int valSlotCount = CountSlots(uniformVal.Type);
-
-            _totalUniformSlots += valSlotCount;
+                valComponent = slotLanesUsed[valSlot];
+                slotLanesUsed[valSlot] += valLaneCount;
+                valByteSize = valLaneCount * laneSize;
+            }
+            else
+            {
+                // Matrices and arrays always start a new slot,
+                // and use whole slots.
+                valSlot = slotLanesUsed.Count;
+                int valSlotCount = CountSlots(uniformVal.Type);
+                for (int ii = 0; ii < valSlotCount; ++ii)
+                    slotLanesUsed.Add(4);
+                valByteSize = valSlotCount * slotSize;
+            }
 
             _uniforms.Add(new UniformInfo
             {
                 Name = name,
                 Val = uniformVal,
+                Buffer = buffer.Index,
                 Slot = valSlot,
-                ByteOffset = valSlot * slotSize,
+                Component = valComponent,
+                ByteOffset = valSlot * slotSize + valComponent * laneSize,
+                ByteSize = valByteSize,
             });
 
             return name;
         }
 
+        private ConstantBufferInfo FindConstantBuffer(
+            HashSet<MidAttributeDecl> inputs,
+            bool isSmall)
+        {
+            // A buffer that already depends on everything this
+            // value does costs nothing extra.
+            foreach (var cb in _constantBuffers)
+            {
+                if (cb.Inputs.IsSupersetOf(inputs))
+                    return cb;
+            }
+
+            // A buffer whose inputs this value depends on (e.g.,
+            // world alongside world*view*proj) will mostly be
+            // updated together with it anyway.
+            foreach (var cb in _constantBuffers)
+            {
+                if (!cb.IsShared && cb.Inputs.IsSubsetOf(inputs))
+                {
+                    cb.Inputs.UnionWith(inputs);
+                    return cb;
+                }
+            }
+
+            if (isSmall)
+            {
+                var shared = _constantBuffers.FirstOrDefault((cb) => cb.IsShared);
+                if (shared != null)
+                {
+                    shared.Inputs.UnionWith(inputs);
+                    return shared;
+                }
+            }
+
+            // Once we run out of buffers, everything
+            // else shares the last one.
+            if (_constantBuffers.Count == MaxConstantBuffers)
+            {
+                var last = _constantBuffers[MaxConstantBuffers - 1];
+                last.Inputs.UnionWith(inputs);
+                return last;
+            }
+
+            var result = new ConstantBufferInfo
+            {
+                Index = _constantBuffers.Count,
+                Inputs = new HashSet<MidAttributeDecl>(inputs),
+                IsShared = isSmall,
+            };
+            _constantBuffers.Add(result);
+            return result;
+        }
+
+        // Find the input attributes (those set by the application)
+        // that a uniform value is computed from. Inputs with a
+        // default value get no setter, so they are followed
+        // through like any other attribute.
+        private HashSet<MidAttributeDecl> GetUniformInputs(MidVal uniformVal)
+        {
+            var inputs = new HashSet<MidAttributeDecl>();
+            CollectUniformInputs(uniformVal, inputs, new HashSet<MidAttributeDecl>());
+            return inputs;
+        }
+
+        private void CollectUniformInputs(
+            MidExp exp,
+            HashSet<MidAttributeDecl> inputs,
+            HashSet<MidAttributeDecl> visited)
+        {
+            var transform = new MidTransform((e) =>
+            {
+                MidAttributeDecl decl = null;
+                if (e is MidAttributeRef)
+                    decl = ((MidAttributeRef)e).Decl;
+                else if (e is MidAttributeFetch)
+                    decl = ((MidAttributeFetch)e).Attribute;
+
+                if (decl != null && visited.Add(decl))
+                {
+                    if (decl.Exp == null)
+                        inputs.Add(decl);
+                    else
+                        CollectUniformInputs(decl.Exp, inputs, visited);
+                }
+                return e;
+            });
+            transform.Transform(exp);
+        }
+
+        // Number of 4-byte lanes used by a scalar or vector
+        // type, or zero for types that take whole slots.
+        private int CountLanes(MidType type)
+        {
+            var builtin = type as MidBuiltinType;
+            if (builtin == null)
+                return 0;
+
+            switch (builtin.Name)
+            {
+                case "uint": return 1;
+                case "uint2": return 2;
+                case "uint3": return 3;
+                case "uint4": return 4;
+                case "float": return 1;
+                case "float2": return 2;
+                case "float3": return 3;
+                case "float4": return 4;
+                default:
+                    return 0;
+            }
+        }
+
         private int CountSlots(MidType type)
         {
-            return CountSlotsImpl((dynamic)type);
+            return _countSlotsImpl.For(type)(this, type);
         }
 
+        private static readonly TypeDispatcher<Func<SharedContextHLSL, MidType, int>> _countSlotsImpl =
+            new TypeDispatcher<Func<SharedContextHLSL, MidType, int>>("CountSlotsImpl");
+
         private int CountSlotsImpl(MidBuiltinType builtin)
         {
             switch (builtin.Name)
@@ -782,9 +1019,12 @@ namespace Spark.Emit.HLSL
         private string EmitAttrLit(
             MidExp exp )
         {
-            return EmitAttrLitImpl((dynamic)exp);
+            return _emitAttrLitImpl.For(exp)(this, exp);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, MidExp, string>> _emitAttrLitImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, MidExp, string>>("EmitAttrLitImpl");
+
         private string EmitAttrLitImpl(
             MidLit exp )
         {
@@ -991,13 +1231,17 @@ namespace Spark.Emit.HLSL
             string semantic,
             string suffix)
         {
-            return DeclareBaseImpl(
-                (dynamic) val,
+            return _declareBaseImpl.For(val)(
+                this,
+                val,
                 prefix,
                 semantic,
                 suffix);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, EmitValHLSL, string, string, string, IEnumerable<string>>> _declareBaseImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, EmitValHLSL, string, string, string, IEnumerable<string>>>("DeclareBaseImpl");
+
         public IEnumerable<string> DeclareBaseImpl(
             VoidValHLSL val,
             string prefix,
@@ -1057,9 +1301,12 @@ namespace Spark.Emit.HLSL
 
         public ITypeHLSL EmitType(MidType type)
         {
-            return EmitTypeImpl((dynamic)type);
+            return _emitTypeImpl.For(type)(this, type);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, MidType, ITypeHLSL>> _emitTypeImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, MidType, ITypeHLSL>>("EmitTypeImpl");
+
         public IAggTypeHLSL  EmitType(MidElementDecl element)
         {
             IAggTypeHLSL result;
@@ -1151,11 +1398,15 @@ namespace Spark.Emit.HLSL
             ITypeHLSL type,
             EmitValHLSL count)
         {
-            return MakePseudoArrayElemTypeImpl(
-                (dynamic)type,
+            return _makePseudoArrayElemTypeImpl.For(type)(
+                this,
+                type,
                 count);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, ITypeHLSL, EmitValHLSL, ITypeHLSL>> _makePseudoArrayElemTypeImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, ITypeHLSL, EmitValHLSL, ITypeHLSL>>("MakePseudoArrayElemTypeImpl");
+
         private ITypeHLSL MakePseudoArrayElemTypeImpl(
             RealTypeHLSL type,
             EmitValHLSL count)
@@ -1523,9 +1774,12 @@ namespace Spark.Emit.HLSL
             MidExp exp,
             Span span)
         {
-            PreEmitExpImpl((dynamic)exp, span);
+            _preEmitExpImpl.For(exp)(this, exp, span);
         }
 
+        private static readonly TypeDispatcher<Action<EmitContextHLSL, MidExp, Span>> _preEmitExpImpl =
+            new TypeDispatcher<Action<EmitContextHLSL, MidExp, Span>>("PreEmitExpImpl");
+
         public void PreEmitExpImpl(
             MidAttributeRef exp,
             Span span)
@@ -1677,9 +1931,12 @@ namespace Spark.Emit.HLSL
 
         private EmitValHLSL EmitExpRaw(MidExp exp, Span span)
         {
-            return EmitExpImpl((dynamic)exp, span);
+            return _emitExpImpl.For(exp)(this, exp, span);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, MidExp, Span, EmitValHLSL>> _emitExpImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, MidExp, Span, EmitValHLSL>>("EmitExpImpl");
+
         private EmitValHLSL EmitExpImpl(MidIfExp exp, Span span)
         {
             var condition = EmitExp(exp.Condition, span);
@@ -2310,11 +2567,15 @@ namespace Spark.Emit.HLSL
             EmitValHLSL obj,
             EmitValHLSL idx )
         {
-            return GetElemImpl(
-                (dynamic)obj,
+            return _getElemImpl.For(obj)(
+                this,
+                obj,
                 idx);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, EmitValHLSL, EmitValHLSL, EmitValHLSL>> _getElemImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, EmitValHLSL, EmitValHLSL, EmitValHLSL>>("GetElemImpl");
+
         public EmitValHLSL GetElemImpl(
             SimpleValHLSL obj,
             EmitValHLSL idx)
@@ -2480,11 +2741,15 @@ namespace Spark.Emit.HLSL
             EmitValHLSL val,
             Span span)
         {
-            DeclareLocalImpl(
-                (dynamic)val,
+            _declareLocalImpl.For(val)(
+                this,
+                val,
                 span);
         }
 
+        private static readonly TypeDispatcher<Action<EmitContextHLSL, EmitValHLSL, Span>> _declareLocalImpl =
+            new TypeDispatcher<Action<EmitContextHLSL, EmitValHLSL, Span>>("DeclareLocalImpl");
+
         private void DeclareLocalImpl(
             VoidValHLSL val,
             Span span)
@@ -2544,9 +2809,12 @@ namespace Spark.Emit.HLSL
 
         private EmitValHLSL EmitVal(MidVal val, Span span)
         {
-            return EmitValImpl((dynamic)val, span);
+            return _emitValImpl.For(val)(this, val, span);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, MidVal, Span, EmitValHLSL>> _emitValImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, MidVal, Span, EmitValHLSL>>("EmitValImpl");
+
         private EmitValHLSL EmitValImpl(MidStructVal val, Span span)
         {
             var recordType = (IAggTypeHLSL)EmitType(val.Type);
@@ -2638,9 +2906,12 @@ namespace Spark.Emit.HLSL
         private object GetUniformValKey(
             MidVal val)
         {
-            return GetUniformValKeyImpl((dynamic)val);
+            return _getUniformValKeyImpl.For(val)(this, val);
         }
 
+        private static readonly TypeDispatcher<Func<EmitContextHLSL, MidVal, object>> _getUniformValKeyImpl =
+            new TypeDispatcher<Func<EmitContextHLSL, MidVal, object>>("GetUniformValKeyImpl");
+
         private object GetUniformValKeyImpl(
             MidAttributeRef val)
         {
@@ -2781,17 +3052,25 @@ namespace Spark.Emit.HLSL
         public void EmitConstantBufferDecl()
         {
             var cbSpan = new Span();
-            cbSpan.WriteLine("cbuffer Uniforms");
-            cbSpan.WriteLine("{");
-            foreach (var u in _shared.Uniforms)
+            foreach (var cb in _shared.ConstantBuffers)
             {
-                DeclareFields(
-                    EmitType(u.Val.Type),
-                    cbSpan,
-                    u.Name,
-                    suffix: string.Format(" : packoffset(c{0})", u.Slot));
+                cbSpan.WriteLine("cbuffer Uniforms{0} : register(b{0})", cb.Index);
+                cbSpan.WriteLine("{");
+                foreach (var u in _shared.Uniforms)
+                {
+                    if (u.Buffer != cb.Index)
+                        continue;
+
+                    DeclareFields(
+                        EmitType(u.Val.Type),
+                        cbSpan,
+                        u.Name,
+                        suffix: u.Component == 0
+                            ? string.Format(" : packoffset(c{0})", u.Slot)
+                            : string.Format(" : packoffset(c{0}.{1})", u.Slot, "xyzw"[u.Component]));
+                }
+                cbSpan.WriteLine("}");
             }
-            cbSpan.WriteLine("}");
             _cbHeaderSpan.Add(cbSpan);
         }
 
@@ -2882,6 +3161,12 @@ namespace Spark.Emit.HLSL
 
         private IHlslCompiler LoadHlslCompiler()
         {
+            // A compiler may already have been registered (either
+            // by an earlier compile, or explicitly by the host).
+            var compiler = HlslCompilerHelper.Get();
+            if (compiler != null)
+                return compiler;
+
             // Try to ping the SparkCPP DLL to register itself
             SparkRegisterHlslCompiler();
             return HlslCompilerHelper.Get();
@@ -2905,28 +3190,57 @@ namespace Spark.Emit.HLSL
 
         public byte[] Compile(string profile)
         {
+            return EndCompile(BeginCompile(profile));
+        }
+
+        // Start compiling the HLSL generated so far on the thread
+        // pool (unless HlslCompilerHelper.ParallelCompile is off).
+        // Diagnostics aren't thread-safe, so any errors are only
+        // reported once EndCompile is called.
+        public PendingHlslCompile BeginCompile(string profile)
+        {
+            var pending = new PendingHlslCompile { Profile = profile };
+
             if (_hlslCompiler == null)
                 _hlslCompiler = LoadHlslCompiler();
 
+            var compiler = _hlslCompiler;
+            var source = Span.ToString();
+            pending.Task = new System.Threading.Tasks.Task<byte[]>(() =>
+            {
+                if (compiler == null)
+                    return new byte[] { };
+
+                return compiler.Compile(
+                    source,
+                    "main",
+                    profile,
+                    out pending.Errors);
+            });
+
+            if (compiler != null && HlslCompilerHelper.ParallelCompile)
+                pending.Task.Start();
+            else
+                pending.Task.RunSynchronously();
+
+            return pending;
+        }
+
+        public byte[] EndCompile(PendingHlslCompile pending)
+        {
+            var result = pending.Task.Result;
+
             if (_hlslCompiler == null)
             {
                 _shared.Diagnostics.Add(
                     Severity.Error,
                     new SourceRange(),
                     "Could not load HLSL compiler from SparkCPP.dll");
-                return new byte[] { };
             }
 
-            string hlslErrors = null;
-            var result = _hlslCompiler.Compile(
-                Span.ToString(),
-                "main",
-                profile,
-                out hlslErrors);
-
-            if (!string.IsNullOrEmpty(hlslErrors))
+            if (!string.IsNullOrEmpty(pending.Errors))
             {
-                FormatDiagnostics(hlslErrors, _shared.Diagnostics, profile);
+                FormatDiagnostics(pending.Errors, _shared.Diagnostics, pending.Profile);
             }
 
             return result;
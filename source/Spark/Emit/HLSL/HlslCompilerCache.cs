@@ -0,0 +1,196 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace Spark.Emit.HLSL
+{
+    // Memoizes an underlying IHlslCompiler on the
+    // generated HLSL text, entry point and profile.
+    //
+    // Many dynamically-composed shader classes end up
+    // generating byte-identical code for some stages,
+    // so this avoids paying for D3DCompile each time.
+    //
+    // The memo can optionally be backed by a file,
+    // so that it survives across runs.
+    //
+    // Only successful compiles are remembered: a failure
+    // is reported (with its errors) every time, so that a
+    // fixed compiler environment is never masked by a stale
+    // entry, and the persisted file never holds failures.
+    public class HlslCompilerCache : IHlslCompiler
+    {
+        private IHlslCompiler _inner;
+        private Dictionary<string, Entry> _entries = new Dictionary<string, Entry>();
+        private string _persistPath;
+        private int _hitCount;
+        private int _missCount;
+
+        private class Entry
+        {
+            public byte[] Bytecode;
+            public string Errors;
+        }
+
+        public HlslCompilerCache(IHlslCompiler inner)
+        {
+            _inner = inner;
+        }
+
+        public IHlslCompiler Inner { get { return _inner; } }
+        public int HitCount { get { return _hitCount; } }
+        public int MissCount { get { return _missCount; } }
+
+        public byte[] Compile(
+            string source,
+            string entry,
+            string profile,
+            out string errors)
+        {
+            var key = ComputeKey(source, entry, profile);
+
+            Entry cached;
+            lock (_entries)
+            {
+                _entries.TryGetValue(key, out cached);
+            }
+
+            if (cached != null)
+            {
+                System.Threading.Interlocked.Increment(ref _hitCount);
+                errors = cached.Errors;
+                return cached.Bytecode;
+            }
+
+            // Compile outside the lock; two threads racing on the
+            // same key will both compile, but get the same answer.
+            System.Threading.Interlocked.Increment(ref _missCount);
+            var bytecode = _inner.Compile(source, entry, profile, out errors);
+            if (bytecode == null || bytecode.Length == 0)
+                return bytecode;
+
+            var added = new Entry { Bytecode = bytecode, Errors = errors };
+            lock (_entries)
+            {
+                if (_entries.ContainsKey(key))
+                    return bytecode;
+                _entries[key] = added;
+
+                if (_persistPath != null)
+                    AppendEntry(_persistPath, key, added);
+            }
+
+            return bytecode;
+        }
+
+        // Load any entries already in the given file, and append
+        // every new entry to it from now on. Passing null stops
+        // persisting new entries.
+        public void SetPersistPath(string path)
+        {
+            lock (_entries)
+            {
+                _persistPath = path;
+                if (path == null || !System.IO.File.Exists(path))
+                    return;
+
+                LoadEntries(path);
+            }
+        }
+
+        // Any malformed record (e.g., one truncated by a process
+        // that died mid-write, or a file that isn't a cache at all)
+        // is treated as the end of the cache; everything before
+        // it is kept.
+        private void LoadEntries(string path)
+        {
+            try
+            {
+                using (var stream = System.IO.File.OpenRead(path))
+                using (var reader = new System.IO.BinaryReader(stream))
+                {
+                    while (stream.Position < stream.Length)
+                    {
+                        var key = reader.ReadString();
+                        var length = reader.ReadInt32();
+                        if (length <= 0 || length > stream.Length - stream.Position)
+                            return;
+                        var bytecode = reader.ReadBytes(length);
+                        var errors = reader.ReadBoolean() ? reader.ReadString() : null;
+
+                        _entries[key] = new Entry { Bytecode = bytecode, Errors = errors };
+                    }
+                }
+            }
+            catch (System.IO.IOException)
+            {
+                // Includes EndOfStreamException.
+            }
+            catch (System.IO.InvalidDataException)
+            {
+            }
+            catch (FormatException)
+            {
+                // Thrown by ReadString on a bad length prefix.
+            }
+            catch (UnauthorizedAccessException)
+            {
+            }
+        }
+
+        private static void AppendEntry(string path, string key, Entry entry)
+        {
+            try
+            {
+                using (var stream = new System.IO.FileStream(path, System.IO.FileMode.Append, System.IO.FileAccess.Write))
+                using (var writer = new System.IO.BinaryWriter(stream))
+                {
+                    writer.Write(key);
+                    writer.Write(entry.Bytecode.Length);
+                    writer.Write(entry.Bytecode);
+                    writer.Write(entry.Errors != null);
+                    if (entry.Errors != null)
+                        writer.Write(entry.Errors);
+                }
+            }
+            catch (System.IO.IOException)
+            {
+                // Persistence is best-effort only.
+            }
+            catch (UnauthorizedAccessException)
+            {
+            }
+        }
+
+        private static string ComputeKey(
+            string source,
+            string entry,
+            string profile)
+        {
+            using (var sha1 = System.Security.Cryptography.SHA1.Create())
+            {
+                var digest = sha1.ComputeHash(Encoding.UTF8.GetBytes(source));
+                var builder = new StringBuilder();
+                foreach (var b in digest)
+                    builder.AppendFormat("{0:x2}", b);
+                builder.AppendFormat(":{0}:{1}", entry, profile);
+                return builder.ToString();
+            }
+        }
+    }
+}
@@ -103,6 +103,10 @@ namespace Spark.Emit
 
         IEmitBlock InsertBlock();
 
+        // Emit code (via emitThen) that only runs when condition
+        // (an integer value) is non-zero.
+        void If(IEmitVal condition, Action<IEmitBlock> emitThen);
+
         IEmitVal Local(string name, IEmitType type);
         IEmitVal Temp(string name, IEmitVal val);
 
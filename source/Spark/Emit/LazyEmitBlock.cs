@@ -205,6 +205,13 @@ namespace Spark.Emit
             return result;
         }
 
+        public void If(IEmitVal condition, Action<IEmitBlock> emitThen)
+        {
+            var thenBlock = new LazyEmitBlock(_target, _method);
+            emitThen(thenBlock);
+            Defer((b) => { b.If(Un(condition), thenBlock.ApplyTo); });
+        }
+
         public IEmitVal Local(string name, IEmitType type)
         {
             return Defer((b) => b.Local(name, Un(type)));
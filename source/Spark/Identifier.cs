@@ -92,6 +92,8 @@ namespace Spark
             ;
         }
 
+        public string Name { get { return _name; } }
+
         private string _name;
         private int _counter;
     }
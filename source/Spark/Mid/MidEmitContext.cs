@@ -265,16 +265,35 @@ namespace Spark.Mid
             var midModule = new MidModuleDecl(null, this, env);
             _module = midModule;
             _modules[ resModule ] = midModule;
-            foreach (var decl in resModule.Decls)
-                EmitMemberDecl(midModule, decl, env);
-            _module.DoneBuilding();
-            _module.ForceDeep();
+            try
+            {
+                foreach (var decl in resModule.Decls)
+                    EmitMemberDecl(midModule, decl, env);
+                _module.DoneBuilding();
+                _module.ForceDeep();
 
-            _lazy.Force();
+                _lazy.Force();
+            }
+            finally
+            {
+                // Every module lowers its own copy of the generics
+                // it uses (the standard library's included), so
+                // specializations are no use to the next module,
+                // and would keep this one alive in a long-lived
+                // context.
+                _specializations.Clear();
+            }
 
             var midSimplifyContext = new Mid.MidSimplifyContext( _exps );
             midSimplifyContext.SimplifyModule(midModule);
 
+            // Move per-fragment math down to the vertex rate where
+            // that is legal and pays for itself, then simplify again
+            // to drop the fetches it leaves unused.
+            var midHoistRates = new Mid.MidHoistRates( _exps );
+            if( midHoistRates.ApplyToModule(midModule) )
+                midSimplifyContext.SimplifyModule(midModule);
+
             MidMarkOutputs.MarkOutputs(midModule);
 
             var midScalarizeOutputs = new Mid.MidScalarizeOutputs(_identifiers, _exps);
@@ -678,6 +697,18 @@ namespace Spark.Mid
             MidGenericDecl genericDecl,
             IEnumerable<object> args)
         {
+            // Each specialization is only lowered once per module.
+            // Arguments the key can't compare structurally would
+            // never match, so don't cache those at all.
+            MidGenericSpecializationKey key = null;
+            if (MidGenericSpecializationKey.CanCompare(args))
+            {
+                key = new MidGenericSpecializationKey(genericDecl, args);
+                MidMemberDecl cached;
+                if (_specializations.TryGetValue(key, out cached))
+                    return cached.CreateRef(null);
+            }
+
             var resGeneric = genericDecl.ResDecl;
             var env = new MidGlobalEmitEnv(genericDecl.Env, genericDecl.Env.Context);
             foreach (var p in args.Zip(resGeneric.Parameters, Tuple.Create))
@@ -690,12 +721,20 @@ namespace Spark.Mid
                 builder,
                 resGeneric.InnerDecl,
                 env);
+
+            // Cache before forcing, so that a specialization that
+            // refers back to itself finds this decl.
+            if (key != null)
+                _specializations[key] = midDecl;
+
             builder.DoneBuilding();
             builder.ForceDeep();
 
             return midDecl.CreateRef(null);
         }
 
+        private Dictionary<MidGenericSpecializationKey, MidMemberDecl> _specializations = new Dictionary<MidGenericSpecializationKey, MidMemberDecl>();
+
         /*
         public MidMemberDecl SpecializeGenericDeclImpl(
             MidGenericDecl genericDecl,
@@ -759,9 +798,12 @@ namespace Spark.Mid
 
         private MidExp EmitExpRaw(IResExp exp, MidEmitEnv env)
         {
-            return EmitExpImpl((dynamic)exp, env);
+            return _emitExpImpl.For(exp)(this, exp, env);
         }
 
+        private static readonly TypeDispatcher<Func<MidEmitContext, IResExp, MidEmitEnv, MidExp>> _emitExpImpl =
+            new TypeDispatcher<Func<MidEmitContext, IResExp, MidEmitEnv, MidExp>>("EmitExpImpl");
+
         private MidExp EmitExpImpl(
             ResBaseExp exp,
             MidEmitEnv env)
@@ -1088,9 +1130,12 @@ namespace Spark.Mid
             IResMemberTerm memberTerm,
             MidEmitEnv env)
         {
-            BindForMemberTermImpl((dynamic)memberTerm, env);
+            _bindForMemberTermImpl.For(memberTerm)(this, memberTerm, env);
         }
 
+        private static readonly TypeDispatcher<Action<MidEmitContext, IResMemberTerm, MidEmitEnv>> _bindForMemberTermImpl =
+            new TypeDispatcher<Action<MidEmitContext, IResMemberTerm, MidEmitEnv>>("BindForMemberTermImpl");
+
         private void BindForMemberTermImpl(
             ResMemberBind memberBind,
             MidEmitEnv env)
@@ -1260,9 +1305,12 @@ namespace Spark.Mid
 
         private IMidMemberRef EmitMemberTerm(IResMemberTerm resMemberTerm, MidEmitEnv env)
         {
-            return EmitMemberTermImpl((dynamic)resMemberTerm, env);
+            return _emitMemberTermImpl.For(resMemberTerm)(this, resMemberTerm, env);
         }
 
+        private static readonly TypeDispatcher<Func<MidEmitContext, IResMemberTerm, MidEmitEnv, IMidMemberRef>> _emitMemberTermImpl =
+            new TypeDispatcher<Func<MidEmitContext, IResMemberTerm, MidEmitEnv, IMidMemberRef>>("EmitMemberTermImpl");
+
         private IMidMemberRef EmitMemberTermImpl(ResMemberGenericApp resApp, MidEmitEnv env)
         {
             var fun = EmitMemberTerm(resApp.Fun.MemberTerm, env);
@@ -1344,9 +1392,12 @@ namespace Spark.Mid
 
         private MidType EmitTypeExp(IResTypeExp resType, MidEmitEnv env)
         {
-            return EmitTypeExpImpl((dynamic)resType, env);
+            return _emitTypeExpImpl.For(resType)(this, resType, env);
         }
 
+        private static readonly TypeDispatcher<Func<MidEmitContext, IResTypeExp, MidEmitEnv, MidType>> _emitTypeExpImpl =
+            new TypeDispatcher<Func<MidEmitContext, IResTypeExp, MidEmitEnv, MidType>>("EmitTypeExpImpl");
+
         private MidType EmitTypeExpImpl(
             ResVoidType voidType,
             MidEmitEnv env)
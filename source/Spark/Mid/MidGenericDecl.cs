@@ -71,4 +71,125 @@ namespace Spark.Mid
         MidGenericDecl _decl;
         MidMemberTerm _memberTerm;
     }
+
+    // Identifies one specialization of a generic. Builtin types
+    // are created anew at each reference, so arguments are
+    // compared structurally rather than by identity.
+    public class MidGenericSpecializationKey
+    {
+        public MidGenericSpecializationKey(
+            MidGenericDecl decl,
+            IEnumerable<object> args )
+        {
+            _decl = decl;
+            _args = args.ToArray();
+        }
+
+        // Whether every argument is of a kind that ArgEqual
+        // compares structurally.
+        public static bool CanCompare(IEnumerable<object> args)
+        {
+            return args.All(CanCompare);
+        }
+
+        private static bool CanCompare(object arg)
+        {
+            if (arg == null)
+                return true;
+            if (arg is MidBuiltinType)
+            {
+                var builtin = (MidBuiltinType)arg;
+                return builtin.Args == null || CanCompare(builtin.Args);
+            }
+            if (arg is MidLit)
+                return CanCompare(((MidLit)arg).Type);
+            return arg is MidElementType
+                || arg is MidStructRef;
+        }
+
+        public override bool Equals(object obj)
+        {
+            var other = obj as MidGenericSpecializationKey;
+            if (other == null || other._decl != _decl)
+                return false;
+            return ArgsEqual(_args, other._args);
+        }
+
+        public override int GetHashCode()
+        {
+            int hash = _decl.GetHashCode();
+            foreach (var a in _args)
+                hash = hash * 31 + ArgHash(a);
+            return hash;
+        }
+
+        private static bool ArgsEqual(object[] left, object[] right)
+        {
+            if (left == null || right == null)
+                return left == right;
+            if (left.Length != right.Length)
+                return false;
+            for (int ii = 0; ii < left.Length; ++ii)
+            {
+                if (!ArgEqual(left[ii], right[ii]))
+                    return false;
+            }
+            return true;
+        }
+
+        private static bool ArgEqual(object left, object right)
+        {
+            if (left == right)
+                return true;
+            if (left == null || right == null || left.GetType() != right.GetType())
+                return false;
+
+            if (left is MidBuiltinType)
+            {
+                var l = (MidBuiltinType)left;
+                var r = (MidBuiltinType)right;
+                return l.Name == r.Name && ArgsEqual(l.Args, r.Args);
+            }
+            if (left is MidElementType)
+                return ((MidElementType)left).Decl == ((MidElementType)right).Decl;
+            if (left is MidStructRef)
+                return ((MidStructRef)left).Decl == ((MidStructRef)right).Decl;
+            if (left is MidLit)
+            {
+                return object.Equals(((dynamic)left).Value, ((dynamic)right).Value)
+                    && ArgEqual(((MidLit)left).Type, ((MidLit)right).Type);
+            }
+            return false;
+        }
+
+        private static int ArgHash(object arg)
+        {
+            if (arg == null)
+                return 0;
+            if (arg is MidBuiltinType)
+            {
+                var builtin = (MidBuiltinType)arg;
+                int hash = builtin.Name.GetHashCode();
+                if (builtin.Args != null)
+                {
+                    foreach (var a in builtin.Args)
+                        hash = hash * 31 + ArgHash(a);
+                }
+                return hash;
+            }
+            if (arg is MidElementType)
+                return ((MidElementType)arg).Decl.GetHashCode();
+            if (arg is MidStructRef)
+                return ((MidStructRef)arg).Decl.GetHashCode();
+            if (arg is MidLit)
+            {
+                object value = ((dynamic)arg).Value;
+                return value == null ? 0 : value.GetHashCode();
+            }
+            return arg.GetHashCode();
+        }
+
+        private MidGenericDecl _decl;
+        private object[] _args;
+    }
 }
@@ -0,0 +1,488 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+namespace Spark.Mid
+{
+    // Moves @Fragment computations whose only varying inputs
+    // are interpolated @RasterVertex values down to @RasterVertex,
+    // so that they are evaluated once per vertex and the result
+    // interpolated, instead of being re-evaluated per fragment.
+    //
+    // Interpolation is affine, so this is only done for
+    // operations that commute with it (sums, differences, scaling
+    // by an interpolation-invariant value, swizzles and vector
+    // construction). The results can differ from the original
+    // code only by floating-point rounding.
+    //
+    // Every hoisted value is a new interpolant, so candidates are
+    // weighed against the interpolant lanes they add or free.
+    public class MidHoistRates
+    {
+        // Number of interpolant lanes (4 per register) we are
+        // willing to grow a pipeline to. Pipelines already above
+        // this are never allowed to grow.
+        private const int InterpolantLaneBudget = 16 * 4;
+
+        public MidHoistRates(
+            MidExpFactory exps )
+        {
+            _exps = exps;
+        }
+
+        public bool ApplyToModule(MidModuleDecl module)
+        {
+            bool changed = false;
+            foreach (var p in module.Pipelines)
+                changed |= ApplyToPipeline(p);
+            return changed;
+        }
+
+        public bool ApplyToPipeline(MidPipelineDecl pipeline)
+        {
+            _fragment = FindElement(pipeline, "Fragment");
+            _rasterVertex = FindElement(pipeline, "RasterVertex");
+            if (_fragment == null || _rasterVertex == null)
+                return false;
+
+            // When a geometry shader is present, @RasterVertex
+            // values come from it rather than from the vertex
+            // that was interpolated, so leave the pipeline alone.
+            if (_rasterVertex.Attributes.Any((a) => a.IsInput))
+                return false;
+
+            // After simplification every @Fragment value is an
+            // attribute of its own, so the pass works over the
+            // graph of attributes and the references between them.
+            _infos = new Dictionary<MidAttributeDecl, AttrInfo>();
+            _order = new List<AttrInfo>();
+            foreach (var a in _fragment.Attributes.ToArray())
+                GetInfo(a);
+
+            CountUses(pipeline);
+
+            _siteCounts = new Dictionary<MidAttributeDecl, int>();
+            foreach (var info in _order)
+            {
+                if (info.Fetched == null)
+                    continue;
+                int count;
+                _siteCounts.TryGetValue(info.Fetched, out count);
+                _siteCounts[info.Fetched] = count + 1;
+            }
+
+            _lanes = 0;
+            foreach (var attr in _siteCounts.Keys)
+                _lanes += CountLanes(attr.Type);
+            _laneLimit = Math.Max(_lanes, InterpolantLaneBudget);
+
+            foreach (var info in _order)
+            {
+                if (info.Kind == VarKind.Other || info.App == null)
+                    continue;
+                foreach (var arg in ArgInfos(info))
+                    arg.HoistableUses++;
+            }
+
+            var candidates = (from info in _order
+                              where info.Kind == VarKind.Interpolated && info.App != null
+                              select info).ToArray();
+
+            // Only values that something non-hoistable consumes
+            // are worth turning into interpolants; the rest are
+            // computed on the way to one of those.
+            var accepted = new HashSet<AttrInfo>();
+            foreach (var candidate in candidates)
+            {
+                if (candidate.Uses <= candidate.HoistableUses)
+                    continue;
+
+                var deadBefore = FindDead(accepted);
+                accepted.Add(candidate);
+                var deadAfter = FindDead(accepted);
+
+                var killedSites = (from info in deadAfter
+                                   where info.Fetched != null && !deadBefore.Contains(info)
+                                   select info.Fetched).ToArray();
+
+                var counts = new Dictionary<MidAttributeDecl, int>();
+                int freedLanes = 0;
+                foreach (var attr in killedSites)
+                {
+                    int count;
+                    if (!counts.TryGetValue(attr, out count))
+                        count = _siteCounts[attr];
+                    count--;
+                    counts[attr] = count;
+                    if (count == 0)
+                        freedLanes += CountLanes(attr.Type);
+                }
+
+                var hoisted = GetHoistedAttr(candidate);
+                int hoistedCount;
+                if (!counts.TryGetValue(hoisted, out hoistedCount))
+                    _siteCounts.TryGetValue(hoisted, out hoistedCount);
+                int addedLanes = hoistedCount == 0 ? CountLanes(hoisted.Type) : 0;
+
+                // Interpolating a lane costs roughly one ALU
+                // operation in the pixel shader, so only grow the
+                // interpolant count when it saves more work than that.
+                int delta = addedLanes - freedLanes;
+                if (_lanes + delta > _laneLimit
+                    || (delta > 0 && candidate.OpCount < delta))
+                {
+                    accepted.Remove(candidate);
+                    continue;
+                }
+
+                foreach (var p in counts)
+                {
+                    if (p.Value == 0)
+                        _siteCounts.Remove(p.Key);
+                    else
+                        _siteCounts[p.Key] = p.Value;
+                }
+                _siteCounts[hoisted] = hoistedCount + 1;
+                _lanes += delta;
+            }
+
+            // Fetches and operations left unused by this get
+            // removed by the simplify pass that follows.
+            foreach (var info in accepted)
+            {
+                info.Attribute.Exp = _exps.AttributeFetch(
+                    info.Attribute.Exp.Range,
+                    info.Source,
+                    info.Hoisted);
+            }
+            return accepted.Count != 0;
+        }
+
+        private enum VarKind
+        {
+            Other,
+            Interpolated,   // varies across the primitive, but affinely
+            Invariant,      // same value at every vertex and fragment
+        }
+
+        private class AttrInfo
+        {
+            public MidAttributeDecl Attribute;
+            public VarKind Kind;
+            public MidPath Source;              // path to the interpolated vertex
+            public MidAttributeDecl Fetched;    // for a direct fetch of an interpolant
+            public MidBuiltinApp App;           // for an operation
+            public int OpCount;                 // operations computed by this attribute
+            public int Uses;
+            public int HoistableUses;
+            public MidAttributeDecl Hoisted;    // @RasterVertex attribute for this value
+        }
+
+        // Classifies a @Fragment attribute, after the attributes
+        // it refers to, so that _order lists every attribute
+        // after its arguments.
+        private AttrInfo GetInfo(MidAttributeDecl attribute)
+        {
+            AttrInfo info;
+            if (_infos.TryGetValue(attribute, out info))
+                return info;
+
+            info = new AttrInfo { Attribute = attribute, Kind = VarKind.Other };
+            _infos[attribute] = info;
+            if (attribute.Exp != null && !attribute.IsInput)
+                Classify(info);
+            _order.Add(info);
+            return info;
+        }
+
+        private void Classify(AttrInfo info)
+        {
+            var exp = info.Attribute.Exp;
+
+            var fetch = exp as MidAttributeFetch;
+            if (fetch != null)
+            {
+                // System values (e.g., the position) don't reach the
+                // pixel shader as the value that was interpolated.
+                if (IsInterpolatedVertex(fetch.Obj)
+                    && CountLanes(fetch.Type) != 0
+                    && !fetch.Attribute.Name.ToString().StartsWith("__RS_"))
+                {
+                    info.Kind = VarKind.Interpolated;
+                    info.Source = fetch.Obj;
+                    info.Fetched = fetch.Attribute;
+                }
+                return;
+            }
+
+            var app = exp as MidBuiltinApp;
+            if (app == null)
+                return;
+
+            // @Uniform and @Constant values reach the fragment
+            // through a conversion of a reference to the
+            // attribute in their own element.
+            var template = app.Decl.GetTemplate("hlsl");
+            if (template == "__UniformRef" || template == "__ConstantRef")
+            {
+                info.Kind = VarKind.Invariant;
+                info.App = app;
+                return;
+            }
+
+            if (CountLanes(app.Type) == 0)
+                return;
+
+            var args = app.Args.ToArray();
+            var interpolated = new bool[args.Length];
+            MidPath source = null;
+            int opCount = 1;
+            for (int ii = 0; ii < args.Length; ++ii)
+            {
+                if (args[ii] is MidLit)
+                    continue;
+
+                var argInfo = GetArgInfo(args[ii]);
+                if (argInfo == null)
+                    return;
+
+                switch (argInfo.Kind)
+                {
+                    case VarKind.Invariant:
+                        break;
+                    case VarKind.Interpolated:
+                        if (source != null && !IsSamePath(source, argInfo.Source))
+                            return;
+                        source = argInfo.Source;
+                        interpolated[ii] = true;
+                        opCount += argInfo.OpCount;
+                        break;
+                    default:
+                        return;
+                }
+            }
+
+            if (!IsAffine(app, interpolated))
+                return;
+
+            info.Kind = source != null ? VarKind.Interpolated : VarKind.Invariant;
+            info.Source = source;
+            info.App = app;
+            info.OpCount = opCount;
+        }
+
+        // The info for an argument that refers to another
+        // @Fragment attribute, or null for any other argument.
+        private AttrInfo GetArgInfo(MidVal arg)
+        {
+            var attrRef = arg as MidAttributeRef;
+            if (attrRef == null || attrRef.Decl.Element != _fragment)
+                return null;
+            return GetInfo(attrRef.Decl);
+        }
+
+        // Counts the references to each @Fragment attribute, from
+        // the @Fragment element itself and from the elements that
+        // fetch from it. Outputs count as a use of their own.
+        private void CountUses(MidPipelineDecl pipeline)
+        {
+            var countUses = new MidTransform(
+                (e) =>
+                {
+                    MidAttributeDecl used = null;
+                    var attrRef = e as MidAttributeRef;
+                    if (attrRef != null)
+                        used = attrRef.Decl;
+                    var fetch = e as MidAttributeFetch;
+                    if (fetch != null)
+                        used = fetch.Attribute;
+
+                    AttrInfo info;
+                    if (used != null && _infos.TryGetValue(used, out info))
+                        info.Uses++;
+                    return e;
+                });
+
+            foreach (var element in pipeline.Elements)
+            {
+                foreach (var a in element.Attributes)
+                {
+                    if (a.Exp != null)
+                        countUses.Transform(a.Exp);
+                }
+            }
+
+            foreach (var info in _order)
+            {
+                if (info.Attribute.IsOutput)
+                    info.Uses++;
+            }
+        }
+
+        private bool IsAffine(MidBuiltinApp app, bool[] interpolated)
+        {
+            var name = app.Decl.Name.ToString();
+            int argCount = interpolated.Length;
+            int interpolatedCount = interpolated.Count((b) => b);
+
+            switch (name)
+            {
+                case "operator(+)":
+                case "operator(-)":
+                    return argCount == 1 || argCount == 2;
+                case "operator(*)":
+                case "mul":
+                    return argCount == 2 && interpolatedCount <= 1;
+                case "operator(/)":
+                    return argCount == 2 && !interpolated[1];
+                case "float2":
+                case "float3":
+                case "float4":
+                    return true;
+                default:
+                    break;
+            }
+
+            // Swizzles
+            var template = app.Decl.GetTemplate("hlsl");
+            if (argCount == 1 && template != null && template.StartsWith("({0})."))
+                return template.Substring(6).All((c) => "xyzw".IndexOf(c) >= 0);
+
+            return false;
+        }
+
+        private HashSet<AttrInfo> FindDead(
+            HashSet<AttrInfo> accepted)
+        {
+            var remaining = _order.ToDictionary((info) => info, (info) => info.Uses);
+            var dead = new HashSet<AttrInfo>();
+            for (int ii = _order.Count - 1; ii >= 0; --ii)
+            {
+                var info = _order[ii];
+                bool removed = accepted.Contains(info);
+                if (!removed && info.Kind != VarKind.Other && remaining[info] == 0)
+                {
+                    dead.Add(info);
+                    removed = true;
+                }
+
+                if (removed && info.App != null)
+                {
+                    foreach (var arg in ArgInfos(info))
+                        remaining[arg]--;
+                }
+            }
+            return dead;
+        }
+
+        private IEnumerable<AttrInfo> ArgInfos(AttrInfo info)
+        {
+            foreach (var arg in info.App.Args)
+            {
+                var argInfo = GetArgInfo(arg);
+                if (argInfo != null)
+                    yield return argInfo;
+            }
+        }
+
+        private MidAttributeDecl GetHoistedAttr(AttrInfo info)
+        {
+            if (info.Hoisted != null)
+                return info.Hoisted;
+
+            if (info.Fetched != null)
+            {
+                info.Hoisted = info.Fetched;
+                return info.Hoisted;
+            }
+
+            // The emitter only looks at the template of a
+            // __UniformRef/__ConstantRef conversion, so the
+            // @Fragment one can be re-used at @RasterVertex.
+            var app = info.App;
+            var args = (from a in app.Args
+                        select GetVertexVal(a, app.Range)).ToArray();
+            info.Hoisted = _rasterVertex.CacheAttr(
+                new MidBuiltinApp(app.Range, app.Decl, args),
+                info.Attribute.Type);
+            return info.Hoisted;
+        }
+
+        private MidVal GetVertexVal(MidVal val, SourceRange range)
+        {
+            var argInfo = GetArgInfo(val);
+            if (argInfo == null)
+                return val;
+
+            return _exps.AttributeRef(range, GetHoistedAttr(argInfo));
+        }
+
+        private bool IsInterpolatedVertex(MidPath path)
+        {
+            var attrRef = path as MidAttributeRef;
+            if (attrRef == null || attrRef.Decl.Element != _fragment)
+                return false;
+
+            var elementType = attrRef.Decl.Type as MidElementType;
+            return elementType != null && elementType.Decl == _rasterVertex;
+        }
+
+        private static bool IsSamePath(MidPath left, MidPath right)
+        {
+            var leftRef = left as MidAttributeRef;
+            var rightRef = right as MidAttributeRef;
+            return leftRef != null && rightRef != null && leftRef.Decl == rightRef.Decl;
+        }
+
+        private static MidElementDecl FindElement(
+            MidPipelineDecl pipeline,
+            string name)
+        {
+            foreach (var e in pipeline.Elements)
+                if (e.Name.ToString() == name)
+                    return e;
+            return null;
+        }
+
+        private static int CountLanes(MidType type)
+        {
+            var builtin = type as MidBuiltinType;
+            if (builtin == null)
+                return 0;
+
+            switch (builtin.Name)
+            {
+                case "float": return 1;
+                case "float2": return 2;
+                case "float3": return 3;
+                case "float4": return 4;
+                default:
+                    return 0;
+            }
+        }
+
+        private MidExpFactory _exps;
+        private MidElementDecl _fragment;
+        private MidElementDecl _rasterVertex;
+        private Dictionary<MidAttributeDecl, int> _siteCounts;
+        private Dictionary<MidAttributeDecl, AttrInfo> _infos;
+        private List<AttrInfo> _order;
+        private int _lanes;
+        private int _laneLimit;
+    }
+}
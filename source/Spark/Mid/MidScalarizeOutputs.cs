@@ -74,9 +74,12 @@ namespace Spark.Mid
 
         public void TransformChildren(MidExp exp)
         {
-            TransformChildrenImpl((dynamic)exp);
+            _transformChildrenImpl.For(exp)(this, exp);
         }
 
+        private static readonly TypeDispatcher<Action<MidTransform, MidExp>> _transformChildrenImpl =
+            new TypeDispatcher<Action<MidTransform, MidExp>>("TransformChildrenImpl");
+
         private void TransformChildrenImpl(
             MidVal val)
         {
@@ -282,9 +285,12 @@ namespace Spark.Mid
                         Collect(p, e, a);
 
             // Replace uses of these attributes
-            (new MidTransform( (e) => _replacePass.PreTransform((dynamic) e))).ApplyToModule(module);
+            (new MidTransform( (e) => _replacePassPreTransform.For(e)(_replacePass, e))).ApplyToModule(module);
         }
 
+        private static readonly TypeDispatcher<Func<ReplacePass, MidExp, MidExp>> _replacePassPreTransform =
+            new TypeDispatcher<Func<ReplacePass, MidExp, MidExp>>("PreTransform");
+
         public void Collect(
             MidPipelineDecl pipeline,
             MidElementDecl element,
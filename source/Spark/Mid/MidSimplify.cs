@@ -39,6 +39,9 @@ namespace Spark.Mid
 
         private MidTransform _transform;
 
+        private static readonly TypeDispatcher<Func<MidCleanup, MidExp, MidExp>> _cleanupExp =
+            new TypeDispatcher<Func<MidCleanup, MidExp, MidExp>>("CleanupExp");
+
         public void ApplyToModule( MidModuleDecl module )
         {
             /*
@@ -73,7 +76,7 @@ namespace Spark.Mid
             // replacing them with shiny new ones!!!
 
             _transform = new MidTransform(
-                ( e ) => CleanupExp( (dynamic) e ) );
+                ( e ) => _cleanupExp.For( e )( this, e ) );
 
             foreach( var e in p.Elements )
                  e.Clear();
@@ -227,6 +230,15 @@ namespace Spark.Mid
                 _vars[var] = val;
             }
 
+            public bool IsBound(MidVar var)
+            {
+                if (_vars.ContainsKey(var))
+                    return true;
+                if (_parent != null)
+                    return _parent.IsBound(var);
+                return false;
+            }
+
             public MidVal Lookup(MidVarRef varRef)
             {
                 MidVal val;
@@ -241,6 +253,69 @@ namespace Spark.Mid
             private SimplifyEnv _parent;
         }
 
+        // Facts about an expression that the simplifications
+        // query. These are computed bottom-up as each node is
+        // simplified, so that deciding whether a let is dead
+        // doesn't require re-walking its body (which made long
+        // let-chains from inlining quadratic).
+        private class ExpInfo
+        {
+            public bool MightHaveSideEffects;
+            public HashSet<MidLabel> Labels; // labels broken to, or null
+        }
+
+        // Collects the infos of the children of each node
+        // during a post-order walk.
+        private class ExpInfoBuilder
+        {
+            public void Enter()
+            {
+                _marks.Push(_infos.Count);
+            }
+
+            public ExpInfo Exit(MidExp exp)
+            {
+                int mark = _marks.Pop();
+                var result = new ExpInfo();
+                for (int ii = mark; ii < _infos.Count; ++ii)
+                {
+                    var child = _infos[ii];
+                    result.MightHaveSideEffects |= child.MightHaveSideEffects;
+                    if (child.Labels != null)
+                    {
+                        if (result.Labels == null)
+                            result.Labels = new HashSet<MidLabel>();
+                        result.Labels.UnionWith(child.Labels);
+                    }
+                }
+                _infos.RemoveRange(mark, _infos.Count - mark);
+
+                AddOwnFacts(exp, result);
+                return result;
+            }
+
+            public void Push(ExpInfo info)
+            {
+                _infos.Add(info);
+            }
+
+            private List<ExpInfo> _infos = new List<ExpInfo>();
+            private Stack<int> _marks = new Stack<int>();
+        }
+
+        // Use counts for every variable in the attribute or method
+        // being simplified. Variables are unique to the expression
+        // that binds them, so a let's variable is dead exactly
+        // when its count reaches zero. Counts are only ever
+        // over-estimates, which just leaves a let in place.
+        private Dictionary<MidVar, int> _useCounts = new Dictionary<MidVar, int>();
+        private Dictionary<MidExp, ExpInfo> _expInfos = new Dictionary<MidExp, ExpInfo>();
+
+        private static readonly TypeDispatcher<Func<MidSimplifyContext, MidExp, SimplifyEnv, MidExp>> _simplifyExpImpl =
+            new TypeDispatcher<Func<MidSimplifyContext, MidExp, SimplifyEnv, MidExp>>("SimplifyExpImpl");
+        private static readonly TypeDispatcher<Func<MidSimplifyContext, MidLabelExp, MidExp, SimplifyEnv, MidExp>> _simplifyLabelExpImpl =
+            new TypeDispatcher<Func<MidSimplifyContext, MidLabelExp, MidExp, SimplifyEnv, MidExp>>("SimplifyLabelExpImpl", 1);
+
         public void SimplifyModule(MidModuleDecl module)
         {
             foreach (var p in module.Pipelines)
@@ -264,26 +339,68 @@ namespace Spark.Mid
 
         public void SimplifyAttribute(MidAttributeDecl attribute)
         {
+            BeginRoot(attribute.Exp);
             attribute.Exp = SimplifyExp(attribute.Exp, new SimplifyEnv(null));
         }
 
         public void SimplifyMethod(MidMethodDecl method)
         {
+            BeginRoot(method.Body);
             method.Body = SimplifyExp(method.Body, new SimplifyEnv(null));
         }
 
+        private void BeginRoot(MidExp exp)
+        {
+            _useCounts.Clear();
+            _expInfos.Clear();
+            if (exp != null)
+                AdjustUseCounts(exp, 1);
+        }
 
         private MidExp SimplifyExp(MidExp exp, SimplifyEnv env)
         {
             if (exp == null)
                 return null;
 
+            var infos = new ExpInfoBuilder();
             var transform = new MidTransform(
-                null, // no pre-transform
-                (e) => SimplifyExpImpl((dynamic)e, env));
+                (e) =>
+                {
+                    infos.Enter();
+                    return PreSimplifyExp(e, env);
+                },
+                (e) =>
+                {
+                    var info = infos.Exit(e);
+                    var result = _simplifyExpImpl.For(e)(this, e, env);
+                    ExpInfo resultInfo;
+                    if (result != e && _expInfos.TryGetValue(result, out resultInfo))
+                        info = resultInfo;
+                    else
+                    {
+                        AddOwnFacts(result, info);
+                        _expInfos[result] = info;
+                    }
+                    infos.Push(info);
+                    return result;
+                });
             return transform.Transform(exp);
         }
 
+        private MidExp PreSimplifyExp(MidExp exp, SimplifyEnv env)
+        {
+            // Substitute away lets of simple values on the way
+            // down, so that their bodies only get walked once.
+            var let = exp as MidLetExp;
+            if (let != null && let.Exp is MidVal)
+            {
+                var val = (MidVal) _simplifyExpImpl.For(let.Exp)(this, let.Exp, env);
+                let.Exp = val;
+                env.Insert(let.Var, val);
+            }
+            return exp;
+        }
+
         private MidExp SimplifyExpImpl(MidExp exp, SimplifyEnv env)
         {
             return exp;
@@ -308,16 +425,25 @@ namespace Spark.Mid
 
         private MidExp SimplifyExpImpl(MidVarRef val, SimplifyEnv env)
         {
-            return env.Lookup(val);
+            var result = env.Lookup(val);
+            if (result != val && result is MidVarRef)
+                AdjustUseCounts(result, 1);
+            return result;
         }
 
         private MidExp SimplifyExpImpl(MidLabelExp exp, SimplifyEnv env)
         {
-            return SimplifyLabelExpImpl(exp, (dynamic) exp.Body, env);
+            return _simplifyLabelExpImpl.For(exp.Body)(this, exp, exp.Body, env);
         }
 
         private MidExp SimplifyExpImpl(MidLetExp exp, SimplifyEnv env)
         {
+            if (exp.Exp is MidVal && env.IsBound(exp.Var))
+            {
+                // Already substituted away on the way down.
+                return exp.Body;
+            }
+
             if (exp.Exp is MidVal)
             {
                 // The variable is just being bound to a simple
@@ -333,6 +459,7 @@ namespace Spark.Mid
             {
                 // Well, we can't possibly get to the rest of the
                 // expression, right?
+                AdjustUseCounts(exp.Body, -1);
                 return exp.Exp;
             }
 
@@ -362,11 +489,12 @@ namespace Spark.Mid
                 }
             }
 
-            if (!UsesVar(exp.Body, exp.Var) && !MightHaveSideEffects(exp.Exp))
+            if (!IsUsed(exp.Var) && !MightHaveSideEffects(exp.Exp))
             {
-                // \todo: Should be able to DCE the let expression away,
-                // but to do that we need to be sure it doesn't have
-                // any side-effects... :(
+                // Dropping the bound expression may leave lets
+                // further out dead too; since those are simplified
+                // after this one, they get removed in the same sweep.
+                AdjustUseCounts(exp.Exp, -1);
                 return exp.Body;
             }
 
@@ -386,6 +514,8 @@ namespace Spark.Mid
                     var midVarRef = (MidVarRef) midFieldRef.Obj;
                     if (midVarRef.Var == var)
                     {
+                        AdjustUseCounts(midVarRef, -1);
+                        AdjustUseCounts(path, 1);
                         midFieldRef.Obj = path;
                         return midFieldRef;
                     }
@@ -449,70 +579,97 @@ namespace Spark.Mid
             MidExp exp,
             MidLabel label)
         {
+            var labels = GetExpInfo(exp).Labels;
+            return labels != null && labels.Contains(label);
+        }
 
-            bool result = false;
-            var transform = new MidTransform(
-                (e) =>
-                {
-                    if (e is MidBreakExp && (e as MidBreakExp).Label == label)
-                        result = true;
-                    return e;
-                });
-
-            transform.Transform(exp);
+        private bool IsUsed(
+            MidVar var)
+        {
+            int count;
+            return _useCounts.TryGetValue(var, out count) && count > 0;
+        }
 
-            return result;
+        private bool MightHaveSideEffects(
+            MidExp exp )
+        {
+            return GetExpInfo(exp).MightHaveSideEffects;
         }
 
-        private bool UsesVar(
+        private void AdjustUseCounts(
             MidExp exp,
-            MidVar var)
+            int delta)
         {
-
-            bool result = false;
             var transform = new MidTransform(
                 (e) =>
                 {
-                    if (e is MidVarRef && (e as MidVarRef).Var == var)
-                        result = true;
+                    var varRef = e as MidVarRef;
+                    if (varRef != null)
+                    {
+                        int count;
+                        _useCounts.TryGetValue(varRef.Var, out count);
+                        _useCounts[varRef.Var] = count + delta;
+                    }
                     return e;
                 });
 
             transform.Transform(exp);
-
-            return result;
         }
 
-        private bool MightHaveSideEffects(
-            MidExp exp )
+        private ExpInfo GetExpInfo(
+            MidExp exp)
         {
+            ExpInfo info;
+            if (_expInfos.TryGetValue(exp, out info))
+                return info;
 
-            bool result = false;
+            // Expressions built during simplification may not
+            // have been seen yet; analyze (and remember) them.
+            var infos = new ExpInfoBuilder();
             var transform = new MidTransform(
                 (e) =>
                 {
-                    if (e is MidAssignExp)
-                        result = true;
-                    if (e is MidBreakExp)
-                        result = true;
-                    if (e is MidIfExp)
-                        result = true;
-                    if (e is MidForExp)
-                        result = true;
-                    if (e is MidBuiltinApp)
-                    {
-                        // \todo: Need a *huge* fix for this. Stdlib functions that might
-                        // have side-effects need to be marked in some way to avoid this kind of thing... :(
-                        var app = (MidBuiltinApp)e;
-                        if (app.Decl.Name.ToString() == "Append")
-                            result = true;
-                    }
+                    infos.Enter();
+                    return e;
+                },
+                (e) =>
+                {
+                    var eInfo = infos.Exit(e);
+                    _expInfos[e] = eInfo;
+                    infos.Push(eInfo);
                     return e;
                 });
-
             transform.Transform(exp);
+            return _expInfos[exp];
+        }
 
-            return result;
+        private static void AddOwnFacts(
+            MidExp exp,
+            ExpInfo info)
+        {
+            if (exp is MidAssignExp)
+                info.MightHaveSideEffects = true;
+            if (exp is MidBreakExp)
+            {
+                info.MightHaveSideEffects = true;
+                if (info.Labels == null)
+                    info.Labels = new HashSet<MidLabel>();
+                info.Labels.Add((exp as MidBreakExp).Label);
+            }
+            if (exp is MidIfExp)
+                info.MightHaveSideEffects = true;
+            if (exp is MidForExp)
+                info.MightHaveSideEffects = true;
+            if (exp is MidBuiltinApp)
+            {
+                // \todo: Need a *huge* fix for this. Stdlib functions that might
+                // have side-effects need to be marked in some way to avoid this kind of thing... :(
+                var app = (MidBuiltinApp)exp;
+                if (app.Decl.Name.ToString() == "Append")
+                    info.MightHaveSideEffects = true;
+            }
+            if (exp is MidLabelExp && info.Labels != null)
+                info.Labels.Remove((exp as MidLabelExp).Label);
         }
     }
 }
@@ -165,9 +165,12 @@ namespace Spark.Resolve
             AbsGlobalDecl decl,
             ResEnv env)
         {
-            ResolveGlobalDeclImpl(resModule, (dynamic)decl, env.NestDiagnostics());
+            _resolveGlobalDeclImpl.For(decl)(this, resModule, decl, env.NestDiagnostics());
         }
 
+        private static readonly TypeDispatcher<Action<ResolveContext, ResModuleDeclBuilder, AbsGlobalDecl, ResEnv>> _resolveGlobalDeclImpl =
+            new TypeDispatcher<Action<ResolveContext, ResModuleDeclBuilder, AbsGlobalDecl, ResEnv>>("ResolveGlobalDeclImpl", 1);
+
         private class FacetInfo
         {
             public ResFacetDeclBuilder Facet { get; set; }
@@ -1041,12 +1044,16 @@ namespace Spark.Resolve
             ResEnv env,
             ResLocalScope insertScope)
         {
-            return ResolveGenericParamImpl(
-                (dynamic)absParam,
+            return _resolveGenericParamImpl.For(absParam)(
+                this,
+                absParam,
                 env,
                 insertScope);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, AbsGenericParamDecl, ResEnv, ResLocalScope, IResGenericParamDecl>> _resolveGenericParamImpl =
+            new TypeDispatcher<Func<ResolveContext, AbsGenericParamDecl, ResEnv, ResLocalScope, IResGenericParamDecl>>("ResolveGenericParamImpl");
+
         private IResGenericParamDecl ResolveGenericParamImpl(
             AbsGenericTypeParamDecl absParam,
             ResEnv env,
@@ -2403,9 +2410,12 @@ namespace Spark.Resolve
         private IResTerm ResolveTerm(AbsTerm term, ResEnv env)
         {
             if (term == null) return null;
-            return ResolveTermImpl((dynamic)term, env);
+            return _resolveTermImpl.For(term)(this, term, env);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, AbsTerm, ResEnv, IResTerm>> _resolveTermImpl =
+            new TypeDispatcher<Func<ResolveContext, AbsTerm, ResEnv, IResTerm>>("ResolveTermImpl");
+
         private IResTerm ResolveTermImpl(
             AbsIfTerm absExp,
             ResEnv env)
@@ -2488,9 +2498,12 @@ namespace Spark.Resolve
             IResTerm term,
             ResEnv env)
         {
-            return ResolveSingleTermImpl((dynamic) term, env);
+            return _resolveSingleTermImpl.For(term)(this, term, env);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, IResTerm, ResEnv, IResTerm>> _resolveSingleTermImpl =
+            new TypeDispatcher<Func<ResolveContext, IResTerm, ResEnv, IResTerm>>("ResolveSingleTermImpl");
+
         private IResTerm ResolveSingleTermImpl(
             IResTerm term,
             ResEnv env)
@@ -2520,9 +2533,12 @@ namespace Spark.Resolve
             ResEnv env)
         {
             var obj = ResolveSingleTerm(ResolveTerm(absMemberRef.baseObject, env), env);
-            return ResolveMemberRefImpl((dynamic)obj, absMemberRef, env);
+            return _resolveMemberRefImpl.For(obj)(this, obj, absMemberRef, env);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, IResTerm, AbsMemberRef, ResEnv, IResTerm>> _resolveMemberRefImpl =
+            new TypeDispatcher<Func<ResolveContext, IResTerm, AbsMemberRef, ResEnv, IResTerm>>("ResolveMemberRefImpl");
+
         private IResTerm ResolveMemberRefImpl(
             ResLayeredTerm layered,
             AbsMemberRef absMemberRef,
@@ -2533,8 +2549,9 @@ namespace Spark.Resolve
                 throw new NotImplementedException();
             }
 
-            return ResolveMemberRefImpl(
-                (dynamic) layered.First,
+            return _resolveMemberRefImpl.For(layered.First)(
+                this,
+                layered.First,
                 absMemberRef,
                 env );
         }
@@ -2578,8 +2595,9 @@ namespace Spark.Resolve
             var members = group.Members.Eager();
             if (members.Length == 1)
             {
-                return ResolveMemberRefImpl(
-                    (dynamic)members[0],
+                return _resolveMemberRefImpl.For(members[0])(
+                    this,
+                    members[0],
                     absMemberRef,
                     env);
             }
@@ -2641,9 +2659,12 @@ namespace Spark.Resolve
             IResExp obj,
             Identifier name)
         {
-            return LookupMemberImpl(range, (dynamic)type, obj, name);
+            return _lookupMemberImpl.For(type)(this, range, type, obj, name);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, SourceRange, IResTypeExp, IResExp, Identifier, IResTerm>> _lookupMemberImpl =
+            new TypeDispatcher<Func<ResolveContext, SourceRange, IResTypeExp, IResExp, Identifier, IResTerm>>("LookupMemberImpl", 1);
+
         public IResTerm LookupMemberImpl(
             SourceRange range,
             IResTypeExp type,
@@ -2773,9 +2794,12 @@ namespace Spark.Resolve
             AbsArg absArg,
             ResEnv env)
         {
-            return ResolveArgImpl((dynamic)absArg, env);
+            return _resolveArgImpl.For(absArg)(this, absArg, env);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, AbsArg, ResEnv, ResArg<IResTerm>>> _resolveArgImpl =
+            new TypeDispatcher<Func<ResolveContext, AbsArg, ResEnv, ResArg<IResTerm>>>("ResolveArgImpl");
+
         private ResArg<IResTerm> ResolveArgImpl(
             AbsPositionalArg absArg,
             ResEnv env)
@@ -2884,9 +2908,12 @@ namespace Spark.Resolve
             IResGenericArg arg,
             ResEnv env )
         {
-            return CheckDummyArgImpl(range, (dynamic) arg, env);
+            return _checkDummyArgImpl.For(arg)(this, range, arg, env);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, SourceRange, IResGenericArg, ResEnv, bool>> _checkDummyArgImpl =
+            new TypeDispatcher<Func<ResolveContext, SourceRange, IResGenericArg, ResEnv, bool>>("CheckDummyArgImpl", 1);
+
         private bool CheckDummyArgImpl(
             SourceRange range,
             ResGenericTypeArg arg,
@@ -3033,12 +3060,16 @@ namespace Spark.Resolve
             IResMemberRef expectedRef,
             ResEnv env)
         {
-            return TryFindConceptMemberImpl(
+            return _tryFindConceptMemberImpl.For(expectedRef)(
+                this,
                 range,
-                (dynamic)expectedRef,
+                expectedRef,
                 env);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, SourceRange, IResMemberRef, ResEnv, IResMemberRef>> _tryFindConceptMemberImpl =
+            new TypeDispatcher<Func<ResolveContext, SourceRange, IResMemberRef, ResEnv, IResMemberRef>>("TryFindConceptMemberImpl", 1);
+
         private IResMemberRef TryFindConceptMemberImpl(
             SourceRange range,
             IResMemberRef expectedRef,
@@ -3955,9 +3986,12 @@ namespace Spark.Resolve
             IResGenericParamRef param,
             Substitution subst )
         {
-            return MakeDummyArgImpl((dynamic)param, subst);
+            return _makeDummyArgImpl.For(param)(this, param, subst);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, IResGenericParamRef, Substitution, IResGenericArg>> _makeDummyArgImpl =
+            new TypeDispatcher<Func<ResolveContext, IResGenericParamRef, Substitution, IResGenericArg>>("MakeDummyArgImpl");
+
         private IResGenericArg MakeDummyArgImpl(
             IResTypeParamRef param,
             Substitution subst )
@@ -4205,9 +4239,12 @@ namespace Spark.Resolve
         private string OverloadContextName(
             object context )
         {
-            return OverloadContextNameImpl((dynamic)context);
+            return _overloadContextNameImpl.For(context)(this, context);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, object, string>> _overloadContextNameImpl =
+            new TypeDispatcher<Func<ResolveContext, object, string>>("OverloadContextNameImpl");
+
         private string OverloadContextNameImpl(
             object context)
         {
@@ -5619,9 +5656,12 @@ namespace Spark.Resolve
             StmtContext context,
             Func<ResEnv, IResExp> continuation)
         {
-            return ResolveStmtRawImpl((dynamic)absStmt, env, context, continuation);
+            return _resolveStmtRawImpl.For(absStmt)(this, absStmt, env, context, continuation);
         }
 
+        private static readonly TypeDispatcher<Func<ResolveContext, AbsStmt, ResEnv, StmtContext, Func<ResEnv, IResExp>, IResExp>> _resolveStmtRawImpl =
+            new TypeDispatcher<Func<ResolveContext, AbsStmt, ResEnv, StmtContext, Func<ResEnv, IResExp>, IResExp>>("ResolveStmtRawImpl");
+
         private IResExp ResolveStmtRawImpl(
             AbsEmptyStmt absStmt,
             ResEnv env,
@@ -0,0 +1,205 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Linq;
+using System.Linq.Expressions;
+using System.Reflection;
+using System.Text;
+
+namespace Spark
+{
+    // Calls the overload of a method that best matches the runtime
+    // type of one of its arguments, as passing that argument as
+    // (dynamic) would. The overload for each runtime type is picked
+    // once, via reflection, and cached as a compiled delegate, so
+    // that visitors over the Res/Mid trees don't go through the
+    // DLR binder for every node.
+    //
+    // The first parameter of TDelegate is the object the overloads
+    // are declared on (unused for static methods), and the rest
+    // line up with the overloads' parameters.
+    public class TypeDispatcher<TDelegate>
+        where TDelegate : class
+    {
+        public TypeDispatcher(
+            string methodName,
+            int dispatchIndex = 0 )
+        {
+            var invoke = typeof(TDelegate).GetMethod("Invoke");
+            _paramTypes = (from p in invoke.GetParameters()
+                           select p.ParameterType).ToArray();
+            _returnType = invoke.ReturnType;
+            _methodName = methodName;
+            _dispatchIndex = dispatchIndex;
+
+            // GetMethods leaves out private methods declared on base
+            // classes, so walk the hierarchy ourselves. An override
+            // is left to its base definition, which the delegate
+            // then calls virtually.
+            var flags = BindingFlags.Instance | BindingFlags.Static
+                | BindingFlags.Public | BindingFlags.NonPublic
+                | BindingFlags.DeclaredOnly;
+            _candidates = (from t in SelfAndBaseTypes(_paramTypes[0])
+                           from m in t.GetMethods(flags)
+                           where m.Name == methodName
+                           where m.GetBaseDefinition().DeclaringType == t
+                           where AcceptsStaticArgs(m)
+                           select m).ToArray();
+            if (_candidates.Length == 0)
+            {
+                throw new InvalidOperationException(string.Format(
+                    "No overloads of '{0}' on '{1}' match '{2}'",
+                    methodName,
+                    _paramTypes[0],
+                    typeof(TDelegate)));
+            }
+        }
+
+        // Get the delegate to call for the given argument.
+        public TDelegate For(object arg)
+        {
+            if (arg == null)
+                throw new ArgumentNullException("arg");
+
+            return _delegates.GetOrAdd(arg.GetType(), Build);
+        }
+
+        private static IEnumerable<Type> SelfAndBaseTypes(Type type)
+        {
+            for (var t = type; t != null; t = t.BaseType)
+                yield return t;
+        }
+
+        private bool AcceptsStaticArgs(MethodInfo method)
+        {
+            var parameters = method.GetParameters();
+            if (parameters.Length != _paramTypes.Length - 1)
+                return false;
+
+            for (int ii = 0; ii < parameters.Length; ++ii)
+            {
+                if (ii == _dispatchIndex)
+                    continue;
+                if (!parameters[ii].ParameterType.IsAssignableFrom(_paramTypes[ii + 1]))
+                    return false;
+            }
+            return true;
+        }
+
+        private Type DispatchType(MethodInfo method)
+        {
+            return method.GetParameters()[_dispatchIndex].ParameterType;
+        }
+
+        // Infer the type arguments of a generic overload from the
+        // runtime type, the way `dynamic` would for a parameter like
+        // ResLit<T>. Returns null if they can't all be inferred.
+        private MethodInfo Instantiate(MethodInfo method, Type type)
+        {
+            if (!method.IsGenericMethodDefinition)
+                return method;
+
+            var pattern = DispatchType(method);
+            if (!pattern.IsGenericType)
+                return null;
+
+            var definition = pattern.GetGenericTypeDefinition();
+            var typeParams = method.GetGenericArguments();
+            foreach (var t in SelfAndBaseTypes(type).Concat(type.GetInterfaces()))
+            {
+                if (!t.IsGenericType || t.GetGenericTypeDefinition() != definition)
+                    continue;
+
+                var typeArgs = new Type[typeParams.Length];
+                var patternArgs = pattern.GetGenericArguments();
+                var actualArgs = t.GetGenericArguments();
+                for (int ii = 0; ii < patternArgs.Length; ++ii)
+                {
+                    if (patternArgs[ii].IsGenericParameter
+                        && patternArgs[ii].DeclaringMethod != null)
+                    {
+                        typeArgs[patternArgs[ii].GenericParameterPosition] = actualArgs[ii];
+                    }
+                    else if (patternArgs[ii] != actualArgs[ii])
+                    {
+                        typeArgs = null;
+                        break;
+                    }
+                }
+                if (typeArgs == null || typeArgs.Contains(null))
+                    continue;
+
+                try
+                {
+                    return method.MakeGenericMethod(typeArgs);
+                }
+                catch (ArgumentException)
+                {
+                    // The inferred arguments violate a constraint.
+                }
+            }
+            return null;
+        }
+
+        private TDelegate Build(Type type)
+        {
+            var applicable = (from c in _candidates
+                              let m = Instantiate(c, type)
+                              where m != null
+                              where DispatchType(m).IsAssignableFrom(type)
+                              select m).ToArray();
+            var best = (from m in applicable
+                        where applicable.All((o) => DispatchType(o).IsAssignableFrom(DispatchType(m)))
+                        select m).ToArray();
+
+            // As with overload resolution, a non-generic method
+            // beats an equally specific generic one.
+            if (best.Length > 1 && best.Count((m) => !m.IsGenericMethod) == 1)
+                best = best.Where((m) => !m.IsGenericMethod).ToArray();
+            if (best.Length != 1)
+            {
+                throw new InvalidOperationException(string.Format(
+                    "No unique overload of '{0}' for '{1}'",
+                    _methodName,
+                    type));
+            }
+            var method = best[0];
+
+            var lambdaParams = (from t in _paramTypes
+                                select Expression.Parameter(t)).ToArray();
+            var args = (from p in method.GetParameters()
+                        select (Expression) Expression.Convert(
+                            lambdaParams[p.Position + 1],
+                            p.ParameterType)).ToArray();
+
+            Expression body = method.IsStatic
+                ? Expression.Call(method, args)
+                : Expression.Call(lambdaParams[0], method, args);
+            if (_returnType != typeof(void) && body.Type != _returnType)
+                body = Expression.Convert(body, _returnType);
+
+            return Expression.Lambda<TDelegate>(body, lambdaParams).Compile();
+        }
+
+        private Type[] _paramTypes;
+        private Type _returnType;
+        private string _methodName;
+        private int _dispatchIndex;
+        private MethodInfo[] _candidates;
+        private ConcurrentDictionary<Type, TDelegate> _delegates = new ConcurrentDictionary<Type, TDelegate>();
+    }
+}
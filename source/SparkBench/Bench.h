@@ -0,0 +1,49 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// Bench.h
+#ifndef SPARK_BENCH_BENCH_H
+#define SPARK_BENCH_BENCH_H
+
+#include <Windows.h>
+
+namespace sparkbench
+{
+    class Timer
+    {
+    public:
+        Timer()
+        {
+            ::QueryPerformanceFrequency( &_frequency );
+            ::QueryPerformanceCounter( &_start );
+        }
+
+        double GetElapsedMilliseconds() const
+        {
+            LARGE_INTEGER now;
+            ::QueryPerformanceCounter( &now );
+            return 1000.0 * double(now.QuadPart - _start.QuadPart) / double(_frequency.QuadPart);
+        }
+
+    private:
+        LARGE_INTEGER _frequency;
+        LARGE_INTEGER _start;
+    };
+
+    // Times the spark.h math helpers against plain scalar code,
+    // and checks that they agree. Returns non-zero on a mismatch.
+    int RunMathBenchmarks( int repeatCount );
+}
+
+#endif // SPARK_BENCH_BENCH_H
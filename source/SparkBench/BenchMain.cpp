@@ -0,0 +1,183 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// BenchMain.cpp
+//
+// Times IContext::CompileFile on the given .spark files, e.g.:
+//
+//     SparkBench -repeat 10 ..\..\examples\Direct3D11\*\*.spark
+//
+// The first compile of each file in the process is reported on
+// its own ("cold"), since it pays for loading the compiler and
+// the standard library; the repeats after it are summarized.
+// The module cache is disabled unless -cache is given, so each
+// repeat really compiles.
+//
+//     SparkBench -math [-repeat 10]
+//
+// instead times the math helpers in spark.h (see MathBench.cpp).
+
+#include "Bench.h"
+
+#include <spark/context.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        Options()
+            : repeatCount(5)
+            , math(false)
+            , traceFile(nullptr)
+            , cacheDirectory(nullptr)
+        {
+        }
+
+        int repeatCount;
+        bool math;
+        const char* traceFile;
+        const char* cacheDirectory;
+        std::vector<const char*> fileNames;
+    };
+
+    bool ParseOptions( int argc, char** argv, Options* outOptions )
+    {
+        for( int aa = 1; aa < argc; ++aa )
+        {
+            const char* arg = argv[aa];
+            if( arg[0] != '-' )
+            {
+                outOptions->fileNames.push_back( arg );
+                continue;
+            }
+
+            if( strcmp( arg, "-math" ) == 0 )
+            {
+                outOptions->math = true;
+                continue;
+            }
+
+            if( aa + 1 >= argc )
+            {
+                fprintf( stderr, "Option '%s' expects a value\n", arg );
+                return false;
+            }
+
+            const char* value = argv[++aa];
+            if( strcmp( arg, "-repeat" ) == 0 )
+                outOptions->repeatCount = atoi( value );
+            else if( strcmp( arg, "-trace" ) == 0 )
+                outOptions->traceFile = value;
+            else if( strcmp( arg, "-cache" ) == 0 )
+                outOptions->cacheDirectory = value;
+            else
+            {
+                fprintf( stderr, "Unknown option '%s'\n", arg );
+                return false;
+            }
+        }
+
+        if( outOptions->fileNames.empty() && !outOptions->math )
+        {
+            fprintf( stderr, "No input files given\n" );
+            return false;
+        }
+        return outOptions->repeatCount >= 0;
+    }
+
+    // Returns the time taken, or a negative value if the compile failed.
+    double TimeCompile( spark::IContext* context, const char* fileName )
+    {
+        sparkbench::Timer timer;
+        auto module = context->CompileFile( fileName );
+        double elapsed = timer.GetElapsedMilliseconds();
+        if( module == nullptr )
+            return -1.0;
+
+        module->Release();
+
+        // Free the module now, rather than in the next compile,
+        // so that the teardown isn't counted against it.
+        context->ReclaimMemory();
+        return elapsed;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    Options options;
+    if( !ParseOptions( argc, argv, &options ) )
+    {
+        fprintf( stderr, "Usage: SparkBench [-repeat count] [-trace irTraceFile] [-cache cacheDirectory] file.spark ...\n" );
+        fprintf( stderr, "       SparkBench -math [-repeat count]\n" );
+        return 1;
+    }
+
+    if( options.math )
+        return sparkbench::RunMathBenchmarks( options.repeatCount );
+
+    auto context = SparkCreateContext();
+    context->SetModuleCacheDirectory( options.cacheDirectory );
+    context->SetIRTraceFile( options.traceFile );
+
+    printf( "%-40s %10s %10s %10s %10s\n", "file", "cold(ms)", "min(ms)", "mean(ms)", "max(ms)" );
+
+    int failureCount = 0;
+    double totalCold = 0;
+    double totalMean = 0;
+    for( auto ff = options.fileNames.begin(); ff != options.fileNames.end(); ++ff )
+    {
+        const char* fileName = *ff;
+
+        double cold = TimeCompile( context, fileName );
+        if( cold < 0 )
+        {
+            fprintf( stderr, "%s: compile failed\n", fileName );
+            ++failureCount;
+            continue;
+        }
+
+        double minimum = cold;
+        double maximum = cold;
+        double total = 0;
+        for( int rr = 0; rr < options.repeatCount; ++rr )
+        {
+            double elapsed = TimeCompile( context, fileName );
+            if( rr == 0 || elapsed < minimum )
+                minimum = elapsed;
+            if( rr == 0 || elapsed > maximum )
+                maximum = elapsed;
+            total += elapsed;
+        }
+        double mean = options.repeatCount > 0 ? total / options.repeatCount : cold;
+
+        const char* baseName = strrchr( fileName, '\\' );
+        baseName = baseName ? baseName + 1 : fileName;
+        printf( "%-40s %10.1f %10.1f %10.1f %10.1f\n", baseName, cold, minimum, mean, maximum );
+
+        totalCold += cold;
+        totalMean += mean;
+    }
+
+    printf( "%-40s %10.1f %10s %10.1f\n", "total", totalCold, "", totalMean );
+
+    context->Release();
+    return failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,335 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// MathBench.cpp
+//
+// Times the math helpers in spark.h on batches of random data,
+// next to straightforward scalar code computing the same thing,
+// and checks that the two agree. Which SIMD paths spark.h took
+// depends on the compiler options this file is built with.
+
+#include "Bench.h"
+
+#include <spark/spark.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace spark;
+
+namespace
+{
+    const size_t kBatchSize = 4096;
+    const int kPassesPerRepeat = 50;
+
+    float RandomFloat()
+    {
+        return float(rand()) / float(RAND_MAX) * 2.0f - 1.0f;
+    }
+
+    float4 RandomFloat4()
+    {
+        return float4( RandomFloat(), RandomFloat(), RandomFloat(), RandomFloat() );
+    }
+
+    float4x4 RandomFloat4x4()
+    {
+        float4x4 result;
+        for( int c = 0; c < 4; ++c )
+            result.column(c) = RandomFloat4();
+        return result;
+    }
+
+    // The reference versions.
+    float4 ScalarMul( const float4x4& left, const float4& right )
+    {
+        float4 result;
+        for( int r = 0; r < 4; ++r )
+        {
+            result[r] = left(r,0) * right.x
+                + left(r,1) * right.y
+                + left(r,2) * right.z
+                + left(r,3) * right.w;
+        }
+        return result;
+    }
+
+    float4x4 ScalarMul( const float4x4& left, const float4x4& right )
+    {
+        float4x4 result;
+        for( int r = 0; r < 4; ++r )
+        {
+            for( int c = 0; c < 4; ++c )
+            {
+                float sum = 0.0f;
+                for( int ii = 0; ii < 4; ++ii )
+                    sum += left(r,ii) * right(ii,c);
+                result(r,c) = sum;
+            }
+        }
+        return result;
+    }
+
+    float4x4 ScalarTranspose( const float4x4& value )
+    {
+        float4x4 result;
+        for( int r = 0; r < 4; ++r )
+        {
+            for( int c = 0; c < 4; ++c )
+                result(r,c) = value(c,r);
+        }
+        return result;
+    }
+
+    float3 ScalarNormalize( const float3& value )
+    {
+        float invLength = 1.0f / sqrtf( value.x*value.x + value.y*value.y + value.z*value.z );
+        return float3( value.x * invLength, value.y * invLength, value.z * invLength );
+    }
+
+    bool Near( float left, float right )
+    {
+        return fabsf( left - right ) <= 1e-4f * (1.0f + fabsf( left ) + fabsf( right ));
+    }
+
+    bool Near( const float4& left, const float4& right )
+    {
+        for( int ii = 0; ii < 4; ++ii )
+        {
+            if( !Near( left[ii], right[ii] ) )
+                return false;
+        }
+        return true;
+    }
+
+    bool Near( const float4x4& left, const float4x4& right )
+    {
+        for( int c = 0; c < 4; ++c )
+        {
+            if( !Near( left.column(c), right.column(c) ) )
+                return false;
+        }
+        return true;
+    }
+
+    bool Near( const float3& left, const float3& right )
+    {
+        return Near( left.x, right.x ) && Near( left.y, right.y ) && Near( left.z, right.z );
+    }
+
+    struct Inputs
+    {
+        Inputs()
+            : matrices(kBatchSize)
+            , otherMatrices(kBatchSize)
+            , vectors(kBatchSize)
+            , directions(kBatchSize)
+        {
+            for( size_t ii = 0; ii < kBatchSize; ++ii )
+            {
+                matrices[ii] = RandomFloat4x4();
+                otherMatrices[ii] = RandomFloat4x4();
+                vectors[ii] = RandomFloat4();
+                directions[ii] = float3( RandomFloat(), RandomFloat(), RandomFloat() + 2.0f );
+            }
+            shared = RandomFloat4x4();
+        }
+
+        std::vector<float4x4> matrices;
+        std::vector<float4x4> otherMatrices;
+        std::vector<float4> vectors;
+        std::vector<float3> directions;
+        float4x4 shared;
+    };
+
+    // Each benchmark runs one batch with the spark.h helper
+    // (simd) and one with the reference code (scalar), writing
+    // into its own output so the results can be compared.
+    struct Benchmark
+    {
+        const char* name;
+        void (*simd)( const Inputs& inputs, void* output );
+        void (*scalar)( const Inputs& inputs, void* output );
+        bool (*compare)( const void* left, const void* right );
+        size_t outputSize;
+    };
+
+    void MulVectorSimd( const Inputs& in, void* out )
+    {
+        auto result = (float4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = mul( in.matrices[ii], in.vectors[ii] );
+    }
+
+    void MulVectorScalar( const Inputs& in, void* out )
+    {
+        auto result = (float4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = ScalarMul( in.matrices[ii], in.vectors[ii] );
+    }
+
+    void MulMatrixSimd( const Inputs& in, void* out )
+    {
+        auto result = (float4x4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = in.matrices[ii] * in.otherMatrices[ii];
+    }
+
+    void MulMatrixScalar( const Inputs& in, void* out )
+    {
+        auto result = (float4x4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = ScalarMul( in.matrices[ii], in.otherMatrices[ii] );
+    }
+
+    void TransposeSimd( const Inputs& in, void* out )
+    {
+        auto result = (float4x4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = transpose( in.matrices[ii] );
+    }
+
+    void TransposeScalar( const Inputs& in, void* out )
+    {
+        auto result = (float4x4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = ScalarTranspose( in.matrices[ii] );
+    }
+
+    void NormalizeSimd( const Inputs& in, void* out )
+    {
+        auto result = (float3*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = normalize( in.directions[ii] );
+    }
+
+    void NormalizeScalar( const Inputs& in, void* out )
+    {
+        auto result = (float3*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = ScalarNormalize( in.directions[ii] );
+    }
+
+    void MulArrayVectorsSimd( const Inputs& in, void* out )
+    {
+        mulArray( in.shared, &in.vectors[0], (float4*) out, kBatchSize );
+    }
+
+    void MulArrayVectorsScalar( const Inputs& in, void* out )
+    {
+        auto result = (float4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = ScalarMul( in.shared, in.vectors[ii] );
+    }
+
+    void MulArrayMatricesSimd( const Inputs& in, void* out )
+    {
+        mulArray( &in.matrices[0], in.shared, (float4x4*) out, kBatchSize );
+    }
+
+    void MulArrayMatricesScalar( const Inputs& in, void* out )
+    {
+        auto result = (float4x4*) out;
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+            result[ii] = ScalarMul( in.matrices[ii], in.shared );
+    }
+
+    template<typename T>
+    bool CompareAll( const void* left, const void* right )
+    {
+        for( size_t ii = 0; ii < kBatchSize; ++ii )
+        {
+            if( !Near( ((const T*) left)[ii], ((const T*) right)[ii] ) )
+                return false;
+        }
+        return true;
+    }
+
+    const Benchmark kBenchmarks[] =
+    {
+        { "mul(float4x4, float4)", &MulVectorSimd, &MulVectorScalar, &CompareAll<float4>, sizeof(float4) },
+        { "float4x4 * float4x4", &MulMatrixSimd, &MulMatrixScalar, &CompareAll<float4x4>, sizeof(float4x4) },
+        { "transpose(float4x4)", &TransposeSimd, &TransposeScalar, &CompareAll<float4x4>, sizeof(float4x4) },
+        { "normalize(float3)", &NormalizeSimd, &NormalizeScalar, &CompareAll<float3>, sizeof(float3) },
+        { "mulArray(float4x4, float4[])", &MulArrayVectorsSimd, &MulArrayVectorsScalar, &CompareAll<float4>, sizeof(float4) },
+        { "mulArray(float4x4[], float4x4)", &MulArrayMatricesSimd, &MulArrayMatricesScalar, &CompareAll<float4x4>, sizeof(float4x4) },
+    };
+
+    // Best time per element over the repeats, in nanoseconds.
+    double TimeBatches(
+        void (*func)( const Inputs& inputs, void* output ),
+        const Inputs& inputs,
+        void* output,
+        int repeatCount )
+    {
+        double best = 0;
+        for( int rr = 0; rr < repeatCount; ++rr )
+        {
+            sparkbench::Timer timer;
+            for( int pp = 0; pp < kPassesPerRepeat; ++pp )
+                func( inputs, output );
+            double elapsed = timer.GetElapsedMilliseconds();
+            if( rr == 0 || elapsed < best )
+                best = elapsed;
+        }
+        return best * 1e6 / (double(kPassesPerRepeat) * kBatchSize);
+    }
+}
+
+int sparkbench::RunMathBenchmarks( int repeatCount )
+{
+    if( repeatCount < 1 )
+        repeatCount = 1;
+
+#if defined(SPARK_SIMD_FMA)
+    const char* level = "SSE2 + FMA";
+#elif defined(SPARK_SIMD_SSE4_1)
+    const char* level = "SSE4.1";
+#elif defined(SPARK_SIMD_SSE2)
+    const char* level = "SSE2";
+#else
+    const char* level = "none (scalar)";
+#endif
+    printf( "spark.h SIMD: %s\n", level );
+    printf( "%-32s %12s %12s %8s\n", "operation", "spark(ns)", "scalar(ns)", "speedup" );
+
+    Inputs inputs;
+    std::vector<float4x4> simdOutput(kBatchSize);
+    std::vector<float4x4> scalarOutput(kBatchSize);
+
+    int mismatchCount = 0;
+    const size_t benchmarkCount = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+    for( size_t bb = 0; bb < benchmarkCount; ++bb )
+    {
+        const Benchmark& benchmark = kBenchmarks[bb];
+
+        double simd = TimeBatches( benchmark.simd, inputs, &simdOutput[0], repeatCount );
+        double scalar = TimeBatches( benchmark.scalar, inputs, &scalarOutput[0], repeatCount );
+
+        bool match = benchmark.compare( &simdOutput[0], &scalarOutput[0] );
+        if( !match )
+            ++mismatchCount;
+
+        printf( "%-32s %12.2f %12.2f %7.2fx%s\n",
+            benchmark.name,
+            simd,
+            scalar,
+            scalar / simd,
+            match ? "" : "  MISMATCH" );
+    }
+
+    return mismatchCount == 0 ? 0 : 1;
+}
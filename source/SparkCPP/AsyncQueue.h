@@ -0,0 +1,293 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// AsyncQueue.h
+#pragma once
+
+#include <Windows.h>
+#include <process.h>
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include <spark/context.h>
+
+namespace spark
+{
+    class AsyncQueue;
+
+    // A compile queued on a context's AsyncQueue. The status is
+    // guarded by the queue's lock; the results are written by
+    // Execute before the request is marked completed.
+    class AsyncRequest : public IAsyncRequest
+    {
+    public:
+        AsyncRequest(
+            IContext* context,
+            AsyncQueue* queue,
+            int priority )
+            : _referenceCount(1)
+            , _context(context)
+            , _queue(queue)
+            , _status(kAsyncStatus_Pending)
+            , _priority(priority)
+        {
+            // Keep the context (and so the queue) alive for as
+            // long as anybody can still call into the request.
+            _context->Acquire();
+        }
+
+        virtual void Acquire()
+        {
+            ::InterlockedIncrement( &_referenceCount );
+        }
+
+        virtual void Release()
+        {
+            if( ::InterlockedDecrement( &_referenceCount ) != 0 )
+                return;
+
+            auto context = _context;
+            delete this;
+            context->Release();
+        }
+
+        virtual AsyncStatus SPARK_CALL GetStatus();
+        virtual AsyncStatus SPARK_CALL Wait();
+        virtual bool SPARK_CALL Cancel();
+        virtual void SPARK_CALL SetPriority( int priority );
+
+        virtual IModule* SPARK_CALL GetModule() { return nullptr; }
+        virtual IShaderClass* SPARK_CALL GetShaderClass() { return nullptr; }
+
+        // Do the actual work, on the queue's worker thread.
+        virtual void Execute() = 0;
+
+    protected:
+        virtual ~AsyncRequest() {}
+
+    private:
+        friend class AsyncQueue;
+
+        volatile LONG _referenceCount;
+        IContext* _context;
+        AsyncQueue* _queue;
+        AsyncStatus _status;
+        int _priority;
+    };
+
+    // Runs the async requests for a context, one at a time, on a
+    // worker thread that is started when requests are queued and
+    // exits once the queue is empty. The worker holds a reference
+    // to the context while it runs.
+    //
+    // The pending list is expected to be short, and is kept in
+    // submission order, so picking the next request is just a
+    // scan; this lets priorities change while requests wait.
+    class AsyncQueue
+    {
+    public:
+        AsyncQueue()
+            : _owner(nullptr)
+            , _workerRunning(false)
+        {
+            ::InitializeSRWLock( &_lock );
+            ::InitializeConditionVariable( &_changed );
+        }
+
+        void SetOwner( IContext* owner )
+        {
+            _owner = owner;
+        }
+
+        // Queue a request, taking a reference to it until it
+        // has run or been cancelled.
+        void Submit(
+            AsyncRequest* request )
+        {
+            request->Acquire();
+
+            ::AcquireSRWLockExclusive( &_lock );
+            _pending.push_back( request );
+            bool startWorker = !_workerRunning;
+            _workerRunning = true;
+            ::ReleaseSRWLockExclusive( &_lock );
+
+            if( !startWorker )
+                return;
+
+            _owner->Acquire();
+            auto thread = (HANDLE) _beginthreadex( nullptr, 0, &WorkerMain, this, 0, nullptr );
+            if( thread != nullptr )
+            {
+                ::CloseHandle( thread );
+                return;
+            }
+
+            // No thread; drain the queue right here instead.
+            RunWorker();
+        }
+
+        AsyncStatus GetStatus(
+            AsyncRequest* request )
+        {
+            ::AcquireSRWLockShared( &_lock );
+            auto result = request->_status;
+            ::ReleaseSRWLockShared( &_lock );
+            return result;
+        }
+
+        AsyncStatus Wait(
+            AsyncRequest* request )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            if( request->_status == kAsyncStatus_Pending )
+                request->_priority = INT_MAX;
+            while( request->_status == kAsyncStatus_Pending
+                || request->_status == kAsyncStatus_Running )
+            {
+                ::SleepConditionVariableSRW( &_changed, &_lock, INFINITE, 0 );
+            }
+            auto result = request->_status;
+            ::ReleaseSRWLockExclusive( &_lock );
+            return result;
+        }
+
+        bool Cancel(
+            AsyncRequest* request )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            bool cancelled = request->_status == kAsyncStatus_Pending;
+            if( cancelled )
+            {
+                _pending.erase( std::find( _pending.begin(), _pending.end(), request ) );
+                request->_status = kAsyncStatus_Cancelled;
+            }
+            ::ReleaseSRWLockExclusive( &_lock );
+
+            if( !cancelled )
+                return false;
+
+            ::WakeAllConditionVariable( &_changed );
+
+            // The caller still holds a reference, so this
+            // won't destroy the request.
+            request->Release();
+            return true;
+        }
+
+        void SetPriority(
+            AsyncRequest* request,
+            int priority )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            if( request->_status == kAsyncStatus_Pending )
+                request->_priority = priority;
+            ::ReleaseSRWLockExclusive( &_lock );
+        }
+
+    private:
+        static unsigned __stdcall WorkerMain(
+            void* param )
+        {
+            ((AsyncQueue*) param)->RunWorker();
+            return 0;
+        }
+
+        void RunWorker()
+        {
+            for(;;)
+            {
+                ::AcquireSRWLockExclusive( &_lock );
+                auto request = PopNext();
+                if( request == nullptr )
+                    _workerRunning = false;
+                else
+                    request->_status = kAsyncStatus_Running;
+                ::ReleaseSRWLockExclusive( &_lock );
+
+                if( request == nullptr )
+                    break;
+
+                // A compile that throws is treated as one that
+                // failed, rather than taking down the worker.
+                try
+                {
+                    request->Execute();
+                }
+                catch( ... )
+                {
+                }
+
+                ::AcquireSRWLockExclusive( &_lock );
+                request->_status = kAsyncStatus_Completed;
+                ::ReleaseSRWLockExclusive( &_lock );
+                ::WakeAllConditionVariable( &_changed );
+
+                request->Release();
+            }
+
+            // This may destroy the context, and this queue with
+            // it, so it must be the last thing the worker does.
+            _owner->Release();
+        }
+
+        // Take the highest-priority pending request (the
+        // oldest, among equals) off the list.
+        AsyncRequest* PopNext()
+        {
+            if( _pending.empty() )
+                return nullptr;
+
+            auto best = _pending.begin();
+            for( auto ii = best + 1, ie = _pending.end(); ii != ie; ++ii )
+            {
+                if( (*ii)->_priority > (*best)->_priority )
+                    best = ii;
+            }
+
+            auto result = *best;
+            _pending.erase( best );
+            return result;
+        }
+
+        IContext* _owner;
+        SRWLOCK _lock;
+        CONDITION_VARIABLE _changed;
+        std::vector<AsyncRequest*> _pending;
+        bool _workerRunning;
+    };
+
+    inline AsyncStatus SPARK_CALL AsyncRequest::GetStatus()
+    {
+        return _queue->GetStatus( this );
+    }
+
+    inline AsyncStatus SPARK_CALL AsyncRequest::Wait()
+    {
+        return _queue->Wait( this );
+    }
+
+    inline bool SPARK_CALL AsyncRequest::Cancel()
+    {
+        return _queue->Cancel( this );
+    }
+
+    inline void SPARK_CALL AsyncRequest::SetPriority(
+        int priority )
+    {
+        _queue->SetPriority( this, priority );
+    }
+}
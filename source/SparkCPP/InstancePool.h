@@ -0,0 +1,187 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// InstancePool.h
+#pragma once
+
+#include <Windows.h>
+#include <intrin.h>
+#include <malloc.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace spark
+{
+    class ShaderClass;
+
+    // Placed after each instance, so that releasing the instance
+    // can find the class (and pool slot) it came from. Keeping it
+    // out of the front of the slot leaves the instance itself on
+    // a cache-line boundary.
+    struct InstanceHeader
+    {
+        ShaderClass* shaderClass;
+        unsigned int slab;
+        unsigned int slot;
+    };
+
+    static const size_t kInstanceHeaderAlignment = 16;
+    static const size_t kCacheLineSize = 64;
+
+    // Storage for the instances of a single shader class. Slots
+    // are rounded up to whole cache lines and grouped into slabs,
+    // so instances never share a line with one another, and a
+    // walk over the live instances touches memory in order.
+    //
+    // Callers are responsible for locking.
+    class InstancePool
+    {
+    public:
+        enum { kSlotsPerSlab = 64 };
+
+        InstancePool( size_t instanceSize )
+            : _headerOffset( GetHeaderOffset( instanceSize ) )
+            , _slotSize( (GetHeaderOffset( instanceSize ) + sizeof(InstanceHeader) + kCacheLineSize - 1) & ~(kCacheLineSize - 1) )
+            , _firstOpenSlab(0)
+            , _liveCount(0)
+        {}
+
+        ~InstancePool()
+        {
+            for( auto ii = _slabs.begin(), ie = _slabs.end(); ii != ie; ++ii )
+                _aligned_free( ii->memory );
+        }
+
+        // Find the header of an instance of the given size (which
+        // the instance's class desc records), without the pool.
+        static InstanceHeader* FindHeader( void* instance, size_t instanceSize )
+        {
+            return (InstanceHeader*) (((unsigned char*) instance) + GetHeaderOffset( instanceSize ));
+        }
+
+        InstanceHeader* GetHeader( void* instance ) const
+        {
+            return (InstanceHeader*) (((unsigned char*) instance) + _headerOffset);
+        }
+
+        size_t GetSlotSize() const { return _slotSize; }
+
+        // Reserve a zeroed slot, preferring the lowest free address
+        // so that the pool stays compact, and return the instance
+        // at its start. The instance is not reported by GetLive
+        // until it has been marked live.
+        void* Allocate()
+        {
+            while( _firstOpenSlab < _slabs.size()
+                && _slabs[_firstOpenSlab].reserved == ~0ULL )
+            {
+                ++_firstOpenSlab;
+            }
+
+            if( _firstOpenSlab == _slabs.size() )
+            {
+                Slab slab;
+                slab.memory = (unsigned char*) _aligned_malloc( _slotSize * kSlotsPerSlab, kCacheLineSize );
+                slab.reserved = 0;
+                slab.live = 0;
+                _slabs.push_back( slab );
+            }
+
+            auto& slab = _slabs[_firstOpenSlab];
+            unsigned int slot = FindFirstSet( ~slab.reserved );
+            slab.reserved |= Bit( slot );
+
+            void* instance = slab.memory + slot * _slotSize;
+            memset( instance, 0, _slotSize );
+
+            auto header = GetHeader( instance );
+            header->slab = (unsigned int) _firstOpenSlab;
+            header->slot = slot;
+            return instance;
+        }
+
+        void Free( void* instance )
+        {
+            auto header = GetHeader( instance );
+            _slabs[header->slab].reserved &= ~Bit( header->slot );
+            _firstOpenSlab = std::min( _firstOpenSlab, (size_t) header->slab );
+        }
+
+        void MarkLive( void* instance )
+        {
+            auto header = GetHeader( instance );
+            _slabs[header->slab].live |= Bit( header->slot );
+            ++_liveCount;
+        }
+
+        void MarkDead( void* instance )
+        {
+            auto header = GetHeader( instance );
+            _slabs[header->slab].live &= ~Bit( header->slot );
+            --_liveCount;
+        }
+
+        size_t GetLive( void** outInstances, size_t capacity )
+        {
+            size_t count = 0;
+            for( auto ii = _slabs.begin(), ie = _slabs.end(); ii != ie && count < capacity; ++ii )
+            {
+                auto live = ii->live;
+                while( live != 0 && count < capacity )
+                {
+                    unsigned int slot = FindFirstSet( live );
+                    live &= live - 1;
+                    outInstances[count++] = ii->memory + slot * _slotSize;
+                }
+            }
+            return _liveCount;
+        }
+
+    private:
+        struct Slab
+        {
+            unsigned char* memory;
+            unsigned __int64 reserved;
+            unsigned __int64 live;
+        };
+
+        static size_t GetHeaderOffset( size_t instanceSize )
+        {
+            return (instanceSize + kInstanceHeaderAlignment - 1) & ~(kInstanceHeaderAlignment - 1);
+        }
+
+        static unsigned __int64 Bit( unsigned int slot )
+        {
+            return 1ULL << slot;
+        }
+
+        // 32-bit targets lack _BitScanForward64
+        static unsigned int FindFirstSet( unsigned __int64 mask )
+        {
+            unsigned long index;
+            if( _BitScanForward( &index, (unsigned long) mask ) )
+                return index;
+            _BitScanForward( &index, (unsigned long) (mask >> 32) );
+            return index + 32;
+        }
+
+        std::vector<Slab> _slabs;
+        size_t _headerOffset;
+        size_t _slotSize;
+        size_t _firstOpenSlab;
+        size_t _liveCount;
+    };
+}
@@ -189,12 +189,51 @@ namespace Spark
                         afterBlock->begin()));
             }
 
+            void LlvmEmitBlock::If(
+                IEmitVal^ condition,
+                Action<IEmitBlock^>^ emitThen )
+            {
+                Debug("If");
+                auto llvmCondition = GetLlvmVal(condition);
+                if( !llvmCondition->getType()->isIntegerTy(1) )
+                {
+                    llvmCondition = _llvmBuilder->CreateICmpNE(
+                        llvmCondition,
+                        llvm::Constant::getNullValue(llvmCondition->getType()));
+                }
+
+                llvm::BasicBlock* thenBlock = llvm::BasicBlock::Create(
+                    LlvmContext,
+                    "then",
+                    _method->LlvmFunction );
+
+                llvm::BasicBlock* endBlock = llvm::BasicBlock::Create(
+                    LlvmContext,
+                    "endif",
+                    _method->LlvmFunction );
+
+                _llvmBuilder->CreateCondBr( llvmCondition, thenBlock, endBlock );
+
+                llvm::IRBuilder<> thenBuilder( thenBlock );
+                emitThen( gcnew LlvmEmitBlock(
+                    _method,
+                    _llvmEntryBlock,
+                    &thenBuilder ) );
+
+                // The then-builder may have moved on to the
+                // end of a nested If, so branch from wherever
+                // it ended up.
+                thenBuilder.CreateBr( endBlock );
+
+                _llvmBuilder->SetInsertPoint( endBlock );
+            }
+
             IEmitVal^ LlvmEmitBlock::Local(
                 String^ name,
                 IEmitType^ type )
             {
                 Debug("Local");
-                llvm::IRBuilder<> entryBuilder( _llvmEntryBlock );
+                llvm::IRBuilder<> entryBuilder( _llvmEntryBlock, _llvmEntryBlock->begin() );
                 auto llvmLocal = entryBuilder.CreateAlloca(
                     ((LlvmEmitType^) type)->LlvmType,
                     nullptr,
@@ -344,6 +383,26 @@ namespace Spark
                     (const void*) dataPtr);
             }
 
+            void LlvmEmitTarget::Trace(
+                const std::string& message )
+            {
+                if( _trace == nullptr )
+                    return;
+
+                _trace->Append(gcnew String(message.c_str()));
+                _trace->Append('\n');
+            }
+
+            void LlvmEmitTarget::FlushTrace(
+                String^ path )
+            {
+                if( _trace == nullptr || _trace->Length == 0 )
+                    return;
+
+                System::IO::File::AppendAllText(path, _trace->ToString());
+                _trace->Length = 0;
+            }
+
             IEmitVal^ LlvmEmitBlock::GetArrow(
                 IEmitVal^ obj,
                 IEmitField^ field)
@@ -366,16 +425,9 @@ namespace Spark
                 auto llvmFieldPointer = Arrow(obj, field);
                 auto llvmVal = GetLlvmVal(val);
 
-                {
-                    std::ofstream out("dump.txt");
-                    llvm::raw_os_ostream stream(out);
-                    llvmFieldPointer->print(stream);
-                    out << std::endl;
-                    llvmVal->print(stream);
-                    out << std::endl;
-                }
-
                 Debug("SetArrow");
+                Debug(llvmFieldPointer);
+                Debug(llvmVal);
                 _llvmBuilder->CreateStore(
                     llvmVal,
                     llvmFieldPointer);
@@ -488,7 +540,7 @@ namespace Spark
                 Debug(llvmElementType);
                 Debug(llvmArrayType);
 
-                llvm::IRBuilder<> entryBuilder(_llvmEntryBlock);
+                llvm::IRBuilder<> entryBuilder(_llvmEntryBlock, _llvmEntryBlock->begin());
                 auto llvmArrayVar = entryBuilder.CreateAlloca(llvmArrayType);
 
                 Debug(llvmArrayVar);
@@ -537,7 +589,7 @@ namespace Spark
                 auto structType = (LlvmEmitType^) TargetLlvm->GetBuiltinType(structTypeName);
                 auto llvmStructType = structType->LlvmType;
 
-                llvm::IRBuilder<> entryBuilder(_llvmEntryBlock);
+                llvm::IRBuilder<> entryBuilder(_llvmEntryBlock, _llvmEntryBlock->begin());
                 auto llvmStructVar = entryBuilder.CreateAlloca(llvmStructType);
 
                 auto llvmU32Ty = llvm::Type::getInt32Ty(LlvmContext);
@@ -671,12 +723,40 @@ namespace Spark
                 }
                 else// if( format == "spark::d3d11::DrawIndexed16" )
                 {
+                    // As in the C++ target, a template may refer to the
+                    // enclosing method's `device` parameter by name.
+                    if( format->Contains("(device") )
+                    {
+                        auto device = _method->FindParameter("device");
+                        if( device == nullptr )
+                            throw gcnew NotImplementedException();
+
+                        auto argsWithDevice = gcnew array<IEmitVal^>(args->Length + 1);
+                        argsWithDevice[0] = device;
+                        args->CopyTo(argsWithDevice, 1);
+                        args = argsWithDevice;
+                    }
+
                     auto llvmBuiltin = _method->Module->GetBuiltinFunction(format, type, args);
+                    auto llvmBuiltinType = llvmBuiltin->getFunctionType();
                     
                     std::vector<llvm::Value*> llvmArgs;
                     for each( IEmitVal^ a in args )
                     {
-                        llvmArgs.push_back( GetLlvmVal(a) );
+                        // Pointer arguments are all passed as void
+                        // pointers (see GetBuiltinFunction), so that
+                        // call sites may pass e.g. arrays of different
+                        // lengths to the same builtin.
+                        auto llvmArgVal = GetLlvmVal(a);
+                        auto llvmParamType = llvmBuiltinType->getParamType( llvmArgs.size() );
+                        if( llvmArgVal->getType() != llvmParamType
+                            && llvmArgVal->getType()->isPointerTy() )
+                        {
+                            llvmArgVal = _llvmBuilder->CreateBitCast(
+                                llvmArgVal,
+                                llvmParamType);
+                        }
+                        llvmArgs.push_back( llvmArgVal );
                     }
 
                     auto llvmCall = _llvmBuilder->CreateCall(
@@ -739,14 +819,7 @@ namespace Spark
 
                 auto llvmObj = GetLlvmVal(obj);
                 auto fieldIndex = ((LlvmEmitField^) field)->FieldIndex;
-/*
-                {
-                std::ofstream dumpFile("./dump.txt");
-                llvm::raw_os_ostream dumpStream(dumpFile);
-                dumpStream << "obj: " << *llvmObj;
-                dumpStream << "type: " << *(llvmObj->getType());
-                }
-*/
+
                 auto llvmU32Ty = llvm::Type::getInt32Ty(LlvmContext);
                 static const int kIndexCount = 2;
                 llvm::Value* indices[2] = {
@@ -764,6 +837,8 @@ namespace Spark
 
             void LlvmEmitBlock::Debug(const std::string& message)
             {
+                TargetLlvm->Trace(message);
+
                 /*/
                 OutputDebugStringA(message.c_str());
                 OutputDebugStringA("\n");
@@ -784,6 +859,9 @@ namespace Spark
 
             void LlvmEmitBlock::Debug(const llvm::Type* type)
             {
+                if( !TargetLlvm->IsTracing )
+                    return;
+
                 std::ostringstream out;
                 llvm::raw_os_ostream stream(out);
                 type->print(stream);
@@ -792,6 +870,9 @@ namespace Spark
 
             void LlvmEmitBlock::Debug(const llvm::Value* val)
             {
+                if( !TargetLlvm->IsTracing )
+                    return;
+
                 std::ostringstream out;
                 llvm::raw_os_ostream stream(out);
                 val->print(stream);
@@ -831,6 +912,18 @@ namespace Spark
                 return parameter;
             }
 
+            IEmitVal^ LlvmEmitMethod::FindParameter(
+                String^ name )
+            {
+                auto ignored = LlvmFunction;
+                for each( LlvmEmitVal^ p in _parameters )
+                {
+                    if( p->Name == name )
+                        return p;
+                }
+                return nullptr;
+            }
+
             IEmitVal^ LlvmEmitMethod::ThisParameter::get()
             {
                 auto ignored = LlvmFunction;
@@ -929,16 +1022,18 @@ namespace Spark
                     "entry",
                     _llvmFunction);
 
+                auto llvmBuilder = new llvm::IRBuilder<>(llvmEntryBlock);
                 auto emitEntryBlock = gcnew LlvmEmitBlock(
                     this,
                     llvmEntryBlock,
-                    new llvm::IRBuilder<>(llvmEntryBlock));
+                    llvmBuilder);
 
                 ((Spark::Emit::LazyEmitBlock^) _entryBlock)->ApplyTo( emitEntryBlock );
 
                 // \todo: proper tail block!!!
-                llvm::IRBuilder<> tailBuilder(llvmEntryBlock);
-                tailBuilder.CreateRetVoid();
+                // (Any If will have moved the builder on from
+                // the entry block, so return from where it is.)
+                llvmBuilder->CreateRetVoid();
             }
 
             // LlvmEmitClass
@@ -1037,10 +1132,6 @@ namespace Spark
             {
                 if( _structType == nullptr )
                 {
-//                    std::ofstream dumpFile("./dump.txt");
-
-//                    dumpFile << std::string(NativeString(_name)).c_str();
-
                     std::vector<const llvm::Type*> fieldTypes;
                     UInt32 fieldIndex = 0;
 
@@ -1322,10 +1413,15 @@ namespace Spark
 
                 auto llvmResultType = ((ILlvmEmitType^) resultType)->LlvmType;
 
+                auto llvmVoidPointerType = ((LlvmEmitType^) _target->GetBuiltinType("v*"))->LlvmType;
+
                 std::vector<const llvm::Type*> llvmParamTypes;
                 for each( IEmitVal^ a in args )
                 {
-                    llvmParamTypes.push_back( ((ILlvmEmitType^) a->Type)->LlvmType );
+                    auto llvmParamType = ((ILlvmEmitType^) a->Type)->LlvmType;
+                    if( llvmParamType->isPointerTy() )
+                        llvmParamType = llvmVoidPointerType;
+                    llvmParamTypes.push_back( llvmParamType );
                 }
 
                 auto llvmFunctionType = llvm::FunctionType::get(
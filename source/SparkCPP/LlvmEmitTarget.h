@@ -163,6 +163,10 @@ namespace Spark
 
                 virtual IEmitBlock^ InsertBlock();
 
+                virtual void If(
+                    IEmitVal^ condition,
+                    Action<IEmitBlock^>^ emitThen );
+
                 virtual IEmitVal^ Local(
                     String^ name,
                     IEmitType^ type );
@@ -262,6 +266,9 @@ namespace Spark
                     IEmitType^ type,
                     String^ name );
 
+                IEmitVal^ FindParameter(
+                    String^ name );
+
                 virtual property IEmitVal^ ThisParameter
                 {
                     IEmitVal^ get();
@@ -652,6 +659,31 @@ namespace Spark
                     _callback = callback;
                 }
 
+                // Opt-in tracing of the IR built during emission.
+                // Messages are buffered in memory, and written out
+                // in one go by FlushTrace.
+                void EnableTrace()
+                {
+                    if( _trace == nullptr )
+                        _trace = gcnew System::Text::StringBuilder();
+                }
+
+                void DisableTrace()
+                {
+                    _trace = nullptr;
+                }
+
+                property bool IsTracing
+                {
+                    bool get() { return _trace != nullptr; }
+                }
+
+                void Trace(
+                    const std::string& message );
+
+                void FlushTrace(
+                    String^ path );
+
             private:
                 const llvm::Type* AddBuiltinType(
                     String^ name,
@@ -676,6 +708,7 @@ namespace Spark
 
                 LlvmEmitType^ _voidType;
                 spark::IShaderBytecodeCallback* _callback;
+                System::Text::StringBuilder^ _trace;
             };
         }
 
@@ -0,0 +1,251 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// ModuleCache.cpp
+
+#define NOMINMAX
+#include <Windows.h>
+
+#define SPARK_DLL extern "C" __declspec(dllexport)
+
+#pragma unmanaged
+#include <llvm/LLVMContext.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/system_error.h>
+
+#include <fstream>
+#pragma managed
+
+#pragma comment(lib, "LLVMBitReader.lib")
+#pragma comment(lib, "LLVMBitWriter.lib")
+
+#include "ModuleCache.h"
+
+namespace spark
+{
+    static const unsigned int kModuleCacheEntryMagic = 'SPKC';
+
+    void SPARK_CALL RecordingBytecodeCallback::ProcessBytecode(
+        const char* stageName,
+        unsigned int dataSize,
+        const void* data )
+    {
+        ModuleCacheBytecode bytecode;
+        bytecode.stageName = stageName;
+        bytecode.data.assign(
+            (const unsigned char*) data,
+            (const unsigned char*) data + dataSize );
+        _entry->bytecode.push_back( bytecode );
+
+        if( _inner != nullptr )
+            _inner->ProcessBytecode( stageName, dataSize, data );
+    }
+
+    ModuleCache::ModuleCache()
+        : _hitCount(0)
+        , _missCount(0)
+    {
+    }
+
+    void ModuleCache::SetDirectory( const char* path )
+    {
+        _directory = path ? path : "";
+        if( _directory.empty() )
+            return;
+
+        // Directory may well exist already, so ignore failure here
+        // and let the individual reads/writes fail instead.
+        ::CreateDirectoryA( _directory.c_str(), NULL );
+    }
+
+    std::string ModuleCache::GetPath( const std::string& key, const char* extension )
+    {
+        return _directory + "\\" + key + extension;
+    }
+
+    llvm::Module* ModuleCache::Load(
+        const std::string& key,
+        ModuleCacheEntry* outEntry )
+    {
+        if( !IsEnabled() )
+            return nullptr;
+
+        ModuleCacheEntry entry;
+        if( !ReadEntry( GetPath( key, ".entry" ), &entry ) )
+        {
+            ::InterlockedIncrement( &_missCount );
+            return nullptr;
+        }
+
+        llvm::OwningPtr<llvm::MemoryBuffer> buffer;
+        if( llvm::MemoryBuffer::getFile( GetPath( key, ".bc" ), buffer ) )
+        {
+            ::InterlockedIncrement( &_missCount );
+            return nullptr;
+        }
+
+        std::string errorStr;
+        llvm::Module* result = llvm::ParseBitcodeFile(
+            buffer.get(),
+            llvm::getGlobalContext(),
+            &errorStr );
+        if( result == nullptr )
+        {
+            OutputDebugStringA( "Spark: discarding bad module cache entry: " );
+            OutputDebugStringA( errorStr.c_str() );
+            OutputDebugStringA( "\n" );
+
+            ::InterlockedIncrement( &_missCount );
+            return nullptr;
+        }
+
+        ::InterlockedIncrement( &_hitCount );
+        if( outEntry != nullptr )
+            *outEntry = entry;
+        return result;
+    }
+
+    void ModuleCache::Store(
+        const std::string& key,
+        const llvm::Module* module,
+        const ModuleCacheEntry& entry )
+    {
+        if( !IsEnabled() )
+            return;
+
+        // Write the bitcode under a temporary name and only move it
+        // into place once it is complete, so that a concurrent (or
+        // crashed) writer can never leave a truncated entry behind.
+        std::string bitcodePath = GetPath( key, ".bc" );
+        std::string tempPath = bitcodePath + ".tmp";
+        {
+            std::string errorStr;
+            llvm::raw_fd_ostream out( tempPath.c_str(), errorStr, llvm::raw_fd_ostream::F_Binary );
+            if( !errorStr.empty() )
+                return;
+
+            llvm::WriteBitcodeToFile( module, out );
+            out.close();
+            if( out.has_error() )
+            {
+                out.clear_error();
+                ::DeleteFileA( tempPath.c_str() );
+                return;
+            }
+        }
+
+        if( !WriteEntry( GetPath( key, ".entry" ), entry ) )
+        {
+            ::DeleteFileA( tempPath.c_str() );
+            return;
+        }
+
+        ::MoveFileExA( tempPath.c_str(), bitcodePath.c_str(), MOVEFILE_REPLACE_EXISTING );
+    }
+
+    void ModuleCache::GetStats( ModuleCacheStats* outStats )
+    {
+        outStats->hitCount = _hitCount;
+        outStats->missCount = _missCount;
+    }
+
+    static bool ReadU32( std::istream& in, unsigned int* outValue )
+    {
+        in.read( (char*) outValue, sizeof(*outValue) );
+        return in.good();
+    }
+
+    static bool ReadString( std::istream& in, std::string* outValue )
+    {
+        unsigned int size = 0;
+        if( !ReadU32( in, &size ) )
+            return false;
+        outValue->resize( size );
+        if( size != 0 )
+            in.read( &(*outValue)[0], size );
+        return in.good();
+    }
+
+    static void WriteU32( std::ostream& out, unsigned int value )
+    {
+        out.write( (const char*) &value, sizeof(value) );
+    }
+
+    static void WriteString( std::ostream& out, const std::string& value )
+    {
+        WriteU32( out, (unsigned int) value.size() );
+        out.write( value.data(), value.size() );
+    }
+
+    bool ModuleCache::ReadEntry( const std::string& path, ModuleCacheEntry* outEntry )
+    {
+        std::ifstream in( path.c_str(), std::ios::in | std::ios::binary );
+        if( !in )
+            return false;
+
+        unsigned int magic = 0;
+        if( !ReadU32( in, &magic ) || magic != kModuleCacheEntryMagic )
+            return false;
+
+        if( !ReadString( in, &outEntry->className ) )
+            return false;
+
+        unsigned int count = 0;
+        if( !ReadU32( in, &count ) )
+            return false;
+
+        outEntry->bytecode.resize( count );
+        for( unsigned int ii = 0; ii < count; ++ii )
+        {
+            auto& bytecode = outEntry->bytecode[ii];
+            if( !ReadString( in, &bytecode.stageName ) )
+                return false;
+
+            unsigned int size = 0;
+            if( !ReadU32( in, &size ) )
+                return false;
+            bytecode.data.resize( size );
+            if( size != 0 )
+                in.read( (char*) &bytecode.data[0], size );
+            if( !in.good() )
+                return false;
+        }
+
+        return true;
+    }
+
+    bool ModuleCache::WriteEntry( const std::string& path, const ModuleCacheEntry& entry )
+    {
+        std::ofstream out( path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+        if( !out )
+            return false;
+
+        WriteU32( out, kModuleCacheEntryMagic );
+        WriteString( out, entry.className );
+        WriteU32( out, (unsigned int) entry.bytecode.size() );
+        for( auto ii = entry.bytecode.begin(), ie = entry.bytecode.end(); ii != ie; ++ii )
+        {
+            WriteString( out, ii->stageName );
+            WriteU32( out, (unsigned int) ii->data.size() );
+            if( !ii->data.empty() )
+                out.write( (const char*) &ii->data[0], ii->data.size() );
+        }
+
+        out.close();
+        return !out.fail();
+    }
+}
@@ -0,0 +1,101 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// ModuleCache.h
+#pragma once
+
+#pragma unmanaged
+#include <llvm/Module.h>
+#pragma managed
+
+#include <string>
+#include <vector>
+
+#include "../include/spark/context.h"
+
+namespace spark
+{
+    // A shader bytecode blob produced while compiling a module,
+    // saved alongside the bitcode so that an application's
+    // IShaderBytecodeCallback still sees it on a cache hit.
+    struct ModuleCacheBytecode
+    {
+        std::string stageName;
+        std::vector<unsigned char> data;
+    };
+
+    struct ModuleCacheEntry
+    {
+        std::string className;
+        std::vector<ModuleCacheBytecode> bytecode;
+    };
+
+    // Forwards bytecode to an (optional) user callback, while
+    // keeping a copy to write into the cache.
+    class RecordingBytecodeCallback : public IShaderBytecodeCallback
+    {
+    public:
+        RecordingBytecodeCallback(
+            ModuleCacheEntry* entry,
+            IShaderBytecodeCallback* inner )
+            : _entry(entry)
+            , _inner(inner)
+        {}
+
+        virtual void SPARK_CALL ProcessBytecode(
+            const char* stageName,
+            unsigned int dataSize,
+            const void* data );
+
+    private:
+        ModuleCacheEntry* _entry;
+        IShaderBytecodeCallback* _inner;
+    };
+
+    // Content-addressed on-disk cache of optimized modules.
+    // Each entry is a pair of files in the cache directory:
+    //   <key>.bc    - LLVM bitcode, after optimization
+    //   <key>.entry - class name and shader bytecode blobs
+    // Keys come from Spark::Compiler::ModuleCacheKey.
+    class ModuleCache
+    {
+    public:
+        ModuleCache();
+
+        void SetDirectory( const char* path );
+        bool IsEnabled() const { return !_directory.empty(); }
+
+        // Returns nullptr (and counts a miss) if there is
+        // no usable entry for the given key.
+        llvm::Module* Load(
+            const std::string& key,
+            ModuleCacheEntry* outEntry );
+
+        void Store(
+            const std::string& key,
+            const llvm::Module* module,
+            const ModuleCacheEntry& entry );
+
+        void GetStats( ModuleCacheStats* outStats );
+
+    private:
+        std::string GetPath( const std::string& key, const char* extension );
+        bool ReadEntry( const std::string& path, ModuleCacheEntry* outEntry );
+        bool WriteEntry( const std::string& path, const ModuleCacheEntry& entry );
+
+        std::string _directory;
+        volatile long _hitCount;
+        volatile long _missCount;
+    };
+}
@@ -0,0 +1,106 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// ShaderClassTable.h
+#pragma once
+
+#include <Windows.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+namespace spark
+{
+    // The shader classes a context has handed out, so that every
+    // lookup of the same class shares one object (and so one
+    // instance pool). A class is keyed on its owner (the module it
+    // came from, or its desc for FindOrLoadShaderClass) and name.
+    //
+    // The table doesn't keep classes alive: a class removes its
+    // entry when it is destroyed. TClass needs TryAcquire, which
+    // fails once the last reference has been released, and Release.
+    template<typename TClass>
+    class ShaderClassTable
+    {
+    public:
+        typedef std::pair<const void*, std::string> Key;
+
+        ShaderClassTable()
+        {
+            ::InitializeSRWLock( &_lock );
+        }
+
+        // Returns a new reference to the class for the key, or
+        // nullptr if there is none (or it is being destroyed).
+        TClass* Find(
+            const Key& key )
+        {
+            TClass* result = nullptr;
+            ::AcquireSRWLockShared( &_lock );
+            auto ii = _entries.find( key );
+            if( ii != _entries.end() && ii->second->TryAcquire() )
+                result = ii->second;
+            ::ReleaseSRWLockShared( &_lock );
+            return result;
+        }
+
+        // Add a newly-created class, unless another thread got
+        // there first, in which case the new class is released
+        // and a reference to the existing one returned instead.
+        TClass* Intern(
+            const Key& key,
+            TClass* shaderClass )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            auto& entry = _entries[key];
+            if( entry != nullptr && entry->TryAcquire() )
+            {
+                auto existing = entry;
+                ::ReleaseSRWLockExclusive( &_lock );
+
+                shaderClass->Release();
+                return existing;
+            }
+            entry = shaderClass;
+            ::ReleaseSRWLockExclusive( &_lock );
+            return shaderClass;
+        }
+
+        // Called when a class is destroyed. The key may already
+        // have been taken over by a new class.
+        void Remove(
+            const Key& key,
+            TClass* shaderClass )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            auto ii = _entries.find( key );
+            if( ii != _entries.end() && ii->second == shaderClass )
+                _entries.erase( ii );
+            ::ReleaseSRWLockExclusive( &_lock );
+        }
+
+        size_t GetCount()
+        {
+            ::AcquireSRWLockShared( &_lock );
+            size_t count = _entries.size();
+            ::ReleaseSRWLockShared( &_lock );
+            return count;
+        }
+
+    private:
+        SRWLOCK _lock;
+        std::map<Key, TClass*> _entries;
+    };
+}
@@ -26,12 +26,20 @@
 #include <msclr/marshal.h>
 
 #include "LlvmEmitTarget.h"
+#include "AsyncQueue.h"
+#include "InstancePool.h"
+#include "ModuleCache.h"
+#include "ShaderClassTable.h"
 #include <llvm/Analysis/Verifier.h>
 #include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/PassManager.h>
 #include <llvm/Support/StandardPasses.h>
 #include <llvm/Target/TargetSelect.h>
 
+#include <algorithm>
+#include <map>
+#include <set>
 #include <fstream>
 #include <llvm/Support/raw_os_ostream.h>
 #define SPARK_SKIP_PRAGMA_LIB
@@ -62,20 +70,257 @@ static spark::d3d11::DrawSpan __stdcall spark_d3d11_DrawSpan_Create(
     return spark::d3d11::DrawSpan(indices, primitiveSpan);
 }
 
-static void __stdcall spark_DrawSpan_Bind(
-    spark::d3d11::DrawSpan span,
-    ID3D11DeviceContext* context )
+
+static void* __stdcall spark_d3d11_AcquireSharedState(
+    void* instance,
+    ID3D11Device* device )
+{
+    return spark::d3d11::AcquireSharedState( instance, device );
+}
+
+static void __stdcall spark_d3d11_ReleaseSharedState(
+    void* sharedState )
+{
+    spark::d3d11::ReleaseSharedState( sharedState );
+}
+
+static void* __stdcall spark_d3d11_CreateConstantBufferShadow(
+    UINT sizeInBytes )
+{
+    return spark::d3d11::CreateConstantBufferShadow( sizeInBytes );
+}
+
+static void __stdcall spark_d3d11_DestroyConstantBufferShadow(
+    void* shadow )
+{
+    spark::d3d11::DestroyConstantBufferShadow( shadow );
+}
+
+static void* __stdcall spark_d3d11_BeginConstantBufferUpdate(
+    ID3D11DeviceContext* context,
+    void* shadow )
+{
+    return spark::d3d11::BeginConstantBufferUpdate( context, shadow );
+}
+
+static ID3D11Buffer* __stdcall spark_d3d11_EndConstantBufferUpdate(
+    ID3D11DeviceContext* context,
+    ID3D11Buffer* buffer,
+    void* shadow )
+{
+    return spark::d3d11::EndConstantBufferUpdate( context, buffer, shadow );
+}
+
+static void __stdcall spark_d3d11_MarkConstantBufferDirty(
+    ID3D11DeviceContext* context,
+    void* shadow,
+    UINT begin,
+    UINT end )
+{
+    spark::d3d11::MarkConstantBufferDirty( context, shadow, begin, end );
+}
+
+static UINT __stdcall spark_d3d11_CheckUniformInputVersions(
+    ID3D11DeviceContext* context,
+    UINT* cachedVersion,
+    const UINT* inputVersions,
+    UINT inputCount )
+{
+    return spark::d3d11::CheckUniformInputVersions( context, cachedVersion, inputVersions, inputCount );
+}
+
+static void* __stdcall spark_d3d11_ResolveStateShadow(
+    ID3D11DeviceContext* context,
+    void* stateShadow )
+{
+    return spark::d3d11::ResolveStateShadow( context, stateShadow );
+}
+
+static void __stdcall spark_d3d11_ShadowSetShader(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    UINT stage,
+    ID3D11DeviceChild* shader )
+{
+    spark::d3d11::ShadowSetShader( context, stateShadow, stage, shader );
+}
+
+static void __stdcall spark_d3d11_ShadowSetConstantBuffers(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    UINT stage,
+    UINT startSlot,
+    UINT count,
+    ID3D11Buffer* const* buffers )
+{
+    spark::d3d11::ShadowSetConstantBuffers( context, stateShadow, stage, startSlot, count, buffers );
+}
+
+static void __stdcall spark_d3d11_ShadowSetShaderResources(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    UINT stage,
+    UINT startSlot,
+    UINT count,
+    ID3D11ShaderResourceView* const* views )
+{
+    spark::d3d11::ShadowSetShaderResources( context, stateShadow, stage, startSlot, count, views );
+}
+
+static void __stdcall spark_d3d11_ShadowSetSamplers(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    UINT stage,
+    UINT startSlot,
+    UINT count,
+    ID3D11SamplerState* const* samplers )
+{
+    spark::d3d11::ShadowSetSamplers( context, stateShadow, stage, startSlot, count, samplers );
+}
+
+static void __stdcall spark_d3d11_ShadowSetInputLayout(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    ID3D11InputLayout* inputLayout )
+{
+    spark::d3d11::ShadowSetInputLayout( context, stateShadow, inputLayout );
+}
+
+static void __stdcall spark_d3d11_ShadowSetVertexBuffers(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    UINT startSlot,
+    UINT count,
+    ID3D11Buffer* const* buffers,
+    const UINT* strides,
+    const UINT* offsets )
+{
+    spark::d3d11::ShadowSetVertexBuffers( context, stateShadow, startSlot, count, buffers, strides, offsets );
+}
+
+static void __stdcall spark_d3d11_ShadowSetRenderTargets(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    UINT count,
+    ID3D11RenderTargetView* const* renderTargetViews,
+    ID3D11DepthStencilView* depthStencilView )
+{
+    spark::d3d11::ShadowSetRenderTargets( context, stateShadow, count, renderTargetViews, depthStencilView );
+}
+
+static void __stdcall spark_d3d11_ShadowSetBlendState(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    ID3D11BlendState* blendState,
+    const FLOAT* blendFactor,
+    UINT sampleMask )
 {
-    span.Bind( context );
+    spark::d3d11::ShadowSetBlendState( context, stateShadow, blendState, blendFactor, sampleMask );
 }
 
-static void __stdcall spark_DrawSpan_Submit(
-    spark::d3d11::DrawSpan span,
-    ID3D11DeviceContext* context )
+static void __stdcall spark_d3d11_ShadowSetRasterizerState(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    ID3D11RasterizerState* rasterizerState )
 {
-    span.Submit( context );
+    spark::d3d11::ShadowSetRasterizerState( context, stateShadow, rasterizerState );
 }
 
+static void __stdcall spark_d3d11_ShadowSetDepthStencilState(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    ID3D11DepthStencilState* depthStencilState,
+    UINT stencilRef )
+{
+    spark::d3d11::ShadowSetDepthStencilState( context, stateShadow, depthStencilState, stencilRef );
+}
+
+static void __stdcall spark_d3d11_ShadowSetDrawSpan(
+    ID3D11DeviceContext* context,
+    void* stateShadow,
+    const spark::d3d11::DrawSpan* drawSpanOverride,
+    spark::d3d11::DrawSpan drawSpan )
+{
+    spark::d3d11::ShadowSetDrawSpan( context, stateShadow, drawSpanOverride, drawSpan );
+}
+
+static void __stdcall spark_d3d11_SubmitDrawSpan(
+    ID3D11DeviceContext* context,
+    const spark::d3d11::DrawSpan* drawSpanOverride,
+    spark::d3d11::DrawSpan drawSpan )
+{
+    spark::d3d11::SubmitDrawSpan( context, drawSpanOverride, drawSpan );
+}
+
+static ID3D11SamplerState* __stdcall spark_d3d11_CreateSamplerState(
+    ID3D11Device*                 device,
+    D3D11_FILTER                  filter,
+    D3D11_TEXTURE_ADDRESS_MODE    addressU,
+    D3D11_TEXTURE_ADDRESS_MODE    addressV,
+    D3D11_TEXTURE_ADDRESS_MODE    addressW,
+    float                         mipLODBias,
+    UINT                          maxAnisotropy,
+    D3D11_COMPARISON_FUNC         comparisonFunc,
+    spark::float4                 borderColor,
+    float                         minLOD,
+    float                         maxLOD )
+{
+    return spark::d3d11::CreateSamplerState(
+        device,
+        filter,
+        addressU,
+        addressV,
+        addressW,
+        mipLODBias,
+        maxAnisotropy,
+        comparisonFunc,
+        borderColor,
+        minLOD,
+        maxLOD );
+}
+
+static ID3D11RasterizerState* __stdcall spark_d3d11_CreateRasterizerState(
+    ID3D11Device*     device,
+    D3D11_FILL_MODE   fillMode,
+    D3D11_CULL_MODE   cullMode,
+    bool              frontCounterClockwise,
+    int               depthBias,
+    float             depthBiasClamp,
+    float             slopeScaledDepthBias,
+    bool              depthClipEnable,
+    bool              scissorEnable,
+    bool              multisampleEnable,
+    bool              antialiasedLineEnable )
+{
+    return spark::d3d11::CreateRasterizerState(
+        device,
+        fillMode,
+        cullMode,
+        frontCounterClockwise,
+        depthBias,
+        depthBiasClamp,
+        slopeScaledDepthBias,
+        depthClipEnable,
+        scissorEnable,
+        multisampleEnable,
+        antialiasedLineEnable );
+}
+
+static ID3D11DepthStencilState* __stdcall spark_d3d11_CreateDepthStencilState(
+    ID3D11Device*           device,
+    bool                    depthEnable,
+    bool                    depthWriteEnable,
+    D3D11_COMPARISON_FUNC   depthFunc )
+{
+    return spark::d3d11::CreateDepthStencilState( device, depthEnable, depthWriteEnable, depthFunc );
+}
+
+static ID3D11BlendState* __stdcall spark_d3d11_CreateBlendState(
+    ID3D11Device*           device,
+    const D3D11_BLEND_DESC* desc )
+{
+    return spark::d3d11::CreateBlendState( device, desc );
+}
 
 static void* LazyFunctionCreator( const std::string& name )
 {
@@ -88,103 +333,86 @@ static void* LazyFunctionCreator( const std::string& name )
     if( name == "spark::d3d11::DrawSpan" )
         return &spark_d3d11_DrawSpan_Create;
 
-    if( name == "{0}.Submit({1})" )
-        return &spark_DrawSpan_Submit;
+    if( name == "spark::d3d11::AcquireSharedState({0}, {1})" )
+        return &spark_d3d11_AcquireSharedState;
 
-    if( name == "{0}.Bind({1})" )
-        return &spark_DrawSpan_Bind;
+    if( name == "spark::d3d11::ReleaseSharedState({0})" )
+        return &spark_d3d11_ReleaseSharedState;
 
-    OutputDebugStringA( "Failed to load function:" );
-    OutputDebugStringA( name.c_str() );
+    if( name == "spark::d3d11::CreateConstantBufferShadow({0})" )
+        return &spark_d3d11_CreateConstantBufferShadow;
 
-    return NULL;
-}
+    if( name == "spark::d3d11::DestroyConstantBufferShadow({0})" )
+        return &spark_d3d11_DestroyConstantBufferShadow;
 
-template<typename T>
-struct ValueWrapper
-{
-public:
-    ValueWrapper() {}
+    if( name == "spark::d3d11::BeginConstantBufferUpdate({0}, {1})" )
+        return &spark_d3d11_BeginConstantBufferUpdate;
 
-    T* GetValuePtr() { return &_value; }
-    const T* GetValuePtr() const { return &_value; }
+    if( name == "spark::d3d11::EndConstantBufferUpdate({0}, {1}, {2})" )
+        return &spark_d3d11_EndConstantBufferUpdate;
 
-    T* operator->() { return &_value; }
-    const T* operator->() const { return &_value; }
+    if( name == "spark::d3d11::MarkConstantBufferDirty({0}, {1}, {2}, {3})" )
+        return &spark_d3d11_MarkConstantBufferDirty;
 
-private:
-    T _value;
-};
+    if( name == "spark::d3d11::CheckUniformInputVersions({0}, {1}, {2}, {3})" )
+        return &spark_d3d11_CheckUniformInputVersions;
 
-template<typename T>
-static bool operator<( const ValueWrapper<T>& left, const ValueWrapper<T>& right )
-{
-    return memcmp(
-        left.GetValuePtr(),
-        right.GetValuePtr(),
-        sizeof(T)) < 0;
-}
+    if( name == "spark::d3d11::ResolveStateShadow({0}, {1})" )
+        return &spark_d3d11_ResolveStateShadow;
 
-namespace spark
-{
-    namespace d3d11
-    {
-        SPARK_DLL ID3D11SamplerState* CreateSamplerState(
-            ID3D11Device* device,
-            D3D11_FILTER                  filter,
-            D3D11_TEXTURE_ADDRESS_MODE    addressU,
-            D3D11_TEXTURE_ADDRESS_MODE    addressV,
-            D3D11_TEXTURE_ADDRESS_MODE    addressW,
-            float                         mipLODBias,
-            UINT                          maxAnisotropy,
-            D3D11_COMPARISON_FUNC         comparisonFunc,
-            float4                        borderColor,
-            float                         minLOD,
-            float                         maxLOD )
-        {
-            typedef std::map<ValueWrapper<D3D11_SAMPLER_DESC>, ID3D11SamplerState*> Map;
-            static Map map;
-
-            ValueWrapper<D3D11_SAMPLER_DESC> desc;
-            desc->Filter = filter;
-            desc->AddressU = addressU;
-            desc->AddressV = addressV;
-            desc->AddressW = addressW;
-            desc->MipLODBias = mipLODBias;
-            desc->MaxAnisotropy = maxAnisotropy;
-            desc->ComparisonFunc = comparisonFunc;
-            for( int ii = 0; ii < 4; ++ii )
-                desc->BorderColor[ii] = borderColor[ii];
-            desc->MinLOD = minLOD;
-            desc->MaxLOD = maxLOD;
-
-            auto ii = map.find( desc );
-            if( ii != map.end() )
-                return ii->second;
-
-            ID3D11SamplerState* result = nullptr;
-            device->CreateSamplerState( desc.GetValuePtr(), &result );
-            map.insert( std::make_pair( desc, result ) );
-            return result;
-        }
-
-        SPARK_DLL ID3D11RasterizerState* CreateRasterizerState(
-            D3D11_FILL_MODE   fillMode,
-            D3D11_CULL_MODE   cullMode,
-            bool              frontCounterClockwise,
-            int               depthBias,
-            float             depthBiasClamp,
-            float             slopeScaledDepthBias,
-            bool              depthClipEnable,
-            bool              scissorEnable,
-            bool              multisampleEnable,
-            bool              antialiasedLineEnable )
-        {
-            return nullptr;
-        }
-    }
-}
+    if( name == "spark::d3d11::ShadowSetShader({0}, {1}, {2}, {3})" )
+        return &spark_d3d11_ShadowSetShader;
+
+    if( name == "spark::d3d11::ShadowSetConstantBuffers({0}, {1}, {2}, {3}, {4}, {5})" )
+        return &spark_d3d11_ShadowSetConstantBuffers;
+
+    if( name == "spark::d3d11::ShadowSetShaderResources({0}, {1}, {2}, {3}, {4}, {5})" )
+        return &spark_d3d11_ShadowSetShaderResources;
+
+    if( name == "spark::d3d11::ShadowSetSamplers({0}, {1}, {2}, {3}, {4}, {5})" )
+        return &spark_d3d11_ShadowSetSamplers;
+
+    if( name == "spark::d3d11::ShadowSetInputLayout({0}, {1}, {2})" )
+        return &spark_d3d11_ShadowSetInputLayout;
+
+    if( name == "spark::d3d11::ShadowSetVertexBuffers({0}, {1}, {2}, {3}, {4}, {5}, {6})" )
+        return &spark_d3d11_ShadowSetVertexBuffers;
+
+    if( name == "spark::d3d11::ShadowSetRenderTargets({0}, {1}, {2}, {3}, {4})" )
+        return &spark_d3d11_ShadowSetRenderTargets;
+
+    if( name == "spark::d3d11::ShadowSetBlendState({0}, {1}, {2}, {3}, {4})" )
+        return &spark_d3d11_ShadowSetBlendState;
+
+    if( name == "spark::d3d11::ShadowSetRasterizerState({0}, {1}, {2})" )
+        return &spark_d3d11_ShadowSetRasterizerState;
+
+    if( name == "spark::d3d11::ShadowSetDepthStencilState({0}, {1}, {2}, {3})" )
+        return &spark_d3d11_ShadowSetDepthStencilState;
+
+    if( name == "spark::d3d11::ShadowSetDrawSpan({0}, {1}, {2}, {3})" )
+        return &spark_d3d11_ShadowSetDrawSpan;
+
+    if( name == "spark::d3d11::SubmitDrawSpan({0}, {1}, {2})" )
+        return &spark_d3d11_SubmitDrawSpan;
+
+    if( name == "spark::d3d11::CreateSamplerState(device, {0}, {1}, {2}, {3}, {4}, {5}, {6}, {7}, {8}, {9})" )
+        return &spark_d3d11_CreateSamplerState;
+
+    if( name == "spark::d3d11::CreateRasterizerState(device, {0}, {1}, {2}, {3}, {4}, {5}, {6}, {7}, {8}, {9})" )
+        return &spark_d3d11_CreateRasterizerState;
 
+    if( name == "spark::d3d11::CreateDepthStencilState(device, {0}, {1}, {2})" )
+        return &spark_d3d11_CreateDepthStencilState;
+
+    if( name == "spark::d3d11::CreateBlendState({0}, {1})" )
+        return &spark_d3d11_CreateBlendState;
+
+    OutputDebugStringA( "Failed to load function:" );
+    OutputDebugStringA( name.c_str() );
+
+    return NULL;
+}
 
 namespace spark
 {
@@ -199,20 +427,537 @@ namespace spark
         const void* facetInfo;
         void (__stdcall *Initialize)( void* obj, void* device );
         void (__stdcall *Finalize)( void* obj );
-        void (__stdcall *Submit)( void* obj, void* device, void* context );
+        void (__stdcall *Submit)( void* obj, void* device, void* context, const void* drawSpan, void* stateShadow );
+        unsigned int sharedSizeInBytes;
+        void (__stdcall *InitializeShared)( void* shared, void* device );
+        void (__stdcall *FinalizeShared)( void* shared );
+        const char* name;
+    };
+
+    namespace d3d11
+    {
+        // Header placed in front of each class-level shared block.
+        // Blocks are keyed on (class, device), since the objects
+        // in them are only valid for the device that created them.
+        struct SharedStateHeader
+        {
+            const ShaderClassDesc* desc;
+            ID3D11Device* device;
+            unsigned __int32 referenceCount;
+        };
+
+        // Keep the shared block itself 16-byte aligned: the header
+        // is padded out to a multiple of that (16 bytes on x86, 32
+        // on x64), and the whole allocation aligned to it.
+        static const size_t kSharedStateAlignment = 16;
+        static const size_t kSharedStateHeaderSize =
+            (sizeof(SharedStateHeader) + kSharedStateAlignment - 1) & ~(kSharedStateAlignment - 1);
+        static_assert( kSharedStateHeaderSize % kSharedStateAlignment == 0, "SharedStateHeader size not aligned" );
+        static_assert( kSharedStateAlignment % __alignof(SharedStateHeader) == 0, "SharedStateHeader alignment too large" );
+
+        typedef std::map<std::pair<const ShaderClassDesc*, ID3D11Device*>, SharedStateHeader*> SharedStateMap;
+        static SharedStateMap gSharedStates;
+        static SRWLOCK gSharedStatesLock = SRWLOCK_INIT;
+
+        static void* GetSharedStateData( SharedStateHeader* header )
+        {
+            return ((unsigned char*) header) + kSharedStateHeaderSize;
+        }
+
+        SPARK_DLL void* AcquireSharedState(
+            void* instance,
+            ID3D11Device* device )
+        {
+            // The class-info pointer is always the first
+            // field of an instance.
+            auto desc = *(const ShaderClassDesc**) instance;
+            auto key = std::make_pair( desc, device );
+
+            ::AcquireSRWLockExclusive( &gSharedStatesLock );
+
+            SharedStateHeader* header = nullptr;
+            auto ii = gSharedStates.find( key );
+            if( ii != gSharedStates.end() )
+            {
+                header = ii->second;
+                header->referenceCount++;
+            }
+            else
+            {
+                // Create the state while still holding the lock, so
+                // that nobody else sees a partially-initialized block.
+                size_t size = kSharedStateHeaderSize + desc->sharedSizeInBytes;
+                header = (SharedStateHeader*) _aligned_malloc( size, kSharedStateAlignment );
+                memset( header, 0, size );
+                header->desc = desc;
+                header->device = device;
+                header->referenceCount = 1;
+
+                desc->InitializeShared( GetSharedStateData( header ), device );
+
+                gSharedStates.insert( std::make_pair( key, header ) );
+            }
+
+            ::ReleaseSRWLockExclusive( &gSharedStatesLock );
+
+            return GetSharedStateData( header );
+        }
+
+        SPARK_DLL void ReleaseSharedState(
+            void* sharedState )
+        {
+            if( sharedState == nullptr )
+                return;
+
+            auto header = (SharedStateHeader*) (((unsigned char*) sharedState) - kSharedStateHeaderSize);
+
+            ::AcquireSRWLockExclusive( &gSharedStatesLock );
+            bool last = (--header->referenceCount == 0);
+            if( last )
+                gSharedStates.erase( std::make_pair( header->desc, header->device ) );
+            ::ReleaseSRWLockExclusive( &gSharedStatesLock );
+
+            if( !last )
+                return;
+
+            header->desc->FinalizeShared( sharedState );
+            _aligned_free( header );
+        }
+
+        static const ShaderClassDesc* GetShaderClassDesc( const D3D11DrawPass* instance )
+        {
+            // The class-info pointer is always the first
+            // field of an instance.
+            return *(const ShaderClassDesc* const*) instance;
+        }
+
+        static bool CompareSubmitBatchItems(
+            const SubmitBatchItem& left,
+            const SubmitBatchItem& right )
+        {
+            auto leftDesc = GetShaderClassDesc( left.instance );
+            auto rightDesc = GetShaderClassDesc( right.instance );
+            if( leftDesc != rightDesc )
+                return leftDesc < rightDesc;
+            return left.stateKey < right.stateKey;
+        }
+
+        SPARK_DLL void SubmitBatch(
+            ID3D11Device* device,
+            ID3D11DeviceContext* context,
+            SubmitBatchItem* items,
+            UINT itemCount )
+        {
+            std::stable_sort(
+                items,
+                items + itemCount,
+                &CompareSubmitBatchItems );
+
+            bool temporaryShadow = (GetStateShadow( context ) == nullptr);
+            if( temporaryShadow )
+                EnableStateShadow( context );
+            void* stateShadow = GetStateShadow( context );
+
+            UINT ii = 0;
+            while( ii < itemCount )
+            {
+                auto desc = GetShaderClassDesc( items[ii].instance );
+                auto submit = desc->Submit;
+
+                for( ; ii < itemCount && GetShaderClassDesc( items[ii].instance ) == desc; ++ii )
+                {
+                    submit( items[ii].instance, device, context, items[ii].drawSpan, stateShadow );
+                }
+            }
+
+            if( temporaryShadow )
+                DisableStateShadow( context );
+        }
+
+        // The shadow holds two copies of the buffer contents: the
+        // staging area that Submit writes into, and the contents
+        // that were last uploaded to the GPU. Outside of the dirty
+        // range [dirtyBegin, dirtyEnd) marked since the last
+        // Submit began, the two are known to be equal.
+        struct ConstantBufferShadowHeader
+        {
+            UINT sizeInBytes;
+            bool valid;
+            UINT dirtyBegin;
+            UINT dirtyEnd;
+        };
+
+        static const size_t kConstantBufferShadowHeaderSize = 16;
+        static_assert( sizeof(ConstantBufferShadowHeader) <= kConstantBufferShadowHeaderSize, "ConstantBufferShadowHeader too large" );
+
+        static volatile LONG gConstantBufferUploadCount = 0;
+        static volatile LONG gConstantBufferSkippedUploadCount = 0;
+
+        static unsigned char* GetConstantBufferStaging( ConstantBufferShadowHeader* header )
+        {
+            return ((unsigned char*) header) + kConstantBufferShadowHeaderSize;
+        }
+
+        static unsigned char* GetConstantBufferUploaded( ConstantBufferShadowHeader* header )
+        {
+            return GetConstantBufferStaging( header ) + header->sizeInBytes;
+        }
+
+        SPARK_DLL void* CreateConstantBufferShadow(
+            UINT sizeInBytes )
+        {
+            auto header = (ConstantBufferShadowHeader*) calloc( kConstantBufferShadowHeaderSize + 2*sizeInBytes, 1 );
+            header->sizeInBytes = sizeInBytes;
+            header->valid = false;
+            return header;
+        }
+
+        SPARK_DLL void DestroyConstantBufferShadow(
+            void* shadow )
+        {
+            free( shadow );
+        }
+
+        // Deferred contexts may be recording on several threads at
+        // once, possibly submitting the same instance, so they can't
+        // use the per-instance buffer and staging area. Instead each
+        // deferred context gets its own ring of dynamic constant
+        // buffers (per buffer size) and its own staging area. The
+        // ring is attached to the context as private data, and so is
+        // freed along with the context.
+        static const UINT kConstantBufferRingLength = 4;
+        static const UINT kMaxConstantBufferSize = D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16;
+
+        // Upper bound on the constant buffers used by one Submit
+        // (see SharedContextHLSL.MaxConstantBuffers).
+        static const UINT kMaxSubmitConstantBuffers = 4;
+
+        // {7E1C40B2-96A4-4D3B-8C5F-0A2E6B9D13F4}
+        static const GUID kConstantBufferRingGuid =
+            { 0x7e1c40b2, 0x96a4, 0x4d3b, { 0x8c, 0x5f, 0x0a, 0x2e, 0x6b, 0x9d, 0x13, 0xf4 } };
+
+        class ConstantBufferRing : public IUnknown
+        {
+        public:
+            ConstantBufferRing()
+                : _referenceCount(1)
+                , _stagingBegin(0)
+                , _stagingEnd(0)
+            {
+            }
+
+            virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** outObject )
+            {
+                if( riid == __uuidof(IUnknown) )
+                {
+                    AddRef();
+                    *outObject = static_cast<IUnknown*>(this);
+                    return S_OK;
+                }
+                *outObject = nullptr;
+                return E_NOINTERFACE;
+            }
+
+            virtual ULONG STDMETHODCALLTYPE AddRef()
+            {
+                return ::InterlockedIncrement( &_referenceCount );
+            }
+
+            virtual ULONG STDMETHODCALLTYPE Release()
+            {
+                ULONG result = ::InterlockedDecrement( &_referenceCount );
+                if( result == 0 )
+                    delete this;
+                return result;
+            }
+
+            // Submit begins the updates of all its buffers before
+            // ending any of them, and ends them in the same order,
+            // so each update gets the next region of the staging
+            // area, and Upload consumes them first-in, first-out.
+            void* BeginStaging(
+                UINT size )
+            {
+                if( _stagingEnd + size > sizeof(_staging) )
+                    _stagingBegin = _stagingEnd = 0;
+
+                void* result = _staging + _stagingEnd;
+                _stagingEnd += size;
+                return result;
+            }
+
+            ID3D11Buffer* Upload(
+                ID3D11DeviceContext* context,
+                UINT size )
+            {
+                const unsigned char* staging = _staging + _stagingBegin;
+                _stagingBegin += size;
+                if( _stagingBegin >= _stagingEnd )
+                    _stagingBegin = _stagingEnd = 0;
+
+                auto& slot = _slots[size];
+                auto& buffer = slot.buffers[slot.next];
+                slot.next = (slot.next + 1) % kConstantBufferRingLength;
+
+                if( buffer == nullptr )
+                {
+                    D3D11_BUFFER_DESC desc;
+                    memset( &desc, 0, sizeof(desc) );
+                    desc.ByteWidth = size;
+                    desc.Usage = D3D11_USAGE_DYNAMIC;
+                    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+                    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+                    ID3D11Device* device = nullptr;
+                    context->GetDevice( &device );
+                    device->CreateBuffer( &desc, nullptr, &buffer );
+                    device->Release();
+
+                    if( buffer == nullptr )
+                        return nullptr;
+                }
+
+                D3D11_MAPPED_SUBRESOURCE mapped;
+                if( FAILED( context->Map( buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped ) ) )
+                    return buffer;
+
+                memcpy( mapped.pData, staging, size );
+                context->Unmap( buffer, 0 );
+                return buffer;
+            }
+
+        private:
+            ~ConstantBufferRing()
+            {
+                for( auto ii = _slots.begin(); ii != _slots.end(); ++ii )
+                {
+                    for( UINT bb = 0; bb < kConstantBufferRingLength; ++bb )
+                    {
+                        if( ii->second.buffers[bb] != nullptr )
+                            ii->second.buffers[bb]->Release();
+                    }
+                }
+            }
+
+            struct Slot
+            {
+                Slot()
+                    : next(0)
+                {
+                    memset( buffers, 0, sizeof(buffers) );
+                }
+
+                ID3D11Buffer* buffers[kConstantBufferRingLength];
+                UINT next;
+            };
+
+            volatile LONG _referenceCount;
+            std::map<UINT, Slot> _slots;
+            UINT _stagingBegin;
+            UINT _stagingEnd;
+            unsigned char _staging[kMaxConstantBufferSize * kMaxSubmitConstantBuffers];
+        };
+
+        static ConstantBufferRing* GetConstantBufferRing(
+            ID3D11DeviceContext* context )
+        {
+            IUnknown* data = nullptr;
+            UINT size = sizeof(data);
+            if( SUCCEEDED( context->GetPrivateData( kConstantBufferRingGuid, &size, &data ) )
+                && data != nullptr )
+            {
+                // The context keeps its own reference, and it outlives
+                // this call, so we don't need to hold one.
+                data->Release();
+                return static_cast<ConstantBufferRing*>(data);
+            }
+
+            auto ring = new ConstantBufferRing();
+            context->SetPrivateDataInterface( kConstantBufferRingGuid, ring );
+            ring->Release();
+            return ring;
+        }
+
+        static bool IsDeferredContext(
+            ID3D11DeviceContext* context )
+        {
+            return context->GetType() == D3D11_DEVICE_CONTEXT_DEFERRED;
+        }
+
+        SPARK_DLL void* BeginConstantBufferUpdate(
+            ID3D11DeviceContext* context,
+            void* shadow )
+        {
+            auto header = (ConstantBufferShadowHeader*) shadow;
+            if( IsDeferredContext( context ) )
+                return GetConstantBufferRing( context )->BeginStaging( header->sizeInBytes );
+
+            header->dirtyBegin = header->sizeInBytes;
+            header->dirtyEnd = 0;
+            return GetConstantBufferStaging( header );
+        }
+
+        SPARK_DLL void MarkConstantBufferDirty(
+            ID3D11DeviceContext* context,
+            void* shadow,
+            UINT begin,
+            UINT end )
+        {
+            // Deferred contexts always upload the whole buffer, and
+            // may share the shadow across threads, so leave it alone.
+            if( IsDeferredContext( context ) )
+                return;
+
+            auto header = (ConstantBufferShadowHeader*) shadow;
+            header->dirtyBegin = std::min( header->dirtyBegin, begin );
+            header->dirtyEnd = std::max( header->dirtyEnd, std::min( end, header->sizeInBytes ) );
+        }
+
+        SPARK_DLL ID3D11Buffer* EndConstantBufferUpdate(
+            ID3D11DeviceContext* context,
+            ID3D11Buffer* buffer,
+            void* shadow )
+        {
+            auto header = (ConstantBufferShadowHeader*) shadow;
+            UINT size = header->sizeInBytes;
+
+            if( IsDeferredContext( context ) )
+            {
+                // A command list can't rely on the buffer contents
+                // left behind by another one, so always upload.
+                ::InterlockedIncrement( &gConstantBufferUploadCount );
+                return GetConstantBufferRing( context )->Upload( context, size );
+            }
+
+            auto staging = GetConstantBufferStaging( header );
+            auto uploaded = GetConstantBufferUploaded( header );
+
+            // Only the range written during this Submit can differ
+            // from what was last uploaded; if nothing was written
+            // there is nothing to compare at all.
+            UINT dirtyBegin = header->dirtyBegin;
+            UINT dirtyEnd = header->dirtyEnd;
+            if( header->valid
+                && (dirtyBegin >= dirtyEnd
+                    || memcmp( staging + dirtyBegin, uploaded + dirtyBegin, dirtyEnd - dirtyBegin ) == 0) )
+            {
+                ::InterlockedIncrement( &gConstantBufferSkippedUploadCount );
+                return buffer;
+            }
+
+            D3D11_MAPPED_SUBRESOURCE mapped;
+            if( FAILED( context->Map( buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped ) ) )
+                return buffer;
+
+            // WRITE_DISCARD leaves the old contents undefined, so the
+            // whole buffer is written, but only the dirty range of
+            // the uploaded copy can have changed.
+            memcpy( mapped.pData, staging, size );
+            context->Unmap( buffer, 0 );
+
+            if( header->valid )
+                memcpy( uploaded + dirtyBegin, staging + dirtyBegin, dirtyEnd - dirtyBegin );
+            else
+                memcpy( uploaded, staging, size );
+            header->valid = true;
+
+            ::InterlockedIncrement( &gConstantBufferUploadCount );
+            return buffer;
+        }
+
+        SPARK_DLL void GetConstantBufferUploadStats(
+            ConstantBufferUploadStats* outStats )
+        {
+            outStats->uploadCount = (unsigned int) gConstantBufferUploadCount;
+            outStats->skippedUploadCount = (unsigned int) gConstantBufferSkippedUploadCount;
+        }
+
+        static volatile LONG gUniformRecomputeCount = 0;
+        static volatile LONG gUniformSkippedRecomputeCount = 0;
+
+        SPARK_DLL UINT CheckUniformInputVersions(
+            ID3D11DeviceContext* context,
+            UINT* cachedVersion,
+            const UINT* inputVersions,
+            UINT inputCount )
+        {
+            // Deferred contexts stage into a fresh area of their
+            // ring each time (and may be recording the same instance
+            // on several threads), so they can't reuse the values.
+            if( IsDeferredContext( context ) )
+            {
+                ::InterlockedIncrement( &gUniformRecomputeCount );
+                return 1;
+            }
+
+            // The versions only ever count up, so their sum only
+            // matches the cached one if none of them has changed.
+            UINT version = 0;
+            for( UINT ii = 0; ii < inputCount; ++ii )
+                version += inputVersions[ii];
+
+            if( version == *cachedVersion )
+            {
+                ::InterlockedIncrement( &gUniformSkippedRecomputeCount );
+                return 0;
+            }
+
+            *cachedVersion = version;
+            ::InterlockedIncrement( &gUniformRecomputeCount );
+            return 1;
+        }
+
+        SPARK_DLL void GetUniformRecomputeStats(
+            UniformRecomputeStats* outStats )
+        {
+            outStats->recomputeCount = (unsigned int) gUniformRecomputeCount;
+            outStats->skippedRecomputeCount = (unsigned int) gUniformSkippedRecomputeCount;
+        }
+    }
+
+    // Fields at the start of every instance (matching the layout
+    // of spark::ShaderInstance).
+    struct InstanceBase
+    {
+        const void* info;
+        volatile LONG referenceCount;
     };
 
     class ShaderClass : public IShaderClass
     {
     public:
         ShaderClass(
+            Context* context,
+            Module* module,
             IResPipelineRef^ resShaderClass,
             const ShaderClassDesc* desc,
-            const char* name)
-            : _desc(desc)
-            , _name(name)
+            const char* name);
+
+        virtual void Acquire()
+        {
+            ::InterlockedIncrement( &_referenceCount );
+        }
+
+        virtual void Release()
         {
-            _resShaderClass = resShaderClass;
+            if( ::InterlockedDecrement( &_referenceCount ) != 0 )
+                return;
+
+            delete this;
+        }
+
+        // Acquire a reference, unless the last one has already
+        // been released (and the class is being destroyed).
+        bool TryAcquire()
+        {
+            for(;;)
+            {
+                LONG count = _referenceCount;
+                if( count == 0 )
+                    return false;
+                if( ::InterlockedCompareExchange( &_referenceCount, count + 1, count ) == count )
+                    return true;
+            }
         }
 
         virtual const char* SPARK_CALL GetName()
@@ -221,78 +966,111 @@ namespace spark
         }
 
         virtual void* SPARK_CALL CreateInstance(
-            ID3D11Device* device )
-        {
-            struct Instance
-            {
-                const void* info;
-                unsigned int referenceCount;
-            };
+            ID3D11Device* device );
 
-            auto result = (Instance*) calloc( _desc->sizeInBytes, 1 );
-            result->info = _desc;
-            result->referenceCount = 1;
+        virtual void SPARK_CALL CreateInstances(
+            ID3D11Device* device,
+            size_t count,
+            void** outInstances );
 
-            _desc->Initialize( result, device );
+        virtual void SPARK_CALL ReleaseInstances(
+            size_t count,
+            void*const* instances );
 
-            return result;
-        }
+        virtual size_t SPARK_CALL GetLiveInstances(
+            void** outInstances,
+            size_t capacity );
+
+        void ReleaseInstance(
+            void* instance );
+
+        IResPipelineRef^ GetResShaderClass();
+
+        Module* GetModule() { return _module; }
 
-        IResPipelineRef^ GetResShaderClass()
+        // The class's key in the context's ShaderClassTable.
+        std::pair<const void*, std::string> GetTableKey()
         {
-            return _resShaderClass;
+            return std::make_pair( _module != nullptr ? (const void*) _module : (const void*) _desc, _name );
         }
 
     private:
+        ~ShaderClass();
+
+        void FreeInstances(
+            size_t count,
+            void*const* instances );
+
+        volatile LONG _referenceCount;
+        Context* _context;
+        Module* _module;
         gcroot<IResPipelineRef^> _resShaderClass;
         const ShaderClassDesc* _desc;
         std::string _name;
+
+        // Every live instance holds a reference to its class, so
+        // the pool outlives all of the instances allocated from it.
+        // Abstract classes (with no desc) never allocate from it.
+        InstancePool _instances;
+        SRWLOCK _instancesLock;
     };
 
-    class Module : public IModule
+    // Keeps track of how much machine code the JIT
+    // has emitted for one module.
+    class JitCodeListener : public llvm::JITEventListener
     {
     public:
-        Module(
-            Context* context,
-            IResModuleDecl^ resModule,
-            Spark::Emit::LLVM::LlvmEmitModule^ emitModule )
-            : _context(context)
+        JitCodeListener()
+            : _codeSize(0)
+        {}
+
+        virtual void NotifyFunctionEmitted(
+            const llvm::Function& function,
+            void* code,
+            size_t size,
+            const EmittedFunctionDetails& details )
         {
-            _resModule = resModule;
-            _emitModule = emitModule;
-            _llvmModule = _emitModule->LlvmModule;
-            _llvmEngine = nullptr;
+            _codeSize += size;
         }
 
-        virtual IShaderClass* SPARK_CALL FindShaderClass(
-            const char* inClassName )
-        {
-            std::string className(inClassName);
+        size_t GetCodeSize() const { return _codeSize; }
 
-            // Need to find the 'res' version of the class, too:
-            auto resClass = ResModuleHelpers::FindShaderClass( _resModule, msclr::interop::marshal_as<String^>(inClassName) );
-            if( resClass == nullptr )
-                return nullptr;
+    private:
+        size_t _codeSize;
+    };
 
+    class Module : public IModule
+    {
+    public:
+        Module(
+            Context* context,
+            IResModuleDecl^ resModule,
+            Spark::Emit::LLVM::LlvmEmitModule^ emitModule );
 
-            auto classDescGlobal = _llvmModule->getNamedValue(className.c_str());
-            ShaderClassDesc* classDesc = nullptr;
-            if( classDescGlobal != nullptr )
-            {
-                classDesc = (ShaderClassDesc*) _llvmEngine->getPointerToGlobal( classDescGlobal );
-            }
+        // A module loaded from the module cache. The front-end
+        // representation is only rebuilt if somebody asks for it
+        // (e.g., to use one of its classes as a mixin).
+        Module(
+            Context* context,
+            llvm::Module* llvmModule );
 
-            return new ShaderClass( resClass, classDesc, inClassName );
-        }
+        // Tears down the execution engine (freeing the JIT code)
+        // and the LLVM module. Only the Context deletes modules,
+        // on the compiling thread; see Context::ReclaimMemory.
+        ~Module();
 
-        void OptimizeAndCompile()
+        virtual void Acquire()
         {
-            LLVMLinkInJIT();
-            llvm::InitializeNativeTarget();
+            ::InterlockedIncrement( &_referenceCount );
+        }
 
-            std::string errorStr;
+        virtual void Release();
 
+        virtual IShaderClass* SPARK_CALL FindShaderClass(
+            const char* inClassName );
 
+        void Optimize()
+        {
             llvm::PassManager passManager;
 
             passManager.add(llvm::createVerifierPass());                  // Verify that input is correct
@@ -317,12 +1095,18 @@ namespace spark
             {
                 std::ofstream dumpFile("./dump.txt");
 
-                dumpFile << errorStr.c_str() << "\n\n";
-
                 llvm::raw_os_ostream dumpStream(dumpFile);
                 llvmModule->print(dumpStream, nullptr);
             }
             //*/
+        }
+
+        void Compile()
+        {
+            LLVMLinkInJIT();
+            llvm::InitializeNativeTarget();
+
+            std::string errorStr;
 
             llvm::EngineBuilder engineBuilder(_llvmModule);
             engineBuilder.setEngineKind(llvm::EngineKind::JIT);
@@ -338,17 +1122,27 @@ namespace spark
                 throw "Couldn't create engine";
             }
 
+            // Lazy stubs are never used: once a function is
+            // requested, everything it calls is compiled with it.
             _llvmEngine->DisableLazyCompilation();
             _llvmEngine->InstallLazyFunctionCreator( &LazyFunctionCreator );
+            _llvmEngine->RegisterJITEventListener( &_jitListener );
 
             _llvmEngine->runStaticConstructorsDestructors(false);
 
-            // Compile everything.
-            for( auto ii = _llvmModule->begin(), ie = _llvmModule->end(); ii != ie; ++ii)
-            {
-                auto& function = *ii;
-                _llvmEngine->runJITOnFunction(&function);
-            }
+            // Nothing else is compiled up front. A module may hold
+            // many shader classes (e.g., a large permutation module)
+            // of which only a few are ever used, so code is only
+            // generated when FindShaderClass asks for a class
+            // descriptor; the JIT then emits the Initialize,
+            // Finalize, Submit (etc.) functions that descriptor
+            // refers to, along with their callees.
+        }
+
+        void OptimizeAndCompile()
+        {
+            Optimize();
+            Compile();
         }
 
         virtual IShaderClass* SPARK_CALL CreateShaderClass(
@@ -356,21 +1150,260 @@ namespace spark
             IShaderClass*const* mixins,
             IShaderBytecodeCallback* callback = nullptr );
 
+        virtual IAsyncRequest* SPARK_CALL CreateShaderClassAsync(
+            size_t mixinCount,
+            IShaderClass*const* mixins,
+            IShaderBytecodeCallback* callback = nullptr,
+            int priority = 0 );
+
+        IShaderClass* CompileShaderClass(
+            size_t mixinCount,
+            IShaderClass*const* mixins,
+            IShaderBytecodeCallback* callback );
+
+        llvm::Module* GetLlvmModule() { return _llvmModule; }
+        size_t GetJitCodeSize() const { return _jitListener.GetCodeSize(); }
+
+        // Key of this module in the module cache (empty if
+        // the module isn't cacheable), and enough information
+        // to rebuild the front-end representation on demand.
+        const std::string& GetCacheKey() { return _cacheKey; }
+        void SetCacheSource( const std::string& cacheKey, const char* fileName )
+        {
+            _cacheKey = cacheKey;
+            _fileName = fileName;
+        }
+        void SetCacheSource( const std::string& cacheKey, size_t mixinCount, IShaderClass*const* mixins )
+        {
+            // A composed module keeps its mixins alive, both
+            // so that the front-end representation can be rebuilt
+            // and so that they outlive any cache keys naming them.
+            _cacheKey = cacheKey;
+            _mixins.assign( mixins, mixins + mixinCount );
+            for( size_t ii = 0; ii < mixinCount; ++ii )
+                mixins[ii]->Acquire();
+        }
+
+        IResPipelineRef^ FindResShaderClass( const char* className );
+
     private:
+        volatile LONG _referenceCount;
         Context* _context;
         gcroot<IResModuleDecl^> _resModule;
         gcroot<Spark::Emit::LLVM::LlvmEmitModule^> _emitModule;
         llvm::Module* _llvmModule;
         llvm::ExecutionEngine* _llvmEngine;
+        JitCodeListener _jitListener;
+        std::string _cacheKey;
+        std::string _fileName;
+        std::vector<IShaderClass*> _mixins;
+    };
+
+    // In-memory cache of dynamically-composed shader classes.
+    // A mixin's ShaderClass can be destroyed and looked up again,
+    // so a mixin is identified by its module and class name rather
+    // than by pointer. Mixin order is significant, and is kept as-is.
+    //
+    // The first caller for a given key compiles the class; any
+    // other callers for the same key wait for that compile rather
+    // than starting their own.
+    //
+    // The cache doesn't keep classes alive: a class removes its
+    // entry when it is destroyed. Failed compiles aren't cached.
+    class ShaderClassCache
+    {
+    public:
+        typedef std::vector<std::pair<Module*, std::string>> Key;
+
+        struct Entry
+        {
+            Entry()
+                : ready(false)
+                , removed(false)
+                , waiterCount(0)
+                , result(nullptr)
+            {}
+
+            bool ready;
+            bool removed;
+            unsigned int waiterCount;
+            ShaderClass* result;
+            std::vector<ModuleCacheBytecode> bytecode;
+        };
+
+        ShaderClassCache()
+        {
+            ::InitializeSRWLock( &_lock );
+            ::InitializeConditionVariable( &_ready );
+        }
+
+        ~ShaderClassCache()
+        {
+            for( auto ii = _entries.begin(), ie = _entries.end(); ii != ie; ++ii )
+                delete ii->second;
+        }
+
+        // Look up a key. If the class is already cached (or being
+        // compiled by somebody else), this waits for it, sets
+        // 'outResult' to a new reference (or nullptr if that compile
+        // failed), copies the bytecode to replay, and returns nullptr.
+        // Otherwise it returns a new entry, and the caller must
+        // compile the class and Publish it.
+        Entry* Acquire(
+            const Key& key,
+            ShaderClass** outResult,
+            std::vector<ModuleCacheBytecode>* outBytecode )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            for(;;)
+            {
+                auto ii = _entries.find( key );
+                if( ii == _entries.end() )
+                {
+                    auto entry = new Entry();
+                    _entries.insert( std::make_pair( key, entry ) );
+                    ::ReleaseSRWLockExclusive( &_lock );
+                    return entry;
+                }
+
+                auto entry = ii->second;
+                entry->waiterCount++;
+                while( !entry->ready )
+                    ::SleepConditionVariableSRW( &_ready, &_lock, INFINITE, 0 );
+                entry->waiterCount--;
+
+                bool found = (entry->result == nullptr) || entry->result->TryAcquire();
+                if( found )
+                {
+                    *outResult = entry->result;
+                    *outBytecode = entry->bytecode;
+                }
+                else if( !entry->removed )
+                {
+                    // The class is being destroyed, so drop its
+                    // entry and go around again to compile anew.
+                    RemoveEntry( entry );
+                }
+
+                if( entry->removed && entry->waiterCount == 0 )
+                    delete entry;
+
+                if( found )
+                {
+                    ::ReleaseSRWLockExclusive( &_lock );
+                    return nullptr;
+                }
+            }
+        }
+
+        void Publish(
+            Entry* entry,
+            ShaderClass* result,
+            const std::vector<ModuleCacheBytecode>& bytecode )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            entry->result = result;
+            entry->bytecode = bytecode;
+            entry->ready = true;
+
+            // Don't cache failures: the key may name
+            // modules that nothing keeps alive.
+            if( result == nullptr )
+            {
+                RemoveEntry( entry );
+                if( entry->waiterCount == 0 )
+                    delete entry;
+            }
+            ::ReleaseSRWLockExclusive( &_lock );
+
+            ::WakeAllConditionVariable( &_ready );
+        }
+
+        // Called when a class is destroyed.
+        void Remove(
+            ShaderClass* shaderClass )
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            for( auto ii = _entries.begin(), ie = _entries.end(); ii != ie; ++ii )
+            {
+                auto entry = ii->second;
+                if( entry->ready && entry->result == shaderClass )
+                {
+                    RemoveEntry( entry );
+                    if( entry->waiterCount == 0 )
+                        delete entry;
+                    break;
+                }
+            }
+            ::ReleaseSRWLockExclusive( &_lock );
+        }
+
+    private:
+        // Take an entry out of the map. Anybody still waiting
+        // on it is responsible for deleting it.
+        void RemoveEntry(
+            Entry* entry )
+        {
+            entry->removed = true;
+            for( auto ii = _entries.begin(), ie = _entries.end(); ii != ie; ++ii )
+            {
+                if( ii->second == entry )
+                {
+                    _entries.erase( ii );
+                    return;
+                }
+            }
+        }
+
+        SRWLOCK _lock;
+        CONDITION_VARIABLE _ready;
+        std::map<Key, Entry*> _entries;
     };
 
     class Context : public IContext
     {
     public:
+        // Holds the context's compile lock for a scope. Compiling
+        // (including JIT-compiling a module's code) is serialized
+        // between the application's threads and the async worker.
+        // The lock is recursive, since compiling one thing often
+        // means compiling another.
+        class CompileScope
+        {
+        public:
+            explicit CompileScope( Context* context )
+                : _context(context)
+            {
+                ::EnterCriticalSection( &_context->_compileLock );
+            }
+
+            ~CompileScope()
+            {
+                ::LeaveCriticalSection( &_context->_compileLock );
+            }
+
+        private:
+            Context* _context;
+        };
+
         Context()
             : _referenceCount(1)
+            , _shaderClassCount(0)
+            , _instanceCount(0)
         {
+            ::InitializeSRWLock( &_modulesLock );
+            ::InitializeCriticalSection( &_compileLock );
+            _asyncQueue.SetOwner( this );
+
             _identifiers = gcnew Spark::IdentifierFactory();
+
+            const char* cacheDirectory = getenv( "SPARK_MODULE_CACHE" );
+            if( cacheDirectory != nullptr )
+                SetModuleCacheDirectory( cacheDirectory );
+
+            const char* traceFile = getenv( "SPARK_IR_TRACE" );
+            if( traceFile != nullptr )
+                SetIRTraceFile( traceFile );
         }
 
         virtual void Acquire()
@@ -389,7 +1422,69 @@ namespace spark
             delete this;
         }
 
+        // Every async request, and the async worker while it runs,
+        // holds a reference, so the queue is idle by now.
+        ~Context()
+        {
+            ReclaimMemory();
+            ::DeleteCriticalSection( &_compileLock );
+        }
+
         virtual IModule* SPARK_CALL CompileFile(const char* filename)
+        {
+            CompileScope scope( this );
+
+            ReclaimMemory();
+
+            std::string cacheKey;
+            if( _moduleCache.IsEnabled() )
+            {
+                msclr::interop::marshal_context marshal;
+                auto fileNames = gcnew array<String^>{ gcnew String(filename) };
+                auto runtimeBuildId = System::Reflection::Assembly::GetExecutingAssembly()->ManifestModule->ModuleVersionId.ToString();
+                cacheKey = marshal.marshal_as<const char*>(
+                    Spark::Compiler::ModuleCacheKey::ForFiles( fileNames, runtimeBuildId ) );
+
+                auto cachedModule = _moduleCache.Load( cacheKey, nullptr );
+                if( cachedModule != nullptr )
+                {
+                    auto module = new Module( this, cachedModule );
+                    module->SetCacheSource( cacheKey, filename );
+                    module->Compile();
+                    return module;
+                }
+            }
+
+            auto compiler = RunFrontEnd( filename );
+            if( compiler == nullptr )
+                return nullptr;
+
+            auto midModule = compiler->MidModule;
+
+            ModuleCacheEntry cacheEntry;
+            RecordingBytecodeCallback recorder( &cacheEntry, nullptr );
+
+            auto target = (Spark::Emit::LLVM::LlvmEmitTarget^) _emitContext->Target;
+            if( !cacheKey.empty() )
+                target->SetCallback( &recorder );
+            auto emitModule = (Spark::Emit::LLVM::LlvmEmitModule^) _emitContext->EmitModule(midModule);
+            target->SetCallback( nullptr );
+            FlushIRTrace();
+
+            auto module = new Module( this, compiler->ResModule, emitModule );
+            module->Optimize();
+            if( !cacheKey.empty() )
+            {
+                _moduleCache.Store( cacheKey, module->GetLlvmModule(), cacheEntry );
+                module->SetCacheSource( cacheKey, filename );
+            }
+            module->Compile();
+            return module;
+        }
+
+        // Parse, resolve and lower a file, leaving the mid/emit
+        // contexts ready for later dynamic shader-class creation.
+        Compiler^ RunFrontEnd(const char* filename)
         {
             auto compiler = gcnew Compiler();
             compiler->Identifiers = _identifiers;
@@ -411,40 +1506,405 @@ namespace spark
             if( errorCount != 0 )
                 return nullptr;
 
-            auto midModule = compiler->MidModule;
-
             auto target = gcnew Spark::Emit::LLVM::LlvmEmitTarget();
+            if( !_irTraceFile.empty() )
+                target->EnableTrace();
             _emitContext = gcnew Spark::Emit::EmitContext();
             _emitContext->Target = target;
             _emitContext->Identifiers = compiler->Identifiers;
             _emitContext->Diagnostics = compiler->Diagnostics;
 
-            auto emitModule = (Spark::Emit::LLVM::LlvmEmitModule^) _emitContext->EmitModule(midModule);
-
-            auto module = new Module( this, compiler->ResModule, emitModule );
-            module->OptimizeAndCompile();
-            return module;
+            return compiler;
         }
 
+        virtual IAsyncRequest* SPARK_CALL CompileFileAsync(
+            const char* filename,
+            int priority );
+
         virtual IShaderClass* SPARK_CALL FindOrLoadShaderClass( const ShaderClassDesc* desc )
         {
-            return new ShaderClass(
+            auto key = ShaderClassTable<ShaderClass>::Key( desc, desc->name );
+            auto found = _shaderClassTable.Find( key );
+            if( found != nullptr )
+                return found;
+
+            return _shaderClassTable.Intern( key, new ShaderClass(
+                this,
+                nullptr,
                 nullptr,
                 desc,
-                * ((const char**) desc->facetInfo));
+                desc->name) );
+        }
+
+        virtual void SPARK_CALL SetModuleCacheDirectory( const char* path )
+        {
+            CompileScope scope( this );
+
+            _moduleCache.SetDirectory( path );
+
+            // Compiled HLSL bytecode is shared across all contexts,
+            // but persisted alongside the module cache.
+            String^ hlslCachePath = nullptr;
+            if( _moduleCache.IsEnabled() )
+                hlslCachePath = System::IO::Path::Combine( gcnew String(path), "hlsl.cache" );
+            Spark::Emit::HLSL::HlslCompilerHelper::SetPersistPath( hlslCachePath );
+        }
+
+        virtual void SPARK_CALL GetModuleCacheStats( ModuleCacheStats* outStats )
+        {
+            _moduleCache.GetStats( outStats );
+        }
+
+        virtual void SPARK_CALL SetIRTraceFile( const char* path )
+        {
+            CompileScope scope( this );
+
+            _irTraceFile = path != nullptr ? path : "";
+
+            Spark::Emit::EmitContext^ emitContext = _emitContext;
+            if( emitContext == nullptr )
+                return;
+
+            auto target = (Spark::Emit::LLVM::LlvmEmitTarget^) emitContext->Target;
+            if( _irTraceFile.empty() )
+                target->DisableTrace();
+            else
+                target->EnableTrace();
+        }
+
+        // Write out any IR trace buffered during the last emit.
+        void FlushIRTrace()
+        {
+            Spark::Emit::EmitContext^ emitContext = _emitContext;
+            if( emitContext == nullptr || _irTraceFile.empty() )
+                return;
+
+            auto target = (Spark::Emit::LLVM::LlvmEmitTarget^) emitContext->Target;
+            target->FlushTrace( gcnew String(_irTraceFile.c_str()) );
+        }
+
+        virtual void SPARK_CALL ReclaimMemory()
+        {
+            CompileScope scope( this );
+
+            std::vector<Module*> retired;
+
+            ::AcquireSRWLockExclusive( &_modulesLock );
+            retired.swap( _retiredModules );
+            for( auto ii = retired.begin(), ie = retired.end(); ii != ie; ++ii )
+                _modules.erase( *ii );
+            ::ReleaseSRWLockExclusive( &_modulesLock );
+
+            // Deleting a module can release its mixins, and so
+            // retire more modules; keep going until none are left.
+            for( auto ii = retired.begin(), ie = retired.end(); ii != ie; ++ii )
+                delete *ii;
+            if( !retired.empty() )
+                ReclaimMemory();
         }
 
+        virtual void SPARK_CALL GetMemoryStats( ContextMemoryStats* outStats )
+        {
+            ::AcquireSRWLockShared( &_modulesLock );
+            outStats->moduleCount = (unsigned int) (_modules.size() - _retiredModules.size());
+            outStats->pendingModuleCount = (unsigned int) _retiredModules.size();
+            outStats->jitCodeBytes = 0;
+            for( auto ii = _modules.begin(), ie = _modules.end(); ii != ie; ++ii )
+                outStats->jitCodeBytes += (*ii)->GetJitCodeSize();
+            ::ReleaseSRWLockShared( &_modulesLock );
+
+            outStats->shaderClassCount = (unsigned int) _shaderClassCount;
+            outStats->instanceCount = (unsigned int) _instanceCount;
+        }
+
+        void AddModule( Module* module )
+        {
+            ::AcquireSRWLockExclusive( &_modulesLock );
+            _modules.insert( module );
+            ::ReleaseSRWLockExclusive( &_modulesLock );
+        }
+
+        // Called when the last reference to a module is released,
+        // possibly from an arbitrary thread.
+        void RetireModule( Module* module )
+        {
+            ::AcquireSRWLockExclusive( &_modulesLock );
+            _retiredModules.push_back( module );
+            ::ReleaseSRWLockExclusive( &_modulesLock );
+        }
+
+        void CountShaderClasses( LONG delta ) { ::InterlockedExchangeAdd( &_shaderClassCount, delta ); }
+        void CountInstances( LONG delta ) { ::InterlockedExchangeAdd( &_instanceCount, delta ); }
+
         Spark::IdentifierFactory^ GetIdentifiers() { return _identifiers; }
         Spark::Mid::MidEmitContext^ GetMidContext() { return _midContext; }
         Spark::Emit::EmitContext^ GetEmitContext() { return _emitContext; }
+        ModuleCache& GetModuleCache() { return _moduleCache; }
+        ShaderClassCache& GetShaderClassCache() { return _shaderClassCache; }
+        ShaderClassTable<ShaderClass>& GetShaderClassTable() { return _shaderClassTable; }
+        AsyncQueue& GetAsyncQueue() { return _asyncQueue; }
 
     private:
         unsigned __int32 _referenceCount;
         gcroot<Spark::IdentifierFactory^> _identifiers;
         gcroot<Spark::Mid::MidEmitContext^> _midContext;
         gcroot<Spark::Emit::EmitContext^> _emitContext;
+        ModuleCache _moduleCache;
+        ShaderClassCache _shaderClassCache;
+        // Every lookup of a class shares one ShaderClass, and so
+        // one instance pool.
+        ShaderClassTable<ShaderClass> _shaderClassTable;
+        std::string _irTraceFile;
+
+        SRWLOCK _modulesLock;
+        std::set<Module*> _modules;
+        std::vector<Module*> _retiredModules;
+        volatile LONG _shaderClassCount;
+        volatile LONG _instanceCount;
+
+        CRITICAL_SECTION _compileLock;
+        AsyncQueue _asyncQueue;
     };
 
+    ShaderClass::ShaderClass(
+        Context* context,
+        Module* module,
+        IResPipelineRef^ resShaderClass,
+        const ShaderClassDesc* desc,
+        const char* name)
+        : _referenceCount(1)
+        , _context(context)
+        , _module(module)
+        , _desc(desc)
+        , _name(name)
+        , _instances(desc != nullptr ? desc->sizeInBytes : 0)
+    {
+        ::InitializeSRWLock( &_instancesLock );
+        _resShaderClass = resShaderClass;
+
+        if( _module != nullptr )
+            _module->Acquire();
+        _context->CountShaderClasses( 1 );
+    }
+
+    ShaderClass::~ShaderClass()
+    {
+        _context->GetShaderClassTable().Remove( GetTableKey(), this );
+        _context->GetShaderClassCache().Remove( this );
+        _context->CountShaderClasses( -1 );
+        if( _module != nullptr )
+            _module->Release();
+    }
+
+    void* SPARK_CALL ShaderClass::CreateInstance(
+        ID3D11Device* device )
+    {
+        void* result = nullptr;
+        CreateInstances( device, 1, &result );
+        return result;
+    }
+
+    void SPARK_CALL ShaderClass::CreateInstances(
+        ID3D11Device* device,
+        size_t count,
+        void** outInstances )
+    {
+        // Abstract classes (mixins looked up by name) have no
+        // layout to instantiate.
+        if( _desc == nullptr )
+        {
+            for( size_t ii = 0; ii < count; ++ii )
+                outInstances[ii] = nullptr;
+            return;
+        }
+
+        // Reserve every slot under a single lock, so that a batch
+        // of instances is laid out contiguously where possible.
+        ::AcquireSRWLockExclusive( &_instancesLock );
+        for( size_t ii = 0; ii < count; ++ii )
+        {
+            outInstances[ii] = _instances.Allocate();
+            _instances.GetHeader( outInstances[ii] )->shaderClass = this;
+        }
+        ::ReleaseSRWLockExclusive( &_instancesLock );
+
+        // Initialization may create device resources, so do
+        // it outside of the lock.
+        for( size_t ii = 0; ii < count; ++ii )
+        {
+            Acquire();
+
+            auto instance = (InstanceBase*) outInstances[ii];
+            instance->info = _desc;
+            instance->referenceCount = 1;
+
+            _desc->Initialize( instance, device );
+        }
+        _context->CountInstances( (LONG) count );
+
+        // Only report the instances from GetLiveInstances once
+        // they are fully initialized.
+        ::AcquireSRWLockExclusive( &_instancesLock );
+        for( size_t ii = 0; ii < count; ++ii )
+            _instances.MarkLive( outInstances[ii] );
+        ::ReleaseSRWLockExclusive( &_instancesLock );
+    }
+
+    void SPARK_CALL ShaderClass::ReleaseInstances(
+        size_t count,
+        void*const* instances )
+    {
+        std::vector<void*> dead;
+        for( size_t ii = 0; ii < count; ++ii )
+        {
+            auto instance = (InstanceBase*) instances[ii];
+            if( ::InterlockedDecrement( &instance->referenceCount ) == 0 )
+                dead.push_back( instance );
+        }
+
+        if( !dead.empty() )
+            FreeInstances( dead.size(), &dead[0] );
+    }
+
+    size_t SPARK_CALL ShaderClass::GetLiveInstances(
+        void** outInstances,
+        size_t capacity )
+    {
+        ::AcquireSRWLockShared( &_instancesLock );
+        size_t result = _instances.GetLive( outInstances, capacity );
+        ::ReleaseSRWLockShared( &_instancesLock );
+        return result;
+    }
+
+    void ShaderClass::ReleaseInstance(
+        void* instance )
+    {
+        FreeInstances( 1, &instance );
+    }
+
+    void ShaderClass::FreeInstances(
+        size_t count,
+        void*const* instances )
+    {
+        ::AcquireSRWLockExclusive( &_instancesLock );
+        for( size_t ii = 0; ii < count; ++ii )
+            _instances.MarkDead( instances[ii] );
+        ::ReleaseSRWLockExclusive( &_instancesLock );
+
+        for( size_t ii = 0; ii < count; ++ii )
+            _desc->Finalize( instances[ii] );
+
+        ::AcquireSRWLockExclusive( &_instancesLock );
+        for( size_t ii = 0; ii < count; ++ii )
+            _instances.Free( instances[ii] );
+        ::ReleaseSRWLockExclusive( &_instancesLock );
+
+        _context->CountInstances( -(LONG) count );
+
+        // Drop the class references last, since the final
+        // one may destroy the class (and the pool).
+        for( size_t ii = 0; ii < count; ++ii )
+            Release();
+    }
+
+    Module::Module(
+        Context* context,
+        IResModuleDecl^ resModule,
+        Spark::Emit::LLVM::LlvmEmitModule^ emitModule )
+        : _referenceCount(1)
+        , _context(context)
+    {
+        _resModule = resModule;
+        _emitModule = emitModule;
+        _llvmModule = _emitModule->LlvmModule;
+        _llvmEngine = nullptr;
+
+        _context->AddModule( this );
+    }
+
+    Module::Module(
+        Context* context,
+        llvm::Module* llvmModule )
+        : _referenceCount(1)
+        , _context(context)
+    {
+        _resModule = nullptr;
+        _emitModule = nullptr;
+        _llvmModule = llvmModule;
+        _llvmEngine = nullptr;
+
+        _context->AddModule( this );
+    }
+
+    Module::~Module()
+    {
+        for( auto ii = _mixins.begin(), ie = _mixins.end(); ii != ie; ++ii )
+            (*ii)->Release();
+
+        if( _llvmEngine != nullptr )
+        {
+            // The engine owns the LLVM module, and
+            // frees the JIT code along with it.
+            _llvmEngine->UnregisterJITEventListener( &_jitListener );
+            delete _llvmEngine;
+        }
+        else
+        {
+            delete _llvmModule;
+        }
+    }
+
+    void Module::Release()
+    {
+        if( ::InterlockedDecrement( &_referenceCount ) != 0 )
+            return;
+
+        _context->RetireModule( this );
+    }
+
+    IShaderClass* SPARK_CALL Module::FindShaderClass(
+        const char* inClassName )
+    {
+        std::string className(inClassName);
+
+        // Classes already handed out don't need the compile lock.
+        auto& shaderClassTable = _context->GetShaderClassTable();
+        auto key = ShaderClassTable<ShaderClass>::Key( this, className );
+        auto found = shaderClassTable.Find( key );
+        if( found != nullptr )
+            return found;
+
+        Context::CompileScope scope( _context );
+
+        auto classDescGlobal = _llvmModule->getNamedValue(className.c_str());
+
+        // Need to find the 'res' version of the class, too
+        // (unless we came from the cache, in which case it
+        // gets looked up lazily):
+        IResPipelineRef^ resClass = nullptr;
+        if( static_cast<IResModuleDecl^>(_resModule) != nullptr )
+        {
+            resClass = ResModuleHelpers::FindShaderClass( _resModule, msclr::interop::marshal_as<String^>(inClassName) );
+            if( resClass == nullptr )
+                return nullptr;
+        }
+        else if( classDescGlobal == nullptr )
+        {
+            return nullptr;
+        }
+
+        // Getting the address of the descriptor JIT-compiles
+        // the entry points it references, if that hasn't
+        // already happened.
+        ShaderClassDesc* classDesc = nullptr;
+        if( classDescGlobal != nullptr )
+        {
+            classDesc = (ShaderClassDesc*) _llvmEngine->getPointerToGlobal( classDescGlobal );
+        }
+
+        return shaderClassTable.Intern( key, new ShaderClass( _context, this, resClass, classDesc, inClassName ) );
+    }
+
     //
 
     ref class DiagnosticsWriter :
@@ -458,10 +1918,10 @@ namespace spark
         }
     };
 
-    IShaderClass* Module::CreateShaderClass(
+    static IResModuleDecl^ ResolveMixins(
+        Context* context,
         size_t mixinCount,
-        IShaderClass*const* mixins,
-        IShaderBytecodeCallback* callback )
+        IShaderClass*const* mixins )
     {
         auto resMixins = gcnew List<IResPipelineRef^>();
 
@@ -472,10 +1932,12 @@ namespace spark
                 return nullptr;
 
             IResPipelineRef^ resMixin = ((ShaderClass*) mixin)->GetResShaderClass();
+            if( resMixin == nullptr )
+                return nullptr;
             resMixins->Add(resMixin);
         }
 
-        auto identifiers = _context->GetIdentifiers();
+        auto identifiers = context->GetIdentifiers();
         auto diagnostics = gcnew Spark::DiagnosticSink();
         auto resolveContext = gcnew Spark::Resolve::ResolveContext(identifiers, diagnostics);
 
@@ -486,6 +1948,166 @@ namespace spark
             return nullptr;
         }
 
+        return resModule;
+    }
+
+    // Compute the cache key for a dynamically-composed class,
+    // or an empty string if any of the mixins is uncacheable.
+    static std::string GetMixinCacheKey(
+        size_t mixinCount,
+        IShaderClass*const* mixins )
+    {
+        auto moduleKeys = gcnew List<String^>();
+        auto mixinNames = gcnew List<String^>();
+
+        for( size_t ii = 0; ii < mixinCount; ++ii )
+        {
+            auto mixin = (ShaderClass*) mixins[ii];
+            if( mixin == nullptr || mixin->GetModule() == nullptr )
+                return std::string();
+
+            auto& moduleKey = mixin->GetModule()->GetCacheKey();
+            if( moduleKey.empty() )
+                return std::string();
+
+            moduleKeys->Add( gcnew String(moduleKey.c_str()) );
+            mixinNames->Add( gcnew String(mixin->GetName()) );
+        }
+
+        msclr::interop::marshal_context marshal;
+        return marshal.marshal_as<const char*>(
+            Spark::Compiler::ModuleCacheKey::ForMixins( moduleKeys, mixinNames ) );
+    }
+
+    IResPipelineRef^ ShaderClass::GetResShaderClass()
+    {
+        if( static_cast<IResPipelineRef^>(_resShaderClass) == nullptr && _module != nullptr )
+        {
+            _resShaderClass = _module->FindResShaderClass( _name.c_str() );
+        }
+        return _resShaderClass;
+    }
+
+    IResPipelineRef^ Module::FindResShaderClass( const char* className )
+    {
+        // Rebuild the front-end representation of a module
+        // that was loaded from the cache.
+        if( static_cast<IResModuleDecl^>(_resModule) == nullptr )
+        {
+            if( !_fileName.empty() )
+            {
+                auto compiler = _context->RunFrontEnd( _fileName.c_str() );
+                if( compiler == nullptr )
+                    return nullptr;
+                _resModule = compiler->ResModule;
+            }
+            else if( !_mixins.empty() )
+            {
+                _resModule = ResolveMixins( _context, _mixins.size(), &_mixins[0] );
+            }
+
+            if( static_cast<IResModuleDecl^>(_resModule) == nullptr )
+                return nullptr;
+        }
+
+        return ResModuleHelpers::FindShaderClass( _resModule, msclr::interop::marshal_as<String^>(className) );
+    }
+
+    // Replay the bytecode the application would have seen
+    // if we'd compiled from scratch.
+    static void ReplayBytecode(
+        const std::vector<ModuleCacheBytecode>& bytecode,
+        IShaderBytecodeCallback* callback )
+    {
+        if( callback == nullptr )
+            return;
+
+        for( auto ii = bytecode.begin(), ie = bytecode.end(); ii != ie; ++ii )
+        {
+            callback->ProcessBytecode(
+                ii->stageName.c_str(),
+                (unsigned int) ii->data.size(),
+                ii->data.empty() ? nullptr : &ii->data[0] );
+        }
+    }
+
+    IShaderClass* Module::CreateShaderClass(
+        size_t mixinCount,
+        IShaderClass*const* mixins,
+        IShaderBytecodeCallback* callback )
+    {
+        ShaderClassCache::Key key;
+        for( size_t ii = 0; ii < mixinCount; ++ii )
+        {
+            auto mixin = (ShaderClass*) mixins[ii];
+            if( mixin == nullptr )
+                return nullptr;
+            key.push_back( std::make_pair( mixin->GetModule(), std::string(mixin->GetName()) ) );
+        }
+
+        auto& shaderClassCache = _context->GetShaderClassCache();
+
+        // Look the class up before taking the compile lock, so that
+        // threads asking for a class somebody else is compiling wait
+        // on just that class, and threads asking for one that is
+        // already cached don't wait on unrelated compiles at all.
+        ShaderClass* cached = nullptr;
+        std::vector<ModuleCacheBytecode> cachedBytecode;
+        auto entry = shaderClassCache.Acquire( key, &cached, &cachedBytecode );
+        if( entry == nullptr )
+        {
+            ReplayBytecode( cachedBytecode, callback );
+            return cached;
+        }
+
+        Context::CompileScope scope( _context );
+
+        _context->ReclaimMemory();
+
+        ModuleCacheEntry recorded;
+        RecordingBytecodeCallback recorder( &recorded, callback );
+
+        auto result = (ShaderClass*) CompileShaderClass( mixinCount, mixins, &recorder );
+
+        shaderClassCache.Publish( entry, result, recorded.bytecode );
+        return result;
+    }
+
+    IShaderClass* Module::CompileShaderClass(
+        size_t mixinCount,
+        IShaderClass*const* mixins,
+        IShaderBytecodeCallback* callback )
+    {
+        auto& moduleCache = _context->GetModuleCache();
+
+        std::string cacheKey;
+        if( moduleCache.IsEnabled() )
+        {
+            cacheKey = GetMixinCacheKey( mixinCount, mixins );
+            if( !cacheKey.empty() )
+            {
+                ModuleCacheEntry cacheEntry;
+                auto cachedModule = moduleCache.Load( cacheKey, &cacheEntry );
+                if( cachedModule != nullptr )
+                {
+                    ReplayBytecode( cacheEntry.bytecode, callback );
+
+                    auto module = new Module( _context, cachedModule );
+                    module->SetCacheSource( cacheKey, mixinCount, mixins );
+                    module->Compile();
+
+                    // The class holds the only reference we need.
+                    auto shaderClass = module->FindShaderClass( cacheEntry.className.c_str() );
+                    module->Release();
+                    return shaderClass;
+                }
+            }
+        }
+
+        auto resModule = ResolveMixins( _context, mixinCount, mixins );
+        if( resModule == nullptr )
+            return nullptr;
+
         IResMemberDecl^ resShaderClass = nullptr;
         for each( IResMemberDecl^ d in resModule->Decls )
         {
@@ -501,16 +2123,145 @@ namespace spark
         auto emitContext = _context->GetEmitContext();
         auto emitTarget = (Spark::Emit::LLVM::LlvmEmitTarget^) emitContext->Target;
 
-        emitTarget->SetCallback( callback );
+        ModuleCacheEntry cacheEntry;
+        cacheEntry.className = name;
+        RecordingBytecodeCallback recorder( &cacheEntry, callback );
+
+        emitTarget->SetCallback( cacheKey.empty() ? callback : &recorder );
         auto emitModule = (Spark::Emit::LLVM::LlvmEmitModule^) emitContext->EmitModule(midModule);
         emitTarget->SetCallback( nullptr );
+        _context->FlushIRTrace();
 
         auto module = new Module( _context, resModule, emitModule );
-        module->OptimizeAndCompile();
+        module->Optimize();
+        if( !cacheKey.empty() )
+            moduleCache.Store( cacheKey, module->GetLlvmModule(), cacheEntry );
+        module->SetCacheSource( cacheKey, mixinCount, mixins );
+        module->Compile();
 
         auto shaderClass = module->FindShaderClass(name.c_str());
+        module->Release();
         return shaderClass;
     }
+
+    class CompileFileRequest : public AsyncRequest
+    {
+    public:
+        CompileFileRequest(
+            Context* context,
+            const char* filename,
+            int priority )
+            : AsyncRequest( context, &context->GetAsyncQueue(), priority )
+            , _context(context)
+            , _filename(filename)
+            , _result(nullptr)
+        {}
+
+        virtual IModule* SPARK_CALL GetModule()
+        {
+            if( GetStatus() != kAsyncStatus_Completed || _result == nullptr )
+                return nullptr;
+            _result->Acquire();
+            return _result;
+        }
+
+        virtual void Execute()
+        {
+            _result = _context->CompileFile( _filename.c_str() );
+        }
+
+    protected:
+        ~CompileFileRequest()
+        {
+            if( _result != nullptr )
+                _result->Release();
+        }
+
+    private:
+        Context* _context;
+        std::string _filename;
+        IModule* _result;
+    };
+
+    class CreateShaderClassRequest : public AsyncRequest
+    {
+    public:
+        CreateShaderClassRequest(
+            Context* context,
+            Module* module,
+            size_t mixinCount,
+            IShaderClass*const* mixins,
+            IShaderBytecodeCallback* callback,
+            int priority )
+            : AsyncRequest( context, &context->GetAsyncQueue(), priority )
+            , _module(module)
+            , _mixins(mixins, mixins + mixinCount)
+            , _callback(callback)
+            , _result(nullptr)
+        {
+            _module->Acquire();
+            for( auto ii = _mixins.begin(), ie = _mixins.end(); ii != ie; ++ii )
+            {
+                if( *ii != nullptr )
+                    (*ii)->Acquire();
+            }
+        }
+
+        virtual IShaderClass* SPARK_CALL GetShaderClass()
+        {
+            if( GetStatus() != kAsyncStatus_Completed || _result == nullptr )
+                return nullptr;
+            _result->Acquire();
+            return _result;
+        }
+
+        virtual void Execute()
+        {
+            _result = _module->CreateShaderClass(
+                _mixins.size(),
+                _mixins.empty() ? nullptr : &_mixins[0],
+                _callback );
+        }
+
+    protected:
+        ~CreateShaderClassRequest()
+        {
+            if( _result != nullptr )
+                _result->Release();
+            for( auto ii = _mixins.begin(), ie = _mixins.end(); ii != ie; ++ii )
+            {
+                if( *ii != nullptr )
+                    (*ii)->Release();
+            }
+            _module->Release();
+        }
+
+    private:
+        Module* _module;
+        std::vector<IShaderClass*> _mixins;
+        IShaderBytecodeCallback* _callback;
+        IShaderClass* _result;
+    };
+
+    IAsyncRequest* SPARK_CALL Context::CompileFileAsync(
+        const char* filename,
+        int priority )
+    {
+        auto request = new CompileFileRequest( this, filename, priority );
+        _asyncQueue.Submit( request );
+        return request;
+    }
+
+    IAsyncRequest* SPARK_CALL Module::CreateShaderClassAsync(
+        size_t mixinCount,
+        IShaderClass*const* mixins,
+        IShaderBytecodeCallback* callback,
+        int priority )
+    {
+        auto request = new CreateShaderClassRequest( _context, this, mixinCount, mixins, callback, priority );
+        _context->GetAsyncQueue().Submit( request );
+        return request;
+    }
 }
 
 SPARK_DLL spark::IContext* SparkCreateContext()
@@ -518,6 +2269,31 @@ SPARK_DLL spark::IContext* SparkCreateContext()
     return new spark::Context();
 }
 
+SPARK_DLL int SparkPopulateModuleCache(
+    const char* cacheDirectory,
+    const char* filename )
+{
+    auto context = new spark::Context();
+    context->SetModuleCacheDirectory( cacheDirectory );
+
+    auto module = context->CompileFile( filename );
+    int result = module != nullptr ? 0 : 1;
+
+    if( module != nullptr )
+        module->Release();
+    context->Release();
+    return result;
+}
+
+SPARK_DLL void SparkReleaseShaderInstance(
+    void* instance )
+{
+    // Every instance starts with a pointer to its class desc,
+    // which records where the header lies.
+    auto desc = (const spark::ShaderClassDesc*) ((spark::InstanceBase*) instance)->info;
+    spark::InstancePool::FindHeader( instance, desc->sizeInBytes )->shaderClass->ReleaseInstance( instance );
+}
+
 SPARK_DLL void SparkRegisterHlslCompiler()
 {
     auto compiler = gcnew Spark::Emit::HLSL::HlslCompiler();
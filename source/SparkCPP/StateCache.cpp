@@ -0,0 +1,311 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// StateCache.cpp
+
+#define NOMINMAX
+#include <Windows.h>
+
+#define SPARK_DLL extern "C" __declspec(dllexport)
+
+#define SPARK_SKIP_PRAGMA_LIB
+#include <spark/spark.h>
+
+#include <string.h>
+
+#pragma unmanaged
+
+namespace spark
+{
+    namespace d3d11
+    {
+        static HRESULT CreateStateObject( ID3D11Device* device, const D3D11_SAMPLER_DESC* desc, ID3D11SamplerState** outState )
+        {
+            return device->CreateSamplerState( desc, outState );
+        }
+
+        static HRESULT CreateStateObject( ID3D11Device* device, const D3D11_RASTERIZER_DESC* desc, ID3D11RasterizerState** outState )
+        {
+            return device->CreateRasterizerState( desc, outState );
+        }
+
+        static HRESULT CreateStateObject( ID3D11Device* device, const D3D11_BLEND_DESC* desc, ID3D11BlendState** outState )
+        {
+            return device->CreateBlendState( desc, outState );
+        }
+
+        static HRESULT CreateStateObject( ID3D11Device* device, const D3D11_DEPTH_STENCIL_DESC* desc, ID3D11DepthStencilState** outState )
+        {
+            return device->CreateDepthStencilState( desc, outState );
+        }
+
+        // Cache of immutable state objects, keyed on (device, desc).
+        //
+        // These get looked up from per-frame code, possibly on several
+        // recording threads at once, so lookups don't take a lock:
+        // each bucket is a singly-linked list that is only ever
+        // extended at its head, and a node is fully initialized
+        // before it is published. Insertion is serialized by a lock,
+        // and re-checks the bucket so that each state is only created
+        // once.
+        //
+        // Instances are only ever declared at namespace scope, where
+        // zero-initialization gives a valid (empty) cache.
+        template<typename TDesc, typename TState>
+        class StateObjectCache
+        {
+        public:
+            TState* GetOrCreate(
+                ID3D11Device* device,
+                const TDesc& desc )
+            {
+                size_t hash = Hash( device, desc );
+                Node* volatile* bucket = &_buckets[hash % kBucketCount];
+
+                Node* node = Find( *bucket, hash, device, desc );
+                if( node != nullptr )
+                    return node->state;
+
+                ::AcquireSRWLockExclusive( &_lock );
+
+                TState* result = nullptr;
+                node = Find( *bucket, hash, device, desc );
+                if( node != nullptr )
+                {
+                    result = node->state;
+                }
+                else if( SUCCEEDED( CreateStateObject( device, &desc, &result ) ) )
+                {
+                    node = new Node();
+                    node->hash = hash;
+                    node->device = device;
+                    node->desc = desc;
+                    node->state = result;
+                    node->next = *bucket;
+
+                    // Make sure the node contents are visible before
+                    // the node itself is.
+                    ::InterlockedExchangePointer( (PVOID volatile*) bucket, node );
+                }
+
+                ::ReleaseSRWLockExclusive( &_lock );
+                return result;
+            }
+
+            // Not safe to call while other threads may still be
+            // looking up states for the same device.
+            void ReleaseDevice(
+                ID3D11Device* device )
+            {
+                ::AcquireSRWLockExclusive( &_lock );
+
+                for( int bb = 0; bb < kBucketCount; ++bb )
+                {
+                    Node* volatile* link = &_buckets[bb];
+                    while( *link != nullptr )
+                    {
+                        Node* node = *link;
+                        if( node->device != device )
+                        {
+                            link = &node->next;
+                            continue;
+                        }
+
+                        *link = node->next;
+                        node->state->Release();
+                        delete node;
+                    }
+                }
+
+                ::ReleaseSRWLockExclusive( &_lock );
+            }
+
+        private:
+            enum { kBucketCount = 256 };
+
+            struct Node
+            {
+                Node* volatile next;
+                size_t hash;
+                ID3D11Device* device;
+                TDesc desc;
+                TState* state;
+            };
+
+            static size_t Hash(
+                ID3D11Device* device,
+                const TDesc& desc )
+            {
+                // FNV-1a over the device pointer and the descriptor bytes.
+                // Descriptors are always zero-filled before use, so any
+                // padding bytes are consistent.
+                size_t hash = 2166136261U;
+                const unsigned char* bytes = (const unsigned char*) &device;
+                for( size_t ii = 0; ii < sizeof(device); ++ii )
+                    hash = (hash ^ bytes[ii]) * 16777619U;
+                bytes = (const unsigned char*) &desc;
+                for( size_t ii = 0; ii < sizeof(TDesc); ++ii )
+                    hash = (hash ^ bytes[ii]) * 16777619U;
+                return hash;
+            }
+
+            static Node* Find(
+                Node* node,
+                size_t hash,
+                ID3D11Device* device,
+                const TDesc& desc )
+            {
+                for( ; node != nullptr; node = node->next )
+                {
+                    if( node->hash == hash
+                        && node->device == device
+                        && memcmp( &node->desc, &desc, sizeof(TDesc) ) == 0 )
+                    {
+                        return node;
+                    }
+                }
+                return nullptr;
+            }
+
+            Node* volatile _buckets[kBucketCount];
+            SRWLOCK _lock;
+        };
+
+        static StateObjectCache<D3D11_SAMPLER_DESC, ID3D11SamplerState> gSamplerStates;
+        static StateObjectCache<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> gRasterizerStates;
+        static StateObjectCache<D3D11_BLEND_DESC, ID3D11BlendState> gBlendStates;
+        static StateObjectCache<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> gDepthStencilStates;
+
+        SPARK_DLL ID3D11SamplerState* CreateSamplerState(
+            ID3D11Device* device,
+            D3D11_FILTER                  filter,
+            D3D11_TEXTURE_ADDRESS_MODE    addressU,
+            D3D11_TEXTURE_ADDRESS_MODE    addressV,
+            D3D11_TEXTURE_ADDRESS_MODE    addressW,
+            float                         mipLODBias,
+            UINT                          maxAnisotropy,
+            D3D11_COMPARISON_FUNC         comparisonFunc,
+            float4                        borderColor,
+            float                         minLOD,
+            float                         maxLOD )
+        {
+            D3D11_SAMPLER_DESC desc;
+            memset( &desc, 0, sizeof(desc) );
+            desc.Filter = filter;
+            desc.AddressU = addressU;
+            desc.AddressV = addressV;
+            desc.AddressW = addressW;
+            desc.MipLODBias = mipLODBias;
+            desc.MaxAnisotropy = maxAnisotropy;
+            desc.ComparisonFunc = comparisonFunc;
+            for( int ii = 0; ii < 4; ++ii )
+                desc.BorderColor[ii] = borderColor[ii];
+            desc.MinLOD = minLOD;
+            desc.MaxLOD = maxLOD;
+
+            return gSamplerStates.GetOrCreate( device, desc );
+        }
+
+        SPARK_DLL ID3D11RasterizerState* CreateRasterizerState(
+            ID3D11Device*     device,
+            D3D11_FILL_MODE   fillMode,
+            D3D11_CULL_MODE   cullMode,
+            bool              frontCounterClockwise,
+            int               depthBias,
+            float             depthBiasClamp,
+            float             slopeScaledDepthBias,
+            bool              depthClipEnable,
+            bool              scissorEnable,
+            bool              multisampleEnable,
+            bool              antialiasedLineEnable )
+        {
+            D3D11_RASTERIZER_DESC desc;
+            memset( &desc, 0, sizeof(desc) );
+            desc.FillMode = fillMode;
+            desc.CullMode = cullMode;
+            desc.FrontCounterClockwise = frontCounterClockwise;
+            desc.DepthBias = depthBias;
+            desc.DepthBiasClamp = depthBiasClamp;
+            desc.SlopeScaledDepthBias = slopeScaledDepthBias;
+            desc.DepthClipEnable = depthClipEnable;
+            desc.ScissorEnable = scissorEnable;
+            desc.MultisampleEnable = multisampleEnable;
+            desc.AntialiasedLineEnable = antialiasedLineEnable;
+
+            return gRasterizerStates.GetOrCreate( device, desc );
+        }
+
+        SPARK_DLL ID3D11BlendState* CreateBlendState(
+            ID3D11Device*           device,
+            const D3D11_BLEND_DESC* desc )
+        {
+            // The cache hashes and compares descs bytewise, but the
+            // caller's desc has uninitialized padding after each
+            // RenderTargetWriteMask, so copy it into a zeroed one.
+            D3D11_BLEND_DESC key;
+            memset( &key, 0, sizeof(key) );
+            key.AlphaToCoverageEnable = desc->AlphaToCoverageEnable;
+            key.IndependentBlendEnable = desc->IndependentBlendEnable;
+            for( UINT ii = 0; ii < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++ii )
+            {
+                const D3D11_RENDER_TARGET_BLEND_DESC& src = desc->RenderTarget[ii];
+                D3D11_RENDER_TARGET_BLEND_DESC& dst = key.RenderTarget[ii];
+                dst.BlendEnable = src.BlendEnable;
+                dst.SrcBlend = src.SrcBlend;
+                dst.DestBlend = src.DestBlend;
+                dst.BlendOp = src.BlendOp;
+                dst.SrcBlendAlpha = src.SrcBlendAlpha;
+                dst.DestBlendAlpha = src.DestBlendAlpha;
+                dst.BlendOpAlpha = src.BlendOpAlpha;
+                dst.RenderTargetWriteMask = src.RenderTargetWriteMask;
+            }
+
+            return gBlendStates.GetOrCreate( device, key );
+        }
+
+        SPARK_DLL ID3D11DepthStencilState* CreateDepthStencilState(
+            ID3D11Device*           device,
+            bool                    depthEnable,
+            bool                    depthWriteEnable,
+            D3D11_COMPARISON_FUNC   depthFunc )
+        {
+            D3D11_DEPTH_STENCIL_DESC desc;
+            memset( &desc, 0, sizeof(desc) );
+            desc.DepthEnable = depthEnable;
+            desc.DepthWriteMask = depthWriteEnable ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO;
+            desc.DepthFunc = depthFunc;
+            desc.StencilEnable = FALSE;
+            desc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+            desc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+            desc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+            desc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+            desc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+            desc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+            desc.BackFace = desc.FrontFace;
+
+            return gDepthStencilStates.GetOrCreate( device, desc );
+        }
+
+        SPARK_DLL void ReleaseStateObjects(
+            ID3D11Device* device )
+        {
+            gSamplerStates.ReleaseDevice( device );
+            gRasterizerStates.ReleaseDevice( device );
+            gBlendStates.ReleaseDevice( device );
+            gDepthStencilStates.ReleaseDevice( device );
+        }
+    }
+}
+
+#pragma managed
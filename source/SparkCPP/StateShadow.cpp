@@ -0,0 +1,623 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// StateShadow.cpp
+
+#define NOMINMAX
+#include <Windows.h>
+
+#define SPARK_DLL extern "C" __declspec(dllexport)
+
+#define SPARK_SKIP_PRAGMA_LIB
+#include <spark/spark.h>
+
+#include <string.h>
+
+#pragma unmanaged
+
+namespace spark
+{
+    namespace d3d11
+    {
+        // {5C9D3A1E-8F0B-4E7C-A2D6-3B1F4C6E9A07}
+        static const GUID kStateShadowGuid =
+            { 0x5c9d3a1e, 0x8f0b, 0x4e7c, { 0xa2, 0xd6, 0x3b, 0x1f, 0x4c, 0x6e, 0x9a, 0x07 } };
+
+        // Value stored in every slot when the shadow doesn't know
+        // what is bound. It never matches a real object (or NULL),
+        // so the next call for that slot always goes through.
+        static void* const kUnknownState = (void*) ~(UINT_PTR) 0;
+
+        enum
+        {
+            kShaderStageCount = 5,
+            kMaxVertexBuffers = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT,
+            kMaxConstantBuffers = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT,
+            kMaxShaderResources = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT,
+            kMaxSamplers = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT,
+            kMaxRenderTargets = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT,
+        };
+
+        struct StateShadowState
+        {
+            void* shaders[kShaderStageCount];
+            void* constantBuffers[kShaderStageCount][kMaxConstantBuffers];
+            void* shaderResources[kShaderStageCount][kMaxShaderResources];
+            void* samplers[kShaderStageCount][kMaxSamplers];
+
+            void* inputLayout;
+            D3D11_PRIMITIVE_TOPOLOGY primitiveTopology;
+            void* indexBuffer;
+            DXGI_FORMAT indexFormat;
+            UINT indexOffset;
+            void* vertexBuffers[kMaxVertexBuffers];
+            UINT vertexBufferStrides[kMaxVertexBuffers];
+            UINT vertexBufferOffsets[kMaxVertexBuffers];
+
+            void* renderTargets[kMaxRenderTargets];
+            UINT renderTargetCount;
+            void* depthStencilView;
+
+            void* blendState;
+            FLOAT blendFactor[4];
+            UINT sampleMask;
+
+            void* rasterizerState;
+
+            void* depthStencilState;
+            UINT stencilRef;
+
+            StateShadowStats stats;
+        };
+
+        // Attached to the device context as private data with
+        // SetPrivateDataInterface, so that the context holds a
+        // reference and frees the shadow when it is destroyed,
+        // even if DisableStateShadow is never called.
+        class StateShadow : public IUnknown, public StateShadowState
+        {
+        public:
+            StateShadow()
+                : _referenceCount(1)
+            {
+                memset( static_cast<StateShadowState*>(this), 0, sizeof(StateShadowState) );
+            }
+
+            virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** outObject )
+            {
+                if( riid == __uuidof(IUnknown) )
+                {
+                    AddRef();
+                    *outObject = static_cast<IUnknown*>(this);
+                    return S_OK;
+                }
+                *outObject = nullptr;
+                return E_NOINTERFACE;
+            }
+
+            virtual ULONG STDMETHODCALLTYPE AddRef()
+            {
+                return ::InterlockedIncrement( &_referenceCount );
+            }
+
+            virtual ULONG STDMETHODCALLTYPE Release()
+            {
+                ULONG result = ::InterlockedDecrement( &_referenceCount );
+                if( result == 0 )
+                    delete this;
+                return result;
+            }
+
+        private:
+            ~StateShadow() {}
+
+            volatile LONG _referenceCount;
+        };
+
+        static void FillUnknown( void** slots, size_t count )
+        {
+            for( size_t ii = 0; ii < count; ++ii )
+                slots[ii] = kUnknownState;
+        }
+
+        static void InvalidateShadow( StateShadow* shadow )
+        {
+            FillUnknown( shadow->shaders, kShaderStageCount );
+            FillUnknown( &shadow->constantBuffers[0][0], kShaderStageCount*kMaxConstantBuffers );
+            FillUnknown( &shadow->shaderResources[0][0], kShaderStageCount*kMaxShaderResources );
+            FillUnknown( &shadow->samplers[0][0], kShaderStageCount*kMaxSamplers );
+            shadow->inputLayout = kUnknownState;
+            shadow->primitiveTopology = (D3D11_PRIMITIVE_TOPOLOGY) ~0;
+            shadow->indexBuffer = kUnknownState;
+            FillUnknown( shadow->vertexBuffers, kMaxVertexBuffers );
+            FillUnknown( shadow->renderTargets, kMaxRenderTargets );
+            shadow->renderTargetCount = ~0U;
+            shadow->depthStencilView = kUnknownState;
+            shadow->blendState = kUnknownState;
+            shadow->rasterizerState = kUnknownState;
+            shadow->depthStencilState = kUnknownState;
+        }
+
+        // Find the sub-range [first, last) of slots in which `values`
+        // differ from the shadow, and update the shadow to match.
+        // Returns false if nothing differs.
+        static bool UpdateSlots(
+            void** shadowSlots,
+            UINT count,
+            void* const* values,
+            UINT& outFirst,
+            UINT& outLast )
+        {
+            UINT first = count;
+            UINT last = 0;
+            for( UINT ii = 0; ii < count; ++ii )
+            {
+                if( shadowSlots[ii] == values[ii] )
+                    continue;
+
+                shadowSlots[ii] = values[ii];
+                if( first == count )
+                    first = ii;
+                last = ii + 1;
+            }
+
+            outFirst = first;
+            outLast = last;
+            return first != count;
+        }
+
+        static void CountCall( StateShadow* shadow, bool issued )
+        {
+            if( issued )
+                shadow->stats.issuedCallCount++;
+            else
+                shadow->stats.skippedCallCount++;
+        }
+
+        SPARK_DLL void EnableStateShadow(
+            ID3D11DeviceContext* context )
+        {
+            if( GetStateShadow( context ) != nullptr )
+                return;
+
+            auto shadow = new StateShadow();
+            InvalidateShadow( shadow );
+
+            context->SetPrivateDataInterface( kStateShadowGuid, shadow );
+            shadow->Release();
+        }
+
+        SPARK_DLL void DisableStateShadow(
+            ID3D11DeviceContext* context )
+        {
+            // Dropping the context's reference frees the shadow.
+            context->SetPrivateDataInterface( kStateShadowGuid, nullptr );
+        }
+
+        SPARK_DLL void InvalidateStateShadow(
+            ID3D11DeviceContext* context )
+        {
+            auto shadow = (StateShadow*) GetStateShadow( context );
+            if( shadow == nullptr )
+                return;
+
+            InvalidateShadow( shadow );
+        }
+
+        // Forget what is bound to the outputs, and (since binding
+        // an output unbinds any views of the same resource) all of
+        // the shader-resource bindings.
+        static void InvalidateShadowOutputs( StateShadow* shadow )
+        {
+            FillUnknown( &shadow->shaderResources[0][0], kShaderStageCount*kMaxShaderResources );
+            FillUnknown( shadow->renderTargets, kMaxRenderTargets );
+            shadow->renderTargetCount = ~0U;
+            shadow->depthStencilView = kUnknownState;
+        }
+
+        SPARK_DLL void InvalidateStateShadowOutputs(
+            ID3D11DeviceContext* context )
+        {
+            auto shadow = (StateShadow*) GetStateShadow( context );
+            if( shadow == nullptr )
+                return;
+
+            InvalidateShadowOutputs( shadow );
+        }
+
+        SPARK_DLL void GetStateShadowStats(
+            ID3D11DeviceContext* context,
+            StateShadowStats* outStats )
+        {
+            auto shadow = (StateShadow*) GetStateShadow( context );
+            if( shadow == nullptr )
+            {
+                memset( outStats, 0, sizeof(StateShadowStats) );
+                return;
+            }
+
+            *outStats = shadow->stats;
+        }
+
+        SPARK_DLL void* GetStateShadow(
+            ID3D11DeviceContext* context )
+        {
+            IUnknown* data = nullptr;
+            UINT size = sizeof(data);
+            if( FAILED( context->GetPrivateData( kStateShadowGuid, &size, &data ) )
+                || data == nullptr )
+            {
+                return nullptr;
+            }
+
+            // The context keeps its own reference, and the caller
+            // only uses the shadow while the context is alive, so
+            // we don't need to hold one.
+            data->Release();
+            return static_cast<StateShadow*>(data);
+        }
+
+        SPARK_DLL void* ResolveStateShadow(
+            ID3D11DeviceContext* context,
+            void* stateShadow )
+        {
+            if( stateShadow == kLookupStateShadow )
+                return GetStateShadow( context );
+            return stateShadow;
+        }
+
+        SPARK_DLL void ShadowSetShader(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            ID3D11DeviceChild* shader )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed = shadow->shaders[stage] != shader;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+                shadow->shaders[stage] = shader;
+            }
+
+            switch( stage )
+            {
+            case kShaderStage_Vertex:
+                context->VSSetShader( (ID3D11VertexShader*) shader, nullptr, 0 );
+                break;
+            case kShaderStage_Hull:
+                context->HSSetShader( (ID3D11HullShader*) shader, nullptr, 0 );
+                break;
+            case kShaderStage_Domain:
+                context->DSSetShader( (ID3D11DomainShader*) shader, nullptr, 0 );
+                break;
+            case kShaderStage_Geometry:
+                context->GSSetShader( (ID3D11GeometryShader*) shader, nullptr, 0 );
+                break;
+            case kShaderStage_Pixel:
+                context->PSSetShader( (ID3D11PixelShader*) shader, nullptr, 0 );
+                break;
+            }
+        }
+
+        SPARK_DLL void ShadowSetConstantBuffers(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            UINT startSlot,
+            UINT count,
+            ID3D11Buffer* const* buffers )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                UINT first, last;
+                bool changed = UpdateSlots(
+                    &shadow->constantBuffers[stage][startSlot],
+                    count,
+                    (void* const*) buffers,
+                    first,
+                    last );
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+
+                startSlot += first;
+                buffers += first;
+                count = last - first;
+            }
+
+            switch( stage )
+            {
+            case kShaderStage_Vertex:   context->VSSetConstantBuffers( startSlot, count, buffers ); break;
+            case kShaderStage_Hull:     context->HSSetConstantBuffers( startSlot, count, buffers ); break;
+            case kShaderStage_Domain:   context->DSSetConstantBuffers( startSlot, count, buffers ); break;
+            case kShaderStage_Geometry: context->GSSetConstantBuffers( startSlot, count, buffers ); break;
+            case kShaderStage_Pixel:    context->PSSetConstantBuffers( startSlot, count, buffers ); break;
+            }
+        }
+
+        SPARK_DLL void ShadowSetShaderResources(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            UINT startSlot,
+            UINT count,
+            ID3D11ShaderResourceView* const* views )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                UINT first, last;
+                bool changed = UpdateSlots(
+                    &shadow->shaderResources[stage][startSlot],
+                    count,
+                    (void* const*) views,
+                    first,
+                    last );
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+
+                startSlot += first;
+                views += first;
+                count = last - first;
+            }
+
+            switch( stage )
+            {
+            case kShaderStage_Vertex:   context->VSSetShaderResources( startSlot, count, views ); break;
+            case kShaderStage_Hull:     context->HSSetShaderResources( startSlot, count, views ); break;
+            case kShaderStage_Domain:   context->DSSetShaderResources( startSlot, count, views ); break;
+            case kShaderStage_Geometry: context->GSSetShaderResources( startSlot, count, views ); break;
+            case kShaderStage_Pixel:    context->PSSetShaderResources( startSlot, count, views ); break;
+            }
+        }
+
+        SPARK_DLL void ShadowSetSamplers(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT stage,
+            UINT startSlot,
+            UINT count,
+            ID3D11SamplerState* const* samplers )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                UINT first, last;
+                bool changed = UpdateSlots(
+                    &shadow->samplers[stage][startSlot],
+                    count,
+                    (void* const*) samplers,
+                    first,
+                    last );
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+
+                startSlot += first;
+                samplers += first;
+                count = last - first;
+            }
+
+            switch( stage )
+            {
+            case kShaderStage_Vertex:   context->VSSetSamplers( startSlot, count, samplers ); break;
+            case kShaderStage_Hull:     context->HSSetSamplers( startSlot, count, samplers ); break;
+            case kShaderStage_Domain:   context->DSSetSamplers( startSlot, count, samplers ); break;
+            case kShaderStage_Geometry: context->GSSetSamplers( startSlot, count, samplers ); break;
+            case kShaderStage_Pixel:    context->PSSetSamplers( startSlot, count, samplers ); break;
+            }
+        }
+
+        SPARK_DLL void ShadowSetInputLayout(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11InputLayout* inputLayout )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed = shadow->inputLayout != inputLayout;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+                shadow->inputLayout = inputLayout;
+            }
+
+            context->IASetInputLayout( inputLayout );
+        }
+
+        SPARK_DLL void ShadowSetDrawSpan(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            const DrawSpan* drawSpanOverride,
+            DrawSpan drawSpan )
+        {
+            const DrawSpan& span = drawSpanOverride != nullptr ? *drawSpanOverride : drawSpan;
+            const IndexStream& indexStream = span.indexStream;
+            D3D11_PRIMITIVE_TOPOLOGY primitiveTopology = span.primitiveSpan.primitiveTopology;
+
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow == nullptr )
+            {
+                context->IASetPrimitiveTopology( primitiveTopology );
+                context->IASetIndexBuffer( indexStream.buffer, indexStream.format, indexStream.offset );
+                return;
+            }
+
+            bool topologyChanged = shadow->primitiveTopology != primitiveTopology;
+            CountCall( shadow, topologyChanged );
+            if( topologyChanged )
+            {
+                shadow->primitiveTopology = primitiveTopology;
+                context->IASetPrimitiveTopology( primitiveTopology );
+            }
+
+            bool indexStreamChanged =
+                   shadow->indexBuffer != indexStream.buffer
+                || shadow->indexFormat != indexStream.format
+                || shadow->indexOffset != indexStream.offset;
+            CountCall( shadow, indexStreamChanged );
+            if( indexStreamChanged )
+            {
+                shadow->indexBuffer = indexStream.buffer;
+                shadow->indexFormat = indexStream.format;
+                shadow->indexOffset = indexStream.offset;
+                context->IASetIndexBuffer( indexStream.buffer, indexStream.format, indexStream.offset );
+            }
+        }
+
+        SPARK_DLL void SubmitDrawSpan(
+            ID3D11DeviceContext* context,
+            const DrawSpan* drawSpanOverride,
+            DrawSpan drawSpan )
+        {
+            if( drawSpanOverride != nullptr )
+                drawSpan = *drawSpanOverride;
+
+            drawSpan.Submit( context );
+        }
+
+        SPARK_DLL void ShadowSetVertexBuffers(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT startSlot,
+            UINT count,
+            ID3D11Buffer* const* buffers,
+            const UINT* strides,
+            const UINT* offsets )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed =
+                       memcmp( &shadow->vertexBuffers[startSlot], buffers, count*sizeof(void*) ) != 0
+                    || memcmp( &shadow->vertexBufferStrides[startSlot], strides, count*sizeof(UINT) ) != 0
+                    || memcmp( &shadow->vertexBufferOffsets[startSlot], offsets, count*sizeof(UINT) ) != 0;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+
+                memcpy( &shadow->vertexBuffers[startSlot], buffers, count*sizeof(void*) );
+                memcpy( &shadow->vertexBufferStrides[startSlot], strides, count*sizeof(UINT) );
+                memcpy( &shadow->vertexBufferOffsets[startSlot], offsets, count*sizeof(UINT) );
+            }
+
+            context->IASetVertexBuffers( startSlot, count, buffers, strides, offsets );
+        }
+
+        SPARK_DLL void ShadowSetRenderTargets(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            UINT count,
+            ID3D11RenderTargetView* const* renderTargetViews,
+            ID3D11DepthStencilView* depthStencilView )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed =
+                       shadow->renderTargetCount != count
+                    || shadow->depthStencilView != depthStencilView
+                    || memcmp( shadow->renderTargets, renderTargetViews, count*sizeof(void*) ) != 0;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+
+                shadow->renderTargetCount = count;
+                shadow->depthStencilView = depthStencilView;
+                memcpy( shadow->renderTargets, renderTargetViews, count*sizeof(void*) );
+
+                // Binding new outputs makes the runtime unbind any
+                // shader resources that alias them, so we can no
+                // longer trust the shadowed resource bindings.
+                FillUnknown( &shadow->shaderResources[0][0], kShaderStageCount*kMaxShaderResources );
+            }
+
+            context->OMSetRenderTargets( count, renderTargetViews, depthStencilView );
+        }
+
+        SPARK_DLL void ShadowSetBlendState(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11BlendState* blendState,
+            const FLOAT* blendFactor,
+            UINT sampleMask )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed =
+                       shadow->blendState != blendState
+                    || shadow->sampleMask != sampleMask
+                    || memcmp( shadow->blendFactor, blendFactor, sizeof(shadow->blendFactor) ) != 0;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+
+                shadow->blendState = blendState;
+                shadow->sampleMask = sampleMask;
+                memcpy( shadow->blendFactor, blendFactor, sizeof(shadow->blendFactor) );
+            }
+
+            context->OMSetBlendState( blendState, blendFactor, sampleMask );
+        }
+
+        SPARK_DLL void ShadowSetRasterizerState(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11RasterizerState* rasterizerState )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed = shadow->rasterizerState != rasterizerState;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+                shadow->rasterizerState = rasterizerState;
+            }
+
+            context->RSSetState( rasterizerState );
+        }
+
+        SPARK_DLL void ShadowSetDepthStencilState(
+            ID3D11DeviceContext* context,
+            void* stateShadow,
+            ID3D11DepthStencilState* depthStencilState,
+            UINT stencilRef )
+        {
+            auto shadow = (StateShadow*) stateShadow;
+            if( shadow != nullptr )
+            {
+                bool changed =
+                       shadow->depthStencilState != depthStencilState
+                    || shadow->stencilRef != stencilRef;
+                CountCall( shadow, changed );
+                if( !changed )
+                    return;
+                shadow->depthStencilState = depthStencilState;
+                shadow->stencilRef = stencilRef;
+            }
+
+            context->OMSetDepthStencilState( depthStencilState, stencilRef );
+        }
+    }
+}
+
+#pragma managed
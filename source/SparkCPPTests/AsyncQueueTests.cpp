@@ -0,0 +1,291 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// AsyncQueueTests.cpp
+
+#include "TestHarness.h"
+
+#include "AsyncQueue.h"
+
+#include <vector>
+
+using namespace sparktest;
+using namespace spark;
+
+namespace
+{
+    // A flag that threads can wait on.
+    class Gate
+    {
+    public:
+        Gate()
+            : _open(false)
+        {
+            ::InitializeSRWLock( &_lock );
+            ::InitializeConditionVariable( &_changed );
+        }
+
+        void Open()
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            _open = true;
+            ::ReleaseSRWLockExclusive( &_lock );
+            ::WakeAllConditionVariable( &_changed );
+        }
+
+        void WaitOpen()
+        {
+            ::AcquireSRWLockExclusive( &_lock );
+            while( !_open )
+                ::SleepConditionVariableSRW( &_changed, &_lock, INFINITE, 0 );
+            ::ReleaseSRWLockExclusive( &_lock );
+        }
+
+    private:
+        SRWLOCK _lock;
+        CONDITION_VARIABLE _changed;
+        bool _open;
+    };
+
+    // What the requests of one test did, in order.
+    struct QueueLog
+    {
+        QueueLog()
+            : destroyedCount(0)
+        {
+            ::InitializeSRWLock( &lock );
+        }
+
+        void Executed( int id )
+        {
+            ::AcquireSRWLockExclusive( &lock );
+            executed.push_back( id );
+            ::ReleaseSRWLockExclusive( &lock );
+        }
+
+        std::vector<int> GetExecuted()
+        {
+            ::AcquireSRWLockExclusive( &lock );
+            auto result = executed;
+            ::ReleaseSRWLockExclusive( &lock );
+            return result;
+        }
+
+        SRWLOCK lock;
+        std::vector<int> executed;
+        volatile LONG destroyedCount;
+        Gate contextDestroyed;
+    };
+
+    // Owns a queue, like Context does, and deletes itself (and
+    // the queue with it) on the last Release. Nothing but the
+    // reference count is used by the queue.
+    class TestContext : public IContext
+    {
+    public:
+        TestContext( QueueLog* log )
+            : _referenceCount(1)
+            , _log(log)
+        {
+            _queue.SetOwner( this );
+        }
+
+        AsyncQueue& GetQueue() { return _queue; }
+
+        virtual void Acquire()
+        {
+            ::InterlockedIncrement( &_referenceCount );
+        }
+
+        virtual void Release()
+        {
+            if( ::InterlockedDecrement( &_referenceCount ) != 0 )
+                return;
+
+            auto log = _log;
+            delete this;
+            log->contextDestroyed.Open();
+        }
+
+        virtual IModule* SPARK_CALL CompileFile( const char* ) { return nullptr; }
+        virtual IAsyncRequest* SPARK_CALL CompileFileAsync( const char*, int ) { return nullptr; }
+        virtual IShaderClass* SPARK_CALL FindOrLoadShaderClass( const ShaderClassDesc* ) { return nullptr; }
+        virtual void SPARK_CALL SetModuleCacheDirectory( const char* ) {}
+        virtual void SPARK_CALL GetModuleCacheStats( ModuleCacheStats* ) {}
+        virtual void SPARK_CALL ReclaimMemory() {}
+        virtual void SPARK_CALL GetMemoryStats( ContextMemoryStats* ) {}
+        virtual void SPARK_CALL SetIRTraceFile( const char* ) {}
+
+    private:
+        volatile LONG _referenceCount;
+        QueueLog* _log;
+        AsyncQueue _queue;
+    };
+
+    // Logs its id when run; a request given a gate signals that
+    // it has started, and then blocks the worker until the gate
+    // is opened, so that the test can queue up work behind it.
+    class TestRequest : public AsyncRequest
+    {
+    public:
+        TestRequest(
+            TestContext* context,
+            QueueLog* log,
+            int id,
+            int priority,
+            Gate* started = nullptr,
+            Gate* proceed = nullptr )
+            : AsyncRequest( context, &context->GetQueue(), priority )
+            , _log(log)
+            , _id(id)
+            , _started(started)
+            , _proceed(proceed)
+        {}
+
+        virtual void Execute()
+        {
+            _log->Executed( _id );
+            if( _started != nullptr )
+                _started->Open();
+            if( _proceed != nullptr )
+                _proceed->WaitOpen();
+        }
+
+    protected:
+        ~TestRequest()
+        {
+            ::InterlockedIncrement( &_log->destroyedCount );
+        }
+
+    private:
+        QueueLog* _log;
+        int _id;
+        Gate* _started;
+        Gate* _proceed;
+    };
+
+    TestRequest* Submit(
+        TestContext* context,
+        TestRequest* request )
+    {
+        context->GetQueue().Submit( request );
+        return request;
+    }
+}
+
+SPARK_TEST( AsyncQueue_RunsHighestPriorityFirst )
+{
+    QueueLog log;
+    auto context = new TestContext( &log );
+
+    // Hold the worker in request 0 while the rest are queued
+    Gate started, proceed;
+    std::vector<TestRequest*> requests;
+    requests.push_back( Submit( context, new TestRequest( context, &log, 0, 0, &started, &proceed ) ) );
+    started.WaitOpen();
+
+    static const int kPriorities[] = { 0, 5, 1, 5, 0 };
+    for( int ii = 0; ii < 5; ++ii )
+        requests.push_back( Submit( context, new TestRequest( context, &log, ii + 1, kPriorities[ii] ) ) );
+
+    // Reprioritizing a waiting request moves it ahead
+    requests[5]->SetPriority( 9 );
+    CHECK_EQUAL( kAsyncStatus_Running, requests[0]->GetStatus() );
+    CHECK_EQUAL( kAsyncStatus_Pending, requests[1]->GetStatus() );
+
+    // Highest priority first, and in submission order among equals.
+    // (Waiting on a request moves it to the front, so wait on them
+    // in the order they are expected to run.)
+    static const int kExpected[] = { 0, 5, 2, 4, 3, 1 };
+    proceed.Open();
+    for( int ii = 0; ii < 6; ++ii )
+        CHECK_EQUAL( kAsyncStatus_Completed, requests[kExpected[ii]]->Wait() );
+    CHECK( log.GetExecuted() == std::vector<int>( kExpected, kExpected + 6 ) );
+
+    // Too late to change anything now
+    requests[1]->SetPriority( 100 );
+    CHECK( !requests[1]->Cancel() );
+    CHECK_EQUAL( kAsyncStatus_Completed, requests[1]->GetStatus() );
+
+    // The worker may still be dropping its last reference to a
+    // request that has just completed, but every request holds a
+    // reference to the context, so all are gone once it is.
+    for( auto ii = requests.begin(), ie = requests.end(); ii != ie; ++ii )
+        (*ii)->Release();
+    context->Release();
+    log.contextDestroyed.WaitOpen();
+    CHECK_EQUAL( 6, log.destroyedCount );
+}
+
+SPARK_TEST( AsyncQueue_CancelsOnlyPendingRequests )
+{
+    QueueLog log;
+    auto context = new TestContext( &log );
+
+    Gate started, proceed;
+    auto running = Submit( context, new TestRequest( context, &log, 0, 0, &started, &proceed ) );
+    started.WaitOpen();
+
+    auto cancelled = Submit( context, new TestRequest( context, &log, 1, 0 ) );
+    auto kept = Submit( context, new TestRequest( context, &log, 2, 0 ) );
+
+    CHECK( !running->Cancel() );
+    CHECK( cancelled->Cancel() );
+    CHECK_EQUAL( kAsyncStatus_Cancelled, cancelled->GetStatus() );
+    CHECK( !cancelled->Cancel() );
+
+    // A cancelled request doesn't block, and drops the queue's
+    // reference right away
+    CHECK_EQUAL( kAsyncStatus_Cancelled, cancelled->Wait() );
+    cancelled->Release();
+    CHECK_EQUAL( 1, log.destroyedCount );
+
+    proceed.Open();
+    CHECK_EQUAL( kAsyncStatus_Completed, kept->Wait() );
+    CHECK_EQUAL( kAsyncStatus_Completed, running->Wait() );
+
+    static const int kExpected[] = { 0, 2 };
+    CHECK( log.GetExecuted() == std::vector<int>( kExpected, kExpected + 2 ) );
+
+    running->Release();
+    kept->Release();
+    context->Release();
+    log.contextDestroyed.WaitOpen();
+    CHECK_EQUAL( 3, log.destroyedCount );
+}
+
+SPARK_TEST( AsyncQueue_ShutdownRunsPendingRequests )
+{
+    QueueLog log;
+    auto context = new TestContext( &log );
+
+    Gate started, proceed;
+    Submit( context, new TestRequest( context, &log, 0, 0, &started, &proceed ) )->Release();
+    started.WaitOpen();
+    for( int ii = 1; ii < 4; ++ii )
+        Submit( context, new TestRequest( context, &log, ii, 0 ) )->Release();
+
+    // Dropping every reference the application holds leaves the
+    // context alive until the worker has drained the queue; the
+    // worker's own release then destroys it (and the queue).
+    context->Release();
+    CHECK_EQUAL( 0, log.destroyedCount );
+
+    proceed.Open();
+    log.contextDestroyed.WaitOpen();
+
+    static const int kExpected[] = { 0, 1, 2, 3 };
+    CHECK( log.GetExecuted() == std::vector<int>( kExpected, kExpected + 4 ) );
+    CHECK_EQUAL( 4, log.destroyedCount );
+}
@@ -0,0 +1,253 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// ConstantBufferRingTests.cpp
+
+#include "TestHarness.h"
+#include "MockD3D11.h"
+
+#include <spark/spark.h>
+
+#include <limits.h>
+#include <process.h>
+#include <vector>
+
+using namespace sparktest;
+using namespace spark::d3d11;
+
+namespace
+{
+    const UINT kThreadCount = 8;
+    const UINT kDrawsPerThread = 2000;
+    const UINT kSmallBufferSize = 64;
+    const UINT kLargeBufferSize = 1024;
+
+    // Every thread records draws of the same two "instances"
+    // (one shadow per constant buffer), each into its own
+    // deferred context, the way generated Submit code does.
+    struct RecordingThread
+    {
+        MockDeviceContext* context;
+        void* smallShadow;
+        void* largeShadow;
+        ID3D11Buffer* instanceBuffer;
+        UINT threadIndex;
+        volatile LONG* failureCount;
+    };
+
+    void FillPattern( UINT* data, UINT size, UINT seed )
+    {
+        for( UINT ii = 0; ii < size / sizeof(UINT); ++ii )
+            data[ii] = seed + ii;
+    }
+
+    bool CheckPattern( ID3D11Buffer* buffer, UINT size, UINT seed )
+    {
+        auto& data = static_cast<MockBuffer*>(buffer)->GetData();
+        if( data.size() != size )
+            return false;
+
+        const UINT* words = (const UINT*) &data[0];
+        for( UINT ii = 0; ii < size / sizeof(UINT); ++ii )
+        {
+            if( words[ii] != seed + ii )
+                return false;
+        }
+        return true;
+    }
+
+    unsigned __stdcall RecordDraws( void* arg )
+    {
+        auto thread = (RecordingThread*) arg;
+        for( UINT dd = 0; dd < kDrawsPerThread; ++dd )
+        {
+            UINT smallSeed = (thread->threadIndex << 24) | (dd << 4);
+            UINT largeSeed = smallSeed | 1;
+
+            // Begin all updates before ending any, in the same order.
+            auto smallData = (UINT*) BeginConstantBufferUpdate( thread->context, thread->smallShadow );
+            auto largeData = (UINT*) BeginConstantBufferUpdate( thread->context, thread->largeShadow );
+            FillPattern( smallData, kSmallBufferSize, smallSeed );
+            FillPattern( largeData, kLargeBufferSize, largeSeed );
+
+            auto smallBuffer = EndConstantBufferUpdate( thread->context, thread->instanceBuffer, thread->smallShadow );
+            auto largeBuffer = EndConstantBufferUpdate( thread->context, thread->instanceBuffer, thread->largeShadow );
+
+            bool ok =
+                   smallBuffer != nullptr
+                && largeBuffer != nullptr
+                && smallBuffer != thread->instanceBuffer
+                && largeBuffer != thread->instanceBuffer
+                && CheckPattern( smallBuffer, kSmallBufferSize, smallSeed )
+                && CheckPattern( largeBuffer, kLargeBufferSize, largeSeed );
+            if( !ok )
+                ::InterlockedIncrement( thread->failureCount );
+        }
+        return 0;
+    }
+}
+
+SPARK_TEST( ConstantBufferRing_DeferredContextsRecordConcurrently )
+{
+    LONG baseObjectCount = gMockObjectCount;
+    {
+        auto device = new MockDevice();
+
+        D3D11_BUFFER_DESC desc;
+        memset( &desc, 0, sizeof(desc) );
+        desc.ByteWidth = kSmallBufferSize;
+        ID3D11Buffer* instanceBuffer = nullptr;
+        device->CreateBuffer( &desc, nullptr, &instanceBuffer );
+
+        void* smallShadow = CreateConstantBufferShadow( kSmallBufferSize );
+        void* largeShadow = CreateConstantBufferShadow( kLargeBufferSize );
+
+        ConstantBufferUploadStats statsBefore;
+        GetConstantBufferUploadStats( &statsBefore );
+
+        volatile LONG failureCount = 0;
+        RecordingThread threads[kThreadCount];
+        HANDLE handles[kThreadCount];
+        for( UINT tt = 0; tt < kThreadCount; ++tt )
+        {
+            threads[tt].context = new MockDeviceContext( device, D3D11_DEVICE_CONTEXT_DEFERRED );
+            threads[tt].smallShadow = smallShadow;
+            threads[tt].largeShadow = largeShadow;
+            threads[tt].instanceBuffer = instanceBuffer;
+            threads[tt].threadIndex = tt;
+            threads[tt].failureCount = &failureCount;
+        }
+        for( UINT tt = 0; tt < kThreadCount; ++tt )
+            handles[tt] = (HANDLE) _beginthreadex( nullptr, 0, &RecordDraws, &threads[tt], 0, nullptr );
+
+        ::WaitForMultipleObjects( kThreadCount, handles, TRUE, INFINITE );
+        for( UINT tt = 0; tt < kThreadCount; ++tt )
+            ::CloseHandle( handles[tt] );
+
+        CHECK_EQUAL( 0, failureCount );
+
+        // Deferred contexts never skip an upload.
+        ConstantBufferUploadStats statsAfter;
+        GetConstantBufferUploadStats( &statsAfter );
+        CHECK_EQUAL( 2 * kThreadCount * kDrawsPerThread, statsAfter.uploadCount - statsBefore.uploadCount );
+        CHECK_EQUAL( statsBefore.skippedUploadCount, statsAfter.skippedUploadCount );
+
+        // Each context only ever creates a bounded ring of
+        // buffers per size, however many draws it records.
+        CHECK( device->GetCreatedBufferCount() <= 1 + (LONG) (2 * kThreadCount * 4) );
+        for( UINT tt = 0; tt < kThreadCount; ++tt )
+        {
+            CHECK_EQUAL( (int) (2 * kDrawsPerThread), threads[tt].context->GetCallCount( "Map" ) );
+            CHECK_EQUAL( 1, threads[tt].context->GetCallCount( "SetPrivateDataInterface" ) );
+        }
+
+        // The instance's own shadow isn't touched by deferred
+        // contexts, so an immediate context still starts clean.
+        auto immediate = new MockDeviceContext( device );
+        auto staging = (UINT*) BeginConstantBufferUpdate( immediate, smallShadow );
+        FillPattern( staging, kSmallBufferSize, 7 );
+        CHECK( EndConstantBufferUpdate( immediate, instanceBuffer, smallShadow ) == instanceBuffer );
+        CHECK( CheckPattern( instanceBuffer, kSmallBufferSize, 7 ) );
+        immediate->Release();
+
+        // Releasing the contexts releases their rings (held as
+        // private data), and with them the ring buffers.
+        for( UINT tt = 0; tt < kThreadCount; ++tt )
+            threads[tt].context->Release();
+
+        DestroyConstantBufferShadow( smallShadow );
+        DestroyConstantBufferShadow( largeShadow );
+        instanceBuffer->Release();
+        device->Release();
+    }
+    CHECK_EQUAL( baseObjectCount, gMockObjectCount );
+}
+
+SPARK_TEST( ConstantBufferRing_ContextReleasedMidStream )
+{
+    LONG baseObjectCount = gMockObjectCount;
+    {
+        auto device = new MockDevice();
+        void* shadow = CreateConstantBufferShadow( kSmallBufferSize );
+
+        // A context that records one draw and is released (as after
+        // FinishCommandList) must take its ring with it; a new
+        // context gets a fresh one.
+        for( int ii = 0; ii < 16; ++ii )
+        {
+            auto context = new MockDeviceContext( device, D3D11_DEVICE_CONTEXT_DEFERRED );
+            auto staging = (UINT*) BeginConstantBufferUpdate( context, shadow );
+            FillPattern( staging, kSmallBufferSize, ii );
+            auto buffer = EndConstantBufferUpdate( context, nullptr, shadow );
+            CHECK( buffer != nullptr );
+            CHECK( CheckPattern( buffer, kSmallBufferSize, ii ) );
+            context->Release();
+        }
+
+        CHECK_EQUAL( 16, device->GetCreatedBufferCount() );
+        DestroyConstantBufferShadow( shadow );
+        device->Release();
+    }
+    CHECK_EQUAL( baseObjectCount, gMockObjectCount );
+}
+
+SPARK_TEST( ConstantBufferRing_UniformRecomputeSkipsUnchangedInputs )
+{
+    LONG baseObjectCount = gMockObjectCount;
+    {
+        auto device = new MockDevice();
+        auto immediate = new MockDeviceContext( device );
+
+        // As in generated code: the constructor sets the cached
+        // version so that no inputs match it, and each setter
+        // bumps the version of its input.
+        UINT cachedVersion = UINT_MAX;
+        UINT inputVersions[2] = { 0, 0 };
+        ++inputVersions[0];
+
+        UniformRecomputeStats statsBefore;
+        GetUniformRecomputeStats( &statsBefore );
+
+        // The first draw computes the values; the second, with
+        // the same inputs, skips them.
+        CHECK( CheckUniformInputVersions( immediate, &cachedVersion, inputVersions, 2 ) != 0 );
+        CHECK( CheckUniformInputVersions( immediate, &cachedVersion, inputVersions, 2 ) == 0 );
+
+        UniformRecomputeStats statsAfter;
+        GetUniformRecomputeStats( &statsAfter );
+        CHECK_EQUAL( 1u, statsAfter.recomputeCount - statsBefore.recomputeCount );
+        CHECK_EQUAL( 1u, statsAfter.skippedRecomputeCount - statsBefore.skippedRecomputeCount );
+
+        // Setting either input again forces a recompute.
+        ++inputVersions[1];
+        CHECK( CheckUniformInputVersions( immediate, &cachedVersion, inputVersions, 2 ) != 0 );
+        CHECK( CheckUniformInputVersions( immediate, &cachedVersion, inputVersions, 2 ) == 0 );
+
+        GetUniformRecomputeStats( &statsAfter );
+        CHECK_EQUAL( 2u, statsAfter.recomputeCount - statsBefore.recomputeCount );
+        CHECK_EQUAL( 2u, statsAfter.skippedRecomputeCount - statsBefore.skippedRecomputeCount );
+
+        // A deferred context stages into a fresh buffer, so it
+        // always recomputes, and leaves the cached version alone.
+        auto deferred = new MockDeviceContext( device, D3D11_DEVICE_CONTEXT_DEFERRED );
+        UINT versionBefore = cachedVersion;
+        CHECK( CheckUniformInputVersions( deferred, &cachedVersion, inputVersions, 2 ) != 0 );
+        CHECK_EQUAL( versionBefore, cachedVersion );
+
+        deferred->Release();
+        immediate->Release();
+        device->Release();
+    }
+    CHECK_EQUAL( baseObjectCount, gMockObjectCount );
+}
@@ -0,0 +1,166 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// DynamicCastTests.cpp
+
+#include "TestHarness.h"
+
+#include <spark/spark.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace sparktest;
+
+namespace
+{
+    // Mirrors the facet tables the emitter writes for each shader
+    // class: {name, hash, offset} entries sorted by hash.
+    struct TestFacetInfo
+    {
+        const char* name;
+        unsigned int hash;
+        int offset;
+    };
+
+    struct TestClassInfo
+    {
+        int size;
+        int facetCount;
+        const TestFacetInfo* facets;
+    };
+
+    bool CompareFacetHashes( const TestFacetInfo& left, const TestFacetInfo& right )
+    {
+        return left.hash < right.hash;
+    }
+
+    class TestClass
+    {
+    public:
+        void AddFacet( const char* name, int offset )
+        {
+            TestFacetInfo facet = { name, spark::ShaderInstance::HashFacetName( name ), offset };
+            _facets.push_back( facet );
+            std::sort( _facets.begin(), _facets.end(), &CompareFacetHashes );
+
+            _info.size = 256;
+            _info.facetCount = (int) _facets.size();
+            _info.facets = &_facets[0];
+        }
+
+        // Overwrite the table in place, as if the class had been
+        // freed and another allocated at the same address.
+        void ReplaceFacets( const char* const* names, const int* offsets, int count )
+        {
+            for( int ff = 0; ff < count; ++ff )
+            {
+                _facets[ff].name = names[ff];
+                _facets[ff].hash = spark::ShaderInstance::HashFacetName( names[ff] );
+                _facets[ff].offset = offsets[ff];
+            }
+            std::sort( _facets.begin(), _facets.end(), &CompareFacetHashes );
+        }
+
+        const TestClassInfo* GetInfo() const { return &_info; }
+
+    private:
+        std::vector<TestFacetInfo> _facets;
+        TestClassInfo _info;
+    };
+
+    class TestInstance : public spark::ShaderInstance
+    {
+    public:
+        TestInstance( const TestClass& shaderClass )
+        {
+            _shaderClassInfo = (void*) shaderClass.GetInfo();
+            _referenceCount = 1;
+        }
+
+        size_t OffsetOf( void* facet ) const
+        {
+            return facet == nullptr ? ~(size_t) 0 : (unsigned char*) facet - (const unsigned char*) this;
+        }
+    };
+
+    struct Lighting { static const char* StaticGetShaderClassName() { return "Lighting"; } };
+    struct Skinning { static const char* StaticGetShaderClassName() { return "Skinning"; } };
+    struct Fog { static const char* StaticGetShaderClassName() { return "Fog"; } };
+}
+
+SPARK_TEST( DynamicCast_FindsFacetsByName )
+{
+    TestClass shaderClass;
+    shaderClass.AddFacet( "Lighting", 16 );
+    shaderClass.AddFacet( "Skinning", 32 );
+    shaderClass.AddFacet( "Model", 0 );
+
+    TestInstance instance( shaderClass );
+    CHECK_EQUAL( 0u, instance.OffsetOf( instance.DynamicCast( "Model" ) ) );
+    CHECK_EQUAL( 32u, instance.OffsetOf( instance.DynamicCast( "Skinning" ) ) );
+    CHECK_EQUAL( 16u, instance.OffsetOf( instance.DynamicCast<Lighting>() ) );
+    CHECK( instance.DynamicCast( "Fog" ) == nullptr );
+    CHECK( instance.DynamicCast<Fog>() == nullptr );
+}
+
+SPARK_TEST( DynamicCast_CachesPerClass )
+{
+    // The same facet at a different offset in each class; casts
+    // that alternate between them must never reuse the other
+    // class's entry.
+    const int kClassCount = 20;
+    TestClass classes[kClassCount];
+    for( int cc = 0; cc < kClassCount; ++cc )
+    {
+        classes[cc].AddFacet( "Model", 0 );
+        classes[cc].AddFacet( "Skinning", 16 * (cc + 1) );
+        if( cc % 3 == 0 )
+            classes[cc].AddFacet( "Fog", 8 );
+    }
+
+    for( int pass = 0; pass < 4; ++pass )
+    {
+        for( int cc = 0; cc < kClassCount; ++cc )
+        {
+            TestInstance instance( classes[cc] );
+            CHECK_EQUAL( (size_t) (16 * (cc + 1)), instance.OffsetOf( instance.DynamicCast<Skinning>() ) );
+            CHECK_EQUAL( cc % 3 == 0, instance.DynamicCast<Fog>() != nullptr );
+        }
+    }
+}
+
+SPARK_TEST( DynamicCast_TableReusedInPlace )
+{
+    TestClass shaderClass;
+    shaderClass.AddFacet( "Lighting", 16 );
+    shaderClass.AddFacet( "Model", 0 );
+
+    {
+        TestInstance instance( shaderClass );
+        CHECK_EQUAL( 16u, instance.OffsetOf( instance.DynamicCast<Lighting>() ) );
+    }
+
+    // The entry cached for Lighting now lies in a table that
+    // names something else there.
+    const char* const names[] = { "Shadow", "Terrain" };
+    const int offsets[] = { 48, 0 };
+    shaderClass.ReplaceFacets( names, offsets, 2 );
+
+    {
+        TestInstance instance( shaderClass );
+        CHECK( instance.DynamicCast<Lighting>() == nullptr );
+        CHECK_EQUAL( 48u, instance.OffsetOf( instance.DynamicCast( "Shadow" ) ) );
+    }
+}
@@ -0,0 +1,162 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// InstancePoolTests.cpp
+
+#include "TestHarness.h"
+
+#include "InstancePool.h"
+
+#include <vector>
+
+using namespace sparktest;
+using spark::InstanceHeader;
+using spark::InstancePool;
+
+namespace
+{
+    bool IsCacheLineAligned( void* pointer )
+    {
+        return ((size_t) pointer % spark::kCacheLineSize) == 0;
+    }
+}
+
+SPARK_TEST( InstancePool_InstancesAreCacheLineAligned )
+{
+    static const size_t kSizes[] = { 8, 16, 40, 48, 56, 64, 100, 128, 200 };
+    for( size_t ss = 0; ss < sizeof(kSizes) / sizeof(kSizes[0]); ++ss )
+    {
+        size_t size = kSizes[ss];
+        InstancePool pool( size );
+
+        CHECK( pool.GetSlotSize() % spark::kCacheLineSize == 0 );
+        CHECK( pool.GetSlotSize() >= size + sizeof(InstanceHeader) );
+
+        for( int ii = 0; ii < 3; ++ii )
+        {
+            void* instance = pool.Allocate();
+            CHECK( IsCacheLineAligned( instance ) );
+
+            // The header lies past the end of the instance, where
+            // both the pool and a caller holding only the size
+            // can find it.
+            auto header = pool.GetHeader( instance );
+            CHECK( (unsigned char*) header >= (unsigned char*) instance + size );
+            CHECK( (unsigned char*) (header + 1) <= (unsigned char*) instance + pool.GetSlotSize() );
+            CHECK( InstancePool::FindHeader( instance, size ) == header );
+        }
+    }
+}
+
+SPARK_TEST( InstancePool_BulkAllocationSpansSlabs )
+{
+    static const size_t kCount = InstancePool::kSlotsPerSlab * 2 + 10;
+
+    InstancePool pool( 48 );
+    std::vector<void*> instances( kCount );
+    for( size_t ii = 0; ii < kCount; ++ii )
+    {
+        instances[ii] = pool.Allocate();
+        pool.MarkLive( instances[ii] );
+    }
+
+    // Each slab is filled in address order before the next
+    for( size_t ii = 0; ii < kCount; ++ii )
+    {
+        auto header = pool.GetHeader( instances[ii] );
+        CHECK_EQUAL( (unsigned int) (ii / InstancePool::kSlotsPerSlab), header->slab );
+        CHECK_EQUAL( (unsigned int) (ii % InstancePool::kSlotsPerSlab), header->slot );
+
+        if( ii % InstancePool::kSlotsPerSlab != 0 )
+        {
+            CHECK( (unsigned char*) instances[ii]
+                == (unsigned char*) instances[ii - 1] + pool.GetSlotSize() );
+        }
+    }
+
+    // GetLive reports every live instance in memory order, and
+    // the total count even when the buffer is too small
+    std::vector<void*> live( kCount );
+    CHECK_EQUAL( kCount, pool.GetLive( &live[0], kCount ) );
+    CHECK( live == instances );
+
+    void* partial[10];
+    CHECK_EQUAL( kCount, pool.GetLive( partial, 10 ) );
+    for( size_t ii = 0; ii < 10; ++ii )
+        CHECK( partial[ii] == instances[ii] );
+}
+
+SPARK_TEST( InstancePool_ReusesLowestFreeSlot )
+{
+    InstancePool pool( 32 );
+    std::vector<void*> instances;
+    for( size_t ii = 0; ii < InstancePool::kSlotsPerSlab + 4; ++ii )
+    {
+        instances.push_back( pool.Allocate() );
+        pool.MarkLive( instances.back() );
+    }
+
+    // Free one slot in each slab; the first slab's is reused first
+    void* low = instances[5];
+    void* high = instances[InstancePool::kSlotsPerSlab + 1];
+    pool.MarkDead( high );
+    pool.Free( high );
+    pool.MarkDead( low );
+    pool.Free( low );
+
+    CHECK_EQUAL( instances.size() - 2, pool.GetLive( nullptr, 0 ) );
+
+    CHECK( pool.Allocate() == low );
+    CHECK( pool.Allocate() == high );
+
+    // Then allocation continues past the end of the second slab
+    CHECK( pool.Allocate() == (unsigned char*) instances.back() + pool.GetSlotSize() );
+}
+
+SPARK_TEST( InstancePool_InstanceWritesLeaveHeaderIntact )
+{
+    static const size_t kSize = 40;
+
+    InstancePool pool( kSize );
+    void* instance = pool.Allocate();
+    auto header = pool.GetHeader( instance );
+    header->shaderClass = (spark::ShaderClass*) &pool;
+    unsigned int slab = header->slab;
+    unsigned int slot = header->slot;
+
+    memset( instance, 0xCD, kSize );
+
+    CHECK( header->shaderClass == (spark::ShaderClass*) &pool );
+    CHECK_EQUAL( slab, header->slab );
+    CHECK_EQUAL( slot, header->slot );
+}
+
+SPARK_TEST( InstancePool_ReusedSlotsAreZeroed )
+{
+    static const size_t kSize = 64;
+
+    InstancePool pool( kSize );
+    void* instance = pool.Allocate();
+    memset( instance, 0xCD, kSize );
+    pool.Free( instance );
+
+    void* reused = pool.Allocate();
+    CHECK( reused == instance );
+
+    auto bytes = (unsigned char*) reused;
+    bool zeroed = true;
+    for( size_t ii = 0; ii < kSize; ++ii )
+        zeroed = zeroed && bytes[ii] == 0;
+    CHECK( zeroed );
+}
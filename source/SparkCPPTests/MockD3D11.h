@@ -0,0 +1,528 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// MockD3D11.h
+#ifndef SPARK_TESTS_MOCK_D3D11_H
+#define SPARK_TESTS_MOCK_D3D11_H
+
+#include <Windows.h>
+#include <D3D11.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+
+// GPU-free stand-ins for the Direct3D 11 device, device context
+// and buffers. The context counts the calls made on it (by name),
+// keeps private data the way the runtime does (holding a reference
+// to interfaces set with SetPrivateDataInterface until it is
+// destroyed), and Maps buffers to plain CPU memory. Each context
+// must only be used by one thread at a time, like a real one.
+
+namespace sparktest
+{
+    // Number of mock objects currently alive, for leak checks.
+    extern volatile LONG gMockObjectCount;
+
+    template<typename Base>
+    class MockUnknown : public Base
+    {
+    public:
+        MockUnknown()
+            : _referenceCount(1)
+        {
+            ::InterlockedIncrement( &gMockObjectCount );
+        }
+
+        virtual ~MockUnknown()
+        {
+            ::InterlockedDecrement( &gMockObjectCount );
+        }
+
+        virtual HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** outObject )
+        {
+            if( riid == __uuidof(IUnknown) || riid == __uuidof(Base) )
+            {
+                AddRef();
+                *outObject = static_cast<Base*>(this);
+                return S_OK;
+            }
+            *outObject = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        virtual ULONG STDMETHODCALLTYPE AddRef()
+        {
+            return ::InterlockedIncrement( &_referenceCount );
+        }
+
+        virtual ULONG STDMETHODCALLTYPE Release()
+        {
+            ULONG result = ::InterlockedDecrement( &_referenceCount );
+            if( result == 0 )
+                delete this;
+            return result;
+        }
+
+    private:
+        volatile LONG _referenceCount;
+    };
+
+    // Private data, as kept by every ID3D11DeviceChild.
+    class MockPrivateData
+    {
+    public:
+        ~MockPrivateData()
+        {
+            for( auto ii = _entries.begin(); ii != _entries.end(); ++ii )
+            {
+                if( ii->second.object != nullptr )
+                    ii->second.object->Release();
+            }
+        }
+
+        HRESULT Get( REFGUID guid, UINT* ioSize, void* data )
+        {
+            auto ii = _entries.find( Key( guid ) );
+            if( ii == _entries.end() )
+            {
+                *ioSize = 0;
+                return DXGI_ERROR_NOT_FOUND;
+            }
+
+            if( ii->second.object != nullptr )
+            {
+                if( data == nullptr )
+                {
+                    *ioSize = sizeof(IUnknown*);
+                    return S_OK;
+                }
+                if( *ioSize < sizeof(IUnknown*) )
+                    return DXGI_ERROR_MORE_DATA;
+                ii->second.object->AddRef();
+                *(IUnknown**) data = ii->second.object;
+                *ioSize = sizeof(IUnknown*);
+                return S_OK;
+            }
+
+            UINT size = (UINT) ii->second.bytes.size();
+            if( data == nullptr )
+            {
+                *ioSize = size;
+                return S_OK;
+            }
+            if( *ioSize < size )
+                return DXGI_ERROR_MORE_DATA;
+            if( size != 0 )
+                memcpy( data, &ii->second.bytes[0], size );
+            *ioSize = size;
+            return S_OK;
+        }
+
+        HRESULT Set( REFGUID guid, UINT size, const void* data )
+        {
+            Remove( guid );
+            if( data == nullptr )
+                return S_OK;
+
+            Entry& entry = _entries[Key( guid )];
+            entry.object = nullptr;
+            entry.bytes.assign( (const char*) data, (const char*) data + size );
+            return S_OK;
+        }
+
+        HRESULT SetInterface( REFGUID guid, const IUnknown* object )
+        {
+            Remove( guid );
+            if( object == nullptr )
+                return S_OK;
+
+            Entry& entry = _entries[Key( guid )];
+            entry.object = const_cast<IUnknown*>(object);
+            entry.object->AddRef();
+            return S_OK;
+        }
+
+    private:
+        static std::string Key( REFGUID guid )
+        {
+            return std::string( (const char*) &guid, sizeof(GUID) );
+        }
+
+        void Remove( REFGUID guid )
+        {
+            auto ii = _entries.find( Key( guid ) );
+            if( ii == _entries.end() )
+                return;
+            if( ii->second.object != nullptr )
+                ii->second.object->Release();
+            _entries.erase( ii );
+        }
+
+        struct Entry
+        {
+            IUnknown* object;
+            std::vector<char> bytes;
+        };
+
+        std::map<std::string, Entry> _entries;
+    };
+
+    class MockBuffer : public MockUnknown<ID3D11Buffer>
+    {
+    public:
+        MockBuffer( ID3D11Device* device, const D3D11_BUFFER_DESC& desc )
+            : _device(device)
+            , _desc(desc)
+            , _data(desc.ByteWidth)
+            , _mapCount(0)
+        {
+            _device->AddRef();
+        }
+
+        ~MockBuffer()
+        {
+            _device->Release();
+        }
+
+        std::vector<char>& GetData() { return _data; }
+        UINT GetMapCount() const { return _mapCount; }
+        void CountMap() { ++_mapCount; }
+
+        // ID3D11DeviceChild
+        virtual void STDMETHODCALLTYPE GetDevice( ID3D11Device** outDevice ) { _device->AddRef(); *outDevice = _device; }
+        virtual HRESULT STDMETHODCALLTYPE GetPrivateData( REFGUID guid, UINT* ioSize, void* data ) { return _privateData.Get( guid, ioSize, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateData( REFGUID guid, UINT size, const void* data ) { return _privateData.Set( guid, size, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateDataInterface( REFGUID guid, const IUnknown* object ) { return _privateData.SetInterface( guid, object ); }
+
+        // ID3D11Resource
+        virtual void STDMETHODCALLTYPE GetType( D3D11_RESOURCE_DIMENSION* outDimension ) { *outDimension = D3D11_RESOURCE_DIMENSION_BUFFER; }
+        virtual void STDMETHODCALLTYPE SetEvictionPriority( UINT ) {}
+        virtual UINT STDMETHODCALLTYPE GetEvictionPriority() { return 0; }
+
+        // ID3D11Buffer
+        virtual void STDMETHODCALLTYPE GetDesc( D3D11_BUFFER_DESC* outDesc ) { *outDesc = _desc; }
+
+    private:
+        ID3D11Device* _device;
+        D3D11_BUFFER_DESC _desc;
+        std::vector<char> _data;
+        UINT _mapCount;
+        MockPrivateData _privateData;
+    };
+
+    class MockBlendState : public MockUnknown<ID3D11BlendState>
+    {
+    public:
+        MockBlendState( ID3D11Device* device, const D3D11_BLEND_DESC& desc )
+            : _device(device)
+            , _desc(desc)
+        {
+            _device->AddRef();
+        }
+
+        ~MockBlendState()
+        {
+            _device->Release();
+        }
+
+        // ID3D11DeviceChild
+        virtual void STDMETHODCALLTYPE GetDevice( ID3D11Device** outDevice ) { _device->AddRef(); *outDevice = _device; }
+        virtual HRESULT STDMETHODCALLTYPE GetPrivateData( REFGUID guid, UINT* ioSize, void* data ) { return _privateData.Get( guid, ioSize, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateData( REFGUID guid, UINT size, const void* data ) { return _privateData.Set( guid, size, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateDataInterface( REFGUID guid, const IUnknown* object ) { return _privateData.SetInterface( guid, object ); }
+
+        // ID3D11BlendState
+        virtual void STDMETHODCALLTYPE GetDesc( D3D11_BLEND_DESC* outDesc ) { *outDesc = _desc; }
+
+    private:
+        ID3D11Device* _device;
+        D3D11_BLEND_DESC _desc;
+        MockPrivateData _privateData;
+    };
+
+    // Only CreateBuffer and CreateBlendState do anything;
+    // everything else fails.
+    class MockDevice : public MockUnknown<ID3D11Device>
+    {
+    public:
+        MockDevice()
+            : _createdBufferCount(0)
+            , _createdBlendStateCount(0)
+        {
+        }
+
+        LONG GetCreatedBufferCount() const { return _createdBufferCount; }
+        LONG GetCreatedBlendStateCount() const { return _createdBlendStateCount; }
+
+        virtual HRESULT STDMETHODCALLTYPE CreateBuffer( const D3D11_BUFFER_DESC* desc, const D3D11_SUBRESOURCE_DATA* initialData, ID3D11Buffer** outBuffer )
+        {
+            auto buffer = new MockBuffer( this, *desc );
+            if( initialData != nullptr && desc->ByteWidth != 0 )
+                memcpy( &buffer->GetData()[0], initialData->pSysMem, desc->ByteWidth );
+            ::InterlockedIncrement( &_createdBufferCount );
+            *outBuffer = buffer;
+            return S_OK;
+        }
+
+        virtual HRESULT STDMETHODCALLTYPE CreateTexture1D( const D3D11_TEXTURE1D_DESC*, const D3D11_SUBRESOURCE_DATA*, ID3D11Texture1D** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateTexture2D( const D3D11_TEXTURE2D_DESC*, const D3D11_SUBRESOURCE_DATA*, ID3D11Texture2D** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateTexture3D( const D3D11_TEXTURE3D_DESC*, const D3D11_SUBRESOURCE_DATA*, ID3D11Texture3D** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateShaderResourceView( ID3D11Resource*, const D3D11_SHADER_RESOURCE_VIEW_DESC*, ID3D11ShaderResourceView** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateUnorderedAccessView( ID3D11Resource*, const D3D11_UNORDERED_ACCESS_VIEW_DESC*, ID3D11UnorderedAccessView** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateRenderTargetView( ID3D11Resource*, const D3D11_RENDER_TARGET_VIEW_DESC*, ID3D11RenderTargetView** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilView( ID3D11Resource*, const D3D11_DEPTH_STENCIL_VIEW_DESC*, ID3D11DepthStencilView** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateInputLayout( const D3D11_INPUT_ELEMENT_DESC*, UINT, const void*, SIZE_T, ID3D11InputLayout** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateVertexShader( const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11VertexShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateGeometryShader( const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11GeometryShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateGeometryShaderWithStreamOutput( const void*, SIZE_T, const D3D11_SO_DECLARATION_ENTRY*, UINT, const UINT*, UINT, UINT, ID3D11ClassLinkage*, ID3D11GeometryShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreatePixelShader( const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11PixelShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateHullShader( const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11HullShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateDomainShader( const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11DomainShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateComputeShader( const void*, SIZE_T, ID3D11ClassLinkage*, ID3D11ComputeShader** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateClassLinkage( ID3D11ClassLinkage** ) { return E_NOTIMPL; }
+
+        virtual HRESULT STDMETHODCALLTYPE CreateBlendState( const D3D11_BLEND_DESC* desc, ID3D11BlendState** outState )
+        {
+            ::InterlockedIncrement( &_createdBlendStateCount );
+            *outState = new MockBlendState( this, *desc );
+            return S_OK;
+        }
+
+        virtual HRESULT STDMETHODCALLTYPE CreateDepthStencilState( const D3D11_DEPTH_STENCIL_DESC*, ID3D11DepthStencilState** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateRasterizerState( const D3D11_RASTERIZER_DESC*, ID3D11RasterizerState** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateSamplerState( const D3D11_SAMPLER_DESC*, ID3D11SamplerState** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateQuery( const D3D11_QUERY_DESC*, ID3D11Query** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreatePredicate( const D3D11_QUERY_DESC*, ID3D11Predicate** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateCounter( const D3D11_COUNTER_DESC*, ID3D11Counter** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CreateDeferredContext( UINT, ID3D11DeviceContext** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE OpenSharedResource( HANDLE, REFIID, void** ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CheckFormatSupport( DXGI_FORMAT, UINT* ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CheckMultisampleQualityLevels( DXGI_FORMAT, UINT, UINT* ) { return E_NOTIMPL; }
+        virtual void STDMETHODCALLTYPE CheckCounterInfo( D3D11_COUNTER_INFO* outInfo ) { memset( outInfo, 0, sizeof(*outInfo) ); }
+        virtual HRESULT STDMETHODCALLTYPE CheckCounter( const D3D11_COUNTER_DESC*, D3D11_COUNTER_TYPE*, UINT*, LPSTR, UINT*, LPSTR, UINT*, LPSTR, UINT* ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE CheckFeatureSupport( D3D11_FEATURE, void*, UINT ) { return E_NOTIMPL; }
+        virtual HRESULT STDMETHODCALLTYPE GetPrivateData( REFGUID guid, UINT* ioSize, void* data ) { return _privateData.Get( guid, ioSize, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateData( REFGUID guid, UINT size, const void* data ) { return _privateData.Set( guid, size, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateDataInterface( REFGUID guid, const IUnknown* object ) { return _privateData.SetInterface( guid, object ); }
+        virtual D3D_FEATURE_LEVEL STDMETHODCALLTYPE GetFeatureLevel() { return D3D_FEATURE_LEVEL_11_0; }
+        virtual UINT STDMETHODCALLTYPE GetCreationFlags() { return 0; }
+        virtual HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() { return S_OK; }
+        virtual void STDMETHODCALLTYPE GetImmediateContext( ID3D11DeviceContext** outContext ) { *outContext = nullptr; }
+        virtual HRESULT STDMETHODCALLTYPE SetExceptionMode( UINT ) { return S_OK; }
+        virtual UINT STDMETHODCALLTYPE GetExceptionMode() { return 0; }
+
+    private:
+        volatile LONG _createdBufferCount;
+        volatile LONG _createdBlendStateCount;
+        MockPrivateData _privateData;
+    };
+
+    // Records the calls made on it. Buffers passed to Map must be
+    // MockBuffers; no other objects passed in are ever touched.
+    class MockDeviceContext : public MockUnknown<ID3D11DeviceContext>
+    {
+    public:
+        MockDeviceContext(
+            ID3D11Device* device,
+            D3D11_DEVICE_CONTEXT_TYPE type = D3D11_DEVICE_CONTEXT_IMMEDIATE )
+            : _device(device)
+            , _type(type)
+        {
+            _device->AddRef();
+        }
+
+        ~MockDeviceContext()
+        {
+            _device->Release();
+        }
+
+        // Number of calls made to the given method (by name)
+        // since the context was created or last reset.
+        int GetCallCount( const char* method ) const
+        {
+            auto ii = _callCounts.find( method );
+            return ii == _callCounts.end() ? 0 : ii->second;
+        }
+
+        int GetTotalCallCount() const
+        {
+            int total = 0;
+            for( auto ii = _callCounts.begin(); ii != _callCounts.end(); ++ii )
+                total += ii->second;
+            return total;
+        }
+
+        void ResetCallCounts() { _callCounts.clear(); }
+
+        // ID3D11DeviceChild
+        virtual void STDMETHODCALLTYPE GetDevice( ID3D11Device** outDevice ) { _device->AddRef(); *outDevice = _device; }
+        virtual HRESULT STDMETHODCALLTYPE GetPrivateData( REFGUID guid, UINT* ioSize, void* data ) { Count( "GetPrivateData" ); return _privateData.Get( guid, ioSize, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateData( REFGUID guid, UINT size, const void* data ) { Count( "SetPrivateData" ); return _privateData.Set( guid, size, data ); }
+        virtual HRESULT STDMETHODCALLTYPE SetPrivateDataInterface( REFGUID guid, const IUnknown* object ) { Count( "SetPrivateDataInterface" ); return _privateData.SetInterface( guid, object ); }
+
+        // ID3D11DeviceContext
+        virtual void STDMETHODCALLTYPE VSSetConstantBuffers( UINT, UINT, ID3D11Buffer* const* ) { Count( "VSSetConstantBuffers" ); }
+        virtual void STDMETHODCALLTYPE PSSetShaderResources( UINT, UINT, ID3D11ShaderResourceView* const* ) { Count( "PSSetShaderResources" ); }
+        virtual void STDMETHODCALLTYPE PSSetShader( ID3D11PixelShader*, ID3D11ClassInstance* const*, UINT ) { Count( "PSSetShader" ); }
+        virtual void STDMETHODCALLTYPE PSSetSamplers( UINT, UINT, ID3D11SamplerState* const* ) { Count( "PSSetSamplers" ); }
+        virtual void STDMETHODCALLTYPE VSSetShader( ID3D11VertexShader*, ID3D11ClassInstance* const*, UINT ) { Count( "VSSetShader" ); }
+        virtual void STDMETHODCALLTYPE DrawIndexed( UINT, UINT, INT ) { Count( "DrawIndexed" ); }
+        virtual void STDMETHODCALLTYPE Draw( UINT, UINT ) { Count( "Draw" ); }
+
+        virtual HRESULT STDMETHODCALLTYPE Map( ID3D11Resource* resource, UINT, D3D11_MAP, UINT, D3D11_MAPPED_SUBRESOURCE* outMapped )
+        {
+            Count( "Map" );
+            auto buffer = static_cast<MockBuffer*>(static_cast<ID3D11Buffer*>(resource));
+            buffer->CountMap();
+            outMapped->pData = buffer->GetData().empty() ? nullptr : &buffer->GetData()[0];
+            outMapped->RowPitch = (UINT) buffer->GetData().size();
+            outMapped->DepthPitch = (UINT) buffer->GetData().size();
+            return S_OK;
+        }
+
+        virtual void STDMETHODCALLTYPE Unmap( ID3D11Resource*, UINT ) { Count( "Unmap" ); }
+        virtual void STDMETHODCALLTYPE PSSetConstantBuffers( UINT, UINT, ID3D11Buffer* const* ) { Count( "PSSetConstantBuffers" ); }
+        virtual void STDMETHODCALLTYPE IASetInputLayout( ID3D11InputLayout* ) { Count( "IASetInputLayout" ); }
+        virtual void STDMETHODCALLTYPE IASetVertexBuffers( UINT, UINT, ID3D11Buffer* const*, const UINT*, const UINT* ) { Count( "IASetVertexBuffers" ); }
+        virtual void STDMETHODCALLTYPE IASetIndexBuffer( ID3D11Buffer*, DXGI_FORMAT, UINT ) { Count( "IASetIndexBuffer" ); }
+        virtual void STDMETHODCALLTYPE DrawIndexedInstanced( UINT, UINT, UINT, INT, UINT ) { Count( "DrawIndexedInstanced" ); }
+        virtual void STDMETHODCALLTYPE DrawInstanced( UINT, UINT, UINT, UINT ) { Count( "DrawInstanced" ); }
+        virtual void STDMETHODCALLTYPE GSSetConstantBuffers( UINT, UINT, ID3D11Buffer* const* ) { Count( "GSSetConstantBuffers" ); }
+        virtual void STDMETHODCALLTYPE GSSetShader( ID3D11GeometryShader*, ID3D11ClassInstance* const*, UINT ) { Count( "GSSetShader" ); }
+        virtual void STDMETHODCALLTYPE IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY ) { Count( "IASetPrimitiveTopology" ); }
+        virtual void STDMETHODCALLTYPE VSSetShaderResources( UINT, UINT, ID3D11ShaderResourceView* const* ) { Count( "VSSetShaderResources" ); }
+        virtual void STDMETHODCALLTYPE VSSetSamplers( UINT, UINT, ID3D11SamplerState* const* ) { Count( "VSSetSamplers" ); }
+        virtual void STDMETHODCALLTYPE Begin( ID3D11Asynchronous* ) { Count( "Begin" ); }
+        virtual void STDMETHODCALLTYPE End( ID3D11Asynchronous* ) { Count( "End" ); }
+        virtual HRESULT STDMETHODCALLTYPE GetData( ID3D11Asynchronous*, void*, UINT, UINT ) { Count( "GetData" ); return E_NOTIMPL; }
+        virtual void STDMETHODCALLTYPE SetPredication( ID3D11Predicate*, BOOL ) { Count( "SetPredication" ); }
+        virtual void STDMETHODCALLTYPE GSSetShaderResources( UINT, UINT, ID3D11ShaderResourceView* const* ) { Count( "GSSetShaderResources" ); }
+        virtual void STDMETHODCALLTYPE GSSetSamplers( UINT, UINT, ID3D11SamplerState* const* ) { Count( "GSSetSamplers" ); }
+        virtual void STDMETHODCALLTYPE OMSetRenderTargets( UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView* ) { Count( "OMSetRenderTargets" ); }
+        virtual void STDMETHODCALLTYPE OMSetRenderTargetsAndUnorderedAccessViews( UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*, UINT, UINT, ID3D11UnorderedAccessView* const*, const UINT* ) { Count( "OMSetRenderTargetsAndUnorderedAccessViews" ); }
+        virtual void STDMETHODCALLTYPE OMSetBlendState( ID3D11BlendState*, const FLOAT[4], UINT ) { Count( "OMSetBlendState" ); }
+        virtual void STDMETHODCALLTYPE OMSetDepthStencilState( ID3D11DepthStencilState*, UINT ) { Count( "OMSetDepthStencilState" ); }
+        virtual void STDMETHODCALLTYPE SOSetTargets( UINT, ID3D11Buffer* const*, const UINT* ) { Count( "SOSetTargets" ); }
+        virtual void STDMETHODCALLTYPE DrawAuto() { Count( "DrawAuto" ); }
+        virtual void STDMETHODCALLTYPE DrawIndexedInstancedIndirect( ID3D11Buffer*, UINT ) { Count( "DrawIndexedInstancedIndirect" ); }
+        virtual void STDMETHODCALLTYPE DrawInstancedIndirect( ID3D11Buffer*, UINT ) { Count( "DrawInstancedIndirect" ); }
+        virtual void STDMETHODCALLTYPE Dispatch( UINT, UINT, UINT ) { Count( "Dispatch" ); }
+        virtual void STDMETHODCALLTYPE DispatchIndirect( ID3D11Buffer*, UINT ) { Count( "DispatchIndirect" ); }
+        virtual void STDMETHODCALLTYPE RSSetState( ID3D11RasterizerState* ) { Count( "RSSetState" ); }
+        virtual void STDMETHODCALLTYPE RSSetViewports( UINT, const D3D11_VIEWPORT* ) { Count( "RSSetViewports" ); }
+        virtual void STDMETHODCALLTYPE RSSetScissorRects( UINT, const D3D11_RECT* ) { Count( "RSSetScissorRects" ); }
+        virtual void STDMETHODCALLTYPE CopySubresourceRegion( ID3D11Resource*, UINT, UINT, UINT, UINT, ID3D11Resource*, UINT, const D3D11_BOX* ) { Count( "CopySubresourceRegion" ); }
+        virtual void STDMETHODCALLTYPE CopyResource( ID3D11Resource*, ID3D11Resource* ) { Count( "CopyResource" ); }
+        virtual void STDMETHODCALLTYPE UpdateSubresource( ID3D11Resource*, UINT, const D3D11_BOX*, const void*, UINT, UINT ) { Count( "UpdateSubresource" ); }
+        virtual void STDMETHODCALLTYPE CopyStructureCount( ID3D11Buffer*, UINT, ID3D11UnorderedAccessView* ) { Count( "CopyStructureCount" ); }
+        virtual void STDMETHODCALLTYPE ClearRenderTargetView( ID3D11RenderTargetView*, const FLOAT[4] ) { Count( "ClearRenderTargetView" ); }
+        virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewUint( ID3D11UnorderedAccessView*, const UINT[4] ) { Count( "ClearUnorderedAccessViewUint" ); }
+        virtual void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat( ID3D11UnorderedAccessView*, const FLOAT[4] ) { Count( "ClearUnorderedAccessViewFloat" ); }
+        virtual void STDMETHODCALLTYPE ClearDepthStencilView( ID3D11DepthStencilView*, UINT, FLOAT, UINT8 ) { Count( "ClearDepthStencilView" ); }
+        virtual void STDMETHODCALLTYPE GenerateMips( ID3D11ShaderResourceView* ) { Count( "GenerateMips" ); }
+        virtual void STDMETHODCALLTYPE SetResourceMinLOD( ID3D11Resource*, FLOAT ) { Count( "SetResourceMinLOD" ); }
+        virtual FLOAT STDMETHODCALLTYPE GetResourceMinLOD( ID3D11Resource* ) { Count( "GetResourceMinLOD" ); return 0.0f; }
+        virtual void STDMETHODCALLTYPE ResolveSubresource( ID3D11Resource*, UINT, ID3D11Resource*, UINT, DXGI_FORMAT ) { Count( "ResolveSubresource" ); }
+        virtual void STDMETHODCALLTYPE ExecuteCommandList( ID3D11CommandList*, BOOL ) { Count( "ExecuteCommandList" ); }
+        virtual void STDMETHODCALLTYPE HSSetShaderResources( UINT, UINT, ID3D11ShaderResourceView* const* ) { Count( "HSSetShaderResources" ); }
+        virtual void STDMETHODCALLTYPE HSSetShader( ID3D11HullShader*, ID3D11ClassInstance* const*, UINT ) { Count( "HSSetShader" ); }
+        virtual void STDMETHODCALLTYPE HSSetSamplers( UINT, UINT, ID3D11SamplerState* const* ) { Count( "HSSetSamplers" ); }
+        virtual void STDMETHODCALLTYPE HSSetConstantBuffers( UINT, UINT, ID3D11Buffer* const* ) { Count( "HSSetConstantBuffers" ); }
+        virtual void STDMETHODCALLTYPE DSSetShaderResources( UINT, UINT, ID3D11ShaderResourceView* const* ) { Count( "DSSetShaderResources" ); }
+        virtual void STDMETHODCALLTYPE DSSetShader( ID3D11DomainShader*, ID3D11ClassInstance* const*, UINT ) { Count( "DSSetShader" ); }
+        virtual void STDMETHODCALLTYPE DSSetSamplers( UINT, UINT, ID3D11SamplerState* const* ) { Count( "DSSetSamplers" ); }
+        virtual void STDMETHODCALLTYPE DSSetConstantBuffers( UINT, UINT, ID3D11Buffer* const* ) { Count( "DSSetConstantBuffers" ); }
+        virtual void STDMETHODCALLTYPE CSSetShaderResources( UINT, UINT, ID3D11ShaderResourceView* const* ) { Count( "CSSetShaderResources" ); }
+        virtual void STDMETHODCALLTYPE CSSetUnorderedAccessViews( UINT, UINT, ID3D11UnorderedAccessView* const*, const UINT* ) { Count( "CSSetUnorderedAccessViews" ); }
+        virtual void STDMETHODCALLTYPE CSSetShader( ID3D11ComputeShader*, ID3D11ClassInstance* const*, UINT ) { Count( "CSSetShader" ); }
+        virtual void STDMETHODCALLTYPE CSSetSamplers( UINT, UINT, ID3D11SamplerState* const* ) { Count( "CSSetSamplers" ); }
+        virtual void STDMETHODCALLTYPE CSSetConstantBuffers( UINT, UINT, ID3D11Buffer* const* ) { Count( "CSSetConstantBuffers" ); }
+
+        // The getters are never used by Spark, and only
+        // report that nothing is bound.
+        virtual void STDMETHODCALLTYPE VSGetConstantBuffers( UINT, UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE PSGetShaderResources( UINT, UINT count, ID3D11ShaderResourceView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE PSGetShader( ID3D11PixelShader** out, ID3D11ClassInstance**, UINT* count ) { *out = nullptr; if( count ) *count = 0; }
+        virtual void STDMETHODCALLTYPE PSGetSamplers( UINT, UINT count, ID3D11SamplerState** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE VSGetShader( ID3D11VertexShader** out, ID3D11ClassInstance**, UINT* count ) { *out = nullptr; if( count ) *count = 0; }
+        virtual void STDMETHODCALLTYPE PSGetConstantBuffers( UINT, UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE IAGetInputLayout( ID3D11InputLayout** out ) { *out = nullptr; }
+        virtual void STDMETHODCALLTYPE IAGetVertexBuffers( UINT, UINT count, ID3D11Buffer** out, UINT*, UINT* ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE IAGetIndexBuffer( ID3D11Buffer** out, DXGI_FORMAT*, UINT* ) { *out = nullptr; }
+        virtual void STDMETHODCALLTYPE GSGetConstantBuffers( UINT, UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE GSGetShader( ID3D11GeometryShader** out, ID3D11ClassInstance**, UINT* count ) { *out = nullptr; if( count ) *count = 0; }
+        virtual void STDMETHODCALLTYPE IAGetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY* out ) { *out = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED; }
+        virtual void STDMETHODCALLTYPE VSGetShaderResources( UINT, UINT count, ID3D11ShaderResourceView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE VSGetSamplers( UINT, UINT count, ID3D11SamplerState** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE GetPredication( ID3D11Predicate** out, BOOL* value ) { *out = nullptr; if( value ) *value = FALSE; }
+        virtual void STDMETHODCALLTYPE GSGetShaderResources( UINT, UINT count, ID3D11ShaderResourceView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE GSGetSamplers( UINT, UINT count, ID3D11SamplerState** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE OMGetRenderTargets( UINT count, ID3D11RenderTargetView** out, ID3D11DepthStencilView** outDepth ) { ClearOut( out, count ); if( outDepth ) *outDepth = nullptr; }
+        virtual void STDMETHODCALLTYPE OMGetRenderTargetsAndUnorderedAccessViews( UINT count, ID3D11RenderTargetView** out, ID3D11DepthStencilView** outDepth, UINT, UINT uavCount, ID3D11UnorderedAccessView** outUAVs ) { ClearOut( out, count ); if( outDepth ) *outDepth = nullptr; ClearOut( outUAVs, uavCount ); }
+        virtual void STDMETHODCALLTYPE OMGetBlendState( ID3D11BlendState** out, FLOAT[4], UINT* ) { if( out ) *out = nullptr; }
+        virtual void STDMETHODCALLTYPE OMGetDepthStencilState( ID3D11DepthStencilState** out, UINT* ) { if( out ) *out = nullptr; }
+        virtual void STDMETHODCALLTYPE SOGetTargets( UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE RSGetState( ID3D11RasterizerState** out ) { *out = nullptr; }
+        virtual void STDMETHODCALLTYPE RSGetViewports( UINT* count, D3D11_VIEWPORT* ) { *count = 0; }
+        virtual void STDMETHODCALLTYPE RSGetScissorRects( UINT* count, D3D11_RECT* ) { *count = 0; }
+        virtual void STDMETHODCALLTYPE HSGetShaderResources( UINT, UINT count, ID3D11ShaderResourceView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE HSGetShader( ID3D11HullShader** out, ID3D11ClassInstance**, UINT* count ) { *out = nullptr; if( count ) *count = 0; }
+        virtual void STDMETHODCALLTYPE HSGetSamplers( UINT, UINT count, ID3D11SamplerState** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE HSGetConstantBuffers( UINT, UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE DSGetShaderResources( UINT, UINT count, ID3D11ShaderResourceView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE DSGetShader( ID3D11DomainShader** out, ID3D11ClassInstance**, UINT* count ) { *out = nullptr; if( count ) *count = 0; }
+        virtual void STDMETHODCALLTYPE DSGetSamplers( UINT, UINT count, ID3D11SamplerState** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE DSGetConstantBuffers( UINT, UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE CSGetShaderResources( UINT, UINT count, ID3D11ShaderResourceView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE CSGetUnorderedAccessViews( UINT, UINT count, ID3D11UnorderedAccessView** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE CSGetShader( ID3D11ComputeShader** out, ID3D11ClassInstance**, UINT* count ) { *out = nullptr; if( count ) *count = 0; }
+        virtual void STDMETHODCALLTYPE CSGetSamplers( UINT, UINT count, ID3D11SamplerState** out ) { ClearOut( out, count ); }
+        virtual void STDMETHODCALLTYPE CSGetConstantBuffers( UINT, UINT count, ID3D11Buffer** out ) { ClearOut( out, count ); }
+
+        virtual void STDMETHODCALLTYPE ClearState() { Count( "ClearState" ); }
+        virtual void STDMETHODCALLTYPE Flush() { Count( "Flush" ); }
+        virtual D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE GetType() { return _type; }
+        virtual UINT STDMETHODCALLTYPE GetContextFlags() { return 0; }
+        virtual HRESULT STDMETHODCALLTYPE FinishCommandList( BOOL, ID3D11CommandList** outCommandList ) { Count( "FinishCommandList" ); *outCommandList = nullptr; return E_NOTIMPL; }
+
+    private:
+        void Count( const char* method ) { ++_callCounts[method]; }
+
+        template<typename T>
+        static void ClearOut( T** out, UINT count )
+        {
+            if( out == nullptr )
+                return;
+            for( UINT ii = 0; ii < count; ++ii )
+                out[ii] = nullptr;
+        }
+
+        ID3D11Device* _device;
+        D3D11_DEVICE_CONTEXT_TYPE _type;
+        std::map<std::string, int> _callCounts;
+        MockPrivateData _privateData;
+    };
+
+    // Distinct, never-dereferenced pointers to stand in for
+    // views and state objects that the mocks only pass around.
+    template<typename T>
+    T* FakeObject( UINT_PTR id )
+    {
+        return reinterpret_cast<T*>( 0x1000 + id * 16 );
+    }
+}
+
+#endif // SPARK_TESTS_MOCK_D3D11_H
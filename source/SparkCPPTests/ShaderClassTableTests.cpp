@@ -0,0 +1,130 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// ShaderClassTableTests.cpp
+
+#include "TestHarness.h"
+
+#include "ShaderClassTable.h"
+
+#include <string>
+
+using namespace sparktest;
+
+namespace
+{
+    // Stands in for ShaderClass: removes itself from the table
+    // when the last reference is released.
+    class TestClass
+    {
+    public:
+        typedef spark::ShaderClassTable<TestClass> Table;
+
+        TestClass(
+            Table* table,
+            const Table::Key& key,
+            int* destroyedCount )
+            : _referenceCount(1)
+            , _table(table)
+            , _key(key)
+            , _destroyedCount(destroyedCount)
+        {
+        }
+
+        bool TryAcquire()
+        {
+            if( _referenceCount == 0 )
+                return false;
+            ++_referenceCount;
+            return true;
+        }
+
+        void Release()
+        {
+            if( --_referenceCount != 0 )
+                return;
+            _table->Remove( _key, this );
+            ++*_destroyedCount;
+            delete this;
+        }
+
+        long GetReferenceCount() { return _referenceCount; }
+
+    private:
+        long _referenceCount;
+        Table* _table;
+        Table::Key _key;
+        int* _destroyedCount;
+    };
+
+    const int kDesc = 0;
+}
+
+SPARK_TEST( ShaderClassTable_LookupsShareOneClass )
+{
+    TestClass::Table table;
+    int destroyedCount = 0;
+    auto key = TestClass::Table::Key( &kDesc, "Foo" );
+
+    CHECK( table.Find( key ) == nullptr );
+
+    auto first = table.Intern( key, new TestClass( &table, key, &destroyedCount ) );
+    auto second = table.Find( key );
+    CHECK( second == first );
+    CHECK_EQUAL( 2, first->GetReferenceCount() );
+
+    // A class created by a caller that lost the race is dropped
+    // in favor of the one already in the table.
+    auto third = table.Intern( key, new TestClass( &table, key, &destroyedCount ) );
+    CHECK( third == first );
+    CHECK_EQUAL( 1, destroyedCount );
+    CHECK_EQUAL( 3, first->GetReferenceCount() );
+    CHECK_EQUAL( 1u, table.GetCount() );
+
+    // Other names, and the same name from another owner, are
+    // different classes.
+    int otherOwner = 0;
+    auto other = table.Intern( TestClass::Table::Key( &otherOwner, "Foo" ),
+        new TestClass( &table, TestClass::Table::Key( &otherOwner, "Foo" ), &destroyedCount ) );
+    CHECK( other != first );
+    CHECK_EQUAL( 2u, table.GetCount() );
+
+    other->Release();
+    first->Release();
+    second->Release();
+    third->Release();
+    CHECK_EQUAL( 3, destroyedCount );
+    CHECK_EQUAL( 0u, table.GetCount() );
+}
+
+SPARK_TEST( ShaderClassTable_ReleasedClassesAreNotHandedOut )
+{
+    TestClass::Table table;
+    int destroyedCount = 0;
+    auto key = TestClass::Table::Key( &kDesc, "Foo" );
+
+    auto first = table.Intern( key, new TestClass( &table, key, &destroyedCount ) );
+    first->Release();
+    CHECK_EQUAL( 1, destroyedCount );
+    CHECK( table.Find( key ) == nullptr );
+
+    // A new class for the key is interned afresh.
+    auto second = table.Intern( key, new TestClass( &table, key, &destroyedCount ) );
+    CHECK( second != nullptr );
+    CHECK( table.Find( key ) == second );
+    second->Release();
+    second->Release();
+    CHECK_EQUAL( 2, destroyedCount );
+    CHECK_EQUAL( 0u, table.GetCount() );
+}
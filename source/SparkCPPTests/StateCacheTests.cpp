@@ -0,0 +1,76 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// StateCacheTests.cpp
+
+#include "TestHarness.h"
+#include "MockD3D11.h"
+
+#include <spark/spark.h>
+
+using namespace sparktest;
+using namespace spark::d3d11;
+
+namespace
+{
+    // Fills a blend desc the way a caller might: field by field,
+    // over memory that holds something other than zeros.
+    void FillBlendDesc( D3D11_BLEND_DESC* desc, unsigned char garbage )
+    {
+        memset( desc, garbage, sizeof(*desc) );
+        desc->AlphaToCoverageEnable = FALSE;
+        desc->IndependentBlendEnable = FALSE;
+        for( UINT ii = 0; ii < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++ii )
+        {
+            D3D11_RENDER_TARGET_BLEND_DESC& rt = desc->RenderTarget[ii];
+            rt.BlendEnable = TRUE;
+            rt.SrcBlend = D3D11_BLEND_SRC_ALPHA;
+            rt.DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+            rt.BlendOp = D3D11_BLEND_OP_ADD;
+            rt.SrcBlendAlpha = D3D11_BLEND_ONE;
+            rt.DestBlendAlpha = D3D11_BLEND_ZERO;
+            rt.BlendOpAlpha = D3D11_BLEND_OP_ADD;
+            rt.RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+        }
+    }
+}
+
+SPARK_TEST( StateCache_BlendStateIgnoresPadding )
+{
+    LONG baseObjectCount = gMockObjectCount;
+    {
+        auto device = new MockDevice();
+
+        // The same state, with different bytes in the padding
+        // after each RenderTargetWriteMask, is only created once.
+        D3D11_BLEND_DESC first;
+        D3D11_BLEND_DESC second;
+        FillBlendDesc( &first, 0x00 );
+        FillBlendDesc( &second, 0xCD );
+
+        ID3D11BlendState* state = CreateBlendState( device, &first );
+        CHECK( state != nullptr );
+        CHECK( CreateBlendState( device, &second ) == state );
+        CHECK_EQUAL( 1, device->GetCreatedBlendStateCount() );
+
+        // A real difference still gets its own state.
+        second.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_RED;
+        CHECK( CreateBlendState( device, &second ) != state );
+        CHECK_EQUAL( 2, device->GetCreatedBlendStateCount() );
+
+        ReleaseStateObjects( device );
+        device->Release();
+    }
+    CHECK_EQUAL( baseObjectCount, gMockObjectCount );
+}
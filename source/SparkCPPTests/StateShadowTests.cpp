@@ -0,0 +1,219 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// StateShadowTests.cpp
+
+#include "TestHarness.h"
+#include "MockD3D11.h"
+
+#include <spark/spark.h>
+
+using namespace sparktest;
+using namespace spark::d3d11;
+
+namespace
+{
+    // A device and immediate context for one test.
+    struct ShadowFixture
+    {
+        ShadowFixture()
+        {
+            device = new MockDevice();
+            context = new MockDeviceContext( device );
+        }
+
+        ~ShadowFixture()
+        {
+            DisableStateShadow( context );
+            context->Release();
+            device->Release();
+        }
+
+        MockDevice* device;
+        MockDeviceContext* context;
+    };
+
+    // The state-setting calls generated Submit code makes for
+    // a simple draw with one texture, sampler and buffer.
+    void SubmitLikeGeneratedCode(
+        ID3D11DeviceContext* context,
+        void* shadow,
+        UINT variant )
+    {
+        ID3D11RenderTargetView* rtv = FakeObject<ID3D11RenderTargetView>( 1 );
+        ShadowSetRenderTargets( context, shadow, 1, &rtv, FakeObject<ID3D11DepthStencilView>( 2 ) );
+
+        ShadowSetInputLayout( context, shadow, FakeObject<ID3D11InputLayout>( 3 ) );
+
+        ID3D11Buffer* vb = FakeObject<ID3D11Buffer>( 4 );
+        UINT stride = 32;
+        UINT offset = 0;
+        ShadowSetVertexBuffers( context, shadow, 0, 1, &vb, &stride, &offset );
+
+        ShadowSetShader( context, shadow, kShaderStage_Vertex, FakeObject<ID3D11DeviceChild>( 5 ) );
+        ShadowSetShader( context, shadow, kShaderStage_Pixel, FakeObject<ID3D11DeviceChild>( 6 ) );
+
+        // Each instance has its own constant buffer.
+        ID3D11Buffer* cb = FakeObject<ID3D11Buffer>( 100 + variant );
+        ShadowSetConstantBuffers( context, shadow, kShaderStage_Vertex, 0, 1, &cb );
+        ShadowSetConstantBuffers( context, shadow, kShaderStage_Pixel, 0, 1, &cb );
+
+        ID3D11ShaderResourceView* srv = FakeObject<ID3D11ShaderResourceView>( 7 );
+        ShadowSetShaderResources( context, shadow, kShaderStage_Pixel, 0, 1, &srv );
+
+        ID3D11SamplerState* sampler = FakeObject<ID3D11SamplerState>( 8 );
+        ShadowSetSamplers( context, shadow, kShaderStage_Pixel, 0, 1, &sampler );
+
+        FLOAT blendFactor[4] = { 1, 1, 1, 1 };
+        ShadowSetBlendState( context, shadow, FakeObject<ID3D11BlendState>( 9 ), blendFactor, 0xFFFFFFFF );
+        ShadowSetRasterizerState( context, shadow, FakeObject<ID3D11RasterizerState>( 10 ) );
+        ShadowSetDepthStencilState( context, shadow, FakeObject<ID3D11DepthStencilState>( 11 ), 0 );
+    }
+}
+
+SPARK_TEST( StateShadow_NullShadowIssuesEveryCall )
+{
+    ShadowFixture f;
+
+    SubmitLikeGeneratedCode( f.context, nullptr, 0 );
+    int perSubmit = f.context->GetTotalCallCount();
+    SubmitLikeGeneratedCode( f.context, nullptr, 0 );
+
+    CHECK_EQUAL( 2 * perSubmit, f.context->GetTotalCallCount() );
+}
+
+SPARK_TEST( StateShadow_FiltersRepeatedSubmits )
+{
+    ShadowFixture f;
+    EnableStateShadow( f.context );
+    void* shadow = GetStateShadow( f.context );
+    CHECK( shadow != nullptr );
+
+    f.context->ResetCallCounts();
+    SubmitLikeGeneratedCode( f.context, shadow, 0 );
+    int firstSubmit = f.context->GetTotalCallCount();
+
+    // Same class, different instances: only the
+    // constant buffers should be rebound.
+    const int kSubmitCount = 100;
+    for( int ii = 1; ii <= kSubmitCount; ++ii )
+        SubmitLikeGeneratedCode( f.context, shadow, ii );
+
+    CHECK_EQUAL( firstSubmit + 2 * kSubmitCount, f.context->GetTotalCallCount() );
+    CHECK_EQUAL( 1, f.context->GetCallCount( "VSSetShader" ) );
+    CHECK_EQUAL( 1, f.context->GetCallCount( "PSSetShaderResources" ) );
+    CHECK_EQUAL( 1 + kSubmitCount, f.context->GetCallCount( "VSSetConstantBuffers" ) );
+
+    StateShadowStats stats;
+    GetStateShadowStats( f.context, &stats );
+    CHECK_EQUAL( (unsigned int) (firstSubmit + 2 * kSubmitCount), stats.issuedCallCount );
+    CHECK( stats.skippedCallCount > 0 );
+}
+
+SPARK_TEST( StateShadow_RenderTargetChangeRebindsShaderResources )
+{
+    ShadowFixture f;
+    EnableStateShadow( f.context );
+    void* shadow = GetStateShadow( f.context );
+
+    ID3D11ShaderResourceView* srv = FakeObject<ID3D11ShaderResourceView>( 1 );
+    ShadowSetShaderResources( f.context, shadow, kShaderStage_Pixel, 0, 1, &srv );
+    ShadowSetShaderResources( f.context, shadow, kShaderStage_Pixel, 0, 1, &srv );
+    CHECK_EQUAL( 1, f.context->GetCallCount( "PSSetShaderResources" ) );
+
+    // The new target might be the resource behind srv, in
+    // which case the runtime has unbound it.
+    ID3D11RenderTargetView* rtv = FakeObject<ID3D11RenderTargetView>( 2 );
+    ShadowSetRenderTargets( f.context, shadow, 1, &rtv, nullptr );
+    ShadowSetShaderResources( f.context, shadow, kShaderStage_Pixel, 0, 1, &srv );
+    CHECK_EQUAL( 2, f.context->GetCallCount( "PSSetShaderResources" ) );
+}
+
+SPARK_TEST( StateShadow_InvalidateOutputsAfterDirectBinds )
+{
+    ShadowFixture f;
+    EnableStateShadow( f.context );
+    void* shadow = GetStateShadow( f.context );
+
+    SubmitLikeGeneratedCode( f.context, shadow, 0 );
+
+    // The application binds a UAV behind Spark's back, and
+    // tells the shadow that outputs have changed.
+    ID3D11UnorderedAccessView* uav = FakeObject<ID3D11UnorderedAccessView>( 20 );
+    f.context->CSSetUnorderedAccessViews( 0, 1, &uav, nullptr );
+    InvalidateStateShadowOutputs( f.context );
+
+    f.context->ResetCallCounts();
+    SubmitLikeGeneratedCode( f.context, shadow, 0 );
+
+    CHECK_EQUAL( 1, f.context->GetCallCount( "OMSetRenderTargets" ) );
+    CHECK_EQUAL( 1, f.context->GetCallCount( "PSSetShaderResources" ) );
+    CHECK_EQUAL( 0, f.context->GetCallCount( "VSSetShader" ) );
+    CHECK_EQUAL( 0, f.context->GetCallCount( "PSSetSamplers" ) );
+}
+
+SPARK_TEST( StateShadow_InvalidateRebindsEverything )
+{
+    ShadowFixture f;
+    EnableStateShadow( f.context );
+    void* shadow = GetStateShadow( f.context );
+
+    f.context->ResetCallCounts();
+    SubmitLikeGeneratedCode( f.context, shadow, 0 );
+    int firstSubmit = f.context->GetTotalCallCount();
+
+    InvalidateStateShadow( f.context );
+    f.context->ResetCallCounts();
+    SubmitLikeGeneratedCode( f.context, shadow, 0 );
+    CHECK_EQUAL( firstSubmit, f.context->GetTotalCallCount() );
+}
+
+SPARK_TEST( StateShadow_ResolveOnlyLooksUpWhenAsked )
+{
+    ShadowFixture f;
+    EnableStateShadow( f.context );
+    void* shadow = GetStateShadow( f.context );
+
+    f.context->ResetCallCounts();
+    CHECK( ResolveStateShadow( f.context, shadow ) == shadow );
+    CHECK( ResolveStateShadow( f.context, nullptr ) == nullptr );
+    CHECK_EQUAL( 0, f.context->GetCallCount( "GetPrivateData" ) );
+
+    CHECK( ResolveStateShadow( f.context, kLookupStateShadow ) == shadow );
+    CHECK_EQUAL( 1, f.context->GetCallCount( "GetPrivateData" ) );
+
+    DisableStateShadow( f.context );
+    CHECK( ResolveStateShadow( f.context, kLookupStateShadow ) == nullptr );
+}
+
+SPARK_TEST( StateShadow_ContextOwnsTheShadow )
+{
+    auto device = new MockDevice();
+    auto context = new MockDeviceContext( device );
+    LONG baseObjectCount = gMockObjectCount;
+
+    EnableStateShadow( context );
+    void* shadow = GetStateShadow( context );
+    CHECK( shadow != nullptr );
+
+    // Enabling it again keeps the existing shadow.
+    EnableStateShadow( context );
+    CHECK( GetStateShadow( context ) == shadow );
+    CHECK_EQUAL( baseObjectCount, gMockObjectCount );
+
+    // Released without DisableStateShadow: the context's
+    // private data holds the only reference, and frees it.
+    context->Release();
+    device->Release();
+}
@@ -0,0 +1,62 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// TestHarness.h
+#ifndef SPARK_TESTS_TEST_HARNESS_H
+#define SPARK_TESTS_TEST_HARNESS_H
+
+#include <stdexcept>
+
+// A minimal self-registering test harness. Each SPARK_TEST
+// defines a test function that is run by TestMain.cpp; a failed
+// CHECK throws, and ends the test.
+
+namespace sparktest
+{
+    typedef void (*TestFunc)();
+
+    struct TestRegistration
+    {
+        TestRegistration(
+            const char* name,
+            TestFunc func );
+    };
+
+    class TestFailure : public std::runtime_error
+    {
+    public:
+        TestFailure( const char* message )
+            : std::runtime_error( message )
+        {
+        }
+    };
+
+    void Fail(
+        const char* file,
+        int line,
+        const char* expression );
+}
+
+#define SPARK_TEST( name ) \
+    static void name(); \
+    static sparktest::TestRegistration name##Registration( #name, &name ); \
+    static void name()
+
+#define CHECK( expression ) \
+    do { if( !(expression) ) sparktest::Fail( __FILE__, __LINE__, #expression ); } while(0)
+
+#define CHECK_EQUAL( expected, actual ) \
+    CHECK( (expected) == (actual) )
+
+#endif // SPARK_TESTS_TEST_HARNESS_H
@@ -0,0 +1,95 @@
+// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+// TestMain.cpp
+
+#include "TestHarness.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace sparktest
+{
+    struct Test
+    {
+        const char* name;
+        TestFunc func;
+    };
+
+    static std::vector<Test>& GetTests()
+    {
+        static std::vector<Test> tests;
+        return tests;
+    }
+
+    TestRegistration::TestRegistration(
+        const char* name,
+        TestFunc func )
+    {
+        Test test = { name, func };
+        GetTests().push_back( test );
+    }
+
+    void Fail(
+        const char* file,
+        int line,
+        const char* expression )
+    {
+        char message[1024];
+        _snprintf( message, sizeof(message) - 1, "%s(%d): CHECK( %s ) failed", file, line, expression );
+        message[sizeof(message) - 1] = 0;
+        throw TestFailure( message );
+    }
+}
+
+// Runs every registered test. Any arguments are treated
+// as substrings of the names of the tests to run.
+int main( int argc, char** argv )
+{
+    auto& tests = sparktest::GetTests();
+
+    int passed = 0;
+    int failed = 0;
+    for( auto ii = tests.begin(); ii != tests.end(); ++ii )
+    {
+        bool selected = (argc <= 1);
+        for( int aa = 1; aa < argc; ++aa )
+        {
+            if( strstr( ii->name, argv[aa] ) != nullptr )
+                selected = true;
+        }
+        if( !selected )
+            continue;
+
+        try
+        {
+            ii->func();
+            ++passed;
+        }
+        catch( std::exception& e )
+        {
+            fprintf( stderr, "FAILED %s: %s\n", ii->name, e.what() );
+            ++failed;
+        }
+        catch( ... )
+        {
+            fprintf( stderr, "FAILED %s: unknown exception\n", ii->name );
+            ++failed;
+        }
+    }
+
+    printf( "%d passed, %d failed\n", passed, failed );
+    return failed == 0 ? 0 : 1;
+}
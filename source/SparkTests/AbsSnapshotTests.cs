@@ -0,0 +1,310 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Reflection;
+using System.Text;
+
+using Spark;
+using Spark.AbstractSyntax;
+
+namespace SparkTests
+{
+    public class AbsSnapshotTests
+    {
+        [Test]
+        public void RoundTripsEveryNodeType()
+        {
+            var identifiers = new IdentifierFactory();
+            var record = BuildEveryNodeType(identifiers);
+
+            var missing = GetLeafNodeTypes().Except(CollectNodeTypes(record)).ToArray();
+            Assert.AreEqual(0, missing.Length, string.Format(
+                "test tree lacks {0}", string.Join(", ", missing.Select((t) => t.Name))));
+
+            // Read into a factory that has already handed out other
+            // identifiers, so indices can't line up by accident.
+            var readIdentifiers = new IdentifierFactory();
+            readIdentifiers.unique("z");
+            readIdentifiers.simpleIdentifier("unrelated");
+
+            var written = Write(record);
+            var read = Read(written, readIdentifiers);
+            Assert.IsNotNull(read);
+            Assert.AreSequenceEqual(written, Write(read));
+
+            // Identifiers are interned into the reader's factory
+            var pipeline = (AbsPipelineDecl) read.decls.Single();
+            var method = (AbsMethodDecl) pipeline.Members.First();
+            var let = (AbsLetStmt) ((AbsSeqStmt) method.body).Head;
+            Assert.IsTrue(object.ReferenceEquals(readIdentifiers.simpleIdentifier("x"), let.Name));
+            Assert.AreEqual(AbsModifiers.Virtual | AbsModifiers.Override, method.Modifiers);
+            Assert.AreEqual(AbsModifiers.Mixin, pipeline.Modifiers);
+        }
+
+        // A new kind of node must get a tag (and a writer overload)
+        // before the stdlib can use it, or snapshots of it would
+        // throw or silently drop the node.
+        [Test]
+        public void EveryNodeTypeHasAWriter()
+        {
+            var writerType = typeof(AbsSnapshot).Assembly.GetType("Spark.AbstractSyntax.AbsSnapshotWriter", true);
+            var written = writerType
+                .GetMethods(BindingFlags.Instance | BindingFlags.NonPublic)
+                .Where((m) => m.Name == "WriteNodeImpl")
+                .Select((m) => m.GetParameters().Single().ParameterType)
+                .Where((t) => t != typeof(AbsSyntax))
+                .ToArray();
+
+            foreach (var type in GetLeafNodeTypes())
+            {
+                Assert.IsTrue(written.Contains(type), string.Format(
+                    "AbsSnapshotWriter has no WriteNodeImpl for {0}", type.Name));
+            }
+
+            var tagType = typeof(AbsSnapshot).Assembly.GetType("Spark.AbstractSyntax.AbsSnapshotTag", true);
+            Assert.AreEqual(written.Length + 1, Enum.GetValues(tagType).Length, "tags (including Null) vs. writers");
+        }
+
+        [Test]
+        public void StdlibSnapshotMatchesParse()
+        {
+            byte[] parsed;
+            var diagnostics = new DiagnosticSink();
+            using (var stream = typeof(AbsSnapshot).Assembly.GetManifestResourceStream("Spark.stdlib.spark"))
+            {
+                var scanner = new Spark.Parser.Generated.Scanner(
+                    stream,
+                    diagnostics,
+                    new IdentifierFactory(),
+                    "Standard Library");
+                var parser = new Spark.Parser.Generated.Parser(scanner);
+                Assert.IsTrue(parser.Parse());
+                parsed = Write(parser.result);
+            }
+
+            // The first Parse may load or create the snapshot; the
+            // second is sure to load it.
+            for (int ii = 0; ii < 2; ++ii)
+            {
+                var compiler = new Spark.Compiler.Compiler();
+                Assert.AreEqual(0, compiler.Parse());
+                Assert.AreSequenceEqual(parsed, Write(compiler.AbsSourceRecords.Single()));
+            }
+        }
+
+        [Test]
+        public void RejectsOtherFormatVersions()
+        {
+            var data = Write(BuildEveryNodeType(new IdentifierFactory()));
+            data[0] ^= 0xFF;
+            Assert.IsNull(Read(data, new IdentifierFactory()));
+        }
+
+        // A damaged snapshot must fail in a way StdlibSnapshot
+        // can recover from, whatever byte was damaged.
+        [Test]
+        public void RejectsCorruptData()
+        {
+            var data = Write(BuildEveryNodeType(new IdentifierFactory()));
+            foreach (var value in new byte[] { 0x00, 0x7F, 0xFF })
+            {
+                for (int ii = sizeof(int); ii < data.Length; ++ii)
+                {
+                    var corrupt = (byte[]) data.Clone();
+                    if (corrupt[ii] == value)
+                        continue;
+                    corrupt[ii] = value;
+                    ReadCorrupt(corrupt, ii);
+                }
+            }
+
+            for (int length = sizeof(int); length < data.Length; ++length)
+                ReadCorrupt(data.Take(length).ToArray(), length);
+        }
+
+        private static void ReadCorrupt(byte[] data, int position)
+        {
+            try
+            {
+                Read(data, new IdentifierFactory());
+            }
+            catch (IOException)
+            {
+            }
+            catch (InvalidDataException)
+            {
+            }
+            catch (Exception ex)
+            {
+                throw new AssertionException(string.Format(
+                    "{0} reading snapshot damaged at {1}: {2}",
+                    ex.GetType().Name, position, ex.Message));
+            }
+        }
+
+        private static byte[] Write(AbsSourceRecord record)
+        {
+            using (var stream = new MemoryStream())
+            {
+                using (var writer = new BinaryWriter(stream))
+                {
+                    AbsSnapshot.Write(writer, record);
+                }
+                return stream.ToArray();
+            }
+        }
+
+        private static AbsSourceRecord Read(byte[] data, IdentifierFactory identifiers)
+        {
+            using (var reader = new BinaryReader(new MemoryStream(data)))
+            {
+                return AbsSnapshot.Read(reader, identifiers);
+            }
+        }
+
+        // The concrete syntax classes that nothing derives from, with
+        // AbsLit<T> closed over each literal type the parser makes.
+        private static IEnumerable<Type> GetLeafNodeTypes()
+        {
+            var types = typeof(AbsSyntax).Assembly.GetTypes()
+                .Where((t) => typeof(AbsSyntax).IsAssignableFrom(t) || IsAbsLit(t))
+                .ToArray();
+
+            foreach (var type in types)
+            {
+                if (type.IsAbstract)
+                    continue;
+                if (types.Any((t) => t.BaseType != null
+                    && (t.BaseType == type || (t.BaseType.IsGenericType && t.BaseType.GetGenericTypeDefinition() == type))))
+                {
+                    continue;
+                }
+
+                if (type.IsGenericTypeDefinition)
+                {
+                    foreach (var arg in new[] { typeof(Int32), typeof(Double), typeof(String), typeof(bool) })
+                        yield return type.MakeGenericType(arg);
+                }
+                else
+                {
+                    yield return type;
+                }
+            }
+        }
+
+        private static bool IsAbsLit(Type type)
+        {
+            return type.IsGenericTypeDefinition && type == typeof(AbsLit<>);
+        }
+
+        private static HashSet<Type> CollectNodeTypes(AbsSyntax root)
+        {
+            var result = new HashSet<Type>();
+            CollectNodeTypes(root, result);
+            return result;
+        }
+
+        private static void CollectNodeTypes(object value, HashSet<Type> result)
+        {
+            if (value is AbsSyntax)
+            {
+                result.Add(value.GetType());
+                foreach (var property in value.GetType().GetProperties(BindingFlags.Instance | BindingFlags.Public))
+                {
+                    if (property.GetIndexParameters().Length == 0)
+                        CollectNodeTypes(property.GetValue(value, null), result);
+                }
+            }
+            else if (value is IEnumerable && !(value is string))
+            {
+                foreach (var item in (IEnumerable) value)
+                    CollectNodeTypes(item, result);
+            }
+        }
+
+        private static AbsSyntaxInfo Info(int line)
+        {
+            return new AbsSyntaxInfo(new SourceRange(
+                "Standard Library",
+                new SourcePos(line, 1, line * 10),
+                new SourcePos(line, 5, line * 10 + 4)));
+        }
+
+        private static AbsSourceRecord BuildEveryNodeType(IdentifierFactory identifiers)
+        {
+            Func<string, Identifier> id = identifiers.simpleIdentifier;
+            var lit = new AbsLit<Int32>(Info(3), 42);
+
+            var app = new AbsApp(Info(4),
+                new AbsVarRef(Info(4), identifiers.operatorIdentifier("+")),
+                new AbsArg[] {
+                    new AbsPositionalArg(Info(4), lit),
+                    new AbsKeywordArg(Info(4), id("k"), new AbsLit<Double>(Info(4), 1.5)) });
+
+            var assign = new AbsAssign(Info(6),
+                new AbsVarRef(Info(6), id("x")),
+                new AbsIfTerm(Info(6),
+                    new AbsLit<bool>(Info(6), false),
+                    new AbsLit<String>(Info(6), "s"),
+                    new AbsVoid(Info(6))));
+
+            var loop = new AbsForStmt(Info(7),
+                id("i"),
+                new AbsElementRef(Info(7), new AbsMemberRef(Info(7), new AbsBaseExp(Info(7)), id("m")), lit),
+                new AbsBlockStmt(Info(7), new AbsStmt[] { new AbsReturnStmt(Info(7)) }));
+
+            var switchStmt = new AbsSwitchStmt(Info(8),
+                lit,
+                new[] { new AbsCase(Info(8), lit,
+                    new AbsReturnStmt(Info(8), new AbsGenericApp(Info(8), new AbsVarRef(Info(8), id("g")), new AbsArg[] { }))) });
+
+            var body = new AbsSeqStmt(Info(5),
+                new AbsLetStmt(Info(5), AbsLetFlavor.Variable, null, id("x"), app),
+                new AbsSeqStmt(Info(6),
+                    new AbsIfStmt(Info(6), new AbsLit<bool>(Info(6), true), new AbsExpStmt(Info(6), assign), new AbsEmptyStmt(Info(6))),
+                    new AbsSeqStmt(Info(7), loop, switchStmt)));
+
+            var method = new AbsMethodDecl(Info(2),
+                id("f"),
+                new AbsFreqQualTerm(Info(2), new AbsVarRef(Info(2), id("Fragment")), new AbsVarRef(Info(2), id("float"))),
+                new[] { new AbsParamDecl(Info(2), id("p"), new AbsVarRef(Info(2), id("int"))) },
+                body);
+            method.GenericParams = new AbsGenericParamDecl[] {
+                new AbsGenericTypeParamDecl(Info(2), id("T")),
+                new AbsGenericValueParamDecl(Info(2), new AbsVarRef(Info(2), id("T")), identifiers.unique("_"), true) };
+            method.Modifiers = AbsModifiers.Virtual | AbsModifiers.Override;
+            method.Attributes.Add(new AbsAttribute(Info(1), id("Builtin"),
+                new AbsArg[] { new AbsPositionalArg(Info(1), new AbsLit<String>(Info(1), "x")) }));
+
+            var members = new AbsMemberDecl[] {
+                method,
+                new AbsTypeSlotDecl(Info(9), id("TS")),
+                new AbsStructDecl(Info(10), id("S"), new AbsMemberDecl[] {
+                    new AbsSlotDecl(Info(10), id("a"), new AbsVarRef(Info(10), id("int")), null) }),
+                new AbsElementDecl(Info(11), id("E")),
+                new AbsConceptDecl(Info(12), id("C"), null, new AbsMemberDecl[] { }) };
+
+            var pipeline = new AbsPipelineDecl(Info(1), id("Base"), new AbsTerm[] { new AbsVarRef(Info(1), id("D3D11")) }, members);
+            pipeline.Modifiers = AbsModifiers.Mixin;
+
+            return new AbsSourceRecord(Info(0), new AbsGlobalDecl[] { pipeline });
+        }
+    }
+}
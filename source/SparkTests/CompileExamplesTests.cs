@@ -0,0 +1,124 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using Spark.Emit.HLSL;
+
+namespace SparkTests
+{
+    // Stands in for D3DCompile when compiling whole modules: every
+    // shader "compiles", to a hash of its source.
+    public class HashingHlslCompiler : IHlslCompiler
+    {
+        public byte[] Compile(
+            string source,
+            string entry,
+            string profile,
+            out string errors)
+        {
+            errors = null;
+            using (var sha = System.Security.Cryptography.SHA1.Create())
+            {
+                return sha.ComputeHash(Encoding.UTF8.GetBytes(profile + ":" + entry + ":" + source));
+            }
+        }
+    }
+
+    // Runs the shipped examples (and the standard library alone)
+    // through every phase of the compiler, down to the generated
+    // C++, so that a phase that throws on some construct shows up
+    // here rather than in sparkc.
+    public class CompileExamplesTests : IDisposable
+    {
+        private string _outputPrefix = Path.Combine(
+            Path.GetTempPath(),
+            "spark-test-" + Guid.NewGuid().ToString("N"));
+
+        public CompileExamplesTests()
+        {
+            HlslCompilerHelper.Register(new HashingHlslCompiler());
+        }
+
+        public void Dispose()
+        {
+            HlslCompilerHelper.Register(null);
+            File.Delete(_outputPrefix + ".h");
+            File.Delete(_outputPrefix + ".cpp");
+        }
+
+        // The examples live at the root of the tree, above the
+        // bin\<platform>\<configuration> output directory.
+        internal static string FindExample(string relativePath)
+        {
+            var directory = new DirectoryInfo(AppDomain.CurrentDomain.BaseDirectory);
+            for (; directory != null; directory = directory.Parent)
+            {
+                var path = Path.Combine(Path.Combine(directory.FullName, "examples"), relativePath);
+                if (File.Exists(path))
+                    return path;
+            }
+            throw new AssertionException("Could not find example " + relativePath);
+        }
+
+        private void CompileCleanly(params string[] inputs)
+        {
+            var compiler = new Spark.Compiler.Compiler
+            {
+                OutputPrefix = _outputPrefix,
+            };
+            foreach (var input in inputs)
+                compiler.AddInput(input);
+
+            Assert.AreEqual(0, compiler.Compile());
+            Assert.IsTrue(new FileInfo(_outputPrefix + ".h").Length > 0);
+            Assert.IsTrue(new FileInfo(_outputPrefix + ".cpp").Length > 0);
+        }
+
+        [Test]
+        public void StandardLibrary()
+        {
+            CompileCleanly();
+        }
+
+        [Test]
+        public void BasicHLSL11()
+        {
+            CompileCleanly(FindExample(@"Direct3D11/BasicHLSL11/BasicSpark11.spark"));
+        }
+
+        [Test]
+        public void CubeMapGS11()
+        {
+            CompileCleanly(FindExample(@"Direct3D11/CubeMapGS11/CubeMapGS.spark"));
+        }
+
+        [Test]
+        public void DeferredShading()
+        {
+            CompileCleanly(FindExample(@"Direct3D11/DeferredShading/DeferredShading.spark"));
+        }
+
+        [Test]
+        public void PNTriangles11()
+        {
+            CompileCleanly(FindExample(@"Direct3D11/PNTriangles11/PNTriangles.spark"));
+        }
+    }
+}
@@ -0,0 +1,118 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Text.RegularExpressions;
+
+using Spark.Emit.HLSL;
+
+namespace SparkTests
+{
+    // Keeps the source of every shader it is asked to compile.
+    public class RecordingHlslCompiler : IHlslCompiler
+    {
+        public readonly List<string> Sources = new List<string>();
+
+        public byte[] Compile(
+            string source,
+            string entry,
+            string profile,
+            out string errors)
+        {
+            lock (Sources)
+            {
+                Sources.Add(source);
+            }
+            errors = null;
+            return Encoding.UTF8.GetBytes(profile + ":" + source);
+        }
+    }
+
+    public class ConstantBufferLayoutTests : IDisposable
+    {
+        private RecordingHlslCompiler _hlslCompiler = new RecordingHlslCompiler();
+
+        private string _outputPrefix = Path.Combine(
+            Path.GetTempPath(),
+            "spark-test-" + Guid.NewGuid().ToString("N"));
+
+        public ConstantBufferLayoutTests()
+        {
+            HlslCompilerHelper.Register(_hlslCompiler);
+        }
+
+        public void Dispose()
+        {
+            HlslCompilerHelper.Register(null);
+            File.Delete(_outputPrefix + ".h");
+            File.Delete(_outputPrefix + ".cpp");
+        }
+
+        // Map each uniform declared in the compiled shaders to
+        // the constant buffer it was placed in. Buffer names are
+        // only unique within a pipeline, so this is only good for
+        // examples with one shader class.
+        private Dictionary<string, string> CompileAndFindBuffers(string example)
+        {
+            var compiler = new Spark.Compiler.Compiler
+            {
+                OutputPrefix = _outputPrefix,
+            };
+            compiler.AddInput(CompileExamplesTests.FindExample(example));
+            Assert.AreEqual(0, compiler.Compile());
+
+            var buffers = new Dictionary<string, string>();
+            var cbuffer = new Regex(@"^cbuffer (\w+)");
+            var uniform = new Regex(@"(\w+)(\[\d+\])? : packoffset");
+            foreach (var source in _hlslCompiler.Sources)
+            {
+                string current = null;
+                foreach (var line in source.Split('\n'))
+                {
+                    var match = cbuffer.Match(line);
+                    if (match.Success)
+                    {
+                        current = match.Groups[1].Value;
+                        continue;
+                    }
+
+                    match = uniform.Match(line);
+                    if (match.Success && current != null)
+                        buffers[match.Groups[1].Value] = current;
+                }
+            }
+            return buffers;
+        }
+
+        // BasicSpark11 has one value per input (world, and
+        // worldViewProj, which is computed from it, then the
+        // light direction and ambient term). The transforms share
+        // a buffer, and the two small lighting values another.
+        [Test]
+        public void BasicHLSL11MergesGroups()
+        {
+            var buffers = CompileAndFindBuffers(@"Direct3D11/BasicHLSL11/BasicSpark11.spark");
+
+            Assert.AreEqual(4, buffers.Count);
+            Assert.AreEqual(2, buffers.Values.Distinct().Count());
+            Assert.AreEqual(buffers["world"], buffers["worldViewProj"]);
+            Assert.AreEqual(buffers["lightDir"], buffers["ambient"]);
+        }
+    }
+}
@@ -0,0 +1,192 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using Spark.Emit.HLSL;
+
+namespace SparkTests
+{
+    // Stands in for D3DCompile: "compiles" any source that
+    // doesn't contain the word "error" into its own bytes.
+    public class StubHlslCompiler : IHlslCompiler
+    {
+        public int CallCount;
+
+        public byte[] Compile(
+            string source,
+            string entry,
+            string profile,
+            out string errors)
+        {
+            System.Threading.Interlocked.Increment(ref CallCount);
+            if (source.Contains("error"))
+            {
+                errors = string.Format("{0}({1}): error X0000: {2}", entry, profile, source);
+                return null;
+            }
+
+            errors = null;
+            return Encoding.UTF8.GetBytes(profile + ":" + source);
+        }
+    }
+
+    public class HlslCompilerCacheTests : IDisposable
+    {
+        private string _path = Path.Combine(
+            Path.GetTempPath(),
+            "spark-test-" + Guid.NewGuid().ToString("N") + ".hlslcache");
+
+        public void Dispose()
+        {
+            if (File.Exists(_path))
+                File.Delete(_path);
+        }
+
+        private static byte[] Compile(IHlslCompiler compiler, string source, string profile = "vs_5_0")
+        {
+            string errors;
+            return compiler.Compile(source, "main", profile, out errors);
+        }
+
+        [Test]
+        public void RepeatedCompileHitsCache()
+        {
+            var stub = new StubHlslCompiler();
+            var cache = new HlslCompilerCache(stub);
+
+            var first = Compile(cache, "float4 main() : SV_Position { return 0; }");
+            var second = Compile(cache, "float4 main() : SV_Position { return 0; }");
+
+            Assert.AreEqual(1, stub.CallCount);
+            Assert.AreEqual(1, cache.HitCount);
+            Assert.AreEqual(1, cache.MissCount);
+            Assert.AreSequenceEqual(first, second);
+        }
+
+        [Test]
+        public void ProfileIsPartOfKey()
+        {
+            var stub = new StubHlslCompiler();
+            var cache = new HlslCompilerCache(stub);
+
+            Compile(cache, "void main() {}", "vs_5_0");
+            Compile(cache, "void main() {}", "ps_5_0");
+
+            Assert.AreEqual(2, stub.CallCount);
+        }
+
+        [Test]
+        public void FailuresAreNotCached()
+        {
+            var stub = new StubHlslCompiler();
+            var cache = new HlslCompilerCache(stub);
+
+            string errors;
+            Assert.IsNull(cache.Compile("error", "main", "vs_5_0", out errors));
+            Assert.IsNotNull(errors);
+            Assert.IsNull(cache.Compile("error", "main", "vs_5_0", out errors));
+            Assert.IsNotNull(errors);
+
+            Assert.AreEqual(2, stub.CallCount);
+            Assert.AreEqual(0, cache.HitCount);
+        }
+
+        [Test]
+        public void FailuresAreNotPersisted()
+        {
+            var cache = new HlslCompilerCache(new StubHlslCompiler());
+            cache.SetPersistPath(_path);
+
+            Compile(cache, "error");
+            Assert.IsFalse(File.Exists(_path) && new FileInfo(_path).Length != 0);
+
+            Compile(cache, "void main() {}");
+            Assert.IsTrue(File.Exists(_path));
+        }
+
+        [Test]
+        public void PersistedEntriesSurviveReload()
+        {
+            var writer = new HlslCompilerCache(new StubHlslCompiler());
+            writer.SetPersistPath(_path);
+            var expected = Compile(writer, "void main() {}");
+
+            var stub = new StubHlslCompiler();
+            var reader = new HlslCompilerCache(stub);
+            reader.SetPersistPath(_path);
+            var actual = Compile(reader, "void main() {}");
+
+            Assert.AreEqual(0, stub.CallCount);
+            Assert.AreSequenceEqual(expected, actual);
+        }
+
+        [Test]
+        public void TruncatedFileKeepsEarlierEntries()
+        {
+            var writer = new HlslCompilerCache(new StubHlslCompiler());
+            writer.SetPersistPath(_path);
+            Compile(writer, "void a() {}");
+            var lengthAfterFirst = new FileInfo(_path).Length;
+            Compile(writer, "void b() {}");
+
+            using (var stream = new FileStream(_path, FileMode.Open))
+                stream.SetLength(lengthAfterFirst + 7);
+
+            var stub = new StubHlslCompiler();
+            var reader = new HlslCompilerCache(stub);
+            reader.SetPersistPath(_path);
+            Compile(reader, "void a() {}");
+            Assert.AreEqual(0, stub.CallCount);
+            Compile(reader, "void b() {}");
+            Assert.AreEqual(1, stub.CallCount);
+        }
+
+        [Test]
+        public void GarbageFileIsIgnored()
+        {
+            var random = new Random(1234);
+            for (int i = 0; i < 32; ++i)
+            {
+                var garbage = new byte[random.Next(1, 256)];
+                random.NextBytes(garbage);
+                File.WriteAllBytes(_path, garbage);
+
+                var stub = new StubHlslCompiler();
+                var cache = new HlslCompilerCache(stub);
+                cache.SetPersistPath(_path);
+
+                Assert.IsNotNull(Compile(cache, "void main() {}"));
+            }
+        }
+
+        [Test]
+        public void NegativeLengthIsIgnored()
+        {
+            using (var writer = new BinaryWriter(File.Create(_path)))
+            {
+                writer.Write("key");
+                writer.Write(-5);
+            }
+
+            var cache = new HlslCompilerCache(new StubHlslCompiler());
+            cache.SetPersistPath(_path);
+            Assert.IsNotNull(Compile(cache, "void main() {}"));
+        }
+    }
+}
@@ -0,0 +1,124 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using Spark.Emit.HLSL;
+using Spark.Mid;
+
+namespace SparkTests
+{
+    public class MidHoistRatesTests : IDisposable
+    {
+        // The light vector is affine in the interpolated position,
+        // so it can be computed per vertex; normalizing it can't.
+        private const string Source = @"
+shader class HoistTest extends D3D11DrawPass
+{
+    input @Uniform float4x4 worldViewProj;
+    input @Uniform float3   lightPos;
+
+    struct PN
+    {
+        float3 position;
+        float3 normal;
+    }
+    input @Uniform VertexStream[PN] myVertexStream;
+    input @Uniform DrawSpan myDrawSpan;
+    override IA_DrawSpan = myDrawSpan;
+
+    @AssembledVertex PN     fetched = myVertexStream( IA_VertexID );
+    @AssembledVertex float3 P_model = fetched.position;
+    @AssembledVertex float3 N_model = fetched.normal;
+
+    override RS_Position = mul(float4(P_model, 1.0f), worldViewProj);
+
+    @Fragment float3 L        = normalize(lightPos - P_model);
+    @Fragment float  lighting = saturate(dot(L, normalize(N_model)));
+    @Fragment float4 color    = float4(lighting, lighting, lighting, 1.0f);
+
+    output @Pixel float4 myTarget = color;
+}
+";
+
+        private string _prefix = Path.Combine(
+            Path.GetTempPath(),
+            "spark-test-" + Guid.NewGuid().ToString("N"));
+
+        public MidHoistRatesTests()
+        {
+            HlslCompilerHelper.Register(new HashingHlslCompiler());
+        }
+
+        public void Dispose()
+        {
+            HlslCompilerHelper.Register(null);
+            File.Delete(_prefix + ".spark");
+            File.Delete(_prefix + ".h");
+            File.Delete(_prefix + ".cpp");
+        }
+
+        private static MidElementDecl FindElement(MidPipelineDecl pipeline, string name)
+        {
+            return pipeline.Elements.Single((e) => e.Name.ToString() == name);
+        }
+
+        private static IEnumerable<string> BuiltinsIn(MidElementDecl element)
+        {
+            return from a in element.Attributes
+                   let app = a.Exp as MidBuiltinApp
+                   where app != null
+                   select app.Decl.Name.ToString();
+        }
+
+        [Test]
+        public void MovesAffineMathToTheVertexStage()
+        {
+            File.WriteAllText(_prefix + ".spark", Source);
+            var compiler = new Spark.Compiler.Compiler { OutputPrefix = _prefix };
+            compiler.AddInput(_prefix + ".spark");
+            Assert.AreEqual(0, compiler.Parse());
+            Assert.AreEqual(0, compiler.Resolve());
+            Assert.AreEqual(0, compiler.Lower());
+
+            var pipeline = compiler.MidModule.Pipelines.Single((p) => p.Name.ToString() == "HoistTest");
+            var rasterVertex = FindElement(pipeline, "RasterVertex");
+            var fragment = FindElement(pipeline, "Fragment");
+
+            Assert.IsTrue(BuiltinsIn(rasterVertex).Contains("operator(-)"), "subtraction moved to @RasterVertex");
+            Assert.IsFalse(BuiltinsIn(fragment).Contains("operator(-)"), "subtraction left at @Fragment");
+            Assert.IsTrue(BuiltinsIn(fragment).Contains("normalize"), "normalize stays at @Fragment");
+
+            // The interpolated position is no longer fetched by
+            // the fragment; only the light vector and normal are.
+            var fetched = (from a in fragment.Attributes
+                           let fetch = a.Exp as MidAttributeFetch
+                           where fetch != null
+                           select fetch.Attribute).ToArray();
+            Assert.AreEqual(2, fetched.Length);
+            Assert.IsTrue(fetched.Any((a) =>
+                {
+                    var app = a.Exp as MidBuiltinApp;
+                    return app != null && app.Decl.Name.ToString() == "operator(-)";
+                }), "fragment fetches the hoisted value");
+
+            Assert.AreEqual(0, compiler.Emit());
+        }
+    }
+}
@@ -0,0 +1,77 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Reflection;
+using System.Text;
+
+using Spark.Mid;
+using Spark.ResolvedSyntax;
+
+namespace SparkTests
+{
+    public class MidSpecializationCacheTests
+    {
+        private static MidBuiltinType Builtin(string name, params object[] args)
+        {
+            return new MidBuiltinType(name, args, new ResBuiltinTag[] { });
+        }
+
+        [Test]
+        public void KeysCompareBuiltinTypesStructurally()
+        {
+            var decl = new MidGenericDecl(null, null, null, null, null);
+            var left = new MidGenericSpecializationKey(decl, new object[] { Builtin("float4") });
+            var right = new MidGenericSpecializationKey(decl, new object[] { Builtin("float4") });
+            var other = new MidGenericSpecializationKey(decl, new object[] { Builtin("float3") });
+
+            Assert.IsTrue(left.Equals(right));
+            Assert.AreEqual(left.GetHashCode(), right.GetHashCode());
+            Assert.IsFalse(left.Equals(other));
+        }
+
+        [Test]
+        public void OnlyComparableArgsAreCached()
+        {
+            var lit = new MidLit<int>(new Spark.SourceRange(), 4, Builtin("int"));
+
+            Assert.IsTrue(MidGenericSpecializationKey.CanCompare(new object[] { Builtin("float4"), lit, null }));
+            Assert.IsTrue(MidGenericSpecializationKey.CanCompare(new object[] { Builtin("Array", Builtin("float"), lit) }));
+
+            Assert.IsFalse(MidGenericSpecializationKey.CanCompare(new object[] { new object() }));
+            Assert.IsFalse(MidGenericSpecializationKey.CanCompare(new object[] { Builtin("Array", "float") }));
+        }
+
+        // SparkCPP lowers every module it loads through one
+        // MidEmitContext, so nothing from one module may stay
+        // in its cache.
+        [Test]
+        public void SpecializationsDontOutliveTheModule()
+        {
+            var compiler = new Spark.Compiler.Compiler();
+            var context = new MidEmitContext(compiler.Identifiers);
+            var field = typeof(MidEmitContext).GetField("_specializations", BindingFlags.NonPublic | BindingFlags.Instance);
+            var specializations = (System.Collections.IDictionary) field.GetValue(context);
+
+            Assert.AreEqual(0, compiler.Parse());
+            Assert.AreEqual(0, compiler.Resolve());
+            Assert.AreEqual(0, compiler.Lower(context));
+
+            Assert.AreEqual(0, specializations.Count);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+using Spark.Compiler;
+
+namespace SparkTests
+{
+    public class ModuleCacheKeyTests : IDisposable
+    {
+        private string _path = Path.Combine(
+            Path.GetTempPath(),
+            "spark-test-" + Guid.NewGuid().ToString("N") + ".spark");
+
+        public ModuleCacheKeyTests()
+        {
+            File.WriteAllText(_path, "shader class Empty extends D3D11DrawPass {}");
+        }
+
+        public void Dispose()
+        {
+            File.Delete(_path);
+        }
+
+        [Test]
+        public void SameInputsGiveTheSameKey()
+        {
+            Assert.AreEqual(
+                ModuleCacheKey.ForFiles(new[] { _path }, "runtime"),
+                ModuleCacheKey.ForFiles(new[] { _path }, "runtime"));
+        }
+
+        [Test]
+        public void KeyCoversTheRuntimeBuild()
+        {
+            Assert.IsFalse(
+                ModuleCacheKey.ForFiles(new[] { _path }, "runtime") == ModuleCacheKey.ForFiles(new[] { _path }, "other runtime"),
+                "a different runtime build shares cache entries");
+        }
+
+        [Test]
+        public void KeyCoversTheSource()
+        {
+            var before = ModuleCacheKey.ForFiles(new[] { _path }, "runtime");
+            File.AppendAllText(_path, "\n");
+            Assert.IsFalse(
+                before == ModuleCacheKey.ForFiles(new[] { _path }, "runtime"),
+                "an edited source file shares cache entries");
+        }
+    }
+}
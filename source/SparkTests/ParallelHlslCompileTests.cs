@@ -0,0 +1,230 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Threading;
+
+using Spark;
+using Spark.Emit.HLSL;
+
+namespace SparkTests
+{
+    // An HLSL compiler whose shaders take longer to compile the
+    // earlier their stage comes in a pass, so that concurrent
+    // compiles finish in the reverse of the order they started.
+    public class SlowHlslCompiler : IHlslCompiler
+    {
+        private static readonly string[] _profileOrder = { "vs", "hs", "ds", "gs", "ps" };
+
+        private int _inFlight;
+        private int _maxInFlight;
+        private List<string> _profiles = new List<string>();
+
+        public string FailingProfile { get; set; }
+        public int MaxInFlight { get { return _maxInFlight; } }
+
+        public IEnumerable<string> Profiles
+        {
+            get { lock (_profiles) return _profiles.ToArray(); }
+        }
+
+        public byte[] Compile(
+            string source,
+            string entry,
+            string profile,
+            out string errors)
+        {
+            lock (_profiles)
+                _profiles.Add(profile);
+
+            int inFlight = Interlocked.Increment(ref _inFlight);
+            for (int max = _maxInFlight; inFlight > max; max = _maxInFlight)
+                Interlocked.CompareExchange(ref _maxInFlight, inFlight, max);
+
+            int order = Array.IndexOf(_profileOrder, profile.Substring(0, 2));
+            Thread.Sleep(20 * (_profileOrder.Length - order));
+
+            Interlocked.Decrement(ref _inFlight);
+
+            errors = null;
+            if (profile == FailingProfile)
+                errors = "shader.hlsl(1,1): error X3004: undeclared identifier 'oops'";
+
+            using (var sha = System.Security.Cryptography.SHA1.Create())
+            {
+                return sha.ComputeHash(Encoding.UTF8.GetBytes(profile + ":" + entry + ":" + source));
+            }
+        }
+    }
+
+    // Keeps every diagnostic added, along with the thread that
+    // added it, even after the compiler flushes them.
+    public class RecordingDiagnostics : IDiagnosticsCollection
+    {
+        private DiagnosticSink _sink = new DiagnosticSink();
+        private List<IDiagnosticsSource> _all = new List<IDiagnosticsSource>();
+        private HashSet<int> _threads = new HashSet<int>();
+
+        public void Add(IDiagnosticsSource source)
+        {
+            lock (_all)
+            {
+                _all.Add(source);
+                _threads.Add(Thread.CurrentThread.ManagedThreadId);
+            }
+            _sink.Add(source);
+        }
+
+        public IEnumerable<Diagnostic> Diagnostics
+        {
+            get { return _sink.Diagnostics; }
+        }
+
+        public IEnumerable<Diagnostic> AllDiagnostics
+        {
+            get { return _all.SelectMany((s) => s.Diagnostics); }
+        }
+
+        public IEnumerable<int> Threads
+        {
+            get { return _threads; }
+        }
+
+        public void Clear()
+        {
+            _sink.Clear();
+        }
+    }
+
+    // The stages of a pass compile their HLSL concurrently (see
+    // D3D11Stage.BeginShaderSetup); the results must still come
+    // out as if the stages had compiled one after another.
+    public class ParallelHlslCompileTests : IDisposable
+    {
+        // Any HLSL the compiler dumps on error lands next to the
+        // input, so work on a copy in a scratch directory.
+        private string _directory = Path.Combine(
+            Path.GetTempPath(),
+            "spark-test-" + Guid.NewGuid().ToString("N"));
+
+        public ParallelHlslCompileTests()
+        {
+            Directory.CreateDirectory(_directory);
+        }
+
+        public void Dispose()
+        {
+            HlslCompilerHelper.Register(null);
+            HlslCompilerHelper.ParallelCompile = true;
+            Directory.Delete(_directory, true);
+        }
+
+        private string CopyExample(string relativePath)
+        {
+            var directory = new DirectoryInfo(AppDomain.CurrentDomain.BaseDirectory);
+            for (; directory != null; directory = directory.Parent)
+            {
+                var path = Path.Combine(Path.Combine(directory.FullName, "examples"), relativePath);
+                if (File.Exists(path))
+                {
+                    var copy = Path.Combine(_directory, Path.GetFileName(path));
+                    File.Copy(path, copy);
+                    return copy;
+                }
+            }
+            throw new AssertionException("Could not find example " + relativePath);
+        }
+
+        private int Compile(
+            string input,
+            string outputName,
+            SlowHlslCompiler hlslCompiler,
+            bool parallel,
+            RecordingDiagnostics diagnostics)
+        {
+            HlslCompilerHelper.Register(hlslCompiler);
+            HlslCompilerHelper.ParallelCompile = parallel;
+
+            var compiler = new Spark.Compiler.Compiler
+            {
+                OutputPrefix = Path.Combine(_directory, outputName),
+                Diagnostics = diagnostics,
+            };
+            compiler.AddInput(input);
+            return compiler.Compile();
+        }
+
+        [Test]
+        public void MatchesSequentialCompile()
+        {
+            // PN triangles use every stage but the GS
+            var input = CopyExample(@"Direct3D11/PNTriangles11/PNTriangles.spark");
+
+            var sequential = new SlowHlslCompiler();
+            Assert.AreEqual(0, Compile(input, "sequential", sequential, false, new RecordingDiagnostics()));
+            Assert.AreEqual(1, sequential.MaxInFlight);
+
+            var parallel = new SlowHlslCompiler();
+            Assert.AreEqual(0, Compile(input, "parallel", parallel, true, new RecordingDiagnostics()));
+            Assert.IsTrue(parallel.MaxInFlight > 1, "stages did not compile concurrently");
+
+            Assert.AreSequenceEqual(
+                sequential.Profiles.OrderBy((p) => p),
+                parallel.Profiles.OrderBy((p) => p));
+            Assert.IsTrue(parallel.Profiles.Any((p) => p.StartsWith("hs")));
+
+            // Each stage's bytecode is embedded in stage order,
+            // whatever order the compiles finished in. (The .cpp
+            // includes the .h by name, so normalize that.)
+            foreach (var extension in new[] { ".h", ".cpp" })
+            {
+                var expected = File.ReadAllText(Path.Combine(_directory, "sequential" + extension));
+                var actual = File.ReadAllText(Path.Combine(_directory, "parallel" + extension));
+                Assert.IsTrue(
+                    expected.Replace("sequential", "parallel") == actual,
+                    "generated " + extension + " differs");
+            }
+        }
+
+        [Test]
+        public void ReportsErrorsOnEmittingThread()
+        {
+            var input = CopyExample(@"Direct3D11/BasicHLSL11/BasicSpark11.spark");
+
+            foreach (var parallel in new[] { false, true })
+            {
+                var hlslCompiler = new SlowHlslCompiler { FailingProfile = "ps_5_0" };
+                var diagnostics = new RecordingDiagnostics();
+
+                var errorCount = Compile(input, "failing", hlslCompiler, parallel, diagnostics);
+
+                Assert.IsTrue(errorCount > 0, "no errors reported");
+                Assert.IsTrue(diagnostics.AllDiagnostics.Any((d) =>
+                    d.Severity == Severity.Error && d.Message.Contains("X3004")),
+                    "HLSL error was not reported");
+
+                // The diagnostics sink isn't thread-safe, so nothing
+                // may be added to it from the compile tasks.
+                Assert.AreSequenceEqual(
+                    new[] { Thread.CurrentThread.ManagedThreadId },
+                    diagnostics.Threads);
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Reflection;
+using System.Text;
+
+namespace SparkTests
+{
+    // Marks a public instance method (no parameters) of
+    // a public class as a test. A fresh instance of the
+    // class is created for every test it contains.
+    [AttributeUsage(AttributeTargets.Method)]
+    public class TestAttribute : Attribute
+    {
+    }
+
+    public class AssertionException : Exception
+    {
+        public AssertionException(string message)
+            : base(message)
+        {
+        }
+    }
+
+    public static class Assert
+    {
+        public static void IsTrue(bool condition, string message = "expected true")
+        {
+            if (!condition)
+                throw new AssertionException(message);
+        }
+
+        public static void IsFalse(bool condition, string message = "expected false")
+        {
+            IsTrue(!condition, message);
+        }
+
+        public static void IsNull(object value, string message = "expected null")
+        {
+            IsTrue(value == null, message);
+        }
+
+        public static void IsNotNull(object value, string message = "expected non-null")
+        {
+            IsTrue(value != null, message);
+        }
+
+        public static void AreEqual<T>(T expected, T actual, string message = null)
+        {
+            if (!EqualityComparer<T>.Default.Equals(expected, actual))
+            {
+                throw new AssertionException(string.Format(
+                    "{0}expected <{1}> but was <{2}>",
+                    message == null ? "" : message + ": ",
+                    expected,
+                    actual));
+            }
+        }
+
+        public static void AreSequenceEqual<T>(IEnumerable<T> expected, IEnumerable<T> actual, string message = null)
+        {
+            var e = expected.ToArray();
+            var a = actual.ToArray();
+            if (!e.SequenceEqual(a))
+            {
+                throw new AssertionException(string.Format(
+                    "{0}expected [{1}] but was [{2}]",
+                    message == null ? "" : message + ": ",
+                    string.Join(", ", e),
+                    string.Join(", ", a)));
+            }
+        }
+    }
+
+    // Finds and runs every [Test] method in this assembly.
+    // Any command-line arguments are treated as substrings
+    // of the "Class.Method" names to run.
+    public static class TestRunner
+    {
+        public static int Run(string[] filters)
+        {
+            var tests = from type in typeof(TestRunner).Assembly.GetTypes()
+                        where type.IsPublic && !type.IsAbstract
+                        from method in type.GetMethods(BindingFlags.Public | BindingFlags.Instance)
+                        where method.IsDefined(typeof(TestAttribute), false)
+                        let name = type.Name + "." + method.Name
+                        where filters.Length == 0 || filters.Any((f) => name.Contains(f))
+                        orderby name
+                        select new { Type = type, Method = method, Name = name };
+
+            int passed = 0;
+            var failures = new List<string>();
+            foreach (var test in tests)
+            {
+                try
+                {
+                    var fixture = Activator.CreateInstance(test.Type);
+                    try
+                    {
+                        test.Method.Invoke(fixture, null);
+                    }
+                    finally
+                    {
+                        var disposable = fixture as IDisposable;
+                        if (disposable != null)
+                            disposable.Dispose();
+                    }
+                    passed++;
+                }
+                catch (TargetInvocationException ex)
+                {
+                    failures.Add(string.Format("{0}: {1}", test.Name, Describe(ex.InnerException)));
+                }
+                catch (Exception ex)
+                {
+                    failures.Add(string.Format("{0}: {1}", test.Name, Describe(ex)));
+                }
+            }
+
+            foreach (var failure in failures)
+                Console.Error.WriteLine("FAILED {0}", failure);
+            Console.WriteLine("{0} passed, {1} failed", passed, failures.Count);
+            return failures.Count == 0 ? 0 : 1;
+        }
+
+        private static string Describe(Exception ex)
+        {
+            if (ex is AssertionException)
+                return ex.Message;
+            return ex.ToString();
+        }
+    }
+}
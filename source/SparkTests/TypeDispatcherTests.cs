@@ -0,0 +1,103 @@
+﻿// Copyright 2011 Intel Corporation
+// All Rights Reserved
+//
+// Permission is granted to use, copy, distribute and prepare derivative works of this
+// software for any purpose and without fee, provided, that the above copyright notice
+// and this statement appear in all copies.  Intel makes no representations about the
+// suitability of this software for any purpose.  THIS SOFTWARE IS PROVIDED "AS IS."
+// INTEL SPECIFICALLY DISCLAIMS ALL WARRANTIES, EXPRESS OR IMPLIED, AND ALL LIABILITY,
+// INCLUDING CONSEQUENTIAL AND OTHER INDIRECT DAMAGES, FOR THE USE OF THIS SOFTWARE,
+// INCLUDING LIABILITY FOR INFRINGEMENT OF ANY PROPRIETARY RIGHTS, AND INCLUDING THE
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  Intel does not
+// assume any responsibility for any errors which may appear in this software nor any
+// responsibility to update it.
+
+
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Text;
+
+using Spark;
+
+namespace SparkTests
+{
+    public class TypeDispatcherTests
+    {
+        public class Animal { }
+        public class Dog : Animal { }
+        public class Puppy : Dog { }
+        public class Cat : Animal { }
+
+        // Overloads are private, on the base class only, as with
+        // the visitors in MidTransform.
+        public class BaseVisitor
+        {
+            private string Visit(Animal animal, int depth) { return "animal" + depth; }
+            private string Visit(Dog dog, int depth) { return "dog" + depth; }
+            protected virtual string Visit(Cat cat, int depth) { return "cat" + depth; }
+
+            private static string Name(Animal animal) { return "static animal"; }
+        }
+
+        public class DerivedVisitor : BaseVisitor
+        {
+            protected override string Visit(Cat cat, int depth) { return "derived cat" + depth; }
+        }
+
+        [Test]
+        public void PicksMostSpecificOverload()
+        {
+            var dispatcher = new TypeDispatcher<Func<BaseVisitor, Animal, int, string>>("Visit");
+            var visitor = new BaseVisitor();
+
+            Assert.AreEqual("animal1", dispatcher.For(new Animal())(visitor, new Animal(), 1));
+            Assert.AreEqual("dog2", dispatcher.For(new Dog())(visitor, new Dog(), 2));
+            Assert.AreEqual("dog3", dispatcher.For(new Puppy())(visitor, new Puppy(), 3));
+            Assert.AreEqual("cat4", dispatcher.For(new Cat())(visitor, new Cat(), 4));
+        }
+
+        [Test]
+        public void FindsPrivateOverloadsOnBaseClasses()
+        {
+            var dispatcher = new TypeDispatcher<Func<DerivedVisitor, Animal, int, string>>("Visit");
+            var visitor = new DerivedVisitor();
+
+            Assert.AreEqual("animal1", dispatcher.For(new Animal())(visitor, new Animal(), 1));
+            Assert.AreEqual("dog2", dispatcher.For(new Puppy())(visitor, new Puppy(), 2));
+        }
+
+        [Test]
+        public void OverridesAreCalledVirtually()
+        {
+            var viaBase = new TypeDispatcher<Func<BaseVisitor, Animal, int, string>>("Visit");
+            var viaDerived = new TypeDispatcher<Func<DerivedVisitor, Animal, int, string>>("Visit");
+            var visitor = new DerivedVisitor();
+
+            Assert.AreEqual("derived cat1", viaBase.For(new Cat())(visitor, new Cat(), 1));
+            Assert.AreEqual("derived cat2", viaDerived.For(new Cat())(visitor, new Cat(), 2));
+        }
+
+        [Test]
+        public void CallsStaticOverloads()
+        {
+            var dispatcher = new TypeDispatcher<Func<DerivedVisitor, Animal, string>>("Name");
+            Assert.AreEqual("static animal", dispatcher.For(new Dog())(null, new Dog()));
+        }
+
+        [Test]
+        public void MissingMethodFailsAtConstruction()
+        {
+            InvalidOperationException caught = null;
+            try
+            {
+                new TypeDispatcher<Func<BaseVisitor, Animal, int, string>>("Vist");
+            }
+            catch (InvalidOperationException e)
+            {
+                caught = e;
+            }
+            Assert.IsNotNull(caught);
+        }
+    }
+}
@@ -50,6 +50,35 @@ namespace sparkc
 
                             result.outputPrefix = option;
                         }
+                        else if (argStr == "-cache")
+                        {
+                            if (argIdx >= argCount)
+                            {
+                                diagnostics.Add(
+                                    Severity.Error,
+                                    range,
+                                    "Option '-cache' expects a directory");
+                                break;
+                            }
+
+                            result.cacheDirectory = args[argIdx++];
+                        }
+                        else if (argStr == "-time")
+                        {
+                            int repeatCount;
+                            if (argIdx >= argCount
+                                || !int.TryParse(args[argIdx++], out repeatCount)
+                                || repeatCount < 0)
+                            {
+                                diagnostics.Add(
+                                    Severity.Error,
+                                    range,
+                                    "Option '-time' expects a repeat count");
+                                break;
+                            }
+
+                            result.timeRepeatCount = repeatCount;
+                        }
                         else
                         {
                             diagnostics.Add(
@@ -66,7 +95,25 @@ namespace sparkc
                 }
 
                 int fileCount = result.fileNames.Count;
-                if (fileCount == 1)
+                if (result.timeRepeatCount >= 0)
+                {
+                    // Each file is compiled on its own, to a scratch
+                    // output, and the standard library is timed even
+                    // with no files given.
+                }
+                else if (result.cacheDirectory != null)
+                {
+                    // Each file is compiled into the cache separately,
+                    // so no output prefix is needed.
+                    if (fileCount == 0)
+                    {
+                        diagnostics.Add(
+                            Severity.Error,
+                            range,
+                            "No input files given");
+                    }
+                }
+                else if (fileCount == 1)
                 {
                     if (result.outputPrefix == null)
                     {
@@ -96,6 +143,10 @@ namespace sparkc
                 {
                     System.Console.Error.WriteLine(
                         "Usage: sparkc [-o outputPrefix] file.spark file2.spark");
+                    System.Console.Error.WriteLine(
+                        "       sparkc -cache cacheDirectory file.spark file2.spark");
+                    System.Console.Error.WriteLine(
+                        "       sparkc -time repeatCount file.spark file2.spark");
                     return null;
                 }
 
@@ -103,10 +154,142 @@ namespace sparkc
             }
 
             public string outputPrefix = null;
+            public string cacheDirectory = null;
+            public int timeRepeatCount = -1;
             public List<string> fileNames = new List<string>();
         }
 
 
+        [System.Runtime.InteropServices.DllImport(
+            "SparkCPP.dll",
+            CallingConvention = System.Runtime.InteropServices.CallingConvention.Cdecl)]
+        static extern int SparkPopulateModuleCache(
+            string cacheDirectory,
+            string fileName);
+
+        // Pre-populate the runtime module cache, so that applications
+        // pointed at the same directory can skip compilation at startup.
+        static void PopulateCache(Options options)
+        {
+            foreach (var fileName in options.fileNames)
+            {
+                var fullName = System.IO.Path.GetFullPath(fileName);
+                if (SparkPopulateModuleCache(options.cacheDirectory, fullName) != 0)
+                {
+                    System.Console.Error.WriteLine(
+                        "{0}: failed to compile into module cache",
+                        fileName);
+                }
+            }
+        }
+
+        class PhaseTimes
+        {
+            public double parse;
+            public double resolve;
+            public double lower;
+            public double emit;
+
+            public double Total { get { return parse + resolve + lower + emit; } }
+        }
+
+        static double Time(Func<int> phase, out int errorCount)
+        {
+            var stopwatch = System.Diagnostics.Stopwatch.StartNew();
+            errorCount = phase();
+            return stopwatch.Elapsed.TotalMilliseconds;
+        }
+
+        // Compile the given file (or just the standard library, if
+        // fileName is null) once, timing each phase. Returns null
+        // if the compile fails.
+        static PhaseTimes TimeCompile(string fileName, string outputPrefix)
+        {
+            var compiler = new Spark.Compiler.Compiler
+            {
+                OutputPrefix = outputPrefix,
+            };
+            if (fileName != null)
+                compiler.AddInput(fileName);
+
+            var times = new PhaseTimes();
+            int errorCount;
+            times.parse = Time(compiler.Parse, out errorCount);
+            if (errorCount != 0)
+                return null;
+            times.resolve = Time(compiler.Resolve, out errorCount);
+            if (errorCount != 0)
+                return null;
+            times.lower = Time(compiler.Lower, out errorCount);
+            if (errorCount != 0)
+                return null;
+            times.emit = Time(compiler.Emit, out errorCount);
+            if (errorCount != 0)
+                return null;
+            return times;
+        }
+
+        // Report how long each phase of compilation takes, for the
+        // standard library alone and for each given file. The first
+        // compile of each is reported on its own ("cold"), since it
+        // includes JIT and cache warm-up; the rest are averaged.
+        static int Benchmark(Options options)
+        {
+            var outputPrefix = System.IO.Path.Combine(
+                System.IO.Path.GetTempPath(),
+                "sparkc-time-" + System.Diagnostics.Process.GetCurrentProcess().Id);
+
+            var inputs = new List<string> { null };
+            inputs.AddRange(options.fileNames);
+
+            System.Console.WriteLine(
+                "{0,-32} {1,9} {2,9} {3,9} {4,9} {5,9} {6,9}",
+                "file", "cold(ms)", "parse", "resolve", "lower", "emit", "mean(ms)");
+
+            int failureCount = 0;
+            try
+            {
+                foreach (var fileName in inputs)
+                {
+                    var name = fileName == null
+                        ? "<standard library>"
+                        : System.IO.Path.GetFileName(fileName);
+
+                    var cold = TimeCompile(fileName, outputPrefix);
+                    if (cold == null)
+                    {
+                        System.Console.Error.WriteLine("{0}: compile failed", name);
+                        ++failureCount;
+                        continue;
+                    }
+
+                    var mean = new PhaseTimes();
+                    int repeatCount = options.timeRepeatCount;
+                    for (int ii = 0; ii < repeatCount; ++ii)
+                    {
+                        var times = TimeCompile(fileName, outputPrefix);
+                        mean.parse += times.parse / repeatCount;
+                        mean.resolve += times.resolve / repeatCount;
+                        mean.lower += times.lower / repeatCount;
+                        mean.emit += times.emit / repeatCount;
+                    }
+                    if (repeatCount == 0)
+                        mean = cold;
+
+                    System.Console.WriteLine(
+                        "{0,-32} {1,9:F1} {2,9:F1} {3,9:F1} {4,9:F1} {5,9:F1} {6,9:F1}",
+                        name, cold.Total, mean.parse, mean.resolve, mean.lower, mean.emit, mean.Total);
+                }
+            }
+            finally
+            {
+                System.IO.File.Delete(outputPrefix + ".h");
+                System.IO.File.Delete(outputPrefix + ".cpp");
+            }
+
+            return failureCount;
+        }
+
         static void Main(string[] args)
         {
             try
@@ -115,6 +298,18 @@ namespace sparkc
                 if (options == null)
                     return;
 
+                if (options.timeRepeatCount >= 0)
+                {
+                    Benchmark(options);
+                    return;
+                }
+
+                if (options.cacheDirectory != null)
+                {
+                    PopulateCache(options);
+                    return;
+                }
+
                 var prefix = options.outputPrefix;
 
                 var compiler = new Spark.Compiler.Compiler